@@ -12,6 +12,7 @@ typedef int64_t   s64;
 typedef int32_t   s32;
 typedef int16_t   s16;
 typedef char      s8;
+typedef unsigned __int128 u128;
 
 typedef u32 ipv4a;              /* in the host byte order */
 typedef u32 ipv4na;             /* in the network byte order */
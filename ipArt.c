@@ -92,9 +92,33 @@
 */
 
 
+#include <pthread.h>
+
 #include "ipArt.h"
 
 
+#ifdef ART_LOOKUP_STATS
+__thread u32 rtArtLookupTick;   /* lookups of this thread (sampling) */
+#endif /* ART_LOOKUP_STATS */
+
+
+/**
+ * @name  subtableSize
+ *
+ * @brief Returns the size of the memory for a subtable (trie node)
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] level level of the subtable
+ *
+ * @retval size_t Size in bytes including the hidden level
+ */
+static inline size_t
+subtableSize (rtTable* pt, int level)
+{
+    return ((1 << (pt->psi[level].sl+1)) + 1) * sizeof(tableEntry);
+}
+
+
 /**
  * @name  rtArtNewSubTable
  *
@@ -107,13 +131,15 @@
  * @retval subtable Pointer to the allocated subtable (success)
  * @retval NULL     Failed to allocate a subtable
  */
-static inline subtable
+subtable
 rtArtNewSubTable (rtTable* pt, int level, tableEntry base)
 {
     register subtable t;
 
     t = (subtable)
-        calloc((1 << (pt->psi[level].sl+1)) + 1, sizeof(tableEntry));
+        pt->alloc.alloc(pt->alloc.ctx, level, subtableSize(pt, level));
+    if ( t == NULL ) return NULL;
+    rtArtCountSubtable(pt, level, subtableSize(pt, level), 1);
 
     t->level = level; /* save level */
     ++t;              /* make level hidden */
@@ -122,10 +148,32 @@ rtArtNewSubTable (rtTable* pt, int level, tableEntry base)
 }
 
 
+/**
+ * @name  rtArtFreeSubtableMem
+ *
+ * @brief Returns the memory of a subtable to the subtable allocator
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] p  Pointer to the beginning of the subtable memory
+ */
+static void
+rtArtFreeSubtableMem (rtTable* pt, void* p)
+{
+    register int level = ((subtable)p)->level;
+
+    rtArtCountSubtable(pt, level, subtableSize(pt, level), -1);
+    pt->alloc.free(pt->alloc.ctx, level, p, subtableSize(pt, level));
+}
+
+
 /**
  * @name  rtArtFreeSubTable
  *
- * @brief Frees the memory allocated for a subtable (trie node)
+ * @brief Frees the memory allocated for a subtable (trie node).
+ *        If the readers are lock-free, the memory is freed after
+ *        all the readers that may see the subtable leave. A writer
+ *        thread of rtArtApplyUpdatesSharded() leaves it to the
+ *        thread that joins it.
  *
  * @param[in] pt Pointer to the routing table
  * @param[in] t  Pointer to the subtable to be freed
@@ -133,7 +181,7 @@ rtArtNewSubTable (rtTable* pt, int level, tableEntry base)
  * @retval tableEntry Subtable default route in the freed subtable.
  *                    This must be restored in the parent subtable.
  */
-static inline tableEntry
+tableEntry
 rtArtFreeSubtable (rtTable* pt, subtable t)
 {
     register tableEntry base;   /* heap default route */
@@ -141,7 +189,13 @@ rtArtFreeSubtable (rtTable* pt, subtable t)
     assert(t);
 
     base = t[1];
-    free(t - 1);                /* get the beginning address of buffer */
+    if ( pt->pShard ) {
+        rtArtShardRetire(pt, t - 1, rtArtFreeSubtableMem);
+    } else if ( pt->pEpoch ) {
+        rtArtRetire(pt, t - 1, rtArtFreeSubtableMem);
+    } else {
+        rtArtFreeSubtableMem(pt, t - 1); /* beginning address of buffer */
+    }
     ++pt->nSubtablesFreed;
 
     return base;
@@ -204,13 +258,13 @@ rtArtInsert (rtTable* pt, subtable t, int k,
 
     t[0].count++;
     if ( k < threshold ) {
-        rtArtAllot(t, k, r, s, threshold, fringeCheck);
+        rtArtCountAllot(pt, rtArtAllot(t, k, r, s, threshold, fringeCheck));
     } else if ( fringeCheck && isSubtable(z) ) {
-        subtablePtr(z).down[1].ent = s;
+        storeRoute(subtablePtr(z).down[1], s);
     } else {
-        t[k].ent = s;
+        storeRoute(t[k], s);
     }
-    pt->nRoutes++;
+    rtArtCountRoute(pt, s, 1);
     return s;
 }
 
@@ -251,13 +305,20 @@ rtArtDelete (rtTable* pt, subtable t, int k,
     }
 
 
-    pt->nRoutes--;
+    rtArtCountRoute(pt, r, -1);
     save = r;
     s = ((k >> 1) > 1) ? t[k >> 1].ent : NULL;
     while ( l-- >= 0 ) {
+        if ( l < 0 ) {
+            /*
+             * Don't free level 0 table. Its counter is shared by
+             * the writers of rtArtApplyUpdatesSharded().
+             */
+            __atomic_sub_fetch(&t[0].count, 1, __ATOMIC_RELAXED);
+            break;
+        }
         t[0].count--;
         if ( t[0].count > 0 ) break;
-        if ( l < 0 ) break;     /* Don't free level 0 table */
 
 #ifdef DEBUG_FREE_HEAP
         {
@@ -269,10 +330,13 @@ rtArtDelete (rtTable* pt, subtable t, int k,
 #endif /* DEBUG_FREE_HEAP */
 
         /*
-         * Counter == 0 and level > 0. Free subtable.
+         * Counter == 0 and level > 0. Free subtable after
+         * restoring the heap default route (r = t[1].ent)
+         * so that lock-free readers never see a freed subtable.
          */
-        r = rtArtFreeSubtable(pt, t).ent; /* r = t[1].ent */
-        pt->pEnt[l]->ent = r;   /* restore heap default route */
+        r = t[1].ent;
+        storeRoute(*pt->pEnt[l], r);
+        rtArtFreeSubtable(pt, t);
 
         t = pt->pTbl[l];        /* set `t' to parent subtable */
     }
@@ -283,11 +347,11 @@ rtArtDelete (rtTable* pt, subtable t, int k,
      * Update subtable `t'.
      */
     if ( k < threshold ) {
-        rtArtAllot(t, k, r, s, threshold, fringeCheck);
+        rtArtCountAllot(pt, rtArtAllot(t, k, r, s, threshold, fringeCheck));
     } else if ( fringeCheck && isSubtable(z) ) {
-        subtablePtr(z).down[1].ent = s;
+        storeRoute(subtablePtr(z).down[1], s);
     } else {
-        t[k].ent = s;
+        storeRoute(t[k], s);
     }
     return save;
 }
@@ -320,16 +384,21 @@ rtArtFindMatch (rtTable* pt, u8* pDest)
     offset = 0;
     pDefRoute = NULL;
     for (l = 0; l < pt->nLevels; ++l ) {
-        ent = pst[fringeIndex(&pDest, &offset, pt->psi[l].sl)];
+        ent = loadEnt(pst[fringeIndex(&pDest, &offset, pt->psi[l].sl)]);
         if ( !ent.ent ) break;
-        if ( !isSubtable(ent) ) return ent.ent;
+        if ( !isSubtable(ent) ) {
+            rtArtSampleLookup(pt, l);
+            return ent.ent;
+        }
         ent = subtablePtr(ent);
         if ( l >= (pt->nLevels - 1) ) break;
-        if ( ent.down[1].ent ) {
-            pDefRoute = ent.down[1].ent;
-        }
         pst = ent.down;
+        ent = loadEnt(pst[1]);
+        if ( ent.ent ) {
+            pDefRoute = ent.ent;
+        }
     }
+    rtArtSampleLookup(pt, l);
 
     /*
      * No match.
@@ -337,7 +406,186 @@ rtArtFindMatch (rtTable* pt, u8* pDest)
     if ( pDefRoute ) {
         return pDefRoute;
     }
-    return pt->root[1].ent;
+    return loadEnt(pt->root[1]).ent;
+}
+
+
+/**
+ * @name   rtArtFindMatch4
+ *
+ * @brief  API function.
+ *         (registered as `pt->findMatch4()' in `rtArtInit()').
+ *         Performs the longest prefix match of an IPv4 address in
+ *         the host byte order. The fringe index of each level is
+ *         taken from `dest' with one shift and one mask.
+ *
+ * @param[in] pt   Pointer to the IPv4 routing table
+ * @param[in] dest Destination IPv4 address in the host byte order
+ *
+ * @retval routeEnt* Pointer to the longest prefix matching route.
+ * @retval NULL      There was no matching route for `dest'
+ */
+static routeEnt *
+rtArtFindMatch4 (rtTable* pt, ipv4a dest)
+{
+    register tableEntry  ent;
+    register tableEntry* pst;
+    register routeEnt*   pDefRoute;
+    register int         l;
+
+
+    assert(pt->alen == 32);
+
+    pst = pt->root;
+    pDefRoute = NULL;
+    for (l = 0; l < pt->nLevels; ++l ) {
+        ent = loadEnt(pst[fringeIndex4(&pt->psi[l], dest)]);
+        if ( !ent.ent ) break;
+        if ( !isSubtable(ent) ) return ent.ent;
+        ent = subtablePtr(ent);
+        if ( l >= (pt->nLevels - 1) ) break;
+        pst = ent.down;
+        ent = loadEnt(pst[1]);
+        if ( ent.ent ) {
+            pDefRoute = ent.ent;
+        }
+    }
+
+    if ( pDefRoute ) {
+        return pDefRoute;
+    }
+    return loadEnt(pt->root[1]).ent;
+}
+
+
+/**
+ * @name   rtArtFindMatch6
+ *
+ * @brief  API function.
+ *         (registered as `pt->findMatch6()' in `rtArtInit()').
+ *         Performs the longest prefix match of an IPv6 address
+ *         given as two 64-bit words in the host byte order.
+ *
+ * @param[in] pt Pointer to the IPv6 routing table
+ * @param[in] hi The first 64 bits of the destination address
+ * @param[in] lo The last 64 bits of the destination address
+ *
+ * @retval routeEnt* Pointer to the longest prefix matching route.
+ * @retval NULL      There was no matching route
+ */
+static routeEnt *
+rtArtFindMatch6 (rtTable* pt, u64 hi, u64 lo)
+{
+    register tableEntry  ent;
+    register tableEntry* pst;
+    register routeEnt*   pDefRoute;
+    register int         l;
+    u128 dest = ((u128)hi << 64) | lo;
+
+
+    assert(pt->alen == 128);
+
+    pst = pt->root;
+    pDefRoute = NULL;
+    for (l = 0; l < pt->nLevels; ++l ) {
+        ent = loadEnt(pst[fringeIndex6(&pt->psi[l], dest)]);
+        if ( !ent.ent ) break;
+        if ( !isSubtable(ent) ) return ent.ent;
+        ent = subtablePtr(ent);
+        if ( l >= (pt->nLevels - 1) ) break;
+        pst = ent.down;
+        ent = loadEnt(pst[1]);
+        if ( ent.ent ) {
+            pDefRoute = ent.ent;
+        }
+    }
+
+    if ( pDefRoute ) {
+        return pDefRoute;
+    }
+    return loadEnt(pt->root[1]).ent;
+}
+
+
+/**
+ * @name   rtArtFindMatchBatch
+ *
+ * @brief  API function.
+ *         (registered as `pt->findMatchBatch()' in `rtArtInit()').
+ *         Performs the longest prefix match for `n' addresses.
+ *         Up to ART_BATCH_WIDTH lookups go down the trie one level
+ *         at a time. The table entry of the next level and the
+ *         subtable default route of each lookup are prefetched
+ *         before they are read so that the cache misses overlap.
+ *
+ * @param[in]  pt    Pointer to the routing table
+ * @param[in]  pDest Array of `n' pointers to the destination IP addresses
+ * @param[out] pRes  Array of `n' route pointers. `pRes[i]' is set to
+ *                   the longest prefix matching route of `pDest[i]'
+ *                   (or NULL if there is no matching route.)
+ * @param[in]  n     The number of addresses to be looked up
+ */
+void
+rtArtFindMatchBatch (rtTable* pt, u8** pDest, routeEnt** pRes, int n)
+{
+    register tableEntry  ent;
+    register routeEnt*   r;
+    tableEntry* pst[ART_BATCH_WIDTH];   /* current subtable */
+    routeEnt*   pDef[ART_BATCH_WIDTH];  /* subtable default route */
+    u8*         pAddr[ART_BATCH_WIDTH];
+    u32         offset[ART_BATCH_WIDTH];
+    u32         index[ART_BATCH_WIDTH];
+    int         live[ART_BATCH_WIDTH];  /* lookups still going down */
+    int i, j, l, m, nLive, nNext;
+
+
+    for ( ; n > 0; n -= m, pDest += m, pRes += m ) {
+        m = (n < ART_BATCH_WIDTH) ? n : ART_BATCH_WIDTH;
+        for ( i = 0; i < m; ++i ) {
+            pst[i]    = pt->root;
+            pAddr[i]  = pDest[i];
+            offset[i] = 0;
+            pDef[i]   = NULL;
+            index[i]  = fringeIndex(&pAddr[i], &offset[i], pt->psi[0].sl);
+            __builtin_prefetch(&pst[i][index[i]]);
+            live[i] = i;
+        }
+        nLive = m;
+        for ( l = 0; nLive > 0; ++l ) {
+            nNext = 0;
+            for ( j = 0; j < nLive; ++j ) {
+                i = live[j];
+                if ( l > 0 ) {
+                    r = loadEnt(pst[i][1]).ent; /* prefetched */
+                    if ( r ) {
+                        pDef[i] = r;
+                    }
+                }
+                ent = loadEnt(pst[i][index[i]]);
+                if ( !ent.ent ) {
+                    pRes[i] = (pDef[i]) ? pDef[i] : loadEnt(pt->root[1]).ent;
+                    continue;
+                }
+                if ( !isSubtable(ent) ) {
+                    pRes[i] = ent.ent;
+                    continue;
+                }
+                assert(l < (pt->nLevels - 1));
+
+                /*
+                 * Go to the next subtable (trie node) and prefetch
+                 * both the subtable default route and the next entry.
+                 */
+                pst[i] = subtablePtr(ent).down;
+                index[i] = fringeIndex(&pAddr[i], &offset[i],
+                                       pt->psi[l+1].sl);
+                __builtin_prefetch(&pst[i][1]);
+                __builtin_prefetch(&pst[i][index[i]]);
+                live[nNext++] = i;
+            }
+            nLive = nNext;
+        }
+    }
 }
 
 
@@ -363,6 +611,7 @@ rtArtFindExactMatch (rtTable* pt, u8* pDest, int plen)
     register int index;
     register int l;
     register int ml;            /* max level */
+    tableEntry def;             /* subtable default route */
     u8* pAddr;
     u32 offset;
 
@@ -373,19 +622,19 @@ rtArtFindExactMatch (rtTable* pt, u8* pDest, int plen)
     offset = 0;
     for ( l = 0; l <= ml; ++l ) {
         index = fringeIndex(&pAddr, &offset, pt->psi[l].sl);
-        ent   = pst[index];
+        ent   = loadEnt(pst[index]);
         if ( !ent.ent ) {
             /*
              * Neither route entry nor subtable pointer.
              * Return the default route pointer.
              */
-            return pt->root[1].ent;    /* default route */
+            return loadEnt(pt->root[1]).ent;   /* default route */
         }
         if ( !isSubtable(ent) ) {
             goto AddrComp;
         }
         if ( l == ml ) {
-            ent.ent = subtablePtr(ent).down[1].ent;
+            ent = loadEnt(subtablePtr(ent).down[1]);
             break;
         }
 
@@ -394,8 +643,9 @@ rtArtFindExactMatch (rtTable* pt, u8* pDest, int plen)
          * 2. Check the subtable default route. Exit if it exists.
          */
         ent = subtablePtr(ent);
-        if ( ent.down[1].ent && (ent.down[1].ent->plen == plen) ) {
-            ent = ent.down[1];
+        def = loadEnt(ent.down[1]);
+        if ( def.ent && (def.ent->plen == plen) ) {
+            ent = def;
             goto AddrComp;
         }
         pst = ent.down;
@@ -412,10 +662,10 @@ AddrComp:
             return ent.ent;
         }
         index >>= 1;
-        ent = pst[index];
+        ent = loadEnt(pst[index]);
     }
 
-    return pt->root[1].ent;      /* default route */
+    return loadEnt(pt->root[1]).ent;    /* default route */
 }
 
 
@@ -423,7 +673,10 @@ AddrComp:
  * @name   rtArtNewRoute
  *
  * @brief  API function.
- *         Allocates memory for a new route entry.
+ *         Allocates memory for a new route entry followed by
+ *         `routeDataSize' bytes of user data (see rtArtInitOpts()).
+ *         The route is taken from the route arena of `pt' if it
+ *         was created with artOptRouteArena.
  *
  * @param[in] pt Pointer to the routing table
  *
@@ -435,7 +688,7 @@ rtArtNewRoute (rtTable* pt)
 {
     register routeEnt *r;
 
-    r = (routeEnt *) calloc(1, sizeof(routeEnt));
+    r = rtArtRouteAlloc(pt);
     if ( r == NULL ) return NULL;
 
     return r;
@@ -446,6 +699,12 @@ rtArtNewRoute (rtTable* pt)
  * @name   rtArtFreeRoute
  *
  * @brief  Frees memory allocated for a route.
+ *         If the readers are lock-free, the memory is freed after
+ *         all the readers that may see the route leave. A route of
+ *         a clone (rtArtClone()) is freed by its last reference, a
+ *         route shared by table replicas by replica 0, and a route
+ *         deleted by a writer thread of rtArtApplyUpdatesSharded()
+ *         after the threads join.
  *
  * @param[in] pt Pointer to the routing table
  * @param[in] r  Pointer to the route to be freed
@@ -458,7 +717,21 @@ rtArtFreeRoute (rtTable* pt, routeEnt* r)
         return;
     }
 
-    free(r);
+    if ( pt->pCow && rtArtCowRelease(pt, r) ) {
+        return;                 /* other clones have `r' */
+    }
+    if ( pt->pRouteOwner ) {
+        return;                 /* freed by the owner of `r' */
+    }
+    if ( pt->pShard ) {
+        rtArtShardRetire(pt, r, rtArtRouteFree);
+        return;
+    }
+    if ( pt->pEpoch ) {
+        rtArtRetire(pt, r, rtArtRouteFree);
+        return;
+    }
+    rtArtRouteFree(pt, r);
 }
 
 
@@ -499,8 +772,8 @@ rtArtInsertRoute (rtTable* pt, routeEnt* pEnt)
      */
     if ( pEnt->plen == 0 ){
         if ( pt->root[1].ent ) return pt->root[1].ent;
-        pt->root[1].ent = pEnt;
-        pt->nRoutes++;
+        storeRoute(pt->root[1], pEnt);
+        rtArtCountRoute(pt, pEnt, 1);
         return pEnt;
     }
 
@@ -528,8 +801,13 @@ rtArtInsertRoute (rtTable* pt, routeEnt* pEnt)
                 /* XXX do something later rather than panicing */
                 panic(("rtArtInsertRoute: no memory"));
             }
-            pst->down = makeSubtable(ent.down);
-            pst2[0].count++;
+            storeDown(*pst, makeSubtable(ent.down));
+            if ( l == 0 ) {
+                /* shared by the writers of rtArtApplyUpdatesSharded() */
+                __atomic_add_fetch(&pst2[0].count, 1, __ATOMIC_RELAXED);
+            } else {
+                pst2[0].count++;
+            }
         }
         pst = ent.down;         /* advance subtable ptr to next level */
 
@@ -546,6 +824,534 @@ rtArtInsertRoute (rtTable* pt, routeEnt* pEnt)
 }
 
 
+/**
+ * @name   rtArtInsertRoutes
+ *
+ * @brief  API function.
+ *         (registered as `pt->bulkLoad()' in `rtArtPcInit()' and
+ *         `rtArtCpInit()').
+ *         Inserts `n' routes one by one by calling `pt->insert()'.
+ *
+ * @param[in]     pt      Pointer to the routing table
+ * @param[in,out] pRoutes Array of `n' route pointers. The routes that
+ *                        were not inserted are moved to the end.
+ * @param[in]     n       The number of routes in `pRoutes'
+ *
+ * @retval int The number of inserted routes (`m'). `pRoutes[m]'
+ *             to `pRoutes[n-1]' have the same IP prefixes as
+ *             existing routes and must be freed by the caller.
+ */
+int
+rtArtInsertRoutes (rtTable* pt, routeEnt** pRoutes, int n)
+{
+    routeEnt* r;
+    int i, m;
+
+    for ( i = m = 0; i < n; ++i ) {
+        r = pRoutes[i];
+        if ( pt->insert(pt, r) == r ) {
+            pRoutes[i]   = pRoutes[m];
+            pRoutes[m++] = r;
+        }
+    }
+    return m;
+}
+
+
+/*
+ * `rtArtTrieBulkLoad()' sorts the routes by the first BULK_KEY_BITS bits
+ * so that the routes sharing subtables are stored one after another,
+ * and prefetches the route BULK_PREFETCH routes ahead since the
+ * routes are no longer visited in the order of their addresses in
+ * memory.
+ */
+#define BULK_KEY_BITS 16
+#define BULK_PREFETCH 8
+
+#define bulkKey(r) (((r)->dest[0] << 8) | (r)->dest[1])
+
+
+/**
+ * @name   bulkSort
+ *
+ * @brief  Sorts the routes by the first BULK_KEY_BITS bits of
+ *         their addresses (counting sort). The routes of prefix
+ *         length <= `sl' are moved to the beginning in the same
+ *         order. The routes are left as they are if there is no
+ *         memory.
+ *
+ * @param[in,out] pRoutes Array of `n' route pointers
+ * @param[in]     n       The number of routes in `pRoutes'
+ * @param[in]     sl      Prefix length of the routes to be moved to
+ *                        the beginning (-1: none)
+ *
+ * @retval int The number of routes of prefix length <= `sl'
+ * @retval -1  There was no memory
+ */
+static int
+bulkSort (routeEnt** pRoutes, int n, int sl)
+{
+    routeEnt** p;
+    int* pCnt;
+    int  i, k, c, sum, rc;
+
+
+#define bulkBucket(r) (((r)->plen <= sl) ? 0 : bulkKey(r) + 1)
+
+    rc   = -1;
+    p    = malloc(n * sizeof(routeEnt*));
+    pCnt = calloc((1 << BULK_KEY_BITS) + 1, sizeof(int));
+    if ( p && pCnt ) {
+        for ( i = 0; i < n; ++i ) {
+            pCnt[bulkBucket(pRoutes[i])]++;
+        }
+        rc = pCnt[0];
+        for ( k = sum = 0; k <= (1 << BULK_KEY_BITS); ++k ) {
+            c       = pCnt[k];
+            pCnt[k] = sum;      /* first position of bucket `k' */
+            sum    += c;
+        }
+        for ( i = 0; i < n; ++i ) {
+            p[pCnt[bulkBucket(pRoutes[i])]++] = pRoutes[i];
+        }
+        memcpy(pRoutes, p, n * sizeof(routeEnt*));
+    }
+    free(pCnt);
+    free(p);
+    return rc;
+
+#undef bulkBucket
+}
+
+
+/**
+ * @name   bulkPlace
+ *
+ * @brief  Pass 1 of `rtArtTrieBulkLoad()'. Stores route `pEnt' only in
+ *         the entry of its base index, creating the subtables on
+ *         the way. The routes are not allotted.
+ *
+ * @param[in] pt        Pointer to the routing table
+ * @param[in] pEnt      Pointer to the route to be stored
+ * @param[in] countRoot false: the subtables created in the root are
+ *                      not counted in `pt->root[0]' (the caller
+ *                      counts them).
+ *
+ * @retval true  Success
+ * @retval false There is a route with the same IP prefix
+ */
+static bool
+bulkPlace (rtTable* pt, routeEnt* pEnt, bool countRoot)
+{
+    register int l, len;
+    register subtable   pst;
+    register tableEntry ent;
+    subtable pst2;
+    u8*      pDest;
+    int      index;
+    u32      offset;
+
+
+    if ( pEnt->plen == 0 ) {
+        if ( pt->root[1].ent ) return false;
+        storeRoute(pt->root[1], pEnt);
+        return true;
+    }
+
+    index  = baseIndex(pt, pEnt->dest, pEnt->plen);
+    len    = pt->psi[0].sl;     /* accumulated address bit length */
+    pst    = pt->root;          /* ptr to subtable */
+    l      = 0;                 /* level */
+    offset = 0;
+    pDest  = pEnt->dest;        /* ptr to dest. IP address */
+    while ( pEnt->plen > len ) {
+        pst2 = pst;             /* save &pst[0] */
+        pst += fringeIndex(&pDest, &offset, pt->psi[l].sl);
+        ent = *pst;
+        if ( isSubtable(ent) ) {
+            ent = subtablePtr(ent);
+        } else {
+            ent.down = rtArtNewSubTable(pt, l+1, ent);
+            if ( ent.down == NULL ) {
+                /* XXX do something later rather than panicing */
+                panic(("bulkPlace: no memory"));
+            }
+            storeDown(*pst, makeSubtable(ent.down));
+            if ( countRoot || (l > 0) ) {
+                pst2[0].count++;
+            }
+        }
+        pst = ent.down;         /* advance subtable ptr to next level */
+
+        ++l;
+        if ( l >= pt->nLevels ) {
+            panic(("bulkPlace: shouldn't happen (l = %d)", l));
+        }
+        len += pt->psi[l].sl;
+    }
+
+    /*
+     * Route with a fringe index goes to index 1 of the subtable
+     * if there is one.
+     */
+    ent = pst[index];
+    if ( isSubtable(ent) ) {
+        if ( subtablePtr(ent).down[1].ent ) return false;
+        storeRoute(subtablePtr(ent).down[1], pEnt);
+    } else {
+        if ( ent.ent ) return false;
+        storeRoute(pst[index], pEnt);
+    }
+    pEnt->level = l;
+    pst[0].count++;
+    return true;
+}
+
+
+/**
+ * @name   bulkAllot
+ *
+ * @brief  Pass 2 of `rtArtTrieBulkLoad()'. Allots the routes stored
+ *         by `bulkPlace()' in subtable `t' and its descendants.
+ *         Each entry is written at most once: an empty entry
+ *         takes the route of its parent, which is visited first
+ *         because the heap is scanned from the least specific
+ *         index to the most specific.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] t  Pointer to a subtable (trie node)
+ * @param[in] l  The level of `t'
+ */
+static void
+bulkAllot (rtTable* pt, subtable t, int l)
+{
+    register int i, threshold, max;
+    register routeEnt* r;
+    subtable pst;
+
+
+    threshold = 1 << pt->psi[l].sl;
+    max       = threshold << 1;
+    for ( i = 2; i < max; ++i ) {
+        r = ((i >> 1) > 1) ? t[i >> 1].ent : NULL;
+        if ( isSubtable(t[i]) ) {
+            pst = subtablePtr(t[i]).down;
+            if ( !pst[1].ent ) {
+                storeRoute(pst[1], r);
+            }
+            bulkAllot(pt, pst, l+1);
+        } else if ( !t[i].ent ) {
+            storeRoute(t[i], r);
+        }
+    }
+}
+
+
+/**
+ * @name   rtArtTrieBulkLoad
+ *
+ * @brief  API function.
+ *         (registered as `pt->bulkLoad()' in `rtArtInit()').
+ *         Inserts `n' routes into an empty routing table. Unlike
+ *         calling `pt->insert()' `n' times, the routes are first
+ *         bucketed by the first BULK_KEY_BITS bits of their
+ *         addresses (`bulkSort()') and each route is stored only
+ *         at its base index (`bulkPlace()'). Then every subtable
+ *         is filled in a single pass (`bulkAllot()'), so no entry
+ *         is written more than once. Falls back to
+ *         `rtArtInsertRoutes()' if `pt' already has routes.
+ *
+ * @param[in]     pt      Pointer to the routing table
+ * @param[in,out] pRoutes Array of `n' route pointers. The routes that
+ *                        were not inserted are moved to the end.
+ *                        The routes must NOT be local variables.
+ * @param[in]     n       The number of routes in `pRoutes'
+ *
+ * @retval int The number of inserted routes (`m'). `pRoutes[m]'
+ *             to `pRoutes[n-1]' have the same IP prefixes as
+ *             other routes and must be freed by the caller.
+ */
+static int
+rtArtTrieBulkLoad (rtTable* pt, routeEnt** pRoutes, int n)
+{
+    routeEnt* r;
+    int i, m;
+
+
+    assert(pt && (pRoutes || (n == 0)));
+
+    if ( pt->nRoutes > 0 ) {
+        return rtArtInsertRoutes(pt, pRoutes, n);
+    }
+
+    bulkSort(pRoutes, n, -1);
+    for ( i = m = 0; i < n; ++i ) {
+        r = pRoutes[i];
+        if ( i + BULK_PREFETCH < n ) {
+            __builtin_prefetch(pRoutes[i + BULK_PREFETCH]);
+        }
+        if ( bulkPlace(pt, r, true) ) {
+            pRoutes[i]   = pRoutes[m];
+            pRoutes[m++] = r;
+            rtArtCountRoute(pt, r, 1);
+        }
+    }
+    bulkAllot(pt, pt->root, 0);
+    rtArtBumpGen(pt);
+
+    return m;
+}
+
+
+/**
+ * @name   rtArtBulkLoad
+ *
+ * @brief  API function.
+ *         Inserts `n' routes into an empty routing table with
+ *         `pt->bulkLoad()' of the table (`rtArtTrieBulkLoad()' of
+ *         a simple trie, `rtArtInsertRoutes()' of the others).
+ *
+ * @param[in]     pt      Pointer to the routing table
+ * @param[in,out] pRoutes Array of `n' route pointers. The routes that
+ *                        were not inserted are moved to the end.
+ *                        The routes must NOT be local variables.
+ * @param[in]     n       The number of routes in `pRoutes'
+ *
+ * @retval int The number of inserted routes (`m'). `pRoutes[m]'
+ *             to `pRoutes[n-1]' have the same IP prefixes as
+ *             other routes and must be freed by the caller.
+ */
+int
+rtArtBulkLoad (rtTable* pt, routeEnt** pRoutes, int n)
+{
+    assert(pt && (pRoutes || (n == 0)));
+
+    return pt->bulkLoad(pt, pRoutes, n);
+}
+
+
+/*
+ * Worker of `rtArtBulkLoadParallel()'. It places and allots the
+ * routes longer than the root stride of the root fringe indices
+ * [f0, f1] in the subtables under them. The counters of `t' and
+ * the subtable allocator are its own.
+ */
+typedef struct bulkWorker bulkWorker;
+struct bulkWorker {
+    rtTable    t;               /* copy of the routing table */
+    routeEnt** pRoutes;         /* routes of the worker */
+    u8*        pOk;             /* true: pRoutes[i] was placed */
+    int        n;               /* # of routes in `pRoutes' */
+    u32        f0, f1;          /* root fringe indices of the routes */
+    pthread_t  tid;
+    bool       forked;          /* `t.alloc' is set up */
+};
+
+
+/**
+ * @name   bulkUnit
+ *
+ * @brief  Returns the smallest unit of the routes sorted by bulkSort()
+ *         that can be given to a worker of rtArtBulkLoadParallel():
+ *         the routes of the same unit may share a root fringe index.
+ */
+static inline u32
+bulkUnit (rtTable* pt, routeEnt* r)
+{
+    register int sl = pt->psi[0].sl;
+
+    return (sl >= BULK_KEY_BITS) ? bulkKey(r)
+                                 : bulkKey(r) >> (BULK_KEY_BITS - sl);
+}
+
+
+/**
+ * @name   bulkWorkerMain
+ *
+ * @brief  Thread function of a worker of rtArtBulkLoadParallel()
+ */
+static void*
+bulkWorkerMain (void* p)
+{
+    bulkWorker* pw = p;
+    rtTable*    pt = &pw->t;
+    u32 f;
+    int i;
+
+
+    for ( i = 0; i < pw->n; ++i ) {
+        if ( i + BULK_PREFETCH < pw->n ) {
+            __builtin_prefetch(pw->pRoutes[i + BULK_PREFETCH]);
+        }
+        pw->pOk[i] = bulkPlace(pt, pw->pRoutes[i], false);
+        if ( pw->pOk[i] ) {
+            rtArtCountRoute(pt, pw->pRoutes[i], 1);
+        }
+    }
+    for ( f = pw->f0; f <= pw->f1; ++f ) {
+        if ( isSubtable(pt->root[f]) ) {
+            bulkAllot(pt, subtablePtr(pt->root[f]).down, 1);
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * @name   rtArtBulkLoadParallel
+ *
+ * @brief  API function.
+ *         Same as `rtArtBulkLoad()' but the subtables are built by
+ *         `nThreads' threads. The routes in the root (prefix length
+ *         <= pt->psi[0].sl) are stored and allotted first. Then the
+ *         rest is split into `nThreads' ranges of the root fringe
+ *         indices of about the same number of routes. Each thread
+ *         builds and allots the subtables under its range with its
+ *         own subtable allocator (see rtArtAllocFork()), so the
+ *         threads share no memory to write but the root fringe
+ *         entries of their own. Falls back to `rtArtBulkLoad()' if
+ *         `nThreads' <= 1, `pt' is not empty, `pt' is not a simple
+ *         trie (or has an exact match index, clones or an image), or
+ *         the subtable allocator of `pt' is given by the user (it may
+ *         not be thread-safe).
+ *
+ * @param[in]     pt       Pointer to the routing table
+ * @param[in,out] pRoutes  Array of `n' route pointers. The routes that
+ *                         were not inserted are moved to the end.
+ *                         The routes must NOT be local variables.
+ * @param[in]     n        The number of routes in `pRoutes'
+ * @param[in]     nThreads The number of threads
+ *
+ * @retval int The number of inserted routes (`m'). `pRoutes[m]'
+ *             to `pRoutes[n-1]' have the same IP prefixes as
+ *             other routes and must be freed by the caller.
+ */
+int
+rtArtBulkLoadParallel (rtTable* pt, routeEnt** pRoutes, int n, int nThreads)
+{
+    bulkWorker* pw;
+    routeEnt**  p;
+    u8*  pOk;
+    int  i, j, k, l, m, b, e, nRoot, nw, sl, shift;
+
+
+    assert(pt && (pRoutes || (n == 0)));
+
+    if ( (nThreads <= 1) || (pt->type != simpleTrie) || pt->pIdx ||
+         pt->pCow || pt->pImg || (pt->nRoutes > 0) ) {
+        return pt->bulkLoad(pt, pRoutes, n);
+    }
+
+    pw  = calloc(nThreads, sizeof(bulkWorker));
+    p   = malloc(n * sizeof(routeEnt*));
+    pOk = malloc(n);
+    if ( !pw || !p || !pOk ) goto fallBack;
+    for ( k = 0; k < nThreads; ++k ) {
+        pw[k].t = *pt;
+        pw[k].t.nRoutes  = 0;
+        pw[k].t.pLvStats = calloc(pt->nLevels, sizeof(rtArtLevelStats));
+        if ( !pw[k].t.pLvStats ) goto fallBack;
+        pw[k].forked = rtArtAllocFork(pt, &pw[k].t.alloc);
+        if ( !pw[k].forked ) goto fallBack;
+    }
+
+    /*
+     * The routes in the root come first.
+     */
+    sl    = pt->psi[0].sl;
+    nRoot = bulkSort(pRoutes, n, sl);
+    if ( nRoot < 0 ) goto fallBack;
+    for ( i = 0; i < nRoot; ++i ) {
+        pOk[i] = bulkPlace(pt, pRoutes[i], true);
+        if ( pOk[i] ) {
+            rtArtCountRoute(pt, pRoutes[i], 1);
+        }
+    }
+    bulkAllot(pt, pt->root, 0); /* no subtable yet */
+
+    /*
+     * Split the rest at the boundaries of the root fringe indices.
+     */
+    shift = (sl > BULK_KEY_BITS) ? sl - BULK_KEY_BITS : 0;
+    for ( k = nw = 0, b = nRoot; (k < nThreads) && (b < n); ++k ) {
+        e = nRoot + (int)((u64)(n - nRoot) * (k + 1) / nThreads);
+        if ( e <= b ) continue;
+        while ( (e < n) &&
+                (bulkUnit(pt, pRoutes[e]) == bulkUnit(pt, pRoutes[e-1])) ) {
+            ++e;
+        }
+        pw[nw].pRoutes = pRoutes + b;
+        pw[nw].pOk     = pOk + b;
+        pw[nw].n       = e - b;
+        pw[nw].f0 = (1 << sl) + (bulkUnit(pt, pRoutes[b]) << shift);
+        pw[nw].f1 = (1 << sl) + ((bulkUnit(pt, pRoutes[e-1]) + 1) << shift) - 1;
+        ++nw;
+        b = e;
+    }
+    for ( k = 0; k < nw; ++k ) {
+        if ( pthread_create(&pw[k].tid, NULL, bulkWorkerMain, &pw[k]) ) {
+            bulkWorkerMain(&pw[k]);
+            pw[k].n = -1;       /* done by this thread */
+        }
+    }
+    for ( k = 0; k < nw; ++k ) {
+        if ( pw[k].n >= 0 ) {
+            pthread_join(pw[k].tid, NULL);
+        }
+    }
+
+    /*
+     * Merge the counters and the subtable allocators of the workers.
+     */
+    for ( k = 0; k < nThreads; ++k ) {
+        for ( l = 0; l < pt->nLevels; ++l ) {
+            pt->pLvStats[l].nSubtables += pw[k].t.pLvStats[l].nSubtables;
+            pt->pLvStats[l].bytes      += pw[k].t.pLvStats[l].bytes;
+            pt->pLvStats[l].nRoutes    += pw[k].t.pLvStats[l].nRoutes;
+        }
+        pt->nRoutes += pw[k].t.nRoutes;
+        rtArtAllocJoin(pt, &pw[k].t.alloc);
+        free(pw[k].t.pLvStats);
+    }
+    for ( i = 1 << sl; i < (2 << sl); ++i ) {
+        if ( isSubtable(pt->root[i]) ) {
+            pt->root[0].count++;
+        }
+    }
+
+    for ( i = m = 0; i < n; ++i ) {
+        if ( pOk[i] ) {
+            p[m++] = pRoutes[i];
+        }
+    }
+    for ( i = 0, j = m; i < n; ++i ) {
+        if ( !pOk[i] ) {
+            p[j++] = pRoutes[i];
+        }
+    }
+    memcpy(pRoutes, p, n * sizeof(routeEnt*));
+    rtArtBumpGen(pt);
+
+    free(pOk);
+    free(p);
+    free(pw);
+    return m;
+
+
+fallBack:
+    for ( k = 0; pw && (k < nThreads); ++k ) {
+        if ( pw[k].forked ) {
+            rtArtAllocJoin(pt, &pw[k].t.alloc);
+        }
+        free(pw[k].t.pLvStats);
+    }
+    free(pOk);
+    free(p);
+    free(pw);
+    return pt->bulkLoad(pt, pRoutes, n);
+}
+
+
 /**
  * @name   rtArtDeleteRoute
  *
@@ -583,8 +1389,10 @@ rtArtDeleteRoute (rtTable* pt, u8* pDest, int plen)
      */
     if ( plen == 0 ) {
         pEnt = pt->root[1].ent;
-        pt->root[1].ent = NULL;
-        pt->nRoutes--;
+        if ( pEnt ) {
+            storeRoute(pt->root[1], NULL);
+            rtArtCountRoute(pt, pEnt, -1);
+        }
         goto FreeAndReturn;
     }
 
@@ -604,31 +1412,280 @@ rtArtDeleteRoute (rtTable* pt, u8* pDest, int plen)
             goto FreeAndReturn;
         }
 
-        pt->pTbl[l] = pst;       /* save sbutable pointer */
-        pst       += fringeIndex(&pDest, &offset, pt->psi[l].sl);
-        ent        = *pst;
-        pt->pEnt[l] = pst;       /* save entry pointer */
-        if ( isSubtable(ent) ) {
-            ent = subtablePtr(ent);
-            pst = ent.down;
-        } else {
-            return false;       /* no route */
-        }
+        pt->pTbl[l] = pst;       /* save sbutable pointer */
+        pst       += fringeIndex(&pDest, &offset, pt->psi[l].sl);
+        ent        = *pst;
+        pt->pEnt[l] = pst;       /* save entry pointer */
+        if ( isSubtable(ent) ) {
+            ent = subtablePtr(ent);
+            pst = ent.down;
+        } else {
+            return false;       /* no route */
+        }
+
+        ++l;
+        if ( l >= (pt->nLevels - 1) ) {
+            flag = false;       /* last level */
+            if ( l >= pt->nLevels ) {
+                panic(("rtArtDeleteRoute: shouldn't happen (l = %d)", l));
+            }
+        }
+        len += pt->psi[l].sl;
+    }
+
+FreeAndReturn:
+    if ( pEnt == NULL ) return false;
+    rtArtFreeRoute(pt, pEnt);
+    return true;
+}
+
+
+/**
+ * @name   rtArtReplaceRoute
+ *
+ * @brief  API function.
+ *         (registered as `pt->replace()').
+ *         Replaces the route that has the same IP prefix (address
+ *         and prefix length) as `pEnt' with `pEnt' in place.
+ *         Unlike `pt->delete()' followed by `pt->insert()', no
+ *         subtable is freed or created and every lookup returns
+ *         either the old route or `pEnt' while it is replaced.
+ *
+ * @param[in] pt   Pointer to the routing table
+ * @param[in] pEnt Pointer to the new route.
+ *                 `pEnt' must NOT point to a local variable.
+ *
+ * @retval routeEnt* The replaced route. It must be freed by the
+ *                   caller with rtArtFreeRoute().
+ * @retval NULL      There is no route of the IP prefix of `pEnt'.
+ *                   `pEnt' is not inserted.
+ */
+static routeEnt*
+rtArtReplaceRoute (rtTable* pt, routeEnt* pEnt)
+{
+    register int         l, len;
+    register tableEntry* pst;
+    register tableEntry  ent;
+    routeEnt* r;
+    u8*       pDest;
+    bool      flag;
+    int       index;
+    u32       offset;
+
+
+    assert((pt != NULL) && (pEnt != NULL));
+
+    /*
+     * Handle default route
+     */
+    if ( pEnt->plen == 0 ) {
+        r = pt->root[1].ent;
+        if ( r ) {
+            pEnt->level = r->level;
+            storeRoute(pt->root[1], pEnt);
+            rtArtBumpGen(pt);
+        }
+        return r;
+    }
+
+    index  = baseIndex(pt, pEnt->dest, pEnt->plen);
+    len    = pt->psi[0].sl;     /* accumulated address bit length */
+    pst    = pt->root;          /* ptr to subtable */
+    l      = 0;                 /* level */
+    flag   = true;
+    offset = 0;
+    pDest  = pEnt->dest;        /* ptr to dest. IP address */
+
+    for (;;) {
+        if ( pEnt->plen <= len ) {
+            ent = pst[index];
+            r = (flag && isSubtable(ent)) ? subtablePtr(ent).down[1].ent
+                                          : ent.ent;
+            if ( (!r) || (r->plen != pEnt->plen) ||
+                 (cmpAddr(r->dest, pEnt->dest, pEnt->plen) == false) ) {
+                return NULL;
+            }
+            rtArtSwapRoute(pt, pst, index, 1 << pt->psi[l].sl,
+                           flag, r, pEnt);
+            return r;
+        }
+
+        pst += fringeIndex(&pDest, &offset, pt->psi[l].sl);
+        ent  = *pst;
+        if ( !isSubtable(ent) ) {
+            return NULL;        /* no route */
+        }
+        pst = subtablePtr(ent).down;
+
+        ++l;
+        if ( l >= (pt->nLevels - 1) ) {
+            flag = false;       /* last level */
+            if ( l >= pt->nLevels ) {
+                panic(("rtArtReplaceRoute: shouldn't happen (l = %d)", l));
+            }
+        }
+        len += pt->psi[l].sl;
+    }
+}
+
+
+/**
+ * @name  ipv4a2addr
+ *
+ * @brief Stores an IPv4 address in the host byte order to `p'
+ *        in the network byte order.
+ */
+static inline void
+ipv4a2addr (u8* p, ipv4a a)
+{
+    ipv4na na = __builtin_bswap32(a);
+
+    memcpy(p, &na, sizeof(na));
+}
+
+
+/**
+ * @name  u64s2addr
+ *
+ * @brief Stores an IPv6 address given as two 64-bit words in the host
+ *        byte order to `p' in the network byte order.
+ */
+static inline void
+u64s2addr (u8* p, u64 hi, u64 lo)
+{
+    u64 x[2];
+
+    x[0] = __builtin_bswap64(hi);
+    x[1] = __builtin_bswap64(lo);
+    memcpy(p, x, sizeof(x));
+}
+
+
+/**
+ * @name   rtArtInsert4
+ *
+ * @brief  API function.
+ *         Sets the IPv4 prefix `dest'/`plen' to route `r' and inserts
+ *         `r' by calling `pt->insert()'.
+ *
+ * @param[in] pt   Pointer to the IPv4 routing table
+ * @param[in] r    Pointer to the route to be inserted
+ * @param[in] dest Destination IPv4 address in the host byte order
+ * @param[in] plen Prefix length
+ *
+ * @retval routeEnt* The same value as `pt->insert()'
+ */
+routeEnt*
+rtArtInsert4 (rtTable* pt, routeEnt* r, ipv4a dest, int plen)
+{
+    assert(pt->alen == 32);
+
+    ipv4a2addr(r->dest, dest);
+    r->plen = plen;
+    return pt->insert(pt, r);
+}
+
+
+/**
+ * @name   rtArtInsert6
+ *
+ * @brief  API function.
+ *         IPv6 version of rtArtInsert4(). The destination address
+ *         is given as two 64-bit words in the host byte order.
+ */
+routeEnt*
+rtArtInsert6 (rtTable* pt, routeEnt* r, u64 hi, u64 lo, int plen)
+{
+    assert(pt->alen == 128);
+
+    u64s2addr(r->dest, hi, lo);
+    r->plen = plen;
+    return pt->insert(pt, r);
+}
+
+
+/**
+ * @name   rtArtDelete4
+ *
+ * @brief  API function.
+ *         Deletes the IPv4 route `dest'/`plen' by calling `pt->delete()'.
+ *
+ * @param[in] pt   Pointer to the IPv4 routing table
+ * @param[in] dest Destination IPv4 address in the host byte order
+ * @param[in] plen Prefix length
+ *
+ * @retval bool The same value as `pt->delete()'
+ */
+bool
+rtArtDelete4 (rtTable* pt, ipv4a dest, int plen)
+{
+    u8 a[16];               /* same size as routeEnt.dest */
+
+    assert(pt->alen == 32);
+
+    ipv4a2addr(a, dest);
+    return pt->delete(pt, a, plen);
+}
+
+
+/**
+ * @name   rtArtDelete6
+ *
+ * @brief  API function.
+ *         IPv6 version of rtArtDelete4().
+ */
+bool
+rtArtDelete6 (rtTable* pt, u64 hi, u64 lo, int plen)
+{
+    u8 a[16];
+
+    assert(pt->alen == 128);
+
+    u64s2addr(a, hi, lo);
+    return pt->delete(pt, a, plen);
+}
+
+
+/**
+ * @name   rtArtFindExactMatch4
+ *
+ * @brief  API function.
+ *         Finds the IPv4 route `dest'/`plen' by calling
+ *         `pt->findExactMatch()'.
+ *
+ * @param[in] pt   Pointer to the IPv4 routing table
+ * @param[in] dest Destination IPv4 address in the host byte order
+ * @param[in] plen Prefix length
+ *
+ * @retval routeEnt* The same value as `pt->findExactMatch()'
+ */
+routeEnt*
+rtArtFindExactMatch4 (rtTable* pt, ipv4a dest, int plen)
+{
+    u8 a[16];               /* same size as routeEnt.dest */
+
+    assert(pt->alen == 32);
 
-        ++l;
-        if ( l >= (pt->nLevels - 1) ) {
-            flag = false;       /* last level */
-            if ( l >= pt->nLevels ) {
-                panic(("rtArtDeleteRoute: shouldn't happen (l = %d)", l));
-            }
-        }
-        len += pt->psi[l].sl;
-    }
+    ipv4a2addr(a, dest);
+    return pt->findExactMatch(pt, a, plen);
+}
 
-FreeAndReturn:
-    if ( pEnt == NULL ) return false;
-    rtArtFreeRoute(pt, pEnt);
-    return true;
+
+/**
+ * @name   rtArtFindExactMatch6
+ *
+ * @brief  API function.
+ *         IPv6 version of rtArtFindExactMatch4().
+ */
+routeEnt*
+rtArtFindExactMatch6 (rtTable* pt, u64 hi, u64 lo, int plen)
+{
+    u8 a[16];
+
+    assert(pt->alen == 128);
+
+    u64s2addr(a, hi, lo);
+    return pt->findExactMatch(pt, a, plen);
 }
 
 
@@ -965,50 +2022,518 @@ endWhile:
 
 
 /**
- * @struct prefixTbl
+ * @name  rtArtIterInit
+ *
+ * @brief API function.
+ *        Initializes iterator `pi' that returns the routes of `pt'
+ *        by rtArtIterNext() in the prefix order (by address, and a
+ *        prefix before the prefixes it covers). The walk needs no
+ *        memory other than `*pi' and can be stopped and resumed at
+ *        any route. It is limited to the routes whose first root
+ *        fringe index (the first `pt->psi[0].sl' bits of the
+ *        address of the prefix, or 0 for the prefixes shorter than
+ *        that) is in [`start', `end'), so that the disjoint ranges
+ *        that cover [0, 1 << pt->psi[0].sl) are walked by different
+ *        threads and make the whole table in order.
+ *        `pt' must not be updated during the walk unless all of it
+ *        is in one read-side critical section of a lock-free reader.
  *
- * @brief Structure used by `collectRoutes()'.
- *        `p' must be a pointer equivalent to
- *        `routeEnt entry[number_of_routes]'.
+ * @param[out] pi    Pointer to the iterator
+ * @param[in]  pt    Pointer to the routing table (simple trie or
+ *                   path-compressed trie)
+ * @param[in]  start The first root fringe index offset to walk
+ * @param[in]  end   The root fringe index offset to stop at.
+ *                   Larger than 1 << pt->psi[0].sl: to the end.
  *
- * @var   i
- * @brief The number of routes collected up to now.
- * @var   p
- * @brief Must be initialized like
- *        `calloc(number_of_routes, sizeof(routeEnt))
+ * @retval true  `pi' is initialized
+ * @retval false `pt' is a compact trie or a table loaded by rtArtLoad()
+ *               and not thawed.
  */
-typedef struct prefixTbl {
-    int i;
-    routeEnt* p;
-} prefixTbl;
+bool
+rtArtIterInit (rtArtIter* pi, rtTable* pt, u32 start, u32 end)
+{
+    u32 n;
+
+    assert(pi && pt);
+
+    if ( ((pt->type != simpleTrie) && (pt->type != pathCompTrie)) ||
+         pt->pImg || (pt->nLevels > ART_MAX_LEVELS) ) {
+        return false;
+    }
+    n = 1 << pt->psi[0].sl;
+    if ( end > n ) {
+        end = n;
+    }
+    pi->pt      = pt;
+    pi->start   = start;
+    pi->end     = end;
+    pi->level   = (start < end) ? 0 : -1;
+    pi->index   = 1;
+    pi->down    = true;
+    pi->def     = (start == 0) && (start < end);
+    pi->pTbl[0] = pt->root;
+    return true;
+}
 
 
 /**
- * @name  collectRoutes
+ * @name  rtArtIterNext
  *
- * @brief Callback function for `rtArtFlushRoutes()'.
- *        Delete all the route entries in the routing table.
+ * @brief API function.
+ *        Returns the next route of iterator `pi'. The subtables are
+ *        walked in the depth-first fashion with the stack of the
+ *        subtables in `pi' (one per level), and the heap of each
+ *        subtable in the pre-order by its indices. A route is
+ *        returned at its base index only, in the same way as it is
+ *        freed by flushSubtable().
+ *
+ * @param[in,out] pi Pointer to the iterator
+ *
+ * @retval routeEnt* Pointer to the next route
+ * @retval NULL      There is no more route
+ */
+routeEnt*
+rtArtIterNext (rtArtIter* pi)
+{
+    rtTable*   pt = pi->pt;
+    subtable   t;
+    tableEntry e;
+    routeEnt*  r;
+    u32 i, lo, threshold;
+    int l, d, sl;
+
+
+    if ( pi->def ) {
+        pi->def = false;
+        r = loadEnt(pt->root[1]).ent;
+        if ( r ) return r;
+    }
+
+    l = pi->level;
+    if ( l < 0 ) return NULL;
+    t = pi->pTbl[l];
+    i = pi->index;
+    for (;;) {
+        /*
+         * Advance `i' in the pre-order
+         */
+        threshold = 1 << pt->psi[t[-1].level].sl;
+        if ( pi->down && (i < threshold) ) {
+            i <<= 1;
+        } else if ( pi->down && isSubtable(e = loadEnt(t[i])) ) {
+            pi->pIdx[l] = i;    /* t[1] is done with `i' */
+            t = pi->pTbl[++l] = subtablePtr(e).down;
+            i = 1;
+            continue;
+        } else {
+            while ( i & 1 ) {
+                i >>= 1;
+            }
+            if ( i == 0 ) {
+                if ( l == 0 ) {
+                    pi->level = -1;
+                    return NULL;
+                }
+                t = pi->pTbl[--l];
+                i = pi->pIdx[l];
+                pi->down = false;
+                continue;
+            }
+            ++i;
+        }
+        pi->down = true;
+
+        /*
+         * Skip the root heap indices out of [start, end)
+         */
+        if ( l == 0 ) {
+            sl = pt->psi[0].sl;
+            d  = 31 - __builtin_clz(i);         /* depth of `i' */
+            lo = (i - (1 << d)) << (sl - d);    /* first fringe offset */
+            if ( (lo >= pi->end) || (lo + (1 << (sl - d)) <= pi->start) ) {
+                pi->down = false;
+                continue;
+            }
+            if ( lo < pi->start ) {
+                continue;       /* returned by the previous range */
+            }
+        }
+
+        e = loadEnt(t[i]);
+        r = isSubtable(e) ? loadEnt(subtablePtr(e).down[1]).ent : e.ent;
+        if ( r && (r != (((i >> 1) > 1) ? loadEnt(t[i >> 1]).ent : NULL)) ) {
+            pi->level = l;
+            pi->index = i;
+            return r;
+        }
+    }
+}
+
+
+/**
+ * @name  walkSubtree
+ *
+ * @brief Calls `f' with the routes of the heap below index `k' of
+ *        subtable `t' and of the subtables under its fringe indices
+ *        in the prefix order. A route is passed at its base index
+ *        only as in rtArtIterNext(), and only if it is not shorter
+ *        than `plen' and its first `plen' bits are those of `pDest'
+ *        (a route of a path-compressed trie may be stored under a
+ *        subtable of a different prefix.)
+ *
+ * @retval int The number of the routes passed to `f'
+ */
+static int
+walkSubtree (rtTable* pt, subtable t, u32 k, u8* pDest, int plen,
+             rtFunc f, void* p2)
+{
+    tableEntry e;
+    routeEnt*  r;
+    subtable   s;
+    u32 i, threshold;
+    int n;
+
+
+    threshold = 1 << pt->psi[t[-1].level].sl;
+    n = 0;
+    for ( i = k;; ) {
+        e = loadEnt(t[i]);
+        r = isSubtable(e) ? loadEnt(subtablePtr(e).down[1]).ent : e.ent;
+        if ( r && (r != (((i >> 1) > 1) ? loadEnt(t[i >> 1]).ent : NULL)) &&
+             (r->plen >= plen) && cmpAddr(pDest, r->dest, plen) ) {
+            (*f)(r, p2);
+            ++n;
+        }
+        if ( i < threshold ) {
+            i <<= 1;            /* lower left */
+            continue;
+        }
+        if ( isSubtable(e) ) {
+            s  = subtablePtr(e).down;
+            n += walkSubtree(pt, s, 2, pDest, plen, f, p2);
+            n += walkSubtree(pt, s, 3, pDest, plen, f, p2);
+        }
+        while ( (i & 1) && (i != k) ) {
+            i >>= 1;
+        }
+        if ( i == k ) {
+            return n;
+        }
+        ++i;                    /* lower right */
+    }
+}
+
+
+/**
+ * @name  walkable
+ *
+ * @brief Returns true if the subtables of `pt' can be walked by
+ *        rtArtWalkSubPrefixes() and rtArtWalkCovering().
+ */
+static inline bool
+walkable (rtTable* pt)
+{
+    return ((pt->type == simpleTrie) || (pt->type == pathCompTrie)) &&
+        (pt->pImg == NULL);
+}
+
+
+/**
+ * @name  stepFringe
+ *
+ * @brief Returns the fringe index of `pDest' in a subtable of level `l'.
+ *        The levels that a path-compressed trie skips are skipped.
+ */
+static inline u32
+stepFringe (rtTable* pt, u8* pDest, int l)
+{
+    u32 offset;
+    int bit;
+
+    bit    = pt->psi[l].tl - pt->psi[l].sl;
+    pDest += bit >> 3;
+    offset = bit & 7;
+    return fringeIndex(&pDest, &offset, pt->psi[l].sl);
+}
+
+
+/**
+ * @name  rtArtWalkSubPrefixes
+ *
+ * @brief API function.
+ *        Calls `f' with every route of `pt' covered by prefix
+ *        `pDest'/`plen' (including the route of the prefix itself)
+ *        in the prefix order. Only the subtables on the path to the
+ *        base index of the prefix and the heap and the subtables
+ *        below it are visited, so the cost is that of the part of
+ *        the trie under the prefix rather than that of the table.
+ *        `pt' must not be updated during the walk unless it is in a
+ *        read-side critical section of a lock-free reader.
+ *
+ * @param[in] pt    Pointer to the routing table (simple trie or
+ *                  path-compressed trie)
+ * @param[in] pDest Pointer to the address of the prefix
+ * @param[in] plen  Prefix length (0: the whole table)
+ * @param[in] f     Function called with each route
+ * @param[in] p2    Second parameter of `f'
+ *
+ * @retval int The number of the routes passed to `f'
+ * @retval -1  `pt' is a compact trie or a table loaded by rtArtLoad()
+ *             and not thawed.
+ */
+int
+rtArtWalkSubPrefixes (rtTable* pt, u8* pDest, int plen, rtFunc f, void* p2)
+{
+    tableEntry e;
+    routeEnt*  r;
+    subtable   t;
+    int l, ml, n;
+
+
+    assert(pt && pDest && f && (plen >= 0) && (plen <= pt->alen));
+
+    if ( !walkable(pt) ) {
+        return -1;
+    }
+
+    ml = plen2level(pt, plen);
+    t  = pt->root;
+    n  = 0;
+    for ( l = 0; l < ml; l = t[-1].level ) {
+        e = loadEnt(t[stepFringe(pt, pDest, l)]);
+        if ( !isSubtable(e) ) {
+            r = e.ent;          /* a path-compressed trie may have it */
+            if ( r && (r->plen >= plen) && cmpAddr(pDest, r->dest, plen) ) {
+                (*f)(r, p2);
+                ++n;
+            }
+            return n;
+        }
+        t = subtablePtr(e).down;
+        r = loadEnt(t[1]).ent;
+        if ( r && (r->plen >= plen) && cmpAddr(pDest, r->dest, plen) ) {
+            (*f)(r, p2);
+            ++n;
+        }
+    }
+
+    if ( l == ml ) {
+        return n + walkSubtree(pt, t, baseIndex(pt, pDest, plen),
+                               pDest, plen, f, p2);
+    }
+
+    /*
+     * Path compression skipped level `ml'. Walk the whole subtable.
+     */
+    n += walkSubtree(pt, t, 2, pDest, plen, f, p2);
+    return n + walkSubtree(pt, t, 3, pDest, plen, f, p2);
+}
+
+
+/**
+ * @name  rtArtWalkCovering
+ *
+ * @brief API function.
+ *        Calls `f' with every route of `pt' that covers address
+ *        `pDest' from the default route to the longest matching
+ *        one, that is, the routes `pt->findMatch()' would return if
+ *        the longer routes were deleted. The heap indices from the
+ *        top of each subtable down to the fringe index of `pDest'
+ *        are visited on the way down the trie.
+ *        `pt' must not be updated during the walk unless it is in a
+ *        read-side critical section of a lock-free reader.
+ *
+ * @param[in] pt    Pointer to the routing table (simple trie or
+ *                  path-compressed trie)
+ * @param[in] pDest Pointer to the destination address
+ * @param[in] f     Function called with each route
+ * @param[in] p2    Second parameter of `f'
+ *
+ * @retval int The number of the routes passed to `f'
+ * @retval -1  `pt' is a compact trie or a table loaded by rtArtLoad()
+ *             and not thawed.
+ */
+int
+rtArtWalkCovering (rtTable* pt, u8* pDest, rtFunc f, void* p2)
+{
+    tableEntry e, x;
+    routeEnt*  r;
+    routeEnt*  up;
+    subtable   t;
+    u32 fi;
+    int d, l, n, sl;
+
+
+    assert(pt && pDest && f);
+
+    if ( !walkable(pt) ) {
+        return -1;
+    }
+
+    n = 0;
+    r = loadEnt(pt->root[1]).ent;
+    if ( r ) {
+        (*f)(r, p2);
+        ++n;
+    }
+    for ( t = pt->root;; t = subtablePtr(e).down ) {
+        l  = t[-1].level;
+        sl = pt->psi[l].sl;
+        fi = stepFringe(pt, pDest, l);
+        e  = loadEnt(t[fi]);
+        up = NULL;
+        for ( d = 1; d <= sl; ++d ) {
+            x = (d == sl) ? e : loadEnt(t[fi >> (sl - d)]);
+            r = isSubtable(x) ? loadEnt(subtablePtr(x).down[1]).ent : x.ent;
+            if ( r && (r != up) && cmpAddr(pDest, r->dest, r->plen) ) {
+                (*f)(r, p2);
+                ++n;
+            }
+            up = r;
+        }
+        if ( !isSubtable(e) ) {
+            return n;
+        }
+    }
+}
+
+
+/**
+ * @name  flushRoute
+ *
+ * @brief Frees a route found by `flushSubtable()' after calling
+ *        callback function `f' with it.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] r  Route to be freed
+ * @param[in] f  Callback function (may be NULL)
+ * @param[in] p2 Second parameter of `f'
+ */
+static inline void
+flushRoute (rtTable* pt, routeEnt* r, rtFunc f, void* p2)
+{
+    if ( f ) {
+        (*f)(r, p2);
+    }
+    rtArtCountRoute(pt, r, -1);
+    rtArtFreeRoute(pt, r);
+}
+
+
+/**
+ * @name  flushSubtable
+ *
+ * @brief Frees all the routes in subtable `t' and its descendants,
+ *        and the descendants (post-order). A route is freed at its
+ *        base index only: the other entries pointing to it have
+ *        the same route as their parent entries. The entries of
+ *        the root subtable are cleared before the subtables and
+ *        the routes under them are freed so that lock-free readers
+ *        never reach them.
  *
  * @param[in] pt Pointer to the routing table
+ * @param[in] t  Pointer to a subtable (trie node)
+ * @param[in] f  Callback function (may be NULL)
+ * @param[in] p2 Second parameter of `f'
+ * @param[in] fs Function to free a subtable. The subtables are not
+ *               freed if NULL.
  */
 static void
-collectRoutes (routeEnt* p, void* p2)
+flushSubtable (rtTable* pt, subtable t, rtFunc f, void* p2, rtArtFreeSubFunc fs)
+{
+    register int i, l;
+    register routeEnt* r;       /* route allotted from the parent */
+    tableEntry e;
+    subtable   pst;
+
+
+    l = t[-1].level;
+    for ( i = (1 << (pt->psi[l].sl+1)) - 1; i > 1; --i ) {
+        e = t[i];
+        r = ((i >> 1) > 1) ? t[i >> 1].ent : NULL;
+        if ( t == pt->root ) {
+            storeRoute(t[i], NULL);
+        }
+        if ( isSubtable(e) ) {
+            pst = subtablePtr(e).down;
+            if ( pst[1].ent && (pst[1].ent != r) ) {
+                flushRoute(pt, pst[1].ent, f, p2);
+            }
+            flushSubtable(pt, pst, f, p2, fs);
+            if ( fs ) {
+                (*fs)(pt, pst);
+            }
+        } else if ( e.ent && (e.ent != r) ) {
+            flushRoute(pt, e.ent, f, p2);
+        }
+    }
+}
+
+
+/**
+ * @name  rtArtFlushTrie
+ *
+ * @brief Deletes all the routes and the subtables except the root
+ *        in one post-order traversal. Shared by the simple trie and
+ *        the path-compressed trie.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] f  Callback function called with each route before
+ *               it is freed (may be NULL)
+ * @param[in] p2 Second parameter of `f'
+ * @param[in] fs Function to free a subtable. The subtables are not
+ *               freed if NULL (the table is being destroyed).
+ */
+void
+rtArtFlushTrie (rtTable* pt, rtFunc f, void* p2, rtArtFreeSubFunc fs)
 {
-    prefixTbl* pt = (prefixTbl*)p2;
-    routeEnt* pEnt = pt->p + pt->i; /* &(pt->p[pt->i]) */
+    routeEnt* r;
 
-    ++pt->i;
-    memcpy(pEnt->dest, p->dest, sizeof(pEnt->dest));
-    pEnt->plen  = p->plen;
-    pEnt->level = p->level;
+    r = pt->root[1].ent;        /* default route */
+    storeRoute(pt->root[1], NULL);
+    if ( r ) {
+        flushRoute(pt, r, f, p2);
+    }
+    flushSubtable(pt, pt->root, f, p2, fs);
+    pt->root[0].count = 0;
+    rtArtBumpGen(pt);
+    assert(pt->nRoutes == 0);
+}
+
+
+/**
+ * @name  rtArtFlushRoutesFunc
+ *
+ * @brief API Function.
+ *        (registered as `pt->flushRoutes()' in `rtArtInit()').
+ *        Deletes all the routes in the routing table in one
+ *        post-order traversal that frees the subtables and the
+ *        routes directly. `f' is called with each route before it
+ *        is freed so that the caller can release its own data.
+ *        With lock-free readers, the routes and the subtables are
+ *        freed after the readers leave, but `f' is called at once.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] f  Callback function (may be NULL)
+ * @param[in] p2 Second parameter of `f'
+ *
+ * @retval true Always
+ */
+static bool
+rtArtFlushRoutesFunc (rtTable* pt, rtFunc f, void* p2)
+{
+    rtArtFlushTrie(pt, f, p2, rtArtFreeSubtable);
+    return true;
 }
 
+
 /**
  * @name  rtArtFlushRoutes
  *
  * @brief API Function.
  *        (registered as `pt->flush()').
  *        Delete all the route entries in the routing table.
+ *        Same as `pt->flushRoutes(pt, NULL, NULL)'.
  * @param[in] pt Pointer to the routing table
  *
  * @retval ture  All route entries are successfully deleted.
@@ -1017,30 +2542,7 @@ collectRoutes (routeEnt* p, void* p2)
 bool
 rtArtFlushRoutes (rtTable* pt)
 {
-    prefixTbl t;                /* all prefixes are stored in `t' */
-    bool rc = true;
-    int i, n;
-    n = pt->nRoutes;
-    t.i = 0;
-    t.p = calloc(n, sizeof(routeEnt));
-    if (!t.p) {
-        return false;
-    }
-    /*
-     * Pass 1. Collect all prefixes.
-     */
-    rtArtDFwalk(pt, pt->root, collectRoutes, &t);
-    /*
-     * Pass 2. Delete them.
-     */
-    for (i = 0; i < n; ++i) {
-        if (!pt->delete(pt, t.p[i].dest, t.p[i].plen)) {
-            rc = false;
-            assert(1);
-        }
-    }
-    free(t.p);
-    return rc;
+    return pt->flushRoutes(pt, NULL, NULL);
 }
 
 
@@ -1059,10 +2561,24 @@ rtArtDestroy (rtTable** p)
 {
     rtTable* pt = *p;
 
-    pt->flush(pt);
-    free(pt->root - 1);
+    if ( pt->alloc.destroy ) {
+        /*
+         * The subtables (and the routes in the route arena)
+         * are dropped at once by rtArtAllocDestroy().
+         */
+        if ( !pt->pRouteSlab ) {
+            rtArtFlushTrie(pt, NULL, NULL, NULL);
+        }
+        rtArtEpochFree(pt);
+    } else {
+        rtArtFlushRoutesFunc(pt, NULL, NULL);
+        rtArtEpochFree(pt);
+        rtArtFreeSubtableMem(pt, pt->root - 1);
+    }
+    rtArtAllocDestroy(pt);
     free(pt->pTbl);
     free(pt->pEnt);
+    free(pt->pLvStats);
     free(pt->psi);
     free(pt);
     *p = NULL;
@@ -1089,13 +2605,79 @@ rtArtDestroy (rtTable** p)
  *                    (or the number of stride lengths)
  * @param[in] psl     Pointer to an array of stride lengths
  * @param[in] alen    Bit length of IP addresses (32 or 128)
- * @param[in] type    simpleTrie (0) or pathCompTrie (1).
+ * @param[in] type    simpleTrie (0), pathCompTrie (1), or compactTrie (2).
  *
  * @retval rtTable* Pointer to the allocated routing table
  * @retval NULL     Failed to allocate a new routing table
  */
 rtTable *
 rtArtInit (int nLevels, s8* psl, int alen, trieType type)
+{
+    return rtArtInitOpts(nLevels, psl, alen, type, NULL);
+}
+
+
+/**
+ * @name  rtArtSetOpts
+ *
+ * @brief Applies the routing table options to a newly created table
+ *
+ * @param[in] pt Pointer to the routing table (may be NULL)
+ * @param[in] po Pointer to the options (may be NULL)
+ *
+ * @retval rtTable* `pt'
+ * @retval NULL     `pt' is NULL or failed to apply `po'.
+ *                  `pt' is freed in the latter case.
+ */
+static rtTable *
+rtArtSetOpts (rtTable* pt, rtArtOpts* po)
+{
+    if ( (pt == NULL) || (po == NULL) ) return pt;
+
+    if ( po->flags & artOptConcurrent ) {
+        pt->pEpoch = rtArtEpochNew();
+        if ( pt->pEpoch == NULL ) {
+            pt->deleteTable(&pt);
+            return NULL;
+        }
+    }
+    if ( po->flags & artOptExactIndex ) {
+        if ( !rtArtIndexInit(pt) ) {
+            pt->deleteTable(&pt);
+            return NULL;
+        }
+    }
+
+    return pt;
+}
+
+
+/**
+ * @name  rtArtInitOpts
+ *
+ * @brief API Function.
+ *        Same as rtArtInit() except that the routing table is
+ *        configured by the options pointed to by `po'.
+ *        Example usage:
+ *          - IPv4 routing table looked up by lock-free readers
+ *            (see rtArtRegisterReader())
+ *
+ *         s8        sl[3] = { 16, 8, 8 };
+ *         rtArtOpts opts  = { artOptConcurrent };
+ *         rtTable   pt    = rtArtInitOpts(3, sl, 32, simpleTrie, &opts);
+ *
+ * @param[in] nLevels The number of trie node levels
+ *                    (or the number of stride lengths)
+ * @param[in] psl     Pointer to an array of stride lengths
+ * @param[in] alen    Bit length of IP addresses (32 or 128)
+ * @param[in] type    simpleTrie (0), pathCompTrie (1), or compactTrie (2).
+ * @param[in] po      Pointer to the options. NULL: no option.
+ *
+ * @retval rtTable* Pointer to the allocated routing table
+ * @retval NULL     Failed to allocate a new routing table
+ */
+rtTable *
+rtArtInitOpts (int nLevels, s8* psl, int alen, trieType type, rtArtOpts* po)
 {
     register rtTable *pt;
     register int i;
@@ -1104,6 +2686,7 @@ rtArtInit (int nLevels, s8* psl, int alen, trieType type)
     pt = calloc(1, sizeof(rtTable));
     if ( pt == NULL ) return NULL;
 
+    pt->type    = type;
     pt->nLevels = nLevels;
     pt->alen    = alen;              /* address length */
     pt->len     = bits2bytes(alen);  /* alen in bytes */
@@ -1112,6 +2695,9 @@ rtArtInit (int nLevels, s8* psl, int alen, trieType type)
     pt->psi = calloc(nLevels, sizeof(strideInfo));
     if ( pt->psi == NULL ) goto tblFree;
 
+    pt->pLvStats = calloc(nLevels, sizeof(rtArtLevelStats));
+    if ( pt->pLvStats == NULL ) goto slFree;
+
     sum = 0;
     for ( i = 0; i < nLevels; ++i ) {
         pt->psi[i].sl = psl[i];
@@ -1123,12 +2709,17 @@ rtArtInit (int nLevels, s8* psl, int alen, trieType type)
 
     assert(sum == alen);
 
+    if ( rtArtAllocInit(pt, po) == false ) goto slFree;
+
     if ( type == pathCompTrie ) {
-        return rtArtPcInit(pt);
+        return rtArtSetOpts(rtArtPcInit(pt), po);
+    }
+    if ( type == compactTrie ) {
+        return rtArtSetOpts(rtArtCpInit(pt, po), po);
     }
 
     pt->root = rtArtRootTable(pt);
-    if ( pt->root == NULL ) goto slFree;
+    if ( pt->root == NULL ) goto allocFree;
 
     pt->pEnt = calloc(nLevels, sizeof(subtable));
     if ( pt->pEnt == NULL ) goto rootFree;
@@ -1138,26 +2729,82 @@ rtArtInit (int nLevels, s8* psl, int alen, trieType type)
 
     pt->insert         = rtArtInsertRoute;
     pt->delete         = rtArtDeleteRoute;
+    pt->replace        = rtArtReplaceRoute;
     pt->deleteTable    = rtArtDestroy;
     pt->flush          = rtArtFlushRoutes;
     pt->findMatch      = rtArtFindMatch;
+    pt->findMatch4     = rtArtFindMatch4;
+    pt->findMatch6     = rtArtFindMatch6;
     pt->findExactMatch = rtArtFindExactMatch;
-
-    return pt;
+    pt->findMatchBatch = rtArtFindMatchBatch;
+    pt->bulkLoad       = rtArtTrieBulkLoad;
+    pt->flushRoutes    = rtArtFlushRoutesFunc;
+#ifndef ART_LOOKUP_STATS
+    rtArtSpecialize(pt);
+    rtArtSimdInit(pt);
+#endif /* ART_LOOKUP_STATS */
+
+    return rtArtSetOpts(pt, po);
     assert(1);                  /* should not happen */
 
 
 entFree:
     free(pt->pEnt);
 rootFree:
-    free(pt->root);
+    rtArtFreeSubtableMem(pt, pt->root - 1);
+allocFree:
+    rtArtAllocDestroy(pt);
 slFree:
+    free(pt->pLvStats);
     free(pt->psi);
 tblFree:
     free(pt);
     return NULL;
 }
 
+
+/**
+ * @name  rtArtGetStats
+ *
+ * @brief API Function.
+ *        Takes a snapshot of the counters of routing table `pt':
+ *        the live subtables and their bytes, and the routes of each
+ *        level, and the table entries visited by the allotments of
+ *        the inserts and deletes. The lookups of `pt->findMatch()'
+ *        are sampled only if compiled with ART_LOOKUP_STATS.
+ *        The counters are updated by the writer, so this must be
+ *        called by the writer thread. Tables loaded by rtArtLoad()
+ *        have no subtable counted until they are thawed.
+ *
+ * @param[in]  pt Pointer to the routing table
+ * @param[out] ps Pointer to the snapshot
+ */
+void
+rtArtGetStats (rtTable* pt, rtArtStats* ps)
+{
+    rtArtLevelStats* pl;
+    int l;
+
+
+    assert(pt && ps && (pt->nLevels <= ART_MAX_LEVELS));
+
+    memset(ps, 0, sizeof(*ps));
+    ps->nRoutes        = pt->nRoutes;
+    ps->nAllots        = pt->nAllots;
+    ps->nAllotVisits   = pt->nAllotVisits;
+    ps->maxAllotVisits = pt->maxAllotVisits;
+    ps->nLevels        = pt->nLevels;
+    for ( l = 0; l < pt->nLevels; ++l ) {
+        pl = &ps->level[l];
+        *pl = pt->pLvStats[l];
+        pl->nLookupEnds = __atomic_load_n(&pt->pLvStats[l].nLookupEnds,
+                                          __ATOMIC_RELAXED);
+        ps->nSubtables     += pl->nSubtables;
+        ps->bytes          += pl->bytes;
+        ps->nLookupSamples += pl->nLookupEnds;
+    }
+}
+
 #if 0
 /**
  * @name   heapVisit
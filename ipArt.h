@@ -43,6 +43,7 @@ extern "C" {
 typedef enum {
     simpleTrie   = 0,
     pathCompTrie = 1,           /* trie with path compression */
+    compactTrie  = 2,           /* simple trie with 32-bit table entries */
 } trieType;
 
 typedef struct routeEnt {
@@ -81,14 +82,238 @@ struct pcSubtbls {
     int      idx;
 };
 
+/*
+ * Routing table options (see rtArtInitOpts())
+ */
+enum {
+    artOptConcurrent = 0x0001,  /* lock-free readers and a single writer */
+    artOptSlab       = 0x0002,  /* per-level slab allocator for subtables */
+    artOptHugePages  = 0x0004,  /* slabs on huge pages (implies artOptSlab) */
+    artOptRouteArena = 0x0008,  /* allocate routes from a route arena */
+    artOptExactIndex = 0x0010,  /* hash index for exact matches */
+    artOptNumaLocal  = 0x0020,  /* slabs on NUMA node `numaNode'
+                                   (implies artOptSlab) */
+    artOptCopyRoutes = 0x0040,  /* rtArtReplicasNew(): a copy of each
+                                   route per replica */
+};
+
+/*
+ * Subtable (trie node) allocator.
+ * `alloc()' returns `size' bytes of zero-filled memory for a level
+ * `level' subtable. `size' is always the same for the same level.
+ * `destroy()' frees all the memory at once when the routing table
+ * is destroyed. If it is not NULL, the subtables are not freed
+ * one by one.
+ */
+typedef struct rtArtAllocator rtArtAllocator;
+struct rtArtAllocator {
+    void* (*alloc)(void* ctx, int level, size_t size);
+    void  (*free)(void* ctx, int level, void* p, size_t size);
+    void  (*destroy)(void* ctx);        /* may be NULL */
+    void* ctx;                          /* passed to the functions above */
+};
+
+typedef struct rtArtOpts rtArtOpts;
+struct rtArtOpts {
+    u32 flags;                  /* artOpt* */
+    rtArtAllocator* pAlloc;     /* subtable allocator. NULL: calloc()
+                                   or the slab allocator (artOptSlab) */
+    u32 routeDataSize;          /* bytes of user data after `routeEnt'
+                                   (see rtArtRouteData()) */
+    s32 numaNode;               /* NUMA node (artOptNumaLocal) */
+};
+
+/*
+ * Results of rtArtEvalStrides() and rtArtTuneStrides()
+ */
+typedef struct rtArtStrideStats rtArtStrideStats;
+struct rtArtStrideStats {
+    u64    memory;              /* bytes of the subtables */
+    u64    nSubtables;          /* subtables except the root */
+    int    nLevels;             /* levels with subtables (worst case) */
+    double avgLevels;           /* levels to the node of a route */
+};
+
+/*
+ * Counters of a trie level kept up to date by the updates
+ * (see rtArtGetStats())
+ */
+typedef struct rtArtLevelStats rtArtLevelStats;
+struct rtArtLevelStats {
+    u64 nSubtables;             /* live subtables */
+    u64 bytes;                  /* bytes of the live subtables */
+    u64 nRoutes;                /* routes whose prefix ends at this level */
+    u64 nLookupEnds;            /* sampled lookups that ended at this
+                                   level (ART_LOOKUP_STATS only) */
+};
+
+#define ART_MAX_LEVELS 128      /* 1-bit strides of IPv6 */
+
+/*
+ * Snapshot of the counters returned by rtArtGetStats()
+ */
+typedef struct rtArtStats rtArtStats;
+struct rtArtStats {
+    u64 nRoutes;                /* routes */
+    u64 nSubtables;             /* live subtables of all the levels */
+    u64 bytes;                  /* bytes of the live subtables */
+    u64 nAllots;                /* allotments by inserts and deletes */
+    u64 nAllotVisits;           /* table entries visited by allotments */
+    u64 maxAllotVisits;         /* most entries visited by an allotment */
+    u64 nLookupSamples;         /* sampled lookups. 0 unless compiled
+                                   with ART_LOOKUP_STATS */
+    int nLevels;                /* valid elements of `level[]' */
+    rtArtLevelStats level[ART_MAX_LEVELS];
+};
+
+/*
+ * Batch lookup kernels of IPv4 simple tries (see rtArtSimdSelect())
+ */
+enum {
+    artBatchScalar = 0,         /* rtArtFindMatchBatch() */
+    artBatchAvx2   = 1,         /* 8 addresses at a time with AVX2 */
+    artBatchAvx512 = 2,         /* 32 addresses at a time with AVX-512 */
+};
+
+/*
+ * Batch update operations (see rtArtApplyUpdates())
+ */
+enum {
+    artUpdAdd      = 0,         /* insert route `r' */
+    artUpdWithdraw = 1,         /* delete the route of `pDest'/`plen' */
+    artUpdAnnounce = 2,         /* insert `r' or replace the route of
+                                   the prefix with it */
+};
+
+/*
+ * Results of the batch update operations
+ */
+enum {
+    artUpdDone      = 0,        /* applied */
+    artUpdCancelled = 1,        /* cancelled by a later withdrawal
+                                   (or announcement) */
+    artUpdExists    = 2,        /* add: the prefix has a route */
+    artUpdNotFound  = 3,        /* withdraw: the prefix has no route */
+    artUpdFailed    = 4,        /* add: no memory */
+    artUpdReplaced  = 5,        /* announce: replaced the route */
+};
+
+typedef struct rtArtUpdateOp rtArtUpdateOp;
+struct rtArtUpdateOp {
+    routeEnt* r;                /* artUpdAdd, artUpdAnnounce: route to
+                                   be inserted */
+    u8*  pDest;                 /* artUpdWithdraw: IP address */
+    u8   plen;                  /* artUpdWithdraw: prefix length */
+    u8   op;                    /* artUpdAdd, Withdraw or Announce */
+    u8   rc;                    /* result (artUpd*) */
+};
+
+typedef struct rtArtUpdateStats rtArtUpdateStats;
+struct rtArtUpdateStats {
+    u32    nAdded;              /* routes inserted */
+    u32    nWithdrawn;          /* routes deleted */
+    u32    nReplaced;           /* routes replaced by announcements */
+    u32    nCancelled;          /* cancelled additions and withdrawals */
+    u32    nRejected;           /* artUpdExists, NotFound and Failed */
+    u32    nShards;             /* writer threads (rtArtApplyUpdatesSharded()) */
+    u32    nSerial;             /* operations in the root applied serially */
+    u64    nAllotVisits;        /* entries visited by the allotments */
+    double tCoalesce;           /* seconds to sort and coalesce (simple
+                                   tries coalesce in `tApply') */
+    double tApply;              /* seconds to apply the operations */
+};
+
+/*
+ * Counters of a destination cache (see rtArtCacheGetStats())
+ */
+typedef struct rtArtCacheStats rtArtCacheStats;
+struct rtArtCacheStats {
+    u64 nHits;                  /* lookups answered by the cache */
+    u64 nMisses;                /* lookups that walked the trie */
+    u64 nStale;                 /* misses of the entries invalidated
+                                   by the updates of the table */
+};
+
+/*
+ * Counters of a set of table replicas (see rtArtReplicasGetStats())
+ */
+#define ART_MAX_REPLICAS 16
+
+typedef struct rtArtReplicaStats rtArtReplicaStats;
+struct rtArtReplicaStats {
+    int    nReplicas;           /* valid elements of the arrays below */
+    u64    nUpdates;            /* inserts and deletes applied */
+    double tUpdate;             /* seconds to apply them to all the
+                                   replicas */
+    double maxUpdate;           /* seconds of the slowest update */
+    int    node[ART_MAX_REPLICAS];      /* NUMA node of each replica */
+    u64    bytes[ART_MAX_REPLICAS];     /* bytes of the live subtables */
+    u64    routeBytes[ART_MAX_REPLICAS];/* bytes of the routes owned */
+};
+
+/*
+ * Route feed ingest (see rtArtFeedLoad())
+ */
+enum {
+    artFeedBulk     = 0x0001,   /* bulk load the additions (empty table) */
+    artFeedThreaded = 0x0002,   /* parse on a separate thread */
+};
+
+/*
+ * A prefix decoded from an MRT record by rtArtFeedNext()
+ */
+typedef struct rtArtFeedRec rtArtFeedRec;
+struct rtArtFeedRec {
+    u8        dest[16];         /* address of the prefix (zero-padded) */
+    u8        plen;             /* prefix length */
+    u8        op;               /* artUpdAdd or artUpdWithdraw */
+    u16       peer;             /* TABLE_DUMP_V2 peer index */
+    u32       attrLen;          /* bytes of `pAttr' */
+    const u8* pAttr;            /* artUpdAdd: BGP path attributes in the
+                                   feed (NULL if none) */
+};
+
+typedef struct rtArtFeedStats rtArtFeedStats;
+struct rtArtFeedStats {
+    u64    nRecords;            /* MRT records read */
+    u64    nAdded;              /* routes inserted */
+    u64    nReplaced;           /* announcements of existing prefixes */
+    u64    nWithdrawn;          /* routes deleted */
+    u64    nCancelled;          /* announced and withdrawn (or announced
+                                   again) in a batch */
+    u64    nRejected;           /* withdrawals of missing prefixes,
+                                   duplicates and no memory */
+    u64    nSkipped;            /* prefixes of the other address family,
+                                   other record types and malformed */
+    double tParse;              /* seconds to parse the records */
+    double tApply;              /* seconds to update the table */
+    double tTotal;              /* seconds of rtArtFeedLoad() */
+};
+
+typedef struct rtArtSlab rtArtSlab;
+
+typedef struct rtArtEpoch rtArtEpoch;
+
+typedef struct rtArtCompact rtArtCompact;
+typedef struct rtArtImage rtArtImage;
+typedef struct rtArtFib rtArtFib;
+typedef struct rtArtCow rtArtCow;
+typedef struct rtArtCache rtArtCache;
+typedef struct rtArtIndex rtArtIndex;
+typedef struct rtArtReplicas rtArtReplicas;
+typedef struct rtArtFeed rtArtFeed;
+typedef struct rtArtShard rtArtShard;
+
 typedef struct rtTable rtTable;
+
+typedef void (*rtFunc)(routeEnt*, void*);
+typedef void (*rtArtFeedFunc)(routeEnt*, const rtArtFeedRec*, void*);
+typedef tableEntry (*rtArtFreeSubFunc)(rtTable*, subtable);
+
 struct rtTable {
     tableEntry*  root;    /* pointer to root subtable */
     strideInfo*  psi;     /* array of stride information indexed by level */
-    union {
-        tableEntry** pEnt;/* array of table entry pointers */
-        routeEnt**   pDef;/* array of subtable (trie node) default routes */
-    };
+    tableEntry** pEnt;    /* array of table entry pointers (for deletion) */
     subtable*    pTbl;    /* array of subtable pointers (for deletion) */
     pcSubtbls*   pPcSt;   /* array of pcSubtables pointers (for deleteion) */
     s16          alen;    /* address length in bits for search */
@@ -98,17 +323,75 @@ struct rtTable {
 
     routeEnt* (*insert)(rtTable* p, routeEnt* r);
     bool (*delete)(rtTable* p, u8* pDest, int plen);
+    routeEnt* (*replace)(rtTable* p, routeEnt* r);
     bool (*flush)(rtTable* pt);
     void (*deleteTable)(rtTable** pt);
     routeEnt* (*findMatch)(rtTable *p, u8* pDest);
+    routeEnt* (*findMatch4)(rtTable *p, ipv4a dest);
+    routeEnt* (*findMatch6)(rtTable *p, u64 hi, u64 lo);
     routeEnt* (*findExactMatch)(rtTable *p, u8* pDest, int plen);
+    void (*findMatchBatch)(rtTable *p, u8** pDest, routeEnt** pRes, int n);
+    int  (*bulkLoad)(rtTable *p, routeEnt** pRoutes, int n);
+    bool (*flushRoutes)(rtTable* pt, rtFunc f, void* p2);
 
     int  nRoutes;           /* # of routes */
     int* nHeaps;            /* # of heaps at level `i' */
     int* nTransit;          /* # of transit heaps at level `i'  */
     u32  nSubtablesFreed;   /* # of freed subtables (for debugging) */
+    u32  nSubtablesMoved;   /* # of subtables moved by rtArtRelayout() */
+    u64  gen;               /* generation. Advanced by the updates
+                               (see rtArtBumpGen()) */
+
+    rtArtEpoch* pEpoch;     /* non-NULL if readers are lock-free */
+    rtArtAllocator alloc;   /* subtable allocator */
+    rtArtSlab*  pRouteSlab; /* route arena. NULL: calloc() and free() */
+    u32  routeSize;         /* sizeof(routeEnt) + user data size */
+    rtArtCompact* pCp;      /* compactTrie only (see ipArtCompact.c) */
+    rtArtImage* pImg;       /* non-NULL if loaded by rtArtLoad() */
+    trieType    type;       /* trie type given to rtArtInitOpts() */
+    rtArtCow*   pCow;       /* non-NULL if cloned (see ipArtClone.c) */
+    rtArtIndex* pIdx;       /* artOptExactIndex (see ipArtIndex.c) */
+    rtTable*    pRouteOwner;/* non-NULL: the replica that owns the routes
+                               of this table (see ipArtReplica.c) */
+    rtArtShard* pShard;     /* non-NULL: copy of a table used by a writer
+                               thread of rtArtApplyUpdatesSharded() */
+    u16  relayDepth;        /* rtArtRelayout() resumes at this depth */
+    u8   relayPath[16];     /* and this path (see ipArtRelayout.c) */
+
+    rtArtLevelStats* pLvStats; /* counters of each level */
+    u64  nAllots;           /* # of allotments */
+    u64  nAllotVisits;      /* # of entries visited by the allotments */
+    u64  maxAllotVisits;    /* max # of entries visited by an allotment */
+};
+
+/*
+ * Lock-free reader of a routing table created with artOptConcurrent.
+ * Each reader thread registers its own `rtArtReader' and brackets
+ * the lookups (and the use of the returned routes) with
+ * rtArtReadLock() and rtArtReadUnlock().
+ */
+typedef struct rtArtReader rtArtReader;
+struct rtArtReader {
+    u64          epoch;         /* epoch at rtArtReadLock(). 0: quiescent */
+    u64*         pEpoch;        /* pointer to the epoch of the table */
+    rtArtReader* next;          /* next reader of the same table */
+    u32          inUse;         /* true if registered */
+} __attribute__ ((aligned (64)));
+
+/*
+ * Per-thread handle of a set of table replicas (see
+ * rtArtReplicaAttach()). A reader thread looks up `pt', the replica
+ * on its NUMA node, in the read-side critical sections of `pr'.
+ */
+typedef struct rtArtReplicaHandle rtArtReplicaHandle;
+struct rtArtReplicaHandle {
+    rtTable*     pt;            /* replica of the node of the thread */
+    rtArtReader* pr;            /* lock-free reader of `pt' */
+    int          node;          /* NUMA node of `pt' */
 };
 
+typedef void (*rtArtFreeFunc)(rtTable*, void*);
+
 typedef struct rtArtWalkQnode rtArtWalkQnode;
 struct rtArtWalkQnode
 {
@@ -116,13 +399,67 @@ struct rtArtWalkQnode
     subtable p;
 };
 
-typedef void (*rtFunc)(routeEnt*, void*);
+
+/*
+ * Resumable walk of a routing table in the prefix order (see
+ * rtArtIterInit()). It needs no memory other than itself.
+ */
+typedef struct rtArtIter rtArtIter;
+struct rtArtIter {
+    rtTable* pt;                /* routing table */
+    s32      level;             /* depth of the current subtable. -1: end */
+    u32      index;             /* index in the current subtable */
+    u32      start;             /* the first root fringe index offset */
+    u32      end;               /* root fringe index offset to stop at */
+    bool     down;              /* descend from `index' at the next step */
+    bool     def;               /* the default route is to be returned */
+    subtable pTbl[ART_MAX_LEVELS]; /* subtables from the root */
+    u32      pIdx[ART_MAX_LEVELS]; /* fringe index of pTbl[l+1] in pTbl[l] */
+};
+
+/*
+ * Number of lookups `findMatchBatch()' walks down the trie in lock step.
+ * Trie node accesses of these lookups are prefetched and overlapped.
+ */
+#define ART_BATCH_WIDTH 16
 
 
 #define isSubtable(p) ((p).count&1)
 #define makeSubtable(p) (subtable)((size_t)(p)|1)
 #define subtablePtr(p) ((tableEntry)((p).count&-2))
 
+/*
+ * Table entries visible to lock-free readers are updated by a single
+ * pointer-sized release store and read by a single pointer-sized
+ * acquire load so that a reader never sees a torn or uninitialized
+ * entry. Both are plain loads and stores on x86.
+ */
+#define loadEnt(e) ((tableEntry)__atomic_load_n(&(e).count, __ATOMIC_ACQUIRE))
+#define storeRoute(e, r) __atomic_store_n(&(e).ent, (r), __ATOMIC_RELEASE)
+#define storeDown(e, p) __atomic_store_n(&(e).down, (p), __ATOMIC_RELEASE)
+
+/*
+ * Compiled with -DART_LOOKUP_STATS, one of every ART_LOOKUP_SAMPLE
+ * lookups of `pt->findMatch()' (counted per thread) increments the
+ * `nLookupEnds' counter of the level where it stopped.
+ * The specialized and SIMD lookups are not registered then.
+ */
+#ifdef ART_LOOKUP_STATS
+#ifndef ART_LOOKUP_SAMPLE
+#define ART_LOOKUP_SAMPLE 1024  /* must be a power of 2 */
+#endif
+extern __thread u32 rtArtLookupTick;
+#define rtArtSampleLookup(pt, l)                                        \
+    do {                                                                \
+        if ( (++rtArtLookupTick & (ART_LOOKUP_SAMPLE - 1)) == 0 ) {    \
+            __atomic_fetch_add(&(pt)->pLvStats[(l)].nLookupEnds, 1,    \
+                               __ATOMIC_RELAXED);                       \
+        }                                                               \
+    } while (0)
+#else
+#define rtArtSampleLookup(pt, l)
+#endif
+
 
 /*
  * API functions
@@ -130,19 +467,191 @@ typedef void (*rtFunc)(routeEnt*, void*);
 routeEnt* rtArtNewRoute(rtTable *pt);
 void      rtArtFreeRoute(rtTable *pt, routeEnt *);
 rtTable*  rtArtInit(int nLevels, s8* psl, int alen, trieType type);
+rtTable*  rtArtInitOpts(int nLevels, s8* psl, int alen, trieType type,
+                        rtArtOpts* po);
 rtTable*  rtArtPcInit(rtTable* pt);
+rtTable*  rtArtCpInit(rtTable* pt, rtArtOpts* po);
+bool      rtArtSpecialize(rtTable* pt);
+bool      rtArtSimdInit(rtTable* pt);
+bool      rtArtSimdSelect(rtTable* pt, int kernel);
+u32       rtArtCpNumSubtables(rtTable* pt);
 bool      rtArtFlushRoutes(rtTable* pt);
+int       rtArtBulkLoad(rtTable* pt, routeEnt** pRoutes, int n);
+int       rtArtBulkLoadParallel(rtTable* pt, routeEnt** pRoutes, int n,
+                                int nThreads);
+int       rtArtInsertRoutes(rtTable* pt, routeEnt** pRoutes, int n);
+int       rtArtApplyUpdates(rtTable* pt, rtArtUpdateOp* pOps, int n,
+                            rtArtUpdateStats* ps);
+int       rtArtApplyUpdatesSharded(rtTable* pt, rtArtUpdateOp* pOps, int n,
+                                   int nThreads, rtArtUpdateStats* ps);
+routeEnt* rtArtInsert4(rtTable* pt, routeEnt* r, ipv4a dest, int plen);
+routeEnt* rtArtInsert6(rtTable* pt, routeEnt* r, u64 hi, u64 lo, int plen);
+bool      rtArtDelete4(rtTable* pt, ipv4a dest, int plen);
+bool      rtArtDelete6(rtTable* pt, u64 hi, u64 lo, int plen);
+routeEnt* rtArtFindExactMatch4(rtTable* pt, ipv4a dest, int plen);
+routeEnt* rtArtFindExactMatch6(rtTable* pt, u64 hi, u64 lo, int plen);
+bool      rtArtSave(rtTable* pt, const char* path);
+rtTable*  rtArtLoad(const char* path);
+bool      rtArtThaw(rtTable* pt, rtArtOpts* po);
+rtTable*  rtArtClone(rtTable* pt);
+rtArtFib* rtArtFibCompile(rtTable* pt);
+void      rtArtFibFree(rtArtFib* pf);
+void      rtArtFibPublish(rtTable* pt, rtArtFib** ppFib, rtArtFib* pf);
+u32       rtArtFibFindMatch(rtArtFib* pf, u8* pDest);
+void      rtArtFibFindMatchBatch(rtArtFib* pf, u8** pDest, u32* pRes, int n);
+routeEnt* rtArtFibRoute(rtArtFib* pf, u32 i);
+rtArtCache* rtArtCacheNew(rtTable* pt, int nEntries);
+void      rtArtCacheFree(rtArtCache* pc);
+routeEnt* rtArtCacheFindMatch(rtArtCache* pc, u8* pDest);
+routeEnt* rtArtCacheFindMatch4(rtArtCache* pc, ipv4a dest);
+void      rtArtCacheGetStats(rtArtCache* pc, rtArtCacheStats* ps);
+u64       rtArtFibNumEntries(rtArtFib* pf, u32* pSubtables);
+u32       rtArtFibNumSparse(rtArtFib* pf);
+bool      rtArtEvalStrides(routeEnt** pRoutes, int n, int alen, trieType type,
+                           s8* psl, int nLevels, rtArtStrideStats* pStats);
+int       rtArtTuneStrides(routeEnt** pRoutes, int n, int alen, trieType type,
+                           u64 budget, s8* psl, rtArtStrideStats* pStats);
+int       rtArtTuneStrides6(routeEnt** pRoutes, int n, trieType type,
+                            u64 budget, s8* psl, rtArtStrideStats* pStats);
+int       rtArtTuneTable(rtTable* pt, trieType type, u64 budget, s8* psl,
+                         rtArtStrideStats* pStats);
 void      rtArtWalkTable(rtTable* pt, subtable p, int index,
                          int thresh, rtFunc f, void* p2);
 void      rtArtBFwalk(rtTable* pt, subtable p, rtFunc f, void* p2);
 void      rtArtDFwalk(rtTable* pt, subtable p, rtFunc f, void* p2);
+bool      rtArtIterInit(rtArtIter* pi, rtTable* pt, u32 start, u32 end);
+routeEnt* rtArtIterNext(rtArtIter* pi);
+int       rtArtWalkSubPrefixes(rtTable* pt, u8* pDest, int plen,
+                               rtFunc f, void* p2);
+int       rtArtWalkCovering(rtTable* pt, u8* pDest, rtFunc f, void* p2);
+int       rtArtRelayout(rtTable* pt, long budget);
 void      rtArtCollectStats(rtTable* pt, subtable ps);
+void      rtArtGetStats(rtTable* pt, rtArtStats* ps);
+rtArtReplicas* rtArtReplicasNew(int nLevels, s8* psl, int alen,
+                                trieType type, rtArtOpts* po,
+                                int nReplicas);
+void      rtArtReplicasFree(rtArtReplicas* prs);
+rtTable*  rtArtReplicaTable(rtArtReplicas* prs, int i);
+routeEnt* rtArtReplicasNewRoute(rtArtReplicas* prs);
+void      rtArtReplicasFreeRoute(rtArtReplicas* prs, routeEnt* r);
+routeEnt* rtArtReplicasInsert(rtArtReplicas* prs, routeEnt* r);
+bool      rtArtReplicasDelete(rtArtReplicas* prs, u8* pDest, int plen);
+void      rtArtReplicasSynchronize(rtArtReplicas* prs);
+void      rtArtReplicasGetStats(rtArtReplicas* prs, rtArtReplicaStats* ps);
+rtArtReplicaHandle* rtArtReplicaAttach(rtArtReplicas* prs, int node);
+void      rtArtReplicaDetach(rtArtReplicaHandle* ph);
+rtArtFeed* rtArtFeedOpen(const char* path);
+rtArtFeed* rtArtFeedOpenMem(const u8* p, size_t size);
+void      rtArtFeedClose(rtArtFeed* pf);
+int       rtArtFeedNext(rtArtFeed* pf, int alen, rtArtFeedRec* pRec, int n);
+int       rtArtFeedLoad(rtTable* pt, rtArtFeed* pf, int flags,
+                        rtArtFeedFunc f, void* p2, rtArtFeedStats* ps);
+
+rtArtReader* rtArtRegisterReader(rtTable* pt);
+void      rtArtUnregisterReader(rtArtReader* pr);
+void      rtArtSynchronize(rtTable* pt);
+void      rtArtReclaim(rtTable* pt);
+
+/*
+ * Internal functions shared by the trie implementations
+ */
+void      rtArtFlushTrie(rtTable* pt, rtFunc f, void* p2, rtArtFreeSubFunc fs);
+subtable  rtArtNewSubTable(rtTable* pt, int level, tableEntry base);
+tableEntry rtArtFreeSubtable(rtTable* pt, subtable t);
+void      rtArtFindMatchBatch(rtTable* pt, u8** pDest, routeEnt** pRes, int n);
+bool      rtArtAllocInit(rtTable* pt, rtArtOpts* po);
+void      rtArtAllocDestroy(rtTable* pt);
+bool      rtArtAllocFork(rtTable* pt, rtArtAllocator* pa);
+void      rtArtAllocJoin(rtTable* pt, rtArtAllocator* pa);
+bool      rtArtAllocIsSlab(rtTable* pt);
+size_t    rtArtAllocSlot(rtTable* pt, size_t size);
+void*     rtArtAllocSeq(rtTable* pt, int level, size_t size);
+routeEnt* rtArtRouteAlloc(rtTable* pt);
+void      rtArtRouteFree(rtTable* pt, void* p);
+rtArtEpoch* rtArtEpochNew(void);
+void      rtArtEpochFree(rtTable* pt);
+void      rtArtRetire(rtTable* pt, void* p, rtArtFreeFunc f);
+void      rtArtShardRetire(rtTable* pt, void* p, rtArtFreeFunc f);
+void      rtArtShardBumpGen(rtTable* pt);
+bool      rtArtCowRelease(rtTable* pt, routeEnt* r);
+bool      rtArtIndexInit(rtTable* pt);
 
 
 /*
  * Inline functions
  */
 
+/**
+ * @name  rtArtRouteData
+ *
+ * @brief API function.
+ *        Returns the user data area of a route allocated by
+ *        rtArtNewRoute(). Its size is `routeDataSize' given to
+ *        rtArtInitOpts() and it is zero-filled at allocation.
+ *
+ * @param[in] r Pointer to the route
+ *
+ * @retval void* Pointer to the user data that follows `*r'
+ */
+static inline void*
+rtArtRouteData (routeEnt* r)
+{
+    return r + 1;
+}
+
+
+/**
+ * @name  rtArtReadLock
+ *
+ * @brief API function.
+ *        Starts a read-side critical section of a lock-free reader.
+ *        Routes and subtables unlinked by the writer are not freed
+ *        until all the readers that may see them call
+ *        rtArtReadUnlock(). Never blocks. Must not be nested.
+ *
+ * @param[in] pr Pointer to the reader returned by rtArtRegisterReader()
+ */
+static inline void
+rtArtReadLock (rtArtReader* pr)
+{
+    __atomic_store_n(&pr->epoch, __atomic_load_n(pr->pEpoch, __ATOMIC_ACQUIRE),
+                     __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @name  rtArtReadUnlock
+ *
+ * @brief API function.
+ *        Ends a read-side critical section of a lock-free reader.
+ *        Routes returned in the critical section must not be used
+ *        after this call.
+ *
+ * @param[in] pr Pointer to the reader returned by rtArtRegisterReader()
+ */
+static inline void
+rtArtReadUnlock (rtArtReader* pr)
+{
+    __atomic_store_n(&pr->epoch, 0, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @name  rtArtFibGet
+ *
+ * @brief API function.
+ *        Returns the FIB published by rtArtFibPublish(). A lock-free
+ *        reader must call it between rtArtReadLock() and
+ *        rtArtReadUnlock() and must not use the FIB after that.
+ *
+ * @param[in] ppFib Pointer to the published FIB
+ */
+static inline rtArtFib*
+rtArtFibGet (rtArtFib** ppFib)
+{
+    return __atomic_load_n(ppFib, __ATOMIC_ACQUIRE);
+}
+
+
 /**
  * @name  bitCmp8
  *
@@ -298,8 +807,8 @@ cmpAddr (u8* p1, u8* p2, int plen)
             return false;
         }
     }
-    if ( len == plen ) {
-        return true;
+    if ( len - 8 == plen ) {
+        return true;             /* no remaining bits */
     }
 
     /*
@@ -338,6 +847,85 @@ plen2level (rtTable* pt, int plen)
 }
 
 
+/**
+ * @name  rtArtBumpGen
+ *
+ * @brief Advances the generation of `pt' so that the entries of the
+ *        destination caches (see ipArtCache.c) filled before it are
+ *        not used any more. Called by rtArtCountRoute() for each
+ *        insert and delete, by rtArtRetire() after a deleted route or
+ *        subtable is unlinked from a table of lock-free readers, and
+ *        by the replace functions. The writer threads of
+ *        rtArtApplyUpdatesSharded() advance the generation of the
+ *        table they share (see rtArtShardBumpGen()).
+ *
+ * @param[in] pt Pointer to the routing table
+ */
+static inline void
+rtArtBumpGen (rtTable* pt)
+{
+    if ( pt->pShard ) {
+        rtArtShardBumpGen(pt);
+        return;
+    }
+    __atomic_store_n(&pt->gen, pt->gen + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @name  rtArtCountRoute
+ *
+ * @brief Adds `n' (1 or -1) to the number of routes and to the number
+ *        of routes of the level where the prefix of `r' ends.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] r  Pointer to the inserted or deleted route
+ * @param[in] n  1: inserted, -1: deleted
+ */
+static inline void
+rtArtCountRoute (rtTable* pt, routeEnt* r, int n)
+{
+    rtArtBumpGen(pt);
+    pt->nRoutes += n;
+    pt->pLvStats[plen2level(pt, r->plen)].nRoutes += n;
+}
+
+
+/**
+ * @name  rtArtCountSubtable
+ *
+ * @brief Adds `n' (1 or -1) to the number of subtables of level `l'
+ *        and `n' * `size' to their bytes.
+ *
+ * @param[in] pt   Pointer to the routing table
+ * @param[in] l    Level of the allocated or freed subtable
+ * @param[in] size Size of the subtable memory in bytes
+ * @param[in] n    1: allocated, -1: freed
+ */
+static inline void
+rtArtCountSubtable (rtTable* pt, int l, size_t size, int n)
+{
+    pt->pLvStats[l].nSubtables += n;
+    pt->pLvStats[l].bytes += (u64)n * size;
+}
+
+
+/**
+ * @name  rtArtCountAllot
+ *
+ * @brief Records an allotment that visited `n' table entries.
+ */
+static inline void
+rtArtCountAllot (rtTable* pt, u32 n)
+{
+    ++pt->nAllots;
+    pt->nAllotVisits += n;
+    if ( n > pt->maxAllotVisits ) {
+        pt->maxAllotVisits = n;
+    }
+}
+
+
 /**
  * @name  fringeIndex
  *
@@ -391,6 +979,119 @@ fringeIndex (u8** p, u32* offset, int nBits)
 }
 
 
+/**
+ * @name  fringeIndex4
+ *
+ * @brief Returns the fringe index of an IPv4 address in the host
+ *        byte order at the level described by `psi'.
+ *        The stride is taken with one shift and one mask.
+ *
+ * @param[in] psi Pointer to the stride information of the level
+ * @param[in] a   IPv4 address in the host byte order
+ *
+ * @retval u32 The fringe index
+ */
+static inline u32
+fringeIndex4 (strideInfo* psi, ipv4a a)
+{
+    return ((a >> (32 - psi->tl)) & ((1 << psi->sl) - 1)) + (1 << psi->sl);
+}
+
+
+/**
+ * @name  fringeIndex6
+ *
+ * @brief Returns the fringe index of an IPv6 address held in a u128
+ *        (bit 127 is the first bit of the address) at the level
+ *        described by `psi'.
+ *
+ * @param[in] psi Pointer to the stride information of the level
+ * @param[in] a   IPv6 address
+ *
+ * @retval u32 The fringe index
+ */
+static inline u32
+fringeIndex6 (strideInfo* psi, u128 a)
+{
+    return ((u32)(a >> (128 - psi->tl)) & ((1 << psi->sl) - 1)) +
+        (1 << psi->sl);
+}
+
+
+/**
+ * @name  addr2ipv4a
+ *
+ * @brief Returns the first 32 bits of an address in the network byte
+ *        order as an IPv4 address in the host byte order.
+ */
+static inline ipv4a
+addr2ipv4a (u8* p)
+{
+    ipv4na a;
+
+    memcpy(&a, p, sizeof(a));
+    return __builtin_bswap32(a);
+}
+
+
+/**
+ * @name  addr2u128
+ *
+ * @brief Returns a 128-bit address in the network byte order as a u128.
+ */
+static inline u128
+addr2u128 (u8* p)
+{
+    u64 x[2];
+
+    memcpy(x, p, sizeof(x));
+    return ((u128)__builtin_bswap64(x[0]) << 64) | __builtin_bswap64(x[1]);
+}
+
+
+/**
+ * @name  cmpAddr4
+ *
+ * @brief Compares the first `plen' bits of an IPv4 address in the host
+ *        byte order with an address in the network byte order.
+ *
+ * @param[in] a    IPv4 address in the host byte order
+ * @param[in] p    Pointer to the address in the network byte order
+ * @param[in] plen Number of bits to be compared (0 to 32)
+ *
+ * @retval true  The first `plen' bits are identical
+ * @retval false The first `plen' bits are different
+ */
+static inline bool
+cmpAddr4 (ipv4a a, u8* p, int plen)
+{
+    return ((a ^ addr2ipv4a(p)) & (u32)(~(u64)0 << (32 - plen))) == 0;
+}
+
+
+/**
+ * @name  cmpAddr6
+ *
+ * @brief Compares the first `plen' bits of an IPv6 address held in
+ *        a u128 with an address in the network byte order.
+ *
+ * @param[in] a    IPv6 address
+ * @param[in] p    Pointer to the address in the network byte order
+ * @param[in] plen Number of bits to be compared (0 to 128)
+ *
+ * @retval true  The first `plen' bits are identical
+ * @retval false The first `plen' bits are different
+ */
+static inline bool
+cmpAddr6 (u128 a, u8* p, int plen)
+{
+    if ( plen == 0 ) {
+        return true;
+    }
+    return ((a ^ addr2u128(p)) >> (128 - plen)) == 0;
+}
+
+
 /**
  * @name   baseIndex
  *
@@ -465,13 +1166,14 @@ baseIndex (rtTable* pTbl, u8* p, int plen)
  * @param[in] threshold   The first fringe index of 't'
  * @param[in] fringeCheck False if `t' is the deepest level. Otherwise true.
  *
- * @retval int The base index
+ * @retval u32 The number of visited entries
  */
-static inline void
+static inline u32
 rtArtAllot (subtable t, int k, routeEnt *r,
             routeEnt *s, int threshold, bool fringeCheck)
 {
     register int j = k;
+    register u32 n = 0;         /* visited entries */
 
     assert( k < threshold );
 
@@ -483,18 +1185,20 @@ startChange:
     /*  change fringe nodes
      */
     while (1) {
+        ++n;
         if ( fringeCheck && isSubtable(t[j]) ) {
             if ( subtablePtr(t[j]).down[1].ent == r ) {
-                subtablePtr(t[j]).down[1].ent = s;
+                storeRoute(subtablePtr(t[j]).down[1], s);
             }
         } else if ( t[j].ent == r ) {
-            t[j].ent = s;
+            storeRoute(t[j], s);
         }
         if ( j & 1 ) goto moveUp;
         j++;
     }
 
 nonFringe:
+    ++n;
     if (t[j].ent == r) goto startChange;
 moveOn:
     if (j & 1) goto moveUp;
@@ -502,8 +1206,43 @@ moveOn:
     goto nonFringe;
 moveUp:
     j >>= 1;
-    t[j].ent = s;               /* change non-fringe node */
+    storeRoute(t[j], s);        /* change non-fringe node */
     if (j != k) goto moveOn;
+    return n;
+}
+
+
+/**
+ * @name   rtArtSwapRoute
+ *
+ * @brief  Replaces route `r' at base index `k' of subtable (trie
+ *         node) `t' with route `s' of the same IP prefix. Every
+ *         entry `r' was allotted to is switched to `s' by a single
+ *         store, so a lock-free reader sees either `r' or `s'.
+ *
+ * @param[in] pt          Pointer to the routing table
+ * @param[in] t           Pointer to a subtable (trie node)
+ * @param[in] k           Base index of `r'
+ * @param[in] threshold   The first fringe index of 't'
+ * @param[in] fringeCheck False if `t' is the deepest level. Otherwise true.
+ * @param[in] r           Route pointer to be replaced with 's'
+ * @param[in] s           Route pointer to replace 'r'
+ */
+static inline void
+rtArtSwapRoute (rtTable* pt, subtable t, int k, int threshold,
+                bool fringeCheck, routeEnt* r, routeEnt* s)
+{
+    tableEntry z = t[k];
+
+    s->level = r->level;
+    if ( k < threshold ) {
+        rtArtCountAllot(pt, rtArtAllot(t, k, r, s, threshold, fringeCheck));
+    } else if ( fringeCheck && isSubtable(z) ) {
+        storeRoute(subtablePtr(z).down[1], s);
+    } else {
+        storeRoute(t[k], s);
+    }
+    rtArtBumpGen(pt);
 }
 
 
@@ -0,0 +1,707 @@
+/** @file ipArtAlloc.c
+    @brif Subtable (trie node) and route allocators
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   The size of a subtable depends only on its level (stride length),
+   so the slab allocator has one size class per level. Each class
+   carves its subtables out of its own arenas (SLAB_ARENA_SIZE bytes
+   of mmap()ed memory) so that the subtables of the same level are
+   close to each other, and keeps the freed subtables in a free list.
+   Subtables larger than SLAB_LARGE bytes (e.g., a 16-bit root
+   stride) get their own arena.
+
+   With artOptHugePages the arenas are 2MB huge pages (MAP_HUGETLB).
+   If no huge page is available, normal pages are used with
+   madvise(MADV_HUGEPAGE) instead.
+
+   With artOptNumaLocal the arenas are bound to NUMA node
+   `po->numaNode' by mbind(MPOL_PREFERRED) before the first touch,
+   so the subtables (and the routes in the route arena) are
+   allocated on the node even if the writer runs on another one.
+   The kernel falls back to the other nodes when the node runs out
+   of memory. mbind() is called by syscall() so that the library
+   does not need libnuma.
+
+   The route arena (artOptRouteArena) is a slab allocator with one
+   size class for the routes of the table. The slot size is
+   sizeof(routeEnt) plus the user data size rounded up so that a
+   route up to a cache line never straddles two.
+
+   rtArtAllocSeq() always carves a subtable out of the current arena
+   and skips the free list, so the subtables moved by rtArtRelayout()
+   one after another are contiguous.
+
+   All the arenas are unmapped at once when the table is destroyed.
+*/
+
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "ipArt.h"
+
+
+enum {
+    SLAB_ARENA_SIZE = 2 * 1024 * 1024,  /* one huge page */
+    SLAB_LARGE      = SLAB_ARENA_SIZE / 8,
+    SLAB_ALIGN      = 64,               /* cache line size */
+    SLAB_MAX_NODES  = 64,               /* NUMA nodes of mbind() */
+};
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+typedef struct slabArena slabArena;
+struct slabArena {
+    slabArena* next;
+    slabArena* prev;
+    size_t     size;            /* bytes mapped including this header */
+};
+
+typedef struct slabClass slabClass;
+struct slabClass {
+    void*  pFree;               /* free list linked by the first word */
+    u8*    pCur;                /* unused memory in the current arena */
+    u8*    pEnd;                /* end of the current arena */
+    size_t size;                /* object size (multiple of SLAB_ALIGN) */
+};
+
+typedef struct rtArtSlab rtArtSlab;
+struct rtArtSlab {
+    slabArena* arenas;          /* all the arenas */
+    bool       hugePages;       /* try MAP_HUGETLB */
+    int        node;            /* NUMA node of the arenas. -1: any */
+    slabClass  cls[];           /* size classes indexed by level */
+};
+
+
+#define roundUp(x, a) (((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+
+/**
+ * @name  mallocAlloc
+ *
+ * @brief The default subtable allocator (calloc())
+ */
+static void*
+mallocAlloc (void* ctx, int level, size_t size)
+{
+    return calloc(1, size);
+}
+
+
+/**
+ * @name  mallocFree
+ *
+ * @brief The default subtable allocator (free())
+ */
+static void
+mallocFree (void* ctx, int level, void* p, size_t size)
+{
+    free(p);
+}
+
+
+/**
+ * @name  slabBindArena
+ *
+ * @brief Binds arena memory to the NUMA node of the slab allocator.
+ *        It is a hint: an error (e.g., no such node) is ignored.
+ *
+ * @param[in] ps   Pointer to the slab allocator
+ * @param[in] p    Pointer to the memory (not touched yet)
+ * @param[in] size Size of the memory
+ */
+static void
+slabBindArena (rtArtSlab* ps, void* p, size_t size)
+{
+#ifdef SYS_mbind
+    unsigned long mask;
+
+    if ( (ps->node < 0) || (ps->node >= SLAB_MAX_NODES) ) {
+        return;
+    }
+    mask = 1UL << ps->node;
+    syscall(SYS_mbind, p, size, MPOL_PREFERRED, &mask,
+            (unsigned long)SLAB_MAX_NODES + 1, 0);
+#endif /* SYS_mbind */
+}
+
+
+/**
+ * @name  slabMapArena
+ *
+ * @brief Maps a new arena and links it to the arena list
+ *
+ * @param[in] ps   Pointer to the slab allocator
+ * @param[in] size Minimum size of the arena including the header
+ *
+ * @retval slabArena* Pointer to the new arena
+ * @retval NULL       No memory
+ */
+static slabArena*
+slabMapArena (rtArtSlab* ps, size_t size)
+{
+    slabArena* pa;
+    void* p = MAP_FAILED;
+
+
+    if ( ps->hugePages ) {
+        size = roundUp(size, SLAB_ARENA_SIZE);
+#ifdef MAP_HUGETLB
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif /* MAP_HUGETLB */
+    } else {
+        size = roundUp(size, sysconf(_SC_PAGESIZE));
+    }
+    if ( p == MAP_FAILED ) {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if ( p == MAP_FAILED ) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if ( ps->hugePages ) {
+            madvise(p, size, MADV_HUGEPAGE);
+        }
+#endif /* MADV_HUGEPAGE */
+    }
+    slabBindArena(ps, p, size);
+
+    pa = p;
+    pa->size = size;
+    pa->prev = NULL;
+    pa->next = ps->arenas;
+    if ( pa->next ) {
+        pa->next->prev = pa;
+    }
+    ps->arenas = pa;
+
+    return pa;
+}
+
+
+/**
+ * @name  slabUnmapArena
+ *
+ * @brief Unlinks an arena from the arena list and unmaps it
+ *
+ * @param[in] ps Pointer to the slab allocator
+ * @param[in] pa Pointer to the arena
+ */
+static void
+slabUnmapArena (rtArtSlab* ps, slabArena* pa)
+{
+    if ( pa->prev ) {
+        pa->prev->next = pa->next;
+    } else {
+        ps->arenas = pa->next;
+    }
+    if ( pa->next ) {
+        pa->next->prev = pa->prev;
+    }
+    munmap(pa, pa->size);
+}
+
+
+/**
+ * @name  slabCarve
+ *
+ * @brief Carves an object out of the unused memory of the current
+ *        arena of size class `pc'. A new arena is mapped if the
+ *        current one is full.
+ *
+ * @param[in] ps Pointer to the slab allocator
+ * @param[in] pc Pointer to the size class
+ *
+ * @retval void* Pointer to the zero-filled object
+ * @retval NULL  No memory
+ */
+static void*
+slabCarve (rtArtSlab* ps, slabClass* pc)
+{
+    slabArena* pa;
+    void* p;
+
+
+    if ( pc->pCur + pc->size > pc->pEnd ) {
+        pa = slabMapArena(ps, SLAB_ARENA_SIZE);
+        if ( pa == NULL ) {
+            return NULL;
+        }
+        pc->pCur = (u8*)pa + SLAB_ALIGN;
+        pc->pEnd = (u8*)pa + pa->size;
+    }
+    p = pc->pCur;               /* mmap()ed memory is zero-filled */
+    pc->pCur += pc->size;
+
+    return p;
+}
+
+
+/**
+ * @name  slabAlloc
+ *
+ * @brief Allocates a subtable from the size class of `level'
+ *
+ * @param[in] ctx   Pointer to the slab allocator
+ * @param[in] level Level of the subtable
+ * @param[in] size  Size of the subtable
+ *
+ * @retval void* Pointer to the zero-filled subtable
+ * @retval NULL  No memory
+ */
+static void*
+slabAlloc (void* ctx, int level, size_t size)
+{
+    rtArtSlab* ps = ctx;
+    slabClass* pc = &ps->cls[level];
+    slabArena* pa;
+    void* p;
+
+
+    if ( pc->size == 0 ) {
+        pc->size = roundUp(size, SLAB_ALIGN);
+    }
+    assert(size <= pc->size);
+
+    if ( pc->size > SLAB_LARGE ) {
+        pa = slabMapArena(ps, SLAB_ALIGN + pc->size);
+        return (pa) ? (u8*)pa + SLAB_ALIGN : NULL;
+    }
+
+    if ( pc->pFree ) {
+        p = pc->pFree;
+        pc->pFree = *(void**)p;
+        memset(p, 0, pc->size);
+        return p;
+    }
+    return slabCarve(ps, pc);
+}
+
+
+/**
+ * @name  slabFree
+ *
+ * @brief Returns a subtable to the size class of `level'
+ *
+ * @param[in] ctx   Pointer to the slab allocator
+ * @param[in] level Level of the subtable
+ * @param[in] p     Pointer to the subtable
+ * @param[in] size  Size of the subtable
+ */
+static void
+slabFree (void* ctx, int level, void* p, size_t size)
+{
+    rtArtSlab* ps = ctx;
+    slabClass* pc = &ps->cls[level];
+
+
+    if ( pc->size > SLAB_LARGE ) {
+        slabUnmapArena(ps, (slabArena*)((u8*)p - SLAB_ALIGN));
+        return;
+    }
+    *(void**)p = pc->pFree;
+    pc->pFree  = p;
+}
+
+
+/**
+ * @name  slabDestroy
+ *
+ * @brief Unmaps all the arenas and frees the slab allocator
+ *
+ * @param[in] ctx Pointer to the slab allocator
+ */
+static void
+slabDestroy (void* ctx)
+{
+    rtArtSlab* ps = ctx;
+
+    while ( ps->arenas ) {
+        slabUnmapArena(ps, ps->arenas);
+    }
+    free(ps);
+}
+
+
+/**
+ * @name  slabNew
+ *
+ * @brief Allocates a slab allocator
+ *
+ * @param[in] nClasses  The number of size classes
+ * @param[in] hugePages true: use huge pages for the arenas
+ * @param[in] node      NUMA node of the arenas (-1: any)
+ *
+ * @retval rtArtSlab* Pointer to the slab allocator
+ * @retval NULL       No memory
+ */
+static rtArtSlab*
+slabNew (int nClasses, bool hugePages, int node)
+{
+    rtArtSlab* ps;
+
+    ps = calloc(1, sizeof(rtArtSlab) + nClasses * sizeof(slabClass));
+    if ( ps == NULL ) {
+        return NULL;
+    }
+    ps->hugePages = hugePages;
+    ps->node      = node;
+    return ps;
+}
+
+
+/**
+ * @name  routeSlotSize
+ *
+ * @brief Returns the size of a route in the route arena.
+ *        A route up to a cache line does not straddle cache lines:
+ *        the size is a power of 2 up to SLAB_ALIGN, and a multiple
+ *        of SLAB_ALIGN otherwise.
+ *
+ * @param[in] size sizeof(routeEnt) + user data size
+ *
+ * @retval size_t Slot size in bytes
+ */
+static size_t
+routeSlotSize (size_t size)
+{
+    size_t n;
+
+    if ( size > SLAB_ALIGN ) {
+        return roundUp(size, SLAB_ALIGN);
+    }
+    for ( n = sizeof(void*); n < size; n <<= 1 ) ;
+    return n;
+}
+
+
+/**
+ * @name  subtableAllocInit
+ *
+ * @brief Sets up the subtable allocator of a routing table
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] po Pointer to the options (may be NULL)
+ *
+ * @retval true  Success
+ * @retval false No memory
+ */
+static bool
+subtableAllocInit (rtTable* pt, rtArtOpts* po)
+{
+    rtArtSlab* ps;
+
+
+    if ( po && po->pAlloc ) {
+        pt->alloc = *po->pAlloc;
+        return true;
+    }
+    if ( !po ||
+         !(po->flags & (artOptSlab | artOptHugePages | artOptNumaLocal)) ) {
+        pt->alloc.alloc   = mallocAlloc;
+        pt->alloc.free    = mallocFree;
+        pt->alloc.destroy = NULL;
+        pt->alloc.ctx     = NULL;
+        return true;
+    }
+
+    ps = slabNew(pt->nLevels, (po->flags & artOptHugePages) ? true : false,
+                 (po->flags & artOptNumaLocal) ? po->numaNode : -1);
+    if ( ps == NULL ) {
+        return false;
+    }
+
+    pt->alloc.alloc   = slabAlloc;
+    pt->alloc.free    = slabFree;
+    pt->alloc.destroy = slabDestroy;
+    pt->alloc.ctx     = ps;
+    return true;
+}
+
+
+/**
+ * @name  rtArtAllocInit
+ *
+ * @brief Sets up the subtable and route allocators of a routing
+ *        table. Must be called before the first subtable is
+ *        allocated.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] po Pointer to the options (may be NULL)
+ *
+ * @retval true  Success
+ * @retval false No memory
+ */
+bool
+rtArtAllocInit (rtTable* pt, rtArtOpts* po)
+{
+    rtArtSlab* ps;
+
+
+    if ( subtableAllocInit(pt, po) == false ) {
+        return false;
+    }
+
+    pt->routeSize = sizeof(routeEnt) + ((po) ? po->routeDataSize : 0);
+    if ( po && (po->flags & artOptRouteArena) ) {
+        ps = slabNew(1, (po->flags & artOptHugePages) ? true : false,
+                     (po->flags & artOptNumaLocal) ? po->numaNode : -1);
+        if ( ps == NULL ) {
+            rtArtAllocDestroy(pt);
+            return false;
+        }
+        ps->cls[0].size = routeSlotSize(pt->routeSize);
+        pt->pRouteSlab  = ps;
+    }
+    return true;
+}
+
+
+/**
+ * @name  rtArtAllocDestroy
+ *
+ * @brief Frees all the memory of the subtable allocator if it can
+ *        and all the routes in the route arena
+ *
+ * @param[in] pt Pointer to the routing table
+ */
+void
+rtArtAllocDestroy (rtTable* pt)
+{
+    if ( pt->alloc.destroy ) {
+        pt->alloc.destroy(pt->alloc.ctx);
+        pt->alloc.destroy = NULL;
+    }
+    if ( pt->pRouteSlab ) {
+        slabDestroy(pt->pRouteSlab);
+        pt->pRouteSlab = NULL;
+    }
+}
+
+
+/**
+ * @name  rtArtAllocFork
+ *
+ * @brief Sets up subtable allocator `pa' for a thread that builds
+ *        subtables of `pt' in parallel with the other threads
+ *        (see rtArtBulkLoadParallel()). With the slab allocator,
+ *        each thread carves its subtables out of its own arenas.
+ *        The memory is handed over to `pt' by rtArtAllocJoin().
+ *
+ * @param[in]  pt Pointer to the routing table
+ * @param[out] pa Pointer to the allocator of the thread
+ *
+ * @retval true  Success
+ * @retval false The allocator of `pt' is neither calloc() nor the
+ *               slab allocator, or there was no memory.
+ */
+bool
+rtArtAllocFork (rtTable* pt, rtArtAllocator* pa)
+{
+    rtArtSlab* ps;
+
+
+    if ( pt->alloc.alloc == mallocAlloc ) {
+        *pa = pt->alloc;        /* calloc() is thread-safe */
+        return true;
+    }
+    if ( pt->alloc.alloc != slabAlloc ) {
+        return false;
+    }
+
+    ps = slabNew(pt->nLevels, ((rtArtSlab*)pt->alloc.ctx)->hugePages,
+                 ((rtArtSlab*)pt->alloc.ctx)->node);
+    if ( ps == NULL ) {
+        return false;
+    }
+    pa->alloc   = slabAlloc;
+    pa->free    = slabFree;
+    pa->destroy = slabDestroy;
+    pa->ctx     = ps;
+    return true;
+}
+
+
+/**
+ * @name  rtArtAllocJoin
+ *
+ * @brief Hands the arenas of allocator `pa' set up by rtArtAllocFork()
+ *        over to the slab allocator of `pt' and frees `pa'. The rest
+ *        of the current arena of each size class is kept by the one
+ *        that has more room.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] pa Pointer to the allocator of the thread
+ */
+void
+rtArtAllocJoin (rtTable* pt, rtArtAllocator* pa)
+{
+    rtArtSlab* ps = pt->alloc.ctx;
+    rtArtSlab* pw = pa->ctx;
+    slabArena* pl;
+    slabClass* pc;
+    slabClass* pcw;
+    void** pp;
+    int l;
+
+
+    if ( pa->alloc != slabAlloc ) return;
+
+    while ( (pl = pw->arenas) ) {
+        pw->arenas = pl->next;
+        pl->prev   = NULL;
+        pl->next   = ps->arenas;
+        if ( pl->next ) {
+            pl->next->prev = pl;
+        }
+        ps->arenas = pl;
+    }
+    for ( l = 0; l < pt->nLevels; ++l ) {
+        pc  = &ps->cls[l];
+        pcw = &pw->cls[l];
+        if ( pcw->size == 0 ) continue;
+        if ( pc->size == 0 ) {
+            pc->size = pcw->size;
+        }
+        if ( (pcw->pEnd - pcw->pCur) > (pc->pEnd - pc->pCur) ) {
+            pc->pCur = pcw->pCur;
+            pc->pEnd = pcw->pEnd;
+        }
+        if ( pcw->pFree ) {
+            for ( pp = pcw->pFree; *pp; pp = *pp ) ;
+            *pp = pc->pFree;
+            pc->pFree = pcw->pFree;
+        }
+    }
+    free(pw);
+}
+
+
+/**
+ * @name  rtArtAllocIsSlab
+ *
+ * @brief Returns true if the subtables of `pt' are allocated by the
+ *        slab allocator (artOptSlab or artOptHugePages).
+ */
+bool
+rtArtAllocIsSlab (rtTable* pt)
+{
+    return (pt->alloc.alloc == slabAlloc) ? true : false;
+}
+
+
+/**
+ * @name  rtArtAllocSlot
+ *
+ * @brief Returns the bytes between two subtables of `size' bytes
+ *        allocated one after another by rtArtAllocSeq().
+ */
+size_t
+rtArtAllocSlot (rtTable* pt, size_t size)
+{
+    return roundUp(size, SLAB_ALIGN);
+}
+
+
+/**
+ * @name  rtArtAllocSeq
+ *
+ * @brief Allocates a subtable of `level' from the unused memory of
+ *        the current arena of its size class, not from the free
+ *        list, so that the subtables allocated one after another are
+ *        contiguous (see rtArtRelayout()). It is freed by
+ *        `pt->alloc.free()'.
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] level Level of the subtable
+ * @param[in] size  Size of the subtable
+ *
+ * @retval void* Pointer to the zero-filled subtable
+ * @retval NULL  Not the slab allocator, a subtable larger than
+ *               SLAB_LARGE (it has its own arena), or no memory
+ */
+void*
+rtArtAllocSeq (rtTable* pt, int level, size_t size)
+{
+    rtArtSlab* ps;
+    slabClass* pc;
+
+
+    if ( !rtArtAllocIsSlab(pt) ) {
+        return NULL;
+    }
+    ps = pt->alloc.ctx;
+    pc = &ps->cls[level];
+    if ( pc->size == 0 ) {
+        pc->size = roundUp(size, SLAB_ALIGN);
+    }
+    assert(size <= pc->size);
+    if ( pc->size > SLAB_LARGE ) {
+        return NULL;
+    }
+    return slabCarve(ps, pc);
+}
+
+
+/**
+ * @name  rtArtRouteAlloc
+ *
+ * @brief Allocates a zero-filled route of `pt->routeSize' bytes
+ *        from the route arena or by calloc()
+ *
+ * @param[in] pt Pointer to the routing table
+ *
+ * @retval routeEnt* Pointer to the route
+ * @retval NULL      No memory
+ */
+routeEnt*
+rtArtRouteAlloc (rtTable* pt)
+{
+    if ( pt->pRouteSlab ) {
+        return slabAlloc(pt->pRouteSlab, 0, pt->routeSize);
+    }
+    return calloc(1, pt->routeSize);
+}
+
+
+/**
+ * @name  rtArtRouteFree
+ *
+ * @brief Returns a route to the route arena or free()s it.
+ *        O(1) in either case.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] p  Pointer to the route
+ */
+void
+rtArtRouteFree (rtTable* pt, void* p)
+{
+    if ( pt->pRouteSlab ) {
+        slabFree(pt->pRouteSlab, 0, p, pt->routeSize);
+        return;
+    }
+    free(p);
+}
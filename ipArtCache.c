@@ -0,0 +1,274 @@
+/** @file ipArtCache.c
+    @brif Generation-validated destination cache
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   A destination cache remembers the results of `pt->findMatch()'
+   (or `pt->findMatch4()') of the recently looked up addresses in
+   front of the trie. It is a set associative cache of
+   CACHE_WAYS ways. A set is one cache line, and a hit moves the
+   entry to way 0 (the most recently used).
+
+   Each entry is tagged with the generation of the table
+   (`pt->gen') when it was filled. Every update of the table
+   advances the generation (rtArtBumpGen()), so all the entries
+   filled before the update miss at once without touching the
+   caches. A cache belongs to one reader thread and needs no lock.
+   With lock-free readers (artOptConcurrent), a result is cached
+   only if the generation did not change during the walk, and the
+   generation is advanced again when a deleted route or subtable
+   is retired, so the cache never returns a route that the trie
+   does not return.
+*/
+
+
+#include "ipArt.h"
+
+
+#define CACHE_WAYS 2            /* entries of a set */
+#define CACHE_LINE 64           /* bytes of a set */
+
+typedef struct {
+    u64       tag;              /* `pt->gen' + 1 when filled. 0: empty */
+    u64       k0;               /* address bits 0-63 */
+    u64       k1;               /* address bits 64-127 */
+    routeEnt* r;                /* result of the lookup (may be NULL) */
+} cacheEnt;
+
+struct rtArtCache {
+    rtTable*  pt;               /* routing table */
+    cacheEnt* pEnt;             /* `nSets' * CACHE_WAYS entries */
+    u32       nSets;            /* number of sets (power of 2) */
+    u32       shift;            /* 64 - log2(nSets) */
+    rtArtCacheStats stats;      /* counters */
+};
+
+
+/**
+ * @name   cacheKey
+ *
+ * @brief  Makes the key (the address as two 64-bit words in the host
+ *         byte order) of `pDest'.
+ */
+static inline void
+cacheKey (const u8* pDest, int len, u64* pk0, u64* pk1)
+{
+    register u64 k0, k1;
+    register int i;
+
+
+    k0 = k1 = 0;
+    for ( i = 0; (i < len) && (i < 8); ++i ) {
+        k0 |= (u64)pDest[i] << (56 - (i << 3));
+    }
+    for ( ; i < len; ++i ) {
+        k1 |= (u64)pDest[i] << (56 - ((i - 8) << 3));
+    }
+    *pk0 = k0;
+    *pk1 = k1;
+}
+
+
+/**
+ * @name   cacheSet
+ *
+ * @brief  Returns the first entry of the set of key `k0' and `k1'.
+ */
+static inline cacheEnt*
+cacheSet (rtArtCache* pc, u64 k0, u64 k1)
+{
+    register u64 h;
+
+    h = (k0 ^ (k1 * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+    return &pc->pEnt[(h >> pc->shift) * CACHE_WAYS];
+}
+
+
+/**
+ * @name   cacheFind
+ *
+ * @brief  Looks up the cache. The trie is looked up with `pDest' if
+ *         `pDest' is not NULL, or `dest' otherwise.
+ */
+static inline routeEnt*
+cacheFind (rtArtCache* pc, u64 k0, u64 k1, u8* pDest, ipv4a dest)
+{
+    register rtTable*  pt = pc->pt;
+    register cacheEnt* pe;
+    register routeEnt* r;
+    cacheEnt e;
+    u64      tag;
+    int      w;
+
+
+    tag = __atomic_load_n(&pt->gen, __ATOMIC_ACQUIRE) + 1;
+    pe  = cacheSet(pc, k0, k1);
+    for ( w = 0; w < CACHE_WAYS; ++w ) {
+        if ( (pe[w].k0 == k0) && (pe[w].k1 == k1) && pe[w].tag ) {
+            if ( pe[w].tag == tag ) {
+                r = pe[w].r;
+                if ( w > 0 ) {
+                    e = pe[w];  /* move to way 0 */
+                    memmove(&pe[1], &pe[0], w * sizeof(cacheEnt));
+                    pe[0] = e;
+                }
+                pc->stats.nHits++;
+                return r;
+            }
+            pc->stats.nStale++;
+            break;
+        }
+    }
+
+    pc->stats.nMisses++;
+    r = (pDest) ? pt->findMatch(pt, pDest) : pt->findMatch4(pt, dest);
+
+    /*
+     * Don't cache `r' if the table was updated during the lookup.
+     */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if ( __atomic_load_n(&pt->gen, __ATOMIC_RELAXED) + 1 == tag ) {
+        memmove(&pe[1], &pe[0], (CACHE_WAYS - 1) * sizeof(cacheEnt));
+        pe[0].tag = tag;
+        pe[0].k0  = k0;
+        pe[0].k1  = k1;
+        pe[0].r   = r;
+    }
+    return r;
+}
+
+
+/**
+ * @name   rtArtCacheNew
+ *
+ * @brief  API function.
+ *         Creates a destination cache of routing table `pt' for the
+ *         calling thread. The cache can be used by one thread at a
+ *         time. With lock-free readers, the returned routes must be
+ *         used in the read-side critical section as those of
+ *         `pt->findMatch()'.
+ *
+ * @param[in] pt       Pointer to the routing table
+ * @param[in] nEntries The number of entries. Rounded up to a power
+ *                     of 2 (at least 2 * CACHE_WAYS)
+ *
+ * @retval rtArtCache* Pointer to the cache
+ * @retval NULL        There was no memory
+ */
+rtArtCache*
+rtArtCacheNew (rtTable* pt, int nEntries)
+{
+    rtArtCache* pc;
+    u32 nSets;
+    int bits;
+
+
+    assert(pt && (CACHE_WAYS * sizeof(cacheEnt) <= CACHE_LINE));
+
+    for ( bits = 1, nSets = 2;
+          (nSets * CACHE_WAYS < (u32)nEntries) && (bits < 30); ++bits ) {
+        nSets <<= 1;
+    }
+    pc = calloc(1, sizeof(rtArtCache));
+    if ( pc == NULL ) {
+        return NULL;
+    }
+    if ( posix_memalign((void**)&pc->pEnt, CACHE_LINE,
+                        nSets * CACHE_WAYS * sizeof(cacheEnt)) ) {
+        free(pc);
+        return NULL;
+    }
+    memset(pc->pEnt, 0, nSets * CACHE_WAYS * sizeof(cacheEnt));
+    pc->pt    = pt;
+    pc->nSets = nSets;
+    pc->shift = 64 - bits;
+    return pc;
+}
+
+
+/**
+ * @name   rtArtCacheFree
+ *
+ * @brief  API function.
+ *         Frees a cache created by rtArtCacheNew().
+ *         It must be freed before the routing table.
+ */
+void
+rtArtCacheFree (rtArtCache* pc)
+{
+    if ( pc ) {
+        free(pc->pEnt);
+        free(pc);
+    }
+}
+
+
+/**
+ * @name   rtArtCacheFindMatch
+ *
+ * @brief  API function.
+ *         Same as `pt->findMatch(pt, pDest)' of the table of `pc',
+ *         but the result is looked up in the cache first.
+ *
+ * @param[in] pc    Pointer to the cache
+ * @param[in] pDest Pointer to the destination IP address
+ *
+ * @retval routeEnt* The longest matching route
+ * @retval NULL      There is no matching route
+ */
+routeEnt*
+rtArtCacheFindMatch (rtArtCache* pc, u8* pDest)
+{
+    u64 k0, k1;
+
+    cacheKey(pDest, pc->pt->len, &k0, &k1);
+    return cacheFind(pc, k0, k1, pDest, 0);
+}
+
+
+/**
+ * @name   rtArtCacheFindMatch4
+ *
+ * @brief  API function.
+ *         IPv4 version of rtArtCacheFindMatch(). The destination is
+ *         in the host byte order and the trie is looked up with
+ *         `pt->findMatch4()'. It shares the entries with
+ *         rtArtCacheFindMatch().
+ */
+routeEnt*
+rtArtCacheFindMatch4 (rtArtCache* pc, ipv4a dest)
+{
+    assert(pc->pt->alen == 32);
+
+    return cacheFind(pc, (u64)dest << 32, 0, NULL, dest);
+}
+
+
+/**
+ * @name   rtArtCacheGetStats
+ *
+ * @brief  API function.
+ *         Copies the counters of `pc' to `ps'.
+ */
+void
+rtArtCacheGetStats (rtArtCache* pc, rtArtCacheStats* ps)
+{
+    *ps = pc->stats;
+}
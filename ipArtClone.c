@@ -0,0 +1,746 @@
+/** @file ipArtClone.c
+    @brif Copy-on-write clones of a simple trie
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   rtArtClone() returns a copy of a simple trie that shares all the
+   subtables and the routes with the original. Creating a clone
+   allocates the routing table structure only. The tables created
+   from the same table by rtArtClone() (a clone family) share
+   `rtArtCow' that counts the references to the subtables and to
+   the routes:
+
+     - A subtable is referenced by the entries of the parent
+       subtables and by the `root' of the tables.
+     - A route is referenced by every subtable it is stored in at
+       its base index (or in index 1 of the child subtable at its
+       fringe base index). The entries the route is allotted to
+       are not counted. The default route is referenced by the
+       root subtables.
+
+   Only the counters larger than 1 are kept in an open addressing
+   hash table. A pointer that is not in the hash table is referenced
+   once.
+
+   Before an insert, a delete or a replace, the subtables shared with
+   the other tables on the path from the root to the subtable of the
+   prefix are copied, as well as the shared child subtables whose
+   default route (index 1) the allotment rewrites. The update is then
+   done by the function of the simple trie. A copy references the
+   same children and routes as the original, so only the path is
+   copied. rtArtFreeRoute() frees a route when its last reference
+   is dropped.
+
+   The counters of rtArtGetStats() count the subtables reachable
+   from the table, so the shared subtables are counted by every table
+   of the family.
+
+   Limits:
+     - Only simple tries are cloned. A table loaded by rtArtLoad()
+       is thawed first. Tables that have lock-free readers
+       (artOptConcurrent) are not cloned.
+     - All the tables of a family share the subtable allocator and
+       the route arena, so they must be updated by the same thread.
+     - rtArtBulkLoad() of a clone inserts the routes one by one.
+*/
+
+
+#include "ipArt.h"
+
+
+#define COW_MIN_SLOTS 1024      /* initial size of the hash table */
+
+/*
+ * Reference counter larger than 1
+ */
+typedef struct cowSlot cowSlot;
+struct cowSlot {
+    void* p;                    /* subtable or route. NULL: empty slot */
+    u32   n;                    /* # of references */
+};
+
+struct rtArtCow {
+    u32      nTables;           /* # of tables of the clone family */
+    u32      nSlots;            /* size of `pSlot' (power of 2) */
+    u32      nUsed;             /* # of used slots */
+    cowSlot* pSlot;             /* open addressing hash table */
+
+    /* update functions of the simple trie */
+    routeEnt* (*insert)(rtTable* p, routeEnt* r);
+    bool (*delete)(rtTable* p, u8* pDest, int plen);
+    routeEnt* (*replace)(rtTable* p, routeEnt* r);
+};
+
+
+/**
+ * @name  cowHash
+ *
+ * @brief Returns the home slot of pointer `p'.
+ */
+static inline u32
+cowHash (rtArtCow* pc, void* p)
+{
+    return (u32)(((u64)(size_t)p * 0x9e3779b97f4a7c15ULL) >> 32)
+        & (pc->nSlots - 1);
+}
+
+
+/**
+ * @name  cowFind
+ *
+ * @brief Returns the slot of pointer `p', or the empty slot where
+ *        `p' is added if it is not in the hash table.
+ */
+static inline u32
+cowFind (rtArtCow* pc, void* p)
+{
+    register u32 i;
+
+    for ( i = cowHash(pc, p); pc->pSlot[i].p; i = (i + 1) & (pc->nSlots-1) ) {
+        if ( pc->pSlot[i].p == p ) break;
+    }
+    return i;
+}
+
+
+/**
+ * @name  cowGrow
+ *
+ * @brief Doubles the size of the hash table.
+ */
+static void
+cowGrow (rtArtCow* pc)
+{
+    cowSlot* pOld;
+    u32 i, n;
+
+
+    pOld = pc->pSlot;
+    n    = pc->nSlots;
+    pc->pSlot = calloc(n << 1, sizeof(cowSlot));
+    if ( pc->pSlot == NULL ) {
+        panic(("cowGrow: no memory"));
+    }
+    pc->nSlots = n << 1;
+    for ( i = 0; i < n; ++i ) {
+        if ( pOld[i].p ) {
+            pc->pSlot[cowFind(pc, pOld[i].p)] = pOld[i];
+        }
+    }
+    free(pOld);
+}
+
+
+/**
+ * @name  cowRefs
+ *
+ * @brief Returns the number of references to `p'.
+ */
+static inline u32
+cowRefs (rtArtCow* pc, void* p)
+{
+    register u32 i = cowFind(pc, p);
+
+    return pc->pSlot[i].p ? pc->pSlot[i].n : 1;
+}
+
+
+/**
+ * @name  cowRef
+ *
+ * @brief Adds a reference to `p'.
+ */
+static void
+cowRef (rtArtCow* pc, void* p)
+{
+    register u32 i;
+
+    i = cowFind(pc, p);
+    if ( pc->pSlot[i].p ) {
+        ++pc->pSlot[i].n;
+        return;
+    }
+    pc->pSlot[i].p = p;
+    pc->pSlot[i].n = 2;
+    if ( ++pc->nUsed * 2 > pc->nSlots ) {
+        cowGrow(pc);
+    }
+}
+
+
+/**
+ * @name  cowUnref
+ *
+ * @brief Drops a reference to `p'. The slot of `p' is emptied when
+ *        one reference is left, and the following slots of the same
+ *        cluster are moved back so that no tombstone is needed.
+ *
+ * @retval u32 The number of references left. 0: `p' must be freed.
+ */
+static u32
+cowUnref (rtArtCow* pc, void* p)
+{
+    register u32 i, j, h, mask;
+
+
+    i = cowFind(pc, p);
+    if ( pc->pSlot[i].p == NULL ) {
+        return 0;
+    }
+    if ( --pc->pSlot[i].n > 1 ) {
+        return pc->pSlot[i].n;
+    }
+
+    mask = pc->nSlots - 1;
+    pc->pSlot[i].p = NULL;
+    --pc->nUsed;
+    for ( j = (i + 1) & mask; pc->pSlot[j].p; j = (j + 1) & mask ) {
+        h = cowHash(pc, pc->pSlot[j].p);
+        if ( ((j - h) & mask) >= ((j - i) & mask) ) {
+            pc->pSlot[i] = pc->pSlot[j];
+            pc->pSlot[j].p = NULL;
+            i = j;
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * @name  rtArtCowRelease
+ *
+ * @brief Drops a reference of `pt' to route `r' (called by
+ *        rtArtFreeRoute() if `pt' is a member of a clone family).
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] r  Pointer to the route
+ *
+ * @retval true  `r' is referenced by the other tables. Don't free it.
+ * @retval false `r' was the last reference. It must be freed.
+ */
+bool
+rtArtCowRelease (rtTable* pt, routeEnt* r)
+{
+    return cowUnref(pt->pCow, r) > 0;
+}
+
+
+/**
+ * @name  cowSize
+ *
+ * @brief Returns the size of the memory of a subtable of level `l'
+ *        including the hidden level.
+ */
+static inline size_t
+cowSize (rtTable* pt, int l)
+{
+    return ((1 << (pt->psi[l].sl+1)) + 1) * sizeof(tableEntry);
+}
+
+
+/**
+ * @name  cowCopy
+ *
+ * @brief Copies shared subtable `t' and adds a reference to each
+ *        child subtable and route of `t', then drops the reference
+ *        to `t'. The number of the subtables of `pt' is not changed.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] t  Pointer to the subtable to be copied
+ *
+ * @retval subtable Pointer to the copy, referenced by `pt' only
+ */
+static subtable
+cowCopy (rtTable* pt, subtable t)
+{
+    register int i, n;
+    register routeEnt* r;       /* route allotted from the parent */
+    rtArtCow*  pc = pt->pCow;
+    tableEntry e;
+    subtable   nt, pst;
+    int        l;
+
+
+    l  = t[-1].level;
+    nt = pt->alloc.alloc(pt->alloc.ctx, l, cowSize(pt, l));
+    if ( nt == NULL ) {
+        panic(("cowCopy: no memory"));
+    }
+    memcpy(nt, t - 1, cowSize(pt, l));
+    ++nt;                       /* make level hidden */
+
+    if ( (l == 0) && t[1].ent ) {
+        cowRef(pc, t[1].ent);   /* default route */
+    }
+    n = 1 << (pt->psi[l].sl+1);
+    for ( i = 2; i < n; ++i ) {
+        e = t[i];
+        r = ((i >> 1) > 1) ? t[i >> 1].ent : NULL;
+        if ( isSubtable(e) ) {
+            pst = subtablePtr(e).down;
+            cowRef(pc, pst);
+            if ( pst[1].ent && (pst[1].ent != r) ) {
+                cowRef(pc, pst[1].ent);
+            }
+        } else if ( e.ent && (e.ent != r) ) {
+            cowRef(pc, e.ent);
+        }
+    }
+    cowUnref(pc, t);
+
+    return nt;
+}
+
+
+/**
+ * @name  cowOwn
+ *
+ * @brief Returns the child subtable of entry `*pe' after replacing
+ *        it with a copy if it is shared. The subtable of `pe' must
+ *        not be shared.
+ */
+static inline subtable
+cowOwn (rtTable* pt, tableEntry* pe)
+{
+    subtable t;
+
+    t = subtablePtr(*pe).down;
+    if ( cowRefs(pt->pCow, t) > 1 ) {
+        t = cowCopy(pt, t);
+        storeDown(*pe, makeSubtable(t));
+    }
+    return t;
+}
+
+
+/**
+ * @name  cowPrepareAllot
+ *
+ * @brief Copies the shared child subtables whose default route
+ *        rtArtAllot(t, k, r, ...) rewrites. It visits the same
+ *        entries as rtArtAllot() does.
+ *
+ * @param[in] pt          Pointer to the routing table
+ * @param[in] t           Pointer to the subtable (not shared)
+ * @param[in] k           Index to start process (< `threshold')
+ * @param[in] r           Route to be replaced by the allotment
+ * @param[in] threshold   The first fringe index of `t'
+ * @param[in] fringeCheck False if `t' is the deepest level
+ */
+static void
+cowPrepareAllot (rtTable* pt, subtable t, int k, routeEnt* r,
+                 int threshold, bool fringeCheck)
+{
+    register int j;
+    tableEntry   e;
+
+    for ( j = k << 1; j <= ((k << 1) | 1); ++j ) {
+        e = t[j];
+        if ( j < threshold ) {
+            if ( e.ent == r ) {
+                cowPrepareAllot(pt, t, j, r, threshold, fringeCheck);
+            }
+        } else if ( fringeCheck && isSubtable(e) &&
+                    (subtablePtr(e).down[1].ent == r) ) {
+            cowOwn(pt, &t[j]);
+        }
+    }
+}
+
+
+/**
+ * @name  cowPreparePath
+ *
+ * @brief Copies the shared subtables that an insert, a delete or
+ *        a replace of prefix `pDest'/`plen' updates: the subtables
+ *        on the path from the root and the child subtables rewritten
+ *        by the allotment.
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] pDest Pointer to the IP address of the prefix
+ * @param[in] plen  Prefix length
+ */
+static void
+cowPreparePath (rtTable* pt, u8* pDest, int plen)
+{
+    register int l, len;
+    register subtable pst;
+    tableEntry* pe;
+    routeEnt*   r;
+    int  index, threshold;
+    u32  offset;
+    bool flag;
+
+
+    if ( cowRefs(pt->pCow, pt->root) > 1 ) {
+        pt->root = cowCopy(pt, pt->root);
+    }
+    if ( plen == 0 ) return;
+
+    index  = baseIndex(pt, pDest, plen);
+    len    = pt->psi[0].sl;     /* accumulated address bit length */
+    pst    = pt->root;
+    l      = 0;
+    offset = 0;
+    flag   = true;
+    for (;;) {
+        if ( plen <= len ) {
+            threshold = 1 << pt->psi[l].sl;
+            pe = &pst[index];
+            if ( index < threshold ) {
+                r = pe->ent;
+                cowPrepareAllot(pt, pst, index, r, threshold, flag);
+            } else if ( flag && isSubtable(*pe) ) {
+                cowOwn(pt, pe);
+            }
+            return;
+        }
+
+        pe = pst + fringeIndex(&pDest, &offset, pt->psi[l].sl);
+        if ( !isSubtable(*pe) ) {
+            return;             /* the rest is created by the insert */
+        }
+        pst = cowOwn(pt, pe);
+
+        ++l;
+        if ( l >= (pt->nLevels - 1) ) {
+            flag = false;       /* last level */
+        }
+        len += pt->psi[l].sl;
+    }
+}
+
+
+/**
+ * @name  cowExists
+ *
+ * @brief Returns the route of prefix `pDest'/`plen' in `pt'.
+ */
+static inline routeEnt*
+cowExists (rtTable* pt, u8* pDest, int plen)
+{
+    routeEnt* r;
+
+    r = pt->findExactMatch(pt, pDest, plen);
+    if ( r && (r->plen == plen) && cmpAddr(r->dest, pDest, plen) ) {
+        return r;
+    }
+    return NULL;
+}
+
+
+/**
+ * @name  cowInsertRoute
+ *
+ * @brief API function.
+ *        (registered as `pt->insert()' in rtArtClone()).
+ *        Same as the insert of the simple trie.
+ */
+static routeEnt*
+cowInsertRoute (rtTable* pt, routeEnt* pEnt)
+{
+    routeEnt* r;
+
+    r = cowExists(pt, pEnt->dest, pEnt->plen);
+    if ( r ) return r;
+
+    cowPreparePath(pt, pEnt->dest, pEnt->plen);
+    return pt->pCow->insert(pt, pEnt);
+}
+
+
+/**
+ * @name  cowDeleteRoute
+ *
+ * @brief API function.
+ *        (registered as `pt->delete()' in rtArtClone()).
+ *        Same as the delete of the simple trie. The route is freed
+ *        if no other table of the clone family has it.
+ */
+static bool
+cowDeleteRoute (rtTable* pt, u8* pDest, int plen)
+{
+    if ( cowExists(pt, pDest, plen) == NULL ) return false;
+
+    cowPreparePath(pt, pDest, plen);
+    return pt->pCow->delete(pt, pDest, plen);
+}
+
+
+/**
+ * @name  cowReplaceRoute
+ *
+ * @brief API function.
+ *        (registered as `pt->replace()' in rtArtClone()).
+ *        Same as the replace of the simple trie. The returned route
+ *        must be freed with rtArtFreeRoute() that frees it only if
+ *        no other table of the clone family has it.
+ */
+static routeEnt*
+cowReplaceRoute (rtTable* pt, routeEnt* pEnt)
+{
+    if ( cowExists(pt, pEnt->dest, pEnt->plen) == NULL ) return NULL;
+
+    cowPreparePath(pt, pEnt->dest, pEnt->plen);
+    return pt->pCow->replace(pt, pEnt);
+}
+
+
+/**
+ * @name  cowFreeRoute
+ *
+ * @brief Drops a reference to route `r'. `f' is called with `r'
+ *        before it is freed by the last reference.
+ */
+static inline void
+cowFreeRoute (rtTable* pt, routeEnt* r, rtFunc f, void* p2)
+{
+    if ( cowUnref(pt->pCow, r) ) return;
+
+    if ( f ) {
+        (*f)(r, p2);
+    }
+    rtArtRouteFree(pt, r);
+}
+
+
+static void cowDrop(rtTable* pt, subtable t, rtFunc f, void* p2);
+
+/**
+ * @name  cowFlushEntries
+ *
+ * @brief Drops the references of subtable `t' to its routes and
+ *        to its child subtables in the same way as flushSubtable()
+ *        in ipArt.c frees them. The entries are not cleared.
+ */
+static void
+cowFlushEntries (rtTable* pt, subtable t, rtFunc f, void* p2)
+{
+    register int i;
+    register routeEnt* r;       /* route allotted from the parent */
+    tableEntry e;
+    subtable   pst;
+
+
+    for ( i = (1 << (pt->psi[t[-1].level].sl+1)) - 1; i > 1; --i ) {
+        e = t[i];
+        r = ((i >> 1) > 1) ? t[i >> 1].ent : NULL;
+        if ( isSubtable(e) ) {
+            pst = subtablePtr(e).down;
+            if ( pst[1].ent && (pst[1].ent != r) ) {
+                cowFreeRoute(pt, pst[1].ent, f, p2);
+            }
+            cowDrop(pt, pst, f, p2);
+        } else if ( e.ent && (e.ent != r) ) {
+            cowFreeRoute(pt, e.ent, f, p2);
+        }
+    }
+}
+
+
+/**
+ * @name  cowDrop
+ *
+ * @brief Drops a reference to subtable `t'. It is freed with its
+ *        descendants and routes that are not referenced by the
+ *        other tables of the clone family by the last reference.
+ */
+static void
+cowDrop (rtTable* pt, subtable t, rtFunc f, void* p2)
+{
+    int l;
+
+    if ( cowUnref(pt->pCow, t) ) return;
+
+    cowFlushEntries(pt, t, f, p2);
+    l = t[-1].level;
+    pt->alloc.free(pt->alloc.ctx, l, t - 1, cowSize(pt, l));
+    ++pt->nSubtablesFreed;
+}
+
+
+/**
+ * @name  cowFlushRoutes
+ *
+ * @brief API function.
+ *        (registered as `pt->flushRoutes()' in rtArtClone()).
+ *        Deletes all the routes of `pt'. The subtables and the
+ *        routes shared with the other tables of the clone family
+ *        are left to them, so `f' is called only with the routes
+ *        that are freed.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] f  Callback function (may be NULL)
+ * @param[in] p2 Second parameter of `f'
+ *
+ * @retval true Always
+ */
+static bool
+cowFlushRoutes (rtTable* pt, rtFunc f, void* p2)
+{
+    subtable t;
+    int l;
+
+
+    t = pt->root;
+    if ( cowUnref(pt->pCow, t) ) {
+        t = pt->alloc.alloc(pt->alloc.ctx, 0, cowSize(pt, 0));
+        if ( t == NULL ) {
+            panic(("cowFlushRoutes: no memory"));
+        }
+        t->level = 0;
+        pt->root = t + 1;
+    } else {
+        if ( t[1].ent ) {
+            cowFreeRoute(pt, t[1].ent, f, p2);
+        }
+        cowFlushEntries(pt, t, f, p2);
+        memset(t, 0, cowSize(pt, 0) - sizeof(tableEntry));
+    }
+
+    pt->nRoutes = 0;
+    for ( l = 0; l < pt->nLevels; ++l ) {
+        pt->pLvStats[l].nRoutes    = 0;
+        pt->pLvStats[l].nSubtables = 0;
+        pt->pLvStats[l].bytes      = 0;
+    }
+    rtArtCountSubtable(pt, 0, cowSize(pt, 0), 1);
+    rtArtBumpGen(pt);
+    return true;
+}
+
+
+/**
+ * @name  cowDestroy
+ *
+ * @brief API function.
+ *        (registered as `pt->deleteTable()' in rtArtClone()).
+ *        Deletes all the routes of `pt' and frees `pt'. The subtable
+ *        allocator and the route arena are destroyed with the last
+ *        table of the clone family.
+ *
+ * @param[in,out] p Pointer to the pointer to `rtTable'. `*p' is
+ *                  set to NULL at the end of this function.
+ */
+static void
+cowDestroy (rtTable** p)
+{
+    rtTable*  pt = *p;
+    rtArtCow* pc = pt->pCow;
+
+
+    cowFlushRoutes(pt, NULL, NULL);
+    pt->alloc.free(pt->alloc.ctx, 0, pt->root - 1, cowSize(pt, 0));
+    if ( --pc->nTables == 0 ) {
+        free(pc->pSlot);
+        free(pc);
+        rtArtAllocDestroy(pt);
+    }
+    free(pt->pTbl);
+    free(pt->pEnt);
+    free(pt->pLvStats);
+    free(pt->psi);
+    free(pt);
+    *p = NULL;
+}
+
+
+/**
+ * @name  rtArtClone
+ *
+ * @brief API function.
+ *        Creates a copy-on-write clone of simple trie `pt'. The clone
+ *        shares all the subtables and the routes with `pt' until
+ *        either of them is updated, and an update copies only the
+ *        subtables it writes. The update functions of both `pt' and
+ *        the clone are replaced by the ones of this file.
+ *        The lookups are not changed.
+ *
+ * @param[in] pt Pointer to the routing table to be cloned
+ *
+ * @retval rtTable* Pointer to the clone. It is freed by
+ *                  `deleteTable()' as usual.
+ * @retval NULL     `pt' is not a simple trie, has lock-free readers,
+ *                  or there was no memory.
+ */
+rtTable*
+rtArtClone (rtTable* pt)
+{
+    rtTable*  npt;
+    rtArtCow* pc;
+    int n;
+
+
+    if ( pt == NULL ) return NULL;
+    if ( pt->pImg && !rtArtThaw(pt, NULL) ) return NULL;
+    if ( (pt->type != simpleTrie) || pt->pEpoch || pt->pIdx ) return NULL;
+
+    pc = pt->pCow;
+    if ( pc == NULL ) {
+        pc = calloc(1, sizeof(rtArtCow));
+        if ( pc == NULL ) return NULL;
+        pc->pSlot = calloc(COW_MIN_SLOTS, sizeof(cowSlot));
+        if ( pc->pSlot == NULL ) {
+            free(pc);
+            return NULL;
+        }
+        pc->nSlots  = COW_MIN_SLOTS;
+        pc->nTables = 1;
+        pc->insert  = pt->insert;
+        pc->delete  = pt->delete;
+        pc->replace = pt->replace;
+
+        pt->pCow        = pc;
+        pt->insert      = cowInsertRoute;
+        pt->delete      = cowDeleteRoute;
+        pt->replace     = cowReplaceRoute;
+        pt->flushRoutes = cowFlushRoutes;
+        pt->deleteTable = cowDestroy;
+        pt->bulkLoad    = rtArtInsertRoutes;
+    }
+
+    npt = malloc(sizeof(rtTable));
+    if ( npt == NULL ) return NULL;
+    *npt = *pt;
+
+    n = pt->nLevels;
+    npt->psi      = malloc(n * sizeof(strideInfo));
+    npt->pLvStats = malloc(n * sizeof(rtArtLevelStats));
+    npt->pEnt     = calloc(n, sizeof(tableEntry*));
+    npt->pTbl     = calloc(n, sizeof(subtable));
+    if ( !npt->psi || !npt->pLvStats || !npt->pEnt || !npt->pTbl ) {
+        goto cloneFree;
+    }
+    memcpy(npt->psi, pt->psi, n * sizeof(strideInfo));
+    memcpy(npt->pLvStats, pt->pLvStats, n * sizeof(rtArtLevelStats));
+
+    cowRef(pc, pt->root);
+    ++pc->nTables;
+    return npt;
+
+
+cloneFree:
+    free(npt->pTbl);
+    free(npt->pEnt);
+    free(npt->pLvStats);
+    free(npt->psi);
+    free(npt);
+    return NULL;
+}
@@ -0,0 +1,1282 @@
+/** @file ipArtCompact.c
+    @brif Allotment Routing Table with 32-bit table entries
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   `compactTrie' is the simple trie of ipArt.c with 32-bit table
+   entries instead of pointer-sized ones, which halves the size of
+   every subtable on LP64. The algorithm (allotment, fringe indices,
+   subtable default routes in index 1, reference counter in index 0,
+   level in index -1) is the same.
+
+   An entry is one of the following:
+
+     0                      No route
+     (i << 1)               Route: `pc->ppRoute[i]' (i >= 1)
+     (o << 1) | 1           Subtable: `pc->base + o' (o >= 1)
+
+   The subtables are carved out of one virtual memory space reserved
+   by mmap() (CP_SUBTABLE_SPACE bytes, committed as it grows) so that
+   a subtable is identified by its 31-bit word offset. The freed
+   subtables are kept in a free list per level. The route pointers
+   are kept in the route index table (another reserved space) so
+   that a route is identified by a 31-bit index. Neither space is
+   ever moved, so lookups can run concurrently with the writer
+   (artOptConcurrent) in the same way as the other tries.
+*/
+
+
+#include <sys/mman.h>
+
+#include "ipArt.h"
+
+
+#define CP_SUBTABLE_SPACE ((size_t)1 << 32) /* 2^30 entries */
+#define CP_ROUTE_SPACE    ((size_t)1 << 30) /* 2^27 routes */
+#define CP_COMMIT_SIZE    ((size_t)2 << 20) /* commit unit */
+
+struct rtArtCompact {
+    u32*       base;            /* subtable space */
+    size_t     nWords;          /* # of words reserved */
+    size_t     nCommitted;      /* # of words committed */
+    size_t     top;             /* first word never allocated */
+    u32*       pFree;           /* free subtable lists indexed by level */
+    routeEnt** ppRoute;         /* route index table */
+    size_t     nRouteSlots;     /* # of indices reserved */
+    size_t     nRouteCommitted; /* # of indices committed */
+    u32        nextRoute;       /* first index never used */
+    u32        freeRoute;       /* free list of route indices */
+    u32        nSubtables;      /* # of subtables except the root */
+    u32**      ppEnt;           /* array of entry pointers (for deletion) */
+    u32**      ppTbl;           /* array of subtable pointers (for deletion) */
+    u32*       root;            /* root subtable */
+};
+
+#define cpIsSubtable(e)       ((e) & 1)
+#define cpSubtablePtr(pc, e)  ((pc)->base + ((e) >> 1))
+#define cpRoutePtr(pc, e)     ((pc)->ppRoute[(e) >> 1])
+#define cpMakeSubtable(pc, t) ((u32)(((t) - (pc)->base) << 1) | 1)
+#define cpMakeRoute(i)        ((u32)(i) << 1)
+
+/*
+ * Free route indices are linked through the route index table.
+ * The low bit distinguishes them from route pointers.
+ */
+#define cpIsFreeRoute(p)      ((size_t)(p) & 1)
+#define cpFreeRouteLink(i)    ((routeEnt*)(((size_t)(i) << 1) | 1))
+#define cpFreeRouteNext(p)    ((u32)((size_t)(p) >> 1))
+
+/*
+ * See loadEnt() and storeRoute() in ipArt.h
+ */
+#define cpLoad(e)     __atomic_load_n(&(e), __ATOMIC_ACQUIRE)
+#define cpStore(e, v) __atomic_store_n(&(e), (v), __ATOMIC_RELEASE)
+
+
+/**
+ * @name  subtableWords
+ *
+ * @brief Returns the size of a subtable (trie node) in words
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] level level of the subtable
+ *
+ * @retval size_t Size in 32-bit words including the hidden level
+ */
+static inline size_t
+subtableWords (rtTable* pt, int level)
+{
+    return (1 << (pt->psi[level].sl+1)) + 1;
+}
+
+
+/**
+ * @name  cpCommit
+ *
+ * @brief Makes the first `n' units of a reserved space accessible
+ *
+ * @param[in]     p          Beginning of the reserved space
+ * @param[in,out] pCommitted # of units committed so far
+ * @param[in]     n          # of units needed
+ * @param[in]     unit       Unit size in bytes
+ * @param[in]     max        # of units reserved
+ *
+ * @retval true  Success
+ * @retval false Out of the reserved space or no memory
+ */
+static bool
+cpCommit (void* p, size_t* pCommitted, size_t n, size_t unit, size_t max)
+{
+    size_t start, end;
+
+
+    if ( n <= *pCommitted ) return true;
+    if ( n > max ) return false;
+
+    start = *pCommitted * unit;
+    end   = (n * unit + CP_COMMIT_SIZE - 1) & ~(CP_COMMIT_SIZE - 1);
+    if ( end > max * unit ) {
+        end = max * unit;
+    }
+    if ( mprotect((u8*)p + start, end - start, PROT_READ | PROT_WRITE) ) {
+        return false;
+    }
+    *pCommitted = end / unit;
+    return true;
+}
+
+
+/**
+ * @name  cpNewSubtable
+ *
+ * @brief Allocates a new subtable (trie node)
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] level level of the subtable to be allocated
+ * @param[in] base  Subtable default route stored in index 1
+ *
+ * @retval u32* Pointer to the allocated subtable (success)
+ * @retval NULL Failed to allocate a subtable
+ */
+static u32*
+cpNewSubtable (rtTable* pt, int level, u32 base)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register u32* t;
+    size_t n;
+
+
+    n = subtableWords(pt, level);
+    if ( pc->pFree[level] ) {
+        t = pc->base + pc->pFree[level];
+        pc->pFree[level] = t[0];
+        memset(t, 0, (n - 1) * sizeof(u32));
+    } else {
+        if ( (pc->top + n) >= (1UL << 31) ||
+             !cpCommit(pc->base, &pc->nCommitted, pc->top + n,
+                       sizeof(u32), pc->nWords) ) {
+            return NULL;
+        }
+        t = pc->base + pc->top + 1;
+        pc->top += n;
+        t[-1] = level;          /* level is never changed */
+    }
+    if ( level > 0 ) {
+        ++pc->nSubtables;
+    }
+    rtArtCountSubtable(pt, level, n * sizeof(u32), 1);
+    t[1] = base;
+
+    return t;
+}
+
+
+/**
+ * @name  cpFreeSubtableMem
+ *
+ * @brief Puts a subtable in the free list of its level
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] p  Pointer to the beginning of the subtable (t - 1)
+ */
+static void
+cpFreeSubtableMem (rtTable* pt, void* p)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register u32* t = (u32*)p + 1;
+
+    rtArtCountSubtable(pt, t[-1], subtableWords(pt, t[-1]) * sizeof(u32), -1);
+    t[0] = pc->pFree[t[-1]];
+    pc->pFree[t[-1]] = t - pc->base;
+}
+
+
+/**
+ * @name  cpFreeSubtable
+ *
+ * @brief Frees a subtable (trie node).
+ *        If the readers are lock-free, the subtable is freed after
+ *        all the readers that may see it leave.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] t  Pointer to the subtable to be freed
+ *
+ * @retval u32 Subtable default route in the freed subtable.
+ *             This must be restored in the parent subtable.
+ */
+static inline u32
+cpFreeSubtable (rtTable* pt, u32* t)
+{
+    register u32 base = t[1];
+
+    if ( pt->pEpoch ) {
+        rtArtRetire(pt, t - 1, cpFreeSubtableMem);
+    } else {
+        cpFreeSubtableMem(pt, t - 1);
+    }
+    --pt->pCp->nSubtables;
+    ++pt->nSubtablesFreed;
+
+    return base;
+}
+
+
+/**
+ * @name  cpNewRouteIndex
+ *
+ * @brief Assigns a route index to a route
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] r  Pointer to the route
+ *
+ * @retval u32 Route index (success)
+ * @retval 0   No more index
+ */
+static u32
+cpNewRouteIndex (rtTable* pt, routeEnt* r)
+{
+    register rtArtCompact* pc = pt->pCp;
+    u32 i;
+
+
+    if ( pc->freeRoute ) {
+        i = pc->freeRoute;
+        pc->freeRoute = cpFreeRouteNext(pc->ppRoute[i]);
+    } else {
+        if ( !cpCommit(pc->ppRoute, &pc->nRouteCommitted, pc->nextRoute + 1,
+                       sizeof(routeEnt*), pc->nRouteSlots) ) {
+            return 0;
+        }
+        i = pc->nextRoute++;
+    }
+    pc->ppRoute[i] = r;
+    return i;
+}
+
+
+/**
+ * @name  cpFreeRouteMem
+ *
+ * @brief Frees a route and its route index
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] p  Route index
+ */
+static void
+cpFreeRouteMem (rtTable* pt, void* p)
+{
+    register rtArtCompact* pc = pt->pCp;
+    u32 i = (u32)(size_t)p;
+
+    rtArtRouteFree(pt, pc->ppRoute[i]);
+    pc->ppRoute[i] = cpFreeRouteLink(pc->freeRoute);
+    pc->freeRoute  = i;
+}
+
+
+/**
+ * @name  cpFreeRoute
+ *
+ * @brief Frees a deleted route and its route index.
+ *        If the readers are lock-free, they are freed after
+ *        all the readers that may see them leave.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] e  Route entry
+ */
+static inline void
+cpFreeRoute (rtTable* pt, u32 e)
+{
+    if ( pt->pEpoch ) {
+        rtArtRetire(pt, (void*)(size_t)(e >> 1), cpFreeRouteMem);
+    } else {
+        cpFreeRouteMem(pt, (void*)(size_t)(e >> 1));
+    }
+}
+
+
+/**
+ * @name   cpAllot
+ *
+ * @brief  Same as rtArtAllot() except for the entry size
+ *
+ * @param[in] pc          Pointer to the compact table state
+ * @param[in] t           Pointer to a subtable (trie node)
+ * @param[in] k           Index to start process.
+ *                        `k' must be smaller than `threshold'
+ * @param[in] r           Route entry to be replaced with 's'
+ * @param[in] s           Route entry to replace 'r'
+ * @param[in] threshold   The first fringe index of 't'
+ * @param[in] fringeCheck False if `t' is the deepest level. Otherwise true.
+ *
+ * @retval u32 The number of visited entries
+ */
+static inline u32
+cpAllot (rtArtCompact* pc, u32* t, int k, u32 r,
+         u32 s, int threshold, bool fringeCheck)
+{
+    register int j = k;
+    register u32 n = 0;         /* visited entries */
+
+    assert( k < threshold );
+
+startChange:
+    j <<= 1;
+    if ( j < threshold ) goto nonFringe;
+
+
+    /*  change fringe nodes
+     */
+    while (1) {
+        ++n;
+        if ( fringeCheck && cpIsSubtable(t[j]) ) {
+            if ( cpSubtablePtr(pc, t[j])[1] == r ) {
+                cpStore(cpSubtablePtr(pc, t[j])[1], s);
+            }
+        } else if ( t[j] == r ) {
+            cpStore(t[j], s);
+        }
+        if ( j & 1 ) goto moveUp;
+        j++;
+    }
+
+nonFringe:
+    ++n;
+    if (t[j] == r) goto startChange;
+moveOn:
+    if (j & 1) goto moveUp;
+    j++;
+    goto nonFringe;
+moveUp:
+    j >>= 1;
+    cpStore(t[j], s);           /* change non-fringe node */
+    if (j != k) goto moveOn;
+    return n;
+}
+
+
+/**
+ * @name   cpInsert
+ *
+ * @brief  Inserts route `s' into subtable (trie node) `t'
+ *
+ * @param[in] pt          Pointer to the routing table
+ * @param[in] t           Pointer to a subtable (trie node)
+ * @param[in] k           Base index of `s'
+ * @param[in] threshold   The first fringe index of 't'
+ * @param[in] fringeCheck False if `t' is the deepest level. Otherwise true.
+ * @param[in] s           Route pointer to be inserted
+ *
+ * @retval routeEnt* 1. `s' if route pointer `s' is successfully inserted.
+ *                   2. !`s' if there is an existing route.
+ *                      `s' must be freed in this case.
+ */
+static inline routeEnt*
+cpInsert (rtTable* pt, u32* t, int k,
+          int threshold, bool fringeCheck, routeEnt* s)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register u32 z = t[k];
+    register u32 r;
+    u32 i;
+
+
+    r = (fringeCheck && cpIsSubtable(z)) ? cpSubtablePtr(pc, z)[1] : z;
+    if ( r && (cpRoutePtr(pc, r)->plen == s->plen) &&
+        (cmpAddr(cpRoutePtr(pc, r)->dest, s->dest, s->plen) == true) ) {
+        return cpRoutePtr(pc, r);
+    }
+
+    i = cpNewRouteIndex(pt, s);
+    if ( i == 0 ) {
+        panic(("cpInsert: no route index"));
+    }
+
+    t[0]++;
+    if ( k < threshold ) {
+        rtArtCountAllot(pt, cpAllot(pc, t, k, r, cpMakeRoute(i),
+                                    threshold, fringeCheck));
+    } else if ( fringeCheck && cpIsSubtable(z) ) {
+        cpStore(cpSubtablePtr(pc, z)[1], cpMakeRoute(i));
+    } else {
+        cpStore(t[k], cpMakeRoute(i));
+    }
+    rtArtCountRoute(pt, s, 1);
+    return s;
+}
+
+
+/**
+ * @name   cpDelete
+ *
+ * @brief  Deletes the route at base index `k' of subtable `t'
+ *         if it is (`pDest', `plen')
+ *
+ * @param[in] pt          Pointer to the routing table
+ * @param[in] t           Pointer to a subtable (trie node)
+ * @param[in] k           Base index of (`pDest', `plen')
+ * @param[in] threshold   The first fringe index of 't'
+ * @param[in] fringeCheck False if `t' is the deepest level. Otherwise true.
+ * @param[in] pDest       Pointer to the destination IP address to be deleted.
+ * @param[in] plen        Prefix length of `pDest'
+ * @param[in] l           The level of subtable `t'
+ *
+ * @retval u32 Route entry of the deleted route
+ * @retval 0   There was no matching route
+ */
+static inline u32
+cpDelete (rtTable* pt, u32* t, int k,
+          int threshold, bool fringeCheck, u8* pDest, int plen, int l)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register u32 z = t[k];
+    register u32 r;             /* route to be deleted */
+    register u32 s;             /* route to replace 'r' */
+    u32 save;
+
+
+    r = (fringeCheck && cpIsSubtable(z)) ? cpSubtablePtr(pc, z)[1] : z;
+    if ( (!r) || (cpRoutePtr(pc, r)->plen != plen) ||
+        (cmpAddr(cpRoutePtr(pc, r)->dest, pDest, plen) == false) ) {
+        return 0;
+    }
+
+    rtArtCountRoute(pt, cpRoutePtr(pc, r), -1);
+    save = r;
+    s = ((k >> 1) > 1) ? t[k >> 1] : 0;
+    while ( l-- >= 0 ) {
+        t[0]--;
+        if ( t[0] > 0 ) break;
+        if ( l < 0 ) break;     /* Don't free level 0 table */
+
+        /*
+         * Counter == 0 and level > 0. Free subtable after
+         * restoring the heap default route.
+         */
+        r = t[1];
+        cpStore(*pc->ppEnt[l], r);
+        cpFreeSubtable(pt, t);
+
+        t = pc->ppTbl[l];       /* set `t' to parent subtable */
+    }
+    if ( r != save ) return save; /* subtable(s) are freed */
+
+    if ( k < threshold ) {
+        rtArtCountAllot(pt, cpAllot(pc, t, k, r, s, threshold, fringeCheck));
+    } else if ( fringeCheck && cpIsSubtable(z) ) {
+        cpStore(cpSubtablePtr(pc, z)[1], s);
+    } else {
+        cpStore(t[k], s);
+    }
+    return save;
+}
+
+
+/**
+ * @name   rtArtCpFindMatch
+ *
+ * @brief  API function.
+ *         (registered as `pt->findMatch()' in `rtArtCpInit()').
+ *         Performs the longest prefix match.
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] pDest Pointer to the destination IP address
+ *
+ * @retval routeEnt* Pointer to the longest prefix matching route.
+ * @retval NULL      There was no matching route for `pDest'
+ */
+static routeEnt *
+rtArtCpFindMatch (rtTable* pt, u8* pDest)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register u32  e;
+    register u32* pst;
+    register u32  def;
+    register int  l;
+    u32 offset;
+
+
+    pst    = pc->root;
+    offset = 0;
+    def    = 0;
+    for (l = 0; l < pt->nLevels; ++l ) {
+        e = cpLoad(pst[fringeIndex(&pDest, &offset, pt->psi[l].sl)]);
+        if ( !e ) break;
+        if ( !cpIsSubtable(e) ) {
+            rtArtSampleLookup(pt, l);
+            return cpRoutePtr(pc, e);
+        }
+        if ( l >= (pt->nLevels - 1) ) break;
+        pst = cpSubtablePtr(pc, e);
+        e = cpLoad(pst[1]);
+        if ( e ) {
+            def = e;
+        }
+    }
+    rtArtSampleLookup(pt, l);
+
+    /*
+     * No match.
+     */
+    if ( !def ) {
+        def = cpLoad(pc->root[1]);
+    }
+    return (def) ? cpRoutePtr(pc, def) : NULL;
+}
+
+
+/**
+ * @name   rtArtCpFindMatch4
+ *
+ * @brief  API function.
+ *         (registered as `pt->findMatch4()' in `rtArtCpInit()').
+ *         Performs the longest prefix match of an IPv4 address
+ *         in the host byte order.
+ *
+ * @param[in] pt   Pointer to the IPv4 routing table
+ * @param[in] dest Destination IPv4 address in the host byte order
+ *
+ * @retval routeEnt* Pointer to the longest prefix matching route.
+ * @retval NULL      There was no matching route
+ */
+static routeEnt *
+rtArtCpFindMatch4 (rtTable* pt, ipv4a dest)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register u32  e;
+    register u32* pst;
+    register u32  def;
+    register int  l;
+
+
+    assert(pt->alen == 32);
+
+    pst = pc->root;
+    def = 0;
+    for (l = 0; l < pt->nLevels; ++l ) {
+        e = cpLoad(pst[fringeIndex4(&pt->psi[l], dest)]);
+        if ( !e ) break;
+        if ( !cpIsSubtable(e) ) return cpRoutePtr(pc, e);
+        if ( l >= (pt->nLevels - 1) ) break;
+        pst = cpSubtablePtr(pc, e);
+        e = cpLoad(pst[1]);
+        if ( e ) {
+            def = e;
+        }
+    }
+
+    if ( !def ) {
+        def = cpLoad(pc->root[1]);
+    }
+    return (def) ? cpRoutePtr(pc, def) : NULL;
+}
+
+
+/**
+ * @name   rtArtCpFindMatch6
+ *
+ * @brief  API function.
+ *         (registered as `pt->findMatch6()' in `rtArtCpInit()').
+ *         Performs the longest prefix match of an IPv6 address
+ *         given as two 64-bit words in the host byte order.
+ *
+ * @param[in] pt   Pointer to the IPv6 routing table
+ * @param[in] hi   The first 64 bits of the destination address
+ * @param[in] lo   The last 64 bits of the destination address
+ *
+ * @retval routeEnt* Pointer to the longest prefix matching route.
+ * @retval NULL      There was no matching route
+ */
+static routeEnt *
+rtArtCpFindMatch6 (rtTable* pt, u64 hi, u64 lo)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register u32  e;
+    register u32* pst;
+    register u32  def;
+    register int  l;
+    u128 dest = ((u128)hi << 64) | lo;
+
+
+    assert(pt->alen == 128);
+
+    pst = pc->root;
+    def = 0;
+    for (l = 0; l < pt->nLevels; ++l ) {
+        e = cpLoad(pst[fringeIndex6(&pt->psi[l], dest)]);
+        if ( !e ) break;
+        if ( !cpIsSubtable(e) ) return cpRoutePtr(pc, e);
+        if ( l >= (pt->nLevels - 1) ) break;
+        pst = cpSubtablePtr(pc, e);
+        e = cpLoad(pst[1]);
+        if ( e ) {
+            def = e;
+        }
+    }
+
+    if ( !def ) {
+        def = cpLoad(pc->root[1]);
+    }
+    return (def) ? cpRoutePtr(pc, def) : NULL;
+}
+
+
+/**
+ * @name   rtArtCpFindMatchBatch
+ *
+ * @brief  API function.
+ *         (registered as `pt->findMatchBatch()' in `rtArtCpInit()').
+ *         Performs the longest prefix match for `n' addresses
+ *         in the same way as rtArtFindMatchBatch().
+ *
+ * @param[in]  pt    Pointer to the routing table
+ * @param[in]  pDest Array of `n' pointers to the destination IP addresses
+ * @param[out] pRes  Array of `n' route pointers. `pRes[i]' is set to
+ *                   the longest prefix matching route of `pDest[i]'
+ *                   (or NULL if there is no matching route.)
+ * @param[in]  n     The number of addresses to be looked up
+ */
+static void
+rtArtCpFindMatchBatch (rtTable* pt, u8** pDest, routeEnt** pRes, int n)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register u32 e, r;
+    u32* pst[ART_BATCH_WIDTH];          /* current subtable */
+    u32  def[ART_BATCH_WIDTH];          /* subtable default route */
+    u8*  pAddr[ART_BATCH_WIDTH];
+    u32  offset[ART_BATCH_WIDTH];
+    u32  index[ART_BATCH_WIDTH];
+    int  live[ART_BATCH_WIDTH];         /* lookups still going down */
+    int i, j, l, m, nLive, nNext;
+
+
+    for ( ; n > 0; n -= m, pDest += m, pRes += m ) {
+        m = (n < ART_BATCH_WIDTH) ? n : ART_BATCH_WIDTH;
+        for ( i = 0; i < m; ++i ) {
+            pst[i]    = pc->root;
+            pAddr[i]  = pDest[i];
+            offset[i] = 0;
+            def[i]    = 0;
+            index[i]  = fringeIndex(&pAddr[i], &offset[i], pt->psi[0].sl);
+            __builtin_prefetch(&pst[i][index[i]]);
+            live[i] = i;
+        }
+        nLive = m;
+        for ( l = 0; nLive > 0; ++l ) {
+            nNext = 0;
+            for ( j = 0; j < nLive; ++j ) {
+                i = live[j];
+                if ( l > 0 ) {
+                    r = cpLoad(pst[i][1]);      /* prefetched */
+                    if ( r ) {
+                        def[i] = r;
+                    }
+                }
+                e = cpLoad(pst[i][index[i]]);
+                if ( !cpIsSubtable(e) ) {
+                    if ( !e ) {
+                        e = (def[i]) ? def[i] : cpLoad(pc->root[1]);
+                    }
+                    pRes[i] = (e) ? cpRoutePtr(pc, e) : NULL;
+                    continue;
+                }
+                assert(l < (pt->nLevels - 1));
+
+                pst[i] = cpSubtablePtr(pc, e);
+                index[i] = fringeIndex(&pAddr[i], &offset[i],
+                                       pt->psi[l+1].sl);
+                __builtin_prefetch(&pst[i][1]);
+                __builtin_prefetch(&pst[i][index[i]]);
+                live[nNext++] = i;
+            }
+            nLive = nNext;
+        }
+    }
+}
+
+
+/**
+ * @name  rtArtCpFindExactMatch
+ *
+ * @brief API Function.
+ *        (registered as `pt->findExactMatch()' in `rtArtCpInit()').
+ *        Performs the exact match (address + prefix length.)
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] pDest Pointer to the IP address to be searched for
+ * @param[in] plen  prefix length of `pDest'
+ *
+ * @retval routeEnt* Pointer to the found route entry (success)
+ * @retval NULL      Failed to find a matching route entry
+ */
+static routeEnt *
+rtArtCpFindExactMatch (rtTable* pt, u8* pDest, int plen)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register u32  e;
+    register u32* pst;
+    register int index;
+    register int l;
+    register int ml;            /* max level */
+    routeEnt* r;
+    u32 def;                    /* subtable default route */
+    u8* pAddr;
+    u32 offset;
+
+
+    pst    = pc->root;
+    pAddr  = pDest;
+    ml     = plen2level(pt, plen);
+    offset = 0;
+    for ( l = 0; l <= ml; ++l ) {
+        index = fringeIndex(&pAddr, &offset, pt->psi[l].sl);
+        e     = cpLoad(pst[index]);
+        if ( !e ) {
+            goto Default;
+        }
+        if ( !cpIsSubtable(e) ) {
+            goto AddrComp;
+        }
+        if ( l == ml ) {
+            e = cpLoad(cpSubtablePtr(pc, e)[1]);
+            break;
+        }
+
+        /*
+         * 1. Go to the next subtable (trie node)
+         * 2. Check the subtable default route. Exit if it exists.
+         */
+        def = cpLoad(cpSubtablePtr(pc, e)[1]);
+        if ( def && (cpRoutePtr(pc, def)->plen == plen) ) {
+            e = def;
+            goto AddrComp;
+        }
+        pst = cpSubtablePtr(pc, e);
+    }
+
+AddrComp:
+    while ( index > 0 ) {
+        if ( !e ) {
+            break;              /* no matching route */
+        }
+        r = cpRoutePtr(pc, e);
+        if ( (r->plen == plen) && cmpAddr(pDest, r->dest, r->plen) ) {
+            return r;
+        }
+        index >>= 1;
+        e = cpLoad(pst[index]);
+    }
+
+Default:
+    e = cpLoad(pc->root[1]);
+    return (e) ? cpRoutePtr(pc, e) : NULL; /* default route */
+}
+
+
+/**
+ * @name   rtArtCpInsertRoute
+ *
+ * @brief  API function.
+ *         (registered as `pt->insert()' in `rtArtCpInit()').
+ *         Adds a route represented by `pEnt' to the routing table `pt'
+ *
+ * @param[in] pt   Pointer to the routing table
+ * @param[in] pEnt Pointer to the route added to `pt'.
+ *                 `pEnt' must NOT point to a local variable.
+ *
+ * @retval routeEnt* `pEnt' is successfully inserted.
+ *         pEnt      There is an existing route that has the same
+ *                   IP prefix (address and prefix length).
+ *                   `pEnt' must be freed in this case.
+ */
+static routeEnt*
+rtArtCpInsertRoute (rtTable* pt, routeEnt* pEnt)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register int l, len;
+    register u32* pst;
+    register u32  e;
+    u32*  pst2;
+    u32*  pe;
+    u8*   pDest;
+    int   index;
+    u32   offset, i;
+    bool  flag;
+
+
+    assert((pt != NULL) && (pEnt != NULL));
+
+    /*
+     * Handle default route.
+     */
+    if ( pEnt->plen == 0 ) {
+        if ( pc->root[1] ) return cpRoutePtr(pc, pc->root[1]);
+        i = cpNewRouteIndex(pt, pEnt);
+        if ( i == 0 ) {
+            panic(("rtArtCpInsertRoute: no route index"));
+        }
+        cpStore(pc->root[1], cpMakeRoute(i));
+        rtArtCountRoute(pt, pEnt, 1);
+        return pEnt;
+    }
+
+    index  = baseIndex(pt, pEnt->dest, pEnt->plen);
+    len    = pt->psi[0].sl;     /* accumulated address bit length */
+    pst    = pc->root;          /* ptr to subtable */
+    l      = 0;                 /* level */
+    offset = 0;
+    flag   = true;
+    pDest  = pEnt->dest;        /* ptr to dest. IP address */
+    for (;;) {
+        if ( pEnt->plen <= len ) {
+            pEnt->level = l;
+            return cpInsert(pt, pst, index, 1 << pt->psi[l].sl, flag, pEnt);
+        }
+
+        pst2 = pst;             /* save &pst[0] */
+        pe   = pst + fringeIndex(&pDest, &offset, pt->psi[l].sl);
+        e    = *pe;
+        if ( cpIsSubtable(e) ) {
+            pst = cpSubtablePtr(pc, e);
+        } else {
+            pst = cpNewSubtable(pt, l+1, e);
+            if ( pst == NULL ) {
+                /* XXX do something later rather than panicing */
+                panic(("rtArtCpInsertRoute: no memory"));
+            }
+            cpStore(*pe, cpMakeSubtable(pc, pst));
+            pst2[0]++;
+        }
+
+        ++l;
+        if ( l >= (pt->nLevels - 1) ) {
+            flag = false;       /* last level */
+            if ( l >= pt->nLevels ) {
+                panic(("rtArtCpInsertRoute: shouldn't happen (l = %d)", l));
+            }
+        }
+        len += pt->psi[l].sl;
+    }
+    panic(("rtArtCpInsertRoute: should not happen"));
+}
+
+
+/**
+ * @name   rtArtCpDeleteRoute
+ *
+ * @brief  API function.
+ *         (registered as `pt->delete()' in `rtArtCpInit()').
+ *         Deletes a route represented by an IP prefix
+ *         (address and its prefix length) from the routing table.
+ *         The matched route entry is freed in this function.
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] pDest Pointer to the IP address to be deleted from `pt'
+ * @param[in] plen  Prefix length associated with `pDest'
+ *
+ * @retval ture  If the matching route is deleted from `pt'.
+ *               The route entry is freed in this function.
+ * @retval false If there is no matching route in `pt'.
+ */
+static bool
+rtArtCpDeleteRoute (rtTable* pt, u8* pDest, int plen)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register int  l, len;
+    register u32* pst;
+    register u32  e;
+    u8*   pDest2;
+    bool  flag;
+    int   index;
+    u32   offset;
+
+
+    assert(pt && pDest);
+
+    /*
+     * Handle default route
+     */
+    if ( plen == 0 ) {
+        e = pc->root[1];
+        if ( !e ) return false;
+        cpStore(pc->root[1], 0);
+        rtArtCountRoute(pt, cpRoutePtr(pc, e), -1);
+        cpFreeRoute(pt, e);
+        return true;
+    }
+
+    index  = baseIndex(pt, pDest, plen);
+    len    = pt->psi[0].sl;     /* accumulated address bit length */
+    pst    = pc->root;          /* ptr to subtable */
+    l      = 0;                 /* level */
+    flag   = true;
+    offset = 0;
+    pDest2 = pDest;             /* save dest address ptr */
+
+    for (;;) {
+        if ( plen <= len ) {
+            e = cpDelete(pt, pst, index, 1 << pt->psi[l].sl,
+                         flag, pDest2, plen, l);
+            if ( !e ) return false;
+            cpFreeRoute(pt, e);
+            return true;
+        }
+
+        pc->ppTbl[l] = pst;     /* save sbutable pointer */
+        pst += fringeIndex(&pDest, &offset, pt->psi[l].sl);
+        pc->ppEnt[l] = pst;     /* save entry pointer */
+        e = *pst;
+        if ( !cpIsSubtable(e) ) {
+            return false;       /* no route */
+        }
+        pst = cpSubtablePtr(pc, e);
+
+        ++l;
+        if ( l >= (pt->nLevels - 1) ) {
+            flag = false;       /* last level */
+            if ( l >= pt->nLevels ) {
+                panic(("rtArtCpDeleteRoute: shouldn't happen (l = %d)", l));
+            }
+        }
+        len += pt->psi[l].sl;
+    }
+}
+
+
+/**
+ * @name   rtArtCpReplaceRoute
+ *
+ * @brief  API function.
+ *         (registered as `pt->replace()' in `rtArtCpInit()').
+ *         Same as `rtArtReplaceRoute()' for compact tries. The table
+ *         entries refer to the route through its route index, so
+ *         only the route index table is updated and nothing is
+ *         allotted.
+ *
+ * @param[in] pt   Pointer to the routing table
+ * @param[in] pEnt Pointer to the new route.
+ *                 `pEnt' must NOT point to a local variable.
+ *
+ * @retval routeEnt* The replaced route. It must be freed by the
+ *                   caller with rtArtFreeRoute().
+ * @retval NULL      There is no route of the IP prefix of `pEnt'.
+ */
+static routeEnt*
+rtArtCpReplaceRoute (rtTable* pt, routeEnt* pEnt)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register int  l, len;
+    register u32* pst;
+    register u32  e;
+    routeEnt* r;
+    u8*   pDest;
+    bool  flag;
+    int   index;
+    u32   offset;
+
+
+    assert((pt != NULL) && (pEnt != NULL));
+
+    if ( pEnt->plen == 0 ) {
+        e = pc->root[1];
+    } else {
+        index  = baseIndex(pt, pEnt->dest, pEnt->plen);
+        len    = pt->psi[0].sl; /* accumulated address bit length */
+        pst    = pc->root;      /* ptr to subtable */
+        l      = 0;             /* level */
+        flag   = true;
+        offset = 0;
+        pDest  = pEnt->dest;    /* ptr to dest. IP address */
+        while ( pEnt->plen > len ) {
+            e = pst[fringeIndex(&pDest, &offset, pt->psi[l].sl)];
+            if ( !cpIsSubtable(e) ) {
+                return NULL;    /* no route */
+            }
+            pst = cpSubtablePtr(pc, e);
+
+            ++l;
+            if ( l >= (pt->nLevels - 1) ) {
+                flag = false;   /* last level */
+                if ( l >= pt->nLevels ) {
+                    panic(("rtArtCpReplaceRoute: shouldn't happen (l = %d)",
+                           l));
+                }
+            }
+            len += pt->psi[l].sl;
+        }
+        e = pst[index];
+        if ( flag && cpIsSubtable(e) ) {
+            e = cpSubtablePtr(pc, e)[1];
+        }
+    }
+    if ( !e ) {
+        return NULL;
+    }
+    r = cpRoutePtr(pc, e);
+    if ( (r->plen != pEnt->plen) ||
+         (cmpAddr(r->dest, pEnt->dest, pEnt->plen) == false) ) {
+        return NULL;
+    }
+    pEnt->level = r->level;
+    __atomic_store_n(&cpRoutePtr(pc, e), pEnt, __ATOMIC_RELEASE);
+    rtArtBumpGen(pt);
+    return r;
+}
+
+
+/**
+ * @name  cpFlushSubtable
+ *
+ * @brief Same as `flushSubtable()' in ipArt.c for 32-bit entries.
+ *        Frees all the routes in subtable `t' and its descendants,
+ *        and the descendants (post-order).
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] t  Pointer to a subtable (trie node)
+ * @param[in] f  Callback function (may be NULL)
+ * @param[in] p2 Second parameter of `f'
+ */
+static void
+cpFlushSubtable (rtTable* pt, u32* t, rtFunc f, void* p2)
+{
+    register rtArtCompact* pc = pt->pCp;
+    register int i;
+    register u32 r;             /* route allotted from the parent */
+    u32  e;
+    u32* pst;
+
+
+    for ( i = (1 << (pt->psi[t[-1]].sl+1)) - 1; i > 1; --i ) {
+        e = t[i];
+        r = ((i >> 1) > 1) ? t[i >> 1] : 0;
+        if ( t == pc->root ) {
+            cpStore(t[i], 0);
+        }
+        if ( cpIsSubtable(e) ) {
+            pst = cpSubtablePtr(pc, e);
+            if ( pst[1] && (pst[1] != r) ) {
+                if ( f ) {
+                    (*f)(cpRoutePtr(pc, pst[1]), p2);
+                }
+                rtArtCountRoute(pt, cpRoutePtr(pc, pst[1]), -1);
+                cpFreeRoute(pt, pst[1]);
+            }
+            cpFlushSubtable(pt, pst, f, p2);
+            cpFreeSubtable(pt, pst);
+        } else if ( e && (e != r) ) {
+            if ( f ) {
+                (*f)(cpRoutePtr(pc, e), p2);
+            }
+            rtArtCountRoute(pt, cpRoutePtr(pc, e), -1);
+            cpFreeRoute(pt, e);
+        }
+    }
+}
+
+
+/**
+ * @name  rtArtCpFlushRoutesFunc
+ *
+ * @brief API Function.
+ *        (registered as `pt->flushRoutes()' in `rtArtCpInit()').
+ *        Same as `rtArtFlushRoutesFunc()' for compact tries.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] f  Callback function called with each route before
+ *               it is freed (may be NULL)
+ * @param[in] p2 Second parameter of `f'
+ *
+ * @retval true Always
+ */
+static bool
+rtArtCpFlushRoutesFunc (rtTable* pt, rtFunc f, void* p2)
+{
+    register rtArtCompact* pc = pt->pCp;
+    u32 e;
+
+    e = pc->root[1];            /* default route */
+    cpStore(pc->root[1], 0);
+    if ( e ) {
+        if ( f ) {
+            (*f)(cpRoutePtr(pc, e), p2);
+        }
+        rtArtCountRoute(pt, cpRoutePtr(pc, e), -1);
+        cpFreeRoute(pt, e);
+    }
+    cpFlushSubtable(pt, pc->root, f, p2);
+    pc->root[0] = 0;
+    rtArtBumpGen(pt);
+    assert(pt->nRoutes == 0);
+    return true;
+}
+
+
+/**
+ * @name  rtArtCpDestroy
+ *
+ * @brief API Function.
+ *        (registered as `pt->deleteTable()').
+ *        Frees all the route entries and the routing table itself.
+ *        The subtables are freed at once with the subtable space.
+ *
+ * @param[in,out] p Pointer to the pointer to `rtTable'. `*p' is
+ *                  set to NULL at the end of this function.
+ */
+static void
+rtArtCpDestroy (rtTable** p)
+{
+    rtTable*      pt = *p;
+    rtArtCompact* pc = pt->pCp;
+    u32 i;
+
+
+    rtArtEpochFree(pt);         /* frees the retired routes */
+    if ( !pt->pRouteSlab ) {
+        for ( i = 1; i < pc->nextRoute; ++i ) {
+            if ( !cpIsFreeRoute(pc->ppRoute[i]) ) {
+                rtArtRouteFree(pt, pc->ppRoute[i]);
+            }
+        }
+    }
+    rtArtAllocDestroy(pt);
+    munmap(pc->ppRoute, pc->nRouteSlots * sizeof(routeEnt*));
+    munmap(pc->base, pc->nWords * sizeof(u32));
+    free(pc->ppTbl);
+    free(pc->ppEnt);
+    free(pc->pFree);
+    free(pc);
+    free(pt->pLvStats);
+    free(pt->psi);
+    free(pt);
+    *p = NULL;
+}
+
+
+/**
+ * @name  rtArtCpNumSubtables
+ *
+ * @brief API Function.
+ *        Returns the number of subtables (trie nodes) except the
+ *        root of a compactTrie routing table.
+ *
+ * @param[in] pt Pointer to the routing table
+ *
+ * @retval u32 The number of subtables
+ */
+u32
+rtArtCpNumSubtables (rtTable* pt)
+{
+    return pt->pCp->nSubtables;
+}
+
+
+/**
+ * @name  rtArtCpInit
+ *
+ * @brief Initializes a routing table with 32-bit table entries
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] po Pointer to the options (may be NULL)
+ *
+ * @retval rtTable* Pointer to the initialized routing table
+ * @retval NULL     Failed to initialize `pt' (which is freed
+ *                  in this function.)
+ */
+rtTable*
+rtArtCpInit (rtTable* pt, rtArtOpts* po)
+{
+    rtArtCompact* pc;
+    void* p;
+
+
+    assert(pt);
+    assert(pt->psi);
+
+    pc = calloc(1, sizeof(rtArtCompact));
+    if ( !pc ) {
+        goto slFree;
+    }
+    pt->pCp = pc;
+    pc->pFree = calloc(pt->nLevels, sizeof(u32));
+    pc->ppEnt = calloc(pt->nLevels, sizeof(u32*));
+    pc->ppTbl = calloc(pt->nLevels, sizeof(u32*));
+    if ( !pc->pFree || !pc->ppEnt || !pc->ppTbl ) {
+        goto pcFree;
+    }
+
+    p = mmap(NULL, CP_SUBTABLE_SPACE, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if ( p == MAP_FAILED ) {
+        goto pcFree;
+    }
+    pc->base   = p;
+    pc->nWords = CP_SUBTABLE_SPACE / sizeof(u32);
+    pc->top    = 1;             /* offset 0 means no subtable */
+#ifdef MADV_HUGEPAGE
+    if ( po && (po->flags & artOptHugePages) ) {
+        madvise(p, CP_SUBTABLE_SPACE, MADV_HUGEPAGE);
+    }
+#endif /* MADV_HUGEPAGE */
+
+    p = mmap(NULL, CP_ROUTE_SPACE, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if ( p == MAP_FAILED ) {
+        goto baseFree;
+    }
+    pc->ppRoute     = p;
+    pc->nRouteSlots = CP_ROUTE_SPACE / sizeof(routeEnt*);
+    pc->nextRoute   = 1;        /* index 0 means no route */
+
+    pc->root = cpNewSubtable(pt, 0, 0);
+    if ( !pc->root ) {
+        goto routeFree;
+    }
+
+    pt->insert         = rtArtCpInsertRoute;
+    pt->delete         = rtArtCpDeleteRoute;
+    pt->replace        = rtArtCpReplaceRoute;
+    pt->deleteTable    = rtArtCpDestroy;
+    pt->flush          = rtArtFlushRoutes;
+    pt->findMatch      = rtArtCpFindMatch;
+    pt->findMatch4     = rtArtCpFindMatch4;
+    pt->findMatch6     = rtArtCpFindMatch6;
+    pt->findExactMatch = rtArtCpFindExactMatch;
+    pt->findMatchBatch = rtArtCpFindMatchBatch;
+    pt->bulkLoad       = rtArtInsertRoutes;
+    pt->flushRoutes    = rtArtCpFlushRoutesFunc;
+
+    return pt;
+
+routeFree:
+    munmap(pc->ppRoute, CP_ROUTE_SPACE);
+baseFree:
+    munmap(pc->base, CP_SUBTABLE_SPACE);
+pcFree:
+    free(pc->ppTbl);
+    free(pc->ppEnt);
+    free(pc->pFree);
+    free(pc);
+slFree:
+    rtArtAllocDestroy(pt);
+    free(pt->pLvStats);
+    free(pt->psi);
+    free(pt);
+    return NULL;
+}
@@ -0,0 +1,346 @@
+/** @file ipArtEpoch.c
+    @brif Epoch-based memory reclamation for lock-free readers
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   A routing table created with `artOptConcurrent' is updated by
+   a single writer thread and looked up by any number of reader
+   threads without locks.
+
+   The writer never modifies a table entry that a reader may be
+   reading in a way the reader can observe halfway: every change is
+   a single pointer-sized store, and a new subtable is fully built
+   before it is linked. The only problem left is when to free the
+   subtables and routes the writer unlinked since readers may still
+   be looking at them.
+
+   The table has a global epoch counter. A reader copies it to its
+   own slot in rtArtReadLock() and clears the slot in
+   rtArtReadUnlock(). The writer stamps unlinked memory with the
+   current epoch in rtArtRetire() then advances the epoch. Memory
+   stamped with epoch `e' may be freed once no reader has a nonzero
+   epoch <= `e' because such readers entered after the memory had
+   been unlinked.
+
+   Readers never wait. The writer waits only in rtArtSynchronize().
+
+   Retired memory is freed with the table that retired it, so the
+   replicas that share routes (see ipArtReplica.c) can share one
+   epoch: a shared route is then freed after the readers of all the
+   replicas leave.
+*/
+
+
+#include <sched.h>
+
+#include "ipArt.h"
+
+
+/*
+ * Free the retired memory without waiting when this many items
+ * are retired.
+ */
+enum {
+    RETIRE_THRESHOLD = 1024,
+};
+
+typedef struct retiredMem retiredMem;
+struct retiredMem {
+    void*         p;            /* memory to be freed */
+    rtArtFreeFunc f;            /* function to free `p' */
+    rtTable*      pt;           /* table that retired `p' */
+    u64           epoch;        /* epoch when `p' was retired */
+};
+
+struct rtArtEpoch {
+    u64          epoch;         /* global epoch (starts with 1) */
+    rtArtReader* readers;       /* list of the readers */
+    retiredMem*  pRet;          /* array of retired memory */
+    int          nRet;          /* # of items in `pRet' */
+    int          maxRet;        /* size of `pRet' */
+};
+
+
+/**
+ * @name  rtArtEpochNew
+ *
+ * @brief Allocates the epoch information of a routing table
+ *
+ * @retval rtArtEpoch* Pointer to the allocated epoch information
+ * @retval NULL        Failed to allocate memory
+ */
+rtArtEpoch*
+rtArtEpochNew (void)
+{
+    rtArtEpoch* pe;
+
+    pe = calloc(1, sizeof(rtArtEpoch));
+    if ( pe == NULL ) return NULL;
+
+    pe->epoch = 1;
+    return pe;
+}
+
+
+/**
+ * @name  rtArtEpochFree
+ *
+ * @brief Frees all the retired memory, the readers, and the epoch
+ *        information of a routing table. There must be no reader
+ *        in its critical section.
+ *
+ * @param[in] pt Pointer to the routing table
+ */
+void
+rtArtEpochFree (rtTable* pt)
+{
+    rtArtEpoch*  pe = pt->pEpoch;
+    rtArtReader* pr;
+    int i;
+
+
+    if ( pe == NULL ) return;
+
+    for ( i = 0; i < pe->nRet; ++i ) {
+        pe->pRet[i].f(pe->pRet[i].pt, pe->pRet[i].p);
+    }
+    free(pe->pRet);
+    while ( (pr = pe->readers) ) {
+        pe->readers = pr->next;
+        free(pr);
+    }
+    free(pe);
+    pt->pEpoch = NULL;
+}
+
+
+/**
+ * @name  rtArtRegisterReader
+ *
+ * @brief API function.
+ *        Registers a lock-free reader of a routing table created
+ *        with artOptConcurrent. Each reader thread must have its own
+ *        reader. May be called by any thread at any time.
+ *
+ * @param[in] pt Pointer to the routing table
+ *
+ * @retval rtArtReader* Pointer to the registered reader
+ * @retval NULL         `pt' is not concurrent or no memory
+ */
+rtArtReader*
+rtArtRegisterReader (rtTable* pt)
+{
+    rtArtEpoch*  pe = pt->pEpoch;
+    rtArtReader* pr;
+    u32 unused;
+
+
+    if ( pe == NULL ) return NULL;
+
+    /*
+     * Reuse an unregistered reader if any
+     */
+    for ( pr = __atomic_load_n(&pe->readers, __ATOMIC_ACQUIRE);
+          pr; pr = pr->next ) {
+        unused = false;
+        if ( __atomic_compare_exchange_n(&pr->inUse, &unused, true, false,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ) {
+            return pr;
+        }
+    }
+
+    if ( posix_memalign((void**)&pr, sizeof(rtArtReader),
+                        sizeof(rtArtReader)) != 0 ) {
+        return NULL;
+    }
+    memset(pr, 0, sizeof(rtArtReader));
+    pr->pEpoch = &pe->epoch;
+    pr->inUse  = true;
+    pr->next   = __atomic_load_n(&pe->readers, __ATOMIC_RELAXED);
+    while ( !__atomic_compare_exchange_n(&pe->readers, &pr->next, pr, false,
+                                         __ATOMIC_RELEASE,
+                                         __ATOMIC_RELAXED) ) {
+        ;
+    }
+
+    return pr;
+}
+
+
+/**
+ * @name  rtArtUnregisterReader
+ *
+ * @brief API function.
+ *        Unregisters a reader. The reader must not be in its
+ *        critical section and must not be used after this call.
+ *        The memory is reused by rtArtRegisterReader() and freed
+ *        when the routing table is destroyed.
+ *
+ * @param[in] pr Pointer to the reader
+ */
+void
+rtArtUnregisterReader (rtArtReader* pr)
+{
+    if ( pr == NULL ) return;
+
+    __atomic_store_n(&pr->epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&pr->inUse, false, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @name  minReaderEpoch
+ *
+ * @brief Finds the oldest epoch of the readers in their critical
+ *        section.
+ *
+ * @param[in] pe Pointer to the epoch information
+ *
+ * @retval u64 The smallest nonzero reader epoch. Larger than any
+ *             stamp of the retired memory if there is no such reader.
+ */
+static u64
+minReaderEpoch (rtArtEpoch* pe)
+{
+    rtArtReader* pr;
+    u64 min, e;
+
+
+    min = __atomic_load_n(&pe->epoch, __ATOMIC_SEQ_CST);
+    for ( pr = __atomic_load_n(&pe->readers, __ATOMIC_ACQUIRE);
+          pr; pr = pr->next ) {
+        e = __atomic_load_n(&pr->epoch, __ATOMIC_SEQ_CST);
+        if ( e && (e < min) ) {
+            min = e;
+        }
+    }
+    return min;
+}
+
+
+/**
+ * @name  rtArtReclaim
+ *
+ * @brief API function. (writer only)
+ *        Frees the retired memory that no reader can see.
+ *        Never blocks.
+ *
+ * @param[in] pt Pointer to the routing table
+ */
+void
+rtArtReclaim (rtTable* pt)
+{
+    rtArtEpoch* pe = pt->pEpoch;
+    u64 min;
+    int i, n;
+
+
+    if ( (pe == NULL) || (pe->nRet == 0) ) return;
+
+    min = minReaderEpoch(pe);
+    for ( i = n = 0; i < pe->nRet; ++i ) {
+        if ( pe->pRet[i].epoch < min ) {
+            pe->pRet[i].f(pe->pRet[i].pt, pe->pRet[i].p);
+        } else {
+            pe->pRet[n++] = pe->pRet[i];
+        }
+    }
+    pe->nRet = n;
+}
+
+
+/**
+ * @name  rtArtSynchronize
+ *
+ * @brief API function. (writer only)
+ *        Waits until all the readers in their critical section
+ *        leave, then frees all the retired memory.
+ *
+ * @param[in] pt Pointer to the routing table
+ */
+void
+rtArtSynchronize (rtTable* pt)
+{
+    rtArtEpoch*  pe = pt->pEpoch;
+    rtArtReader* pr;
+    u64 e, re;
+
+
+    if ( pe == NULL ) return;
+
+    e = __atomic_add_fetch(&pe->epoch, 1, __ATOMIC_SEQ_CST);
+    for ( pr = __atomic_load_n(&pe->readers, __ATOMIC_ACQUIRE);
+          pr; pr = pr->next ) {
+        for (;;) {
+            re = __atomic_load_n(&pr->epoch, __ATOMIC_SEQ_CST);
+            if ( (re == 0) || (re >= e) ) break;
+            sched_yield();
+        }
+    }
+    rtArtReclaim(pt);
+}
+
+
+/**
+ * @name  rtArtRetire
+ *
+ * @brief Frees memory unlinked from the routing table when no
+ *        reader can see it. The writer must unlink `p' before
+ *        calling this function.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] p  Pointer to the memory to be freed
+ * @param[in] f  Function to free `p'
+ */
+void
+rtArtRetire (rtTable* pt, void* p, rtArtFreeFunc f)
+{
+    rtArtEpoch* pe = pt->pEpoch;
+    retiredMem* pRet;
+    int n;
+
+
+    assert(pe);
+
+    rtArtBumpGen(pt);           /* `p' is unlinked */
+    if ( pe->nRet >= pe->maxRet ) {
+        rtArtReclaim(pt);
+    }
+    if ( pe->nRet >= pe->maxRet ) {
+        n = (pe->maxRet) ? pe->maxRet * 2 : RETIRE_THRESHOLD;
+        pRet = realloc(pe->pRet, n * sizeof(retiredMem));
+        if ( pRet == NULL ) {
+            /*
+             * No memory to defer. Wait for the readers instead.
+             */
+            rtArtSynchronize(pt);
+            f(pt, p);
+            return;
+        }
+        pe->pRet   = pRet;
+        pe->maxRet = n;
+    }
+
+    pRet = &pe->pRet[pe->nRet++];
+    pRet->p     = p;
+    pRet->f     = f;
+    pRet->pt    = pt;
+    pRet->epoch = __atomic_fetch_add(&pe->epoch, 1, __ATOMIC_SEQ_CST);
+}
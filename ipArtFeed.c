@@ -0,0 +1,899 @@
+/** @file ipArtFeed.c
+    @brif Route feed ingest from MRT dumps and BGP UPDATE streams
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   A feed is a file (mmap()ed) or a memory buffer of MRT records
+   (RFC 6396). rtArtFeedNext() decodes the prefixes in place into
+   fixed-size records (rtArtFeedRec) without any string:
+     - TABLE_DUMP_V2 RIB_IPV4_UNICAST and RIB_IPV6_UNICAST (and
+       their ADD-PATH versions, RFC 8050): one announcement per
+       record with the path attributes of its first RIB entry.
+     - BGP4MP(_ET) MESSAGE(_AS4)(_LOCAL)(_ADDPATH) records of BGP
+       UPDATE messages: the withdrawn routes, MP_UNREACH_NLRI,
+       MP_REACH_NLRI (SAFI unicast) and the NLRI, in this order.
+   The other records and the prefixes of the other address family
+   are skipped. A record running off its end is dropped from there.
+   The path attributes are not copied: `pAttr' points into the feed
+   until it is closed.
+
+   rtArtFeedLoad() converts the records into routes taken from the
+   route allocator of the table (the route arena with
+   artOptRouteArena) and applies them in blocks of FEED_BLOCK
+   records by rtArtApplyUpdates(), or collects the additions and
+   bulk loads them at the end (artFeedBulk). With artFeedThreaded a
+   parser thread fills FEED_QUEUE blocks ahead of the writer, so
+   the load time is that of the trie updates when parsing is
+   faster.
+*/
+
+
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ipArt.h"
+
+
+enum {
+    MRT_HDR_LEN       = 12,     /* timestamp, type, subtype, length */
+    MRT_TABLE_DUMP_V2 = 13,
+    MRT_BGP4MP        = 16,
+    MRT_BGP4MP_ET     = 17,     /* BGP4MP with microseconds */
+    BGP_HDR_LEN       = 19,     /* marker, length, type */
+    BGP_UPDATE        = 2,
+    BGP_MP_REACH      = 14,     /* MP_REACH_NLRI attribute */
+    BGP_MP_UNREACH    = 15,     /* MP_UNREACH_NLRI attribute */
+    BGP_ATTR_EXTLEN   = 0x10,   /* extended length attribute flag */
+    BGP_SAFI_UNICAST  = 1,
+    FEED_SECTS        = 4,      /* prefix lists of an UPDATE */
+    FEED_BLOCK        = 4096,   /* records applied at once */
+    FEED_QUEUE        = 4,      /* blocks parsed ahead */
+};
+
+/*
+ * A list of prefixes in an UPDATE message
+ */
+typedef struct feedSect feedSect;
+struct feedSect {
+    const u8* p;                /* next prefix */
+    const u8* pEnd;             /* end of the list */
+    u8        op;               /* artUpdAdd or artUpdWithdraw */
+    u8        alen;             /* address length in bits */
+    bool      addPath;          /* a path identifier precedes a prefix */
+};
+
+struct rtArtFeed {
+    const u8* pBuf;             /* the feed */
+    size_t    size;             /* bytes of `pBuf' */
+    bool      mapped;           /* `pBuf' is mmap()ed */
+    const u8* pCur;             /* next MRT record */
+    const u8* pAttr;            /* path attributes of the UPDATE */
+    u32       attrLen;          /* bytes of `pAttr' */
+    int       nSect;            /* prefix lists of the UPDATE */
+    int       iSect;            /* current one */
+    feedSect  sect[FEED_SECTS];
+    u64       nRecords;         /* MRT records read */
+    u64       nSkipped;         /* records and prefixes skipped */
+};
+
+/*
+ * Blocks of records passed from the parser thread to the writer
+ */
+typedef struct feedQueue feedQueue;
+struct feedQueue {
+    pthread_mutex_t mtx;
+    pthread_cond_t  cond;
+    rtArtFeed*      pf;
+    int             alen;       /* address length of the table */
+    int             nFull;      /* blocks parsed and not applied */
+    int             nRec[FEED_QUEUE];   /* records of a block. 0: end */
+    rtArtFeedRec*   pBlk[FEED_QUEUE];
+    double          tParse;     /* seconds in rtArtFeedNext() */
+};
+
+/*
+ * The writer side of rtArtFeedLoad()
+ */
+typedef struct feedApply feedApply;
+struct feedApply {
+    rtTable*        pt;
+    int             flags;      /* artFeed* */
+    rtArtFeedFunc   f;          /* called with each new route */
+    void*           p2;         /* second parameter of `f' */
+    rtArtUpdateOp*  pOps;       /* FEED_BLOCK operations */
+    routeEnt**      pRoutes;    /* artFeedBulk: the additions */
+    int             nRoutes;
+    int             maxRoutes;
+    rtArtFeedStats* ps;
+};
+
+
+static inline u32
+get16 (const u8* p)
+{
+    return ((u32)p[0] << 8) | p[1];
+}
+
+
+static inline u32
+get32 (const u8* p)
+{
+    return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+}
+
+
+static double
+feedElapsed (struct timespec* ps)
+{
+    struct timespec te;
+
+    clock_gettime(CLOCK_MONOTONIC, &te);
+    return (te.tv_sec - ps->tv_sec) + (te.tv_nsec - ps->tv_nsec) * 1e-9;
+}
+
+
+/**
+ * @name   feedAddr
+ *
+ * @brief  Copies the `plen' bits of prefix `p' to `pRec' and clears
+ *         the rest of the address.
+ */
+static inline void
+feedAddr (rtArtFeedRec* pRec, const u8* p, int plen)
+{
+    int nb = (plen + 7) >> 3;
+
+    memset(pRec->dest, 0, sizeof(pRec->dest));
+    memcpy(pRec->dest, p, nb);
+    if ( plen & 7 ) {
+        pRec->dest[nb - 1] &= 0xff << (8 - (plen & 7));
+    }
+    pRec->plen = plen;
+}
+
+
+/**
+ * @name   feedAddSect
+ *
+ * @brief  Adds a list of prefixes of the current UPDATE.
+ */
+static void
+feedAddSect (rtArtFeed* pf, const u8* p, const u8* pEnd, int op, int alen,
+             bool addPath)
+{
+    feedSect* ps;
+
+    if ( (p >= pEnd) || (pf->nSect >= FEED_SECTS) ) {
+        return;
+    }
+    ps = &pf->sect[pf->nSect++];
+    ps->p       = p;
+    ps->pEnd    = pEnd;
+    ps->op      = op;
+    ps->alen    = alen;
+    ps->addPath = addPath;
+}
+
+
+/**
+ * @name   feedPrefix
+ *
+ * @brief  Decodes the next prefix of list `ps' into `pRec'.
+ *
+ * @retval 1  `pRec' has the prefix
+ * @retval 0  The prefix is of the other address family
+ * @retval -1 The end of the list, or the rest of it is malformed
+ */
+static int
+feedPrefix (rtArtFeed* pf, feedSect* ps, int alen, rtArtFeedRec* pRec)
+{
+    const u8* p = ps->p;
+    int plen, nb;
+
+
+    if ( ps->addPath ) {
+        p += 4;                 /* path identifier */
+    }
+    if ( p >= ps->pEnd ) {
+        return -1;
+    }
+    plen = *p++;
+    nb   = (plen + 7) >> 3;
+    if ( (plen > ps->alen) || (ps->pEnd - p < nb) ) {
+        pf->nSkipped++;
+        return -1;
+    }
+    ps->p = p + nb;
+    if ( ps->alen != alen ) {
+        pf->nSkipped++;
+        return 0;
+    }
+
+    feedAddr(pRec, p, plen);
+    pRec->op      = ps->op;
+    pRec->peer    = 0;
+    pRec->pAttr   = (ps->op == artUpdAdd) ? pf->pAttr : NULL;
+    pRec->attrLen = (ps->op == artUpdAdd) ? pf->attrLen : 0;
+    return 1;
+}
+
+
+/**
+ * @name   feedRib
+ *
+ * @brief  Decodes a TABLE_DUMP_V2 RIB record [p, pEnd) of subtype
+ *         `sub' into `pRec'.
+ *
+ * @retval 1 `pRec' has the prefix
+ * @retval 0 Skipped
+ */
+static int
+feedRib (rtArtFeed* pf, int sub, const u8* p, const u8* pEnd, int alen,
+         rtArtFeedRec* pRec)
+{
+    const u8* q;
+    u32  nEnts, len;
+    int  ra, hl, plen, nb;
+
+
+    switch ( sub ) {
+    case 2:  ra = 32;  hl = 6;  break;  /* RIB_IPV4_UNICAST */
+    case 4:  ra = 128; hl = 6;  break;  /* RIB_IPV6_UNICAST */
+    case 8:  ra = 32;  hl = 10; break;  /* RIB_IPV4_UNICAST_ADDPATH */
+    case 10: ra = 128; hl = 10; break;  /* RIB_IPV6_UNICAST_ADDPATH */
+    default:
+        goto skip;
+    }
+    if ( (ra != alen) || (pEnd - p < 5) ) {
+        goto skip;
+    }
+    plen = p[4];                /* after the sequence number */
+    p   += 5;
+    nb   = (plen + 7) >> 3;
+    if ( (plen > ra) || (pEnd - p < nb + 2) ) {
+        goto skip;
+    }
+    feedAddr(pRec, p, plen);
+    pRec->op      = artUpdAdd;
+    pRec->peer    = 0;
+    pRec->pAttr   = NULL;
+    pRec->attrLen = 0;
+
+    /*
+     * The first RIB entry: peer index, originated time, (path
+     * identifier,) attribute length and the attributes.
+     */
+    q     = p + nb;
+    nEnts = get16(q);
+    q    += 2;
+    if ( nEnts && (pEnd - q >= hl + 2) ) {
+        pRec->peer = get16(q);
+        len = get16(q + hl);
+        if ( pEnd - (q + hl + 2) >= len ) {
+            pRec->pAttr   = (len) ? q + hl + 2 : NULL;
+            pRec->attrLen = len;
+        }
+    }
+    return 1;
+
+skip:
+    pf->nSkipped++;
+    return 0;
+}
+
+
+/**
+ * @name   feedAttrs
+ *
+ * @brief  Adds the prefix lists of the MP_UNREACH_NLRI and
+ *         MP_REACH_NLRI attributes in [p, pEnd).
+ */
+static void
+feedAttrs (rtArtFeed* pf, const u8* p, const u8* pEnd, bool addPath)
+{
+    const u8* pUnreach = NULL;
+    const u8* pUnreachEnd = NULL;
+    const u8* pReach = NULL;
+    const u8* pReachEnd = NULL;
+    const u8* q;
+    u32 len;
+    int uAlen = 0, rAlen = 0;
+
+
+    while ( pEnd - p >= 3 ) {
+        if ( p[0] & BGP_ATTR_EXTLEN ) {
+            if ( pEnd - p < 4 ) break;
+            len = get16(p + 2);
+            q   = p + 4;
+        } else {
+            len = p[2];
+            q   = p + 3;
+        }
+        if ( pEnd - q < len ) {
+            break;
+        }
+        if ( (p[1] == BGP_MP_UNREACH) && (len >= 3) &&
+             (q[2] == BGP_SAFI_UNICAST) ) {
+            uAlen       = (get16(q) == 1) ? 32 : (get16(q) == 2) ? 128 : 0;
+            pUnreach    = q + 3;
+            pUnreachEnd = q + len;
+        } else if ( (p[1] == BGP_MP_REACH) && (len >= 5) &&
+                    (q[2] == BGP_SAFI_UNICAST) && (5 + q[3] <= len) ) {
+            rAlen     = (get16(q) == 1) ? 32 : (get16(q) == 2) ? 128 : 0;
+            pReach    = q + 5 + q[3];       /* after the next hop */
+            pReachEnd = q + len;
+        }
+        p = q + len;
+    }
+    if ( uAlen ) {
+        feedAddSect(pf, pUnreach, pUnreachEnd, artUpdWithdraw, uAlen, addPath);
+    }
+    if ( rAlen ) {
+        feedAddSect(pf, pReach, pReachEnd, artUpdAdd, rAlen, addPath);
+    }
+}
+
+
+/**
+ * @name   feedBgp4mp
+ *
+ * @brief  Sets up the prefix lists of a BGP4MP record [p, pEnd) of
+ *         subtype `sub' if it has an UPDATE message.
+ */
+static void
+feedBgp4mp (rtArtFeed* pf, int sub, const u8* p, const u8* pEnd)
+{
+    bool addPath;
+    u32  len;
+    int  asLen, ipLen;
+
+
+    switch ( sub ) {
+    case 1:  case 6:  asLen = 2; addPath = false; break;
+    case 4:  case 7:  asLen = 4; addPath = false; break;
+    case 8:  case 10: asLen = 2; addPath = true;  break;
+    case 9:  case 11: asLen = 4; addPath = true;  break;
+    default:
+        goto skip;              /* state changes */
+    }
+
+    /*
+     * Peer AS, local AS, interface index, AFI, peer IP, local IP
+     */
+    if ( pEnd - p < 2 * asLen + 4 ) {
+        goto skip;
+    }
+    len   = get16(p + 2 * asLen + 2);
+    ipLen = (len == 1) ? 4 : (len == 2) ? 16 : 0;
+    p    += 2 * asLen + 4;
+    if ( (ipLen == 0) || (pEnd - p < 2 * ipLen + BGP_HDR_LEN) ) {
+        goto skip;
+    }
+    p  += 2 * ipLen;
+    len = get16(p + 16);
+    if ( (len < BGP_HDR_LEN) || (pEnd - p < len) || (p[18] != BGP_UPDATE) ) {
+        goto skip;
+    }
+    pEnd = p + len;
+    p   += BGP_HDR_LEN;
+
+    /*
+     * Withdrawn routes, path attributes and NLRI
+     */
+    if ( pEnd - p < 2 ) {
+        goto skip;
+    }
+    len = get16(p);
+    p  += 2;
+    if ( pEnd - p < len + 2 ) {
+        goto skip;
+    }
+    feedAddSect(pf, p, p + len, artUpdWithdraw, 32, addPath);
+    p  += len;
+    len = get16(p);
+    p  += 2;
+    if ( pEnd - p < len ) {
+        pf->nSect = 0;
+        goto skip;
+    }
+    pf->pAttr   = (len) ? p : NULL;
+    pf->attrLen = len;
+    feedAttrs(pf, p, p + len, addPath);
+    feedAddSect(pf, p + len, pEnd, artUpdAdd, 32, addPath);
+    return;
+
+skip:
+    pf->nSkipped++;
+}
+
+
+/**
+ * @name   feedRecord
+ *
+ * @brief  Reads the next MRT record. A RIB record is decoded into
+ *         `pRec' and the prefixes of an UPDATE are set up to be
+ *         decoded by feedPrefix().
+ *
+ * @retval 1 `pRec' has a prefix
+ * @retval 0 Otherwise
+ */
+static int
+feedRecord (rtArtFeed* pf, int alen, rtArtFeedRec* pRec)
+{
+    const u8* p    = pf->pCur;
+    const u8* pEnd = pf->pBuf + pf->size;
+    u32 type, sub, len;
+
+
+    type = get16(p + 4);
+    sub  = get16(p + 6);
+    len  = get32(p + 8);
+    p   += MRT_HDR_LEN;
+    if ( (size_t)(pEnd - p) < len ) {
+        pf->pCur = pEnd;        /* truncated */
+        pf->nSkipped++;
+        return 0;
+    }
+    pEnd     = p + len;
+    pf->pCur = pEnd;
+    pf->nRecords++;
+    pf->nSect = pf->iSect = 0;
+
+    switch ( type ) {
+    case MRT_TABLE_DUMP_V2:
+        return feedRib(pf, sub, p, pEnd, alen, pRec);
+    case MRT_BGP4MP_ET:
+        if ( len < 4 ) break;
+        p += 4;                 /* microseconds */
+        /* fall through */
+    case MRT_BGP4MP:
+        feedBgp4mp(pf, sub, p, pEnd);
+        return 0;
+    }
+    pf->nSkipped++;             /* e.g., PEER_INDEX_TABLE */
+    return 0;
+}
+
+
+/**
+ * @name   rtArtFeedOpen
+ *
+ * @brief  API function.
+ *         Opens a file of MRT records. The file is mmap()ed and read
+ *         sequentially.
+ *
+ * @param[in] path Path name of the file
+ *
+ * @retval rtArtFeed* Pointer to the feed
+ * @retval NULL       The file cannot be opened or mapped
+ */
+rtArtFeed*
+rtArtFeedOpen (const char* path)
+{
+    rtArtFeed*  pf;
+    struct stat st;
+    void* p;
+    int   fd;
+
+
+    fd = open(path, O_RDONLY);
+    if ( fd < 0 ) {
+        return NULL;
+    }
+    if ( fstat(fd, &st) < 0 ) {
+        close(fd);
+        return NULL;
+    }
+    p = NULL;
+    if ( st.st_size > 0 ) {
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if ( p == MAP_FAILED ) {
+            close(fd);
+            return NULL;
+        }
+#ifdef MADV_SEQUENTIAL
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+#endif /* MADV_SEQUENTIAL */
+    }
+    close(fd);
+
+    pf = rtArtFeedOpenMem(p, st.st_size);
+    if ( pf == NULL ) {
+        if ( p ) munmap(p, st.st_size);
+        return NULL;
+    }
+    pf->mapped = (p) ? true : false;
+    return pf;
+}
+
+
+/**
+ * @name   rtArtFeedOpenMem
+ *
+ * @brief  API function.
+ *         Opens a buffer of MRT records. The buffer is not copied
+ *         and must be kept until the feed is closed.
+ *
+ * @param[in] p    Pointer to the buffer
+ * @param[in] size Bytes of the buffer
+ *
+ * @retval rtArtFeed* Pointer to the feed
+ * @retval NULL       There was no memory
+ */
+rtArtFeed*
+rtArtFeedOpenMem (const u8* p, size_t size)
+{
+    rtArtFeed* pf;
+
+    pf = calloc(1, sizeof(rtArtFeed));
+    if ( pf == NULL ) {
+        return NULL;
+    }
+    pf->pBuf = p;
+    pf->size = size;
+    pf->pCur = p;
+    return pf;
+}
+
+
+/**
+ * @name   rtArtFeedClose
+ *
+ * @brief  API function.
+ *         Closes a feed. The path attributes of its records are no
+ *         longer valid.
+ */
+void
+rtArtFeedClose (rtArtFeed* pf)
+{
+    if ( pf == NULL ) {
+        return;
+    }
+    if ( pf->mapped ) {
+        munmap((void*)pf->pBuf, pf->size);
+    }
+    free(pf);
+}
+
+
+/**
+ * @name   rtArtFeedNext
+ *
+ * @brief  API function.
+ *         Decodes up to `n' prefixes of address length `alen' from
+ *         the feed in the order of the feed.
+ *
+ * @param[in]  pf   Pointer to the feed
+ * @param[in]  alen Address length in bits (32 or 128)
+ * @param[out] pRec Array of `n' records
+ * @param[in]  n    The number of the records of `pRec'
+ *
+ * @retval int The number of the records decoded. 0: the end of the
+ *             feed
+ */
+int
+rtArtFeedNext (rtArtFeed* pf, int alen, rtArtFeedRec* pRec, int n)
+{
+    const u8* pEnd = pf->pBuf + pf->size;
+    int m, rc;
+
+
+    for ( m = 0; m < n; ) {
+        if ( pf->iSect < pf->nSect ) {
+            rc = feedPrefix(pf, &pf->sect[pf->iSect], alen, &pRec[m]);
+            if ( rc > 0 ) {
+                ++m;
+            } else if ( rc < 0 ) {
+                pf->iSect++;
+            }
+            continue;
+        }
+        if ( pEnd - pf->pCur < MRT_HDR_LEN ) {
+            pf->pCur = pEnd;
+            break;
+        }
+        m += feedRecord(pf, alen, &pRec[m]);
+    }
+    return m;
+}
+
+
+/**
+ * @name   feedParser
+ *
+ * @brief  Parser thread of rtArtFeedLoad(). Fills the blocks of the
+ *         queue in turn until the end of the feed.
+ */
+static void*
+feedParser (void* p)
+{
+    feedQueue* pq = p;
+    struct timespec ts;
+    int i, n;
+
+
+    i = 0;
+    do {
+        pthread_mutex_lock(&pq->mtx);
+        while ( pq->nFull == FEED_QUEUE ) {
+            pthread_cond_wait(&pq->cond, &pq->mtx);
+        }
+        pthread_mutex_unlock(&pq->mtx);
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        n = rtArtFeedNext(pq->pf, pq->alen, pq->pBlk[i], FEED_BLOCK);
+        pq->tParse += feedElapsed(&ts);
+
+        pthread_mutex_lock(&pq->mtx);
+        pq->nRec[i] = n;
+        pq->nFull++;
+        pthread_cond_broadcast(&pq->cond);
+        pthread_mutex_unlock(&pq->mtx);
+        i = (i + 1) % FEED_QUEUE;
+    } while ( n > 0 );
+    return NULL;
+}
+
+
+/**
+ * @name   feedBulkAdd
+ *
+ * @brief  Appends route `r' to the additions of artFeedBulk.
+ *
+ * @retval true  Success
+ * @retval false No memory
+ */
+static bool
+feedBulkAdd (feedApply* pa, routeEnt* r)
+{
+    routeEnt** pr;
+    int n;
+
+    if ( pa->nRoutes == pa->maxRoutes ) {
+        n  = (pa->maxRoutes) ? pa->maxRoutes * 2 : FEED_BLOCK;
+        pr = realloc(pa->pRoutes, n * sizeof(*pr));
+        if ( pr == NULL ) {
+            return false;
+        }
+        pa->pRoutes   = pr;
+        pa->maxRoutes = n;
+    }
+    pa->pRoutes[pa->nRoutes++] = r;
+    return true;
+}
+
+
+/**
+ * @name   feedBlock
+ *
+ * @brief  Applies `n' records to the table. An announcement of a
+ *         prefix that has a route replaces the route.
+ */
+static void
+feedBlock (feedApply* pa, rtArtFeedRec* pRec, int n)
+{
+    register rtTable* pt = pa->pt;
+    rtArtFeedStats* ps = pa->ps;
+    rtArtUpdateOp*  po;
+    routeEnt* r;
+    int i, m;
+
+
+    for ( i = m = 0; i < n; ++i ) {
+        r = NULL;
+        if ( pRec[i].op == artUpdAdd ) {
+            r = rtArtNewRoute(pt);
+            if ( r == NULL ) {
+                ps->nRejected++;
+                continue;
+            }
+            memcpy(r->dest, pRec[i].dest, pt->len);
+            r->plen = pRec[i].plen;
+            if ( pa->f ) {
+                (*pa->f)(r, &pRec[i], pa->p2);
+            }
+        }
+        if ( pa->flags & artFeedBulk ) {
+            if ( r == NULL ) {
+                ps->nRejected++;    /* nothing to withdraw */
+            } else if ( feedBulkAdd(pa, r) == false ) {
+                rtArtFreeRoute(pt, r);
+                ps->nRejected++;
+            }
+            continue;
+        }
+        po = &pa->pOps[m++];
+        po->r     = r;
+        po->pDest = pRec[i].dest;
+        po->plen  = pRec[i].plen;
+        po->op    = (r) ? artUpdAnnounce : artUpdWithdraw;
+    }
+    if ( pa->flags & artFeedBulk ) {
+        return;
+    }
+
+    rtArtApplyUpdates(pt, pa->pOps, m, NULL);
+    for ( i = 0; i < m; ++i ) {
+        po = &pa->pOps[i];
+        switch ( po->rc ) {
+        case artUpdDone:
+            if ( po->op == artUpdAnnounce ) {
+                ps->nAdded++;
+            } else {
+                ps->nWithdrawn++;
+            }
+            continue;
+        case artUpdReplaced:
+            ps->nReplaced++;
+            continue;
+        case artUpdCancelled:
+            ps->nCancelled++;
+            break;
+        default:
+            ps->nRejected++;
+            break;
+        }
+        if ( po->op == artUpdAnnounce ) {
+            rtArtFreeRoute(pt, po->r);
+        }
+    }
+}
+
+
+/**
+ * @name   rtArtFeedLoad
+ *
+ * @brief  API function. (writer only)
+ *         Applies all the prefixes of the rest of feed `pf' to
+ *         routing table `pt': an announcement inserts a route (or
+ *         replaces the route of the prefix) and a withdrawal
+ *         deletes the route. The routes are allocated by
+ *         rtArtNewRoute(pt) and `f' is called with each of them and
+ *         its record (e.g., to set the next hop in the user data
+ *         from the path attributes) before it is inserted.
+ *
+ * @param[in]  pt    Pointer to the routing table
+ * @param[in]  pf    Pointer to the feed
+ * @param[in]  flags artFeedBulk: the additions are bulk loaded at the
+ *                   end (for a snapshot into an empty table) and the
+ *                   withdrawals are rejected.
+ *                   artFeedThreaded: the feed is parsed by another
+ *                   thread while the table is updated.
+ * @param[in]  f     Function called with each new route (may be NULL)
+ * @param[in]  p2    Second parameter of `f'
+ * @param[out] ps    Counters and the time spent (may be NULL)
+ *
+ * @retval int The number of the routes added, replaced or withdrawn
+ * @retval -1  There was no memory
+ */
+int
+rtArtFeedLoad (rtTable* pt, rtArtFeed* pf, int flags, rtArtFeedFunc f,
+               void* p2, rtArtFeedStats* ps)
+{
+    struct timespec ts, ta;
+    rtArtFeedStats st;
+    feedQueue q;
+    feedApply a;
+    pthread_t tid;
+    u64 nRecords, nSkipped;
+    int i, n, nBlks, head, rc;
+
+
+    assert(pt && pf);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    memset(&st, 0, sizeof(st));
+    memset(&q, 0, sizeof(q));
+    memset(&a, 0, sizeof(a));
+    nRecords = pf->nRecords;
+    nSkipped = pf->nSkipped;
+
+    rc    = -1;
+    nBlks = (flags & artFeedThreaded) ? FEED_QUEUE : 1;
+    a.pOps = malloc(FEED_BLOCK * sizeof(rtArtUpdateOp));
+    for ( i = 0; i < nBlks; ++i ) {
+        q.pBlk[i] = malloc(FEED_BLOCK * sizeof(rtArtFeedRec));
+        if ( q.pBlk[i] == NULL ) goto cleanup;
+    }
+    if ( a.pOps == NULL ) goto cleanup;
+    a.pt    = pt;
+    a.flags = flags;
+    a.f     = f;
+    a.p2    = p2;
+    a.ps    = &st;
+    q.pf    = pf;
+    q.alen  = pt->alen;
+
+    if ( flags & artFeedThreaded ) {
+        pthread_mutex_init(&q.mtx, NULL);
+        pthread_cond_init(&q.cond, NULL);
+        if ( pthread_create(&tid, NULL, feedParser, &q) ) {
+            pthread_cond_destroy(&q.cond);
+            pthread_mutex_destroy(&q.mtx);
+            flags &= ~artFeedThreaded;
+        }
+    }
+
+    if ( flags & artFeedThreaded ) {
+        for ( head = 0; ; head = (head + 1) % FEED_QUEUE ) {
+            pthread_mutex_lock(&q.mtx);
+            while ( q.nFull == 0 ) {
+                pthread_cond_wait(&q.cond, &q.mtx);
+            }
+            n = q.nRec[head];
+            pthread_mutex_unlock(&q.mtx);
+            if ( n == 0 ) break;
+
+            clock_gettime(CLOCK_MONOTONIC, &ta);
+            feedBlock(&a, q.pBlk[head], n);
+            st.tApply += feedElapsed(&ta);
+
+            pthread_mutex_lock(&q.mtx);
+            q.nFull--;
+            pthread_cond_broadcast(&q.cond);
+            pthread_mutex_unlock(&q.mtx);
+        }
+        pthread_join(tid, NULL);
+        pthread_cond_destroy(&q.cond);
+        pthread_mutex_destroy(&q.mtx);
+        st.tParse = q.tParse;
+    } else {
+        for (;;) {
+            clock_gettime(CLOCK_MONOTONIC, &ta);
+            n = rtArtFeedNext(pf, pt->alen, q.pBlk[0], FEED_BLOCK);
+            st.tParse += feedElapsed(&ta);
+            if ( n == 0 ) break;
+
+            clock_gettime(CLOCK_MONOTONIC, &ta);
+            feedBlock(&a, q.pBlk[0], n);
+            st.tApply += feedElapsed(&ta);
+        }
+    }
+
+    if ( flags & artFeedBulk ) {
+        clock_gettime(CLOCK_MONOTONIC, &ta);
+        n = pt->bulkLoad(pt, a.pRoutes, a.nRoutes);
+        for ( i = n; i < a.nRoutes; ++i ) {
+            rtArtFreeRoute(pt, a.pRoutes[i]);   /* duplicates */
+        }
+        st.nAdded    += n;
+        st.nRejected += a.nRoutes - n;
+        st.tApply    += feedElapsed(&ta);
+    }
+    rc = (int)(st.nAdded + st.nReplaced + st.nWithdrawn);
+
+cleanup:
+    st.nRecords = pf->nRecords - nRecords;
+    st.nSkipped = pf->nSkipped - nSkipped;
+    st.tTotal   = feedElapsed(&ts);
+    if ( ps ) {
+        *ps = st;
+    }
+    free(a.pRoutes);
+    free(a.pOps);
+    for ( i = 0; i < nBlks; ++i ) {
+        free(q.pBlk[i]);
+    }
+    return rc;
+}
@@ -0,0 +1,811 @@
+/** @file ipArtFib.c
+    @brif Frozen read-only FIB compiled from a routing table
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   rtArtFibCompile() turns a simple trie or a path-compressed trie
+   into a frozen FIB: one array of 32-bit entries that holds the
+   fringe entries (index `1 << sl' to `(1 << (sl+1)) - 1') of all
+   the subtables in breadth-first order.
+
+   The routes are pushed down to the fringe entries when they are
+   compiled (leaf pushing), so a lookup needs neither the subtable
+   default routes nor the address comparison of the path-compressed
+   trie. The levels skipped by a path-compressed subtable are filled
+   with subtables that have only one entry pointing down. A lookup
+   therefore visits one entry per level and stops at the first
+   route:
+
+     0                      No route
+     (i << 1)               Route `i' (rtArtFibRoute(pf, i))
+     (o << 2) | 1           Dense subtable that starts at entry `o'
+     (o << 2) | 3           Sparse subtable that starts at entry `o'
+
+   After leaf pushing, most of the subtables below the root hold a
+   few runs of the same entry. Such a subtable is stored sparse if
+   it takes FIB_SPARSE_DIV times fewer entries than the dense one
+   (poptrie style): a bitmap of `1 << sl' bits, set where an entry
+   differs from the previous one, the number of the bits set before
+   each 64-bit word of the bitmap, and the first entry of each run.
+   Entry `i' is then run `popcount(bits 0 to i) - 1'. A subtable of
+   up to 32 entries has one bitmap word and no popcount. The root
+   is always dense and starts at entry 0.
+
+     sl <= 5: [bitmap: 1][runs]
+     sl >= 6: [bitmap: 2 * nW][popcounts: nW][runs]  nW = fibWords(sl)
+
+   The FIB holds copies of the routes. It does not refer to the
+   routing table after it is compiled, so the table can be updated
+   while the FIB is looked up. A new FIB compiled from the updated
+   table replaces the old one with rtArtFibPublish().
+*/
+
+
+#include "ipArt.h"
+
+
+struct rtArtFib {
+    u32* tbl;                   /* subtables in breadth-first order */
+    u64  nEntries;              /* number of entries in `tbl' */
+    u8*  pRoutes;               /* route copies. index 0 is no route */
+    u32  nRoutes;               /* number of routes including index 0 */
+    u32  routeSlot;             /* bytes of a route copy */
+    u32  nSubtables;            /* number of subtables in `tbl' */
+    u32  nSparse;               /* sparse subtables of them */
+    u16  alen;                  /* address length in bits */
+    u16  nLevels;               /* number of levels */
+    u8*  shift;                 /* first bit of each level */
+    u8*  sl;                    /* stride length of each level */
+};
+
+/*
+ * Subtable to be compiled by fibCompile()
+ */
+typedef struct fibNode fibNode;
+struct fibNode {
+    subtable t;                 /* subtable of the routing table */
+    u64      ref;               /* entry of the parent pointing to it */
+    u32      def;               /* route pushed down to the NULL entries */
+    int      level;             /* level of this node (<= level of `t') */
+};
+
+/*
+ * Used by rtArtFibCompile() to number the routes
+ */
+typedef struct fibBuilder fibBuilder;
+struct fibBuilder {
+    rtTable*   pt;
+    rtArtFib*  pf;
+    routeEnt** pHash;           /* routes numbered so far */
+    u32*       pIdx;            /* route index of `pHash[i]' */
+    u32        hashSize;        /* power of 2 */
+    u32        maxRoutes;       /* size of `pf->pRoutes' in routes */
+    u64        maxEntries;      /* size of `pf->tbl' in entries */
+    fibNode*   pQ;              /* subtables to be compiled */
+    u32        qHead, qTail, qSize;
+    u32*       pVal;            /* entries of the subtable being compiled */
+};
+
+#define FIB_MAX_ENTRIES (1ULL << 30)
+#define FIB_SPARSE_DIV  2       /* sparse if 1/2 of dense or smaller */
+#define FIB_ROOT_REF    ((u64)-1)
+
+/*
+ * 64-bit bitmap words of a sparse subtable of stride length `sl'
+ */
+#define fibWords(sl) (((sl) > 6) ? 1 << ((sl) - 6) : 1)
+
+/*
+ * Entries before the runs of a sparse subtable of stride length `sl'
+ */
+#define fibHeader(sl) (((sl) > 5) ? 3 * fibWords(sl) : 1)
+
+#define fibHash(r, size) \
+    ((u32)(((size_t)(r) >> 4) * 0x9e3779b97f4a7c15ULL >> 32) & ((size) - 1))
+
+
+/**
+ * @name  fibRouteIndex
+ *
+ * @brief Returns the index of the copy of route `r' in the FIB.
+ *        Copies `r' if it is not copied yet.
+ *
+ * @param[in] pb Pointer to the builder
+ * @param[in] r  Pointer to the route (may be NULL)
+ *
+ * @retval u32 The route index (0 if `r' is NULL)
+ * @retval -1  No memory
+ */
+static u32
+fibRouteIndex (fibBuilder* pb, routeEnt* r)
+{
+    rtArtFib*  pf = pb->pf;
+    routeEnt** ph;
+    u32*  pi;
+    u8*   p;
+    u32   h, i, n;
+
+
+    if ( r == NULL ) {
+        return 0;
+    }
+    for ( h = fibHash(r, pb->hashSize); pb->pHash[h];
+          h = (h + 1) & (pb->hashSize - 1) ) {
+        if ( pb->pHash[h] == r ) {
+            return pb->pIdx[h];
+        }
+    }
+
+    /*
+     * New route
+     */
+    if ( pf->nRoutes == pb->maxRoutes ) {
+        n = pb->maxRoutes * 2;
+        p = realloc(pf->pRoutes, (size_t)n * pf->routeSlot);
+        if ( !p ) {
+            return -1;
+        }
+        pf->pRoutes   = p;
+        pb->maxRoutes = n;
+    }
+    i = pf->nRoutes++;
+    memcpy(pf->pRoutes + (size_t)i * pf->routeSlot, r, pb->pt->routeSize);
+    pb->pHash[h] = r;
+    pb->pIdx[h]  = i;
+
+    if ( pf->nRoutes * 2 > pb->hashSize ) {
+        /*
+         * Rehash
+         */
+        n  = pb->hashSize * 2;
+        ph = calloc(n, sizeof(routeEnt*));
+        pi = malloc(n * sizeof(u32));
+        if ( !ph || !pi ) {
+            free(ph);
+            free(pi);
+            return -1;
+        }
+        for ( h = 0; h < pb->hashSize; ++h ) {
+            if ( pb->pHash[h] ) {
+                for ( i = fibHash(pb->pHash[h], n); ph[i]; i = (i + 1) & (n - 1) )
+                    ;
+                ph[i] = pb->pHash[h];
+                pi[i] = pb->pIdx[h];
+            }
+        }
+        free(pb->pHash);
+        free(pb->pIdx);
+        pb->pHash    = ph;
+        pb->pIdx     = pi;
+        pb->hashSize = n;
+        return pf->nRoutes - 1;
+    }
+    return i;
+}
+
+
+/**
+ * @name  fibEnqueue
+ *
+ * @brief Appends a subtable to the queue of the subtables to be
+ *        compiled.
+ *
+ * @param[in] pb    Pointer to the builder
+ * @param[in] t     Subtable of the routing table
+ * @param[in] level Level of the new subtable in the FIB
+ * @param[in] def   Index of the route pushed down to the subtable
+ *
+ * @retval u32 Placeholder of the entry pointing to the new subtable.
+ *             fibCompile() replaces it when the subtable is placed.
+ * @retval 0   No memory or too many subtables
+ */
+static u32
+fibEnqueue (fibBuilder* pb, subtable t, int level, u32 def)
+{
+    fibNode* pn;
+
+
+    if ( pb->qTail >= (FIB_MAX_ENTRIES >> 1) ) {
+        return 0;
+    }
+    if ( pb->qTail == pb->qSize ) {
+        pn = realloc(pb->pQ, pb->qSize * 2 * sizeof(fibNode));
+        if ( !pn ) {
+            return 0;
+        }
+        pb->pQ     = pn;
+        pb->qSize *= 2;
+    }
+    pn = &pb->pQ[pb->qTail];
+    pn->t     = t;
+    pn->ref   = FIB_ROOT_REF;
+    pn->def   = def;
+    pn->level = level;
+
+    return (pb->qTail++ << 2) | 1;
+}
+
+
+/**
+ * @name  fibReserve
+ *
+ * @brief Reserves `n' entries at the end of the FIB.
+ *
+ * @retval true  Success. The first entry is `pb->pf->nEntries - n'
+ * @retval false No memory or too many entries
+ */
+static bool
+fibReserve (fibBuilder* pb, u64 n)
+{
+    rtArtFib* pf = pb->pf;
+    u32* p;
+
+
+    n += pf->nEntries;
+    if ( n > FIB_MAX_ENTRIES ) {
+        return false;
+    }
+    if ( n > pb->maxEntries ) {
+        while ( pb->maxEntries < n ) {
+            pb->maxEntries *= 2;
+        }
+        p = realloc(pf->tbl, pb->maxEntries * sizeof(u32));
+        if ( !p ) {
+            return false;
+        }
+        pf->tbl = p;
+    }
+    pf->nEntries = n;
+    return true;
+}
+
+
+/**
+ * @name  fibPlace
+ *
+ * @brief Stores entry `e' of the subtable being compiled at `tbl[pos]'.
+ *        If `e' is the placeholder of a child, it records `pos' so
+ *        that the child can point it to itself when placed.
+ */
+static inline void
+fibPlace (fibBuilder* pb, u64 pos, u32 e)
+{
+    pb->pf->tbl[pos] = e;
+    if ( e & 1 ) {
+        pb->pQ[e >> 2].ref = pos;
+    }
+}
+
+
+/**
+ * @name  fibCompile
+ *
+ * @brief Compiles subtable `q' of the queue: computes its entries,
+ *        enqueues its children, and places it dense or sparse at the
+ *        end of the FIB.
+ *
+ * @param[in] pb Pointer to the builder
+ * @param[in] q  Index of the subtable in the queue
+ *
+ * @retval true  Success
+ * @retval false No memory or too many entries
+ */
+static bool
+fibCompile (fibBuilder* pb, u32 q)
+{
+    rtTable*  pt = pb->pt;
+    rtArtFib* pf = pb->pf;
+    register tableEntry ent;
+    register int i, n;
+    register u32* pv = pb->pVal;
+    subtable t   = pb->pQ[q].t;
+    int      l   = pb->pQ[q].level;
+    u32      def = pb->pQ[q].def;
+    u64      pos, bm;
+    u32      e, runs, nW, nH, w;
+    u8*      pAddr;
+    u32      offset;
+
+
+    n = 1 << pt->psi[l].sl;
+    if ( l < t[-1].level ) {
+        /*
+         * Level skipped by a path-compressed subtable: only the
+         * entry on its path points down.
+         */
+        pAddr  = (u8*)(t + pt->off) + pt->psi[l].sb;
+        offset = pt->psi[l].bo;
+        i = fringeIndex(&pAddr, &offset, pt->psi[l].sl) - n;
+        e = fibEnqueue(pb, t, l + 1, def);
+        if ( !e ) {
+            return false;
+        }
+        for ( n = n - 1; n >= 0; --n ) {
+            pv[n] = (n == i) ? e : def << 1;
+        }
+        n = 1 << pt->psi[l].sl;
+    } else {
+        for ( i = n; i < (n << 1); ++i ) {
+            ent = loadEnt(t[i]);
+            if ( isSubtable(ent) ) {
+                ent = subtablePtr(ent);
+                e = fibRouteIndex(pb, loadEnt(ent.down[1]).ent);
+                if ( e == (u32)-1 ) {
+                    return false;
+                }
+                e = fibEnqueue(pb, ent.down, l + 1, (e) ? e : def);
+                if ( !e ) {
+                    return false;
+                }
+            } else {
+                e = fibRouteIndex(pb, ent.ent);
+                if ( e == (u32)-1 ) {
+                    return false;
+                }
+                e = ((e) ? e : def) << 1;
+            }
+            pv[i - n] = e;
+        }
+    }
+
+    /*
+     * Count the runs. The placeholders of the children are unique,
+     * so each child is a run.
+     */
+    for ( runs = 1, i = 1; i < n; ++i ) {
+        runs += (pv[i] != pv[i - 1]);
+    }
+    nW  = fibWords(pt->psi[l].sl);
+    nH  = fibHeader(pt->psi[l].sl);
+    pos = pf->nEntries;
+    ++pf->nSubtables;
+    if ( (pb->pQ[q].ref == FIB_ROOT_REF) ||
+         ((nH + runs) * FIB_SPARSE_DIV > (u32)n) ) {
+        if ( !fibReserve(pb, n) ) {
+            return false;
+        }
+        for ( i = 0; i < n; ++i ) {
+            fibPlace(pb, pos + i, pv[i]);
+        }
+        e = (pos << 2) | 1;
+    } else {
+        if ( !fibReserve(pb, nH + runs) ) {
+            return false;
+        }
+        for ( w = 0, runs = 0; w < nW; ++w ) {
+            for ( bm = 0, i = w << 6; (i < n) && (i < (int)(w + 1) << 6); ++i ) {
+                if ( (i == 0) || (pv[i] != pv[i - 1]) ) {
+                    bm |= 1ULL << (i & 63);
+                    fibPlace(pb, pos + nH + runs++, pv[i]);
+                }
+            }
+            if ( nH == 1 ) {
+                pf->tbl[pos] = (u32)bm;
+                break;
+            }
+            pf->tbl[pos + 2 * w]     = (u32)bm;
+            pf->tbl[pos + 2 * w + 1] = (u32)(bm >> 32);
+            pf->tbl[pos + 2 * nW + w] = runs - __builtin_popcountll(bm);
+        }
+        ++pf->nSparse;
+        e = (pos << 2) | 3;
+    }
+    if ( pb->pQ[q].ref != FIB_ROOT_REF ) {
+        pf->tbl[pb->pQ[q].ref] = e;
+    }
+    return true;
+}
+
+
+/**
+ * @name  rtArtFibCompile
+ *
+ * @brief API function.
+ *        Compiles routing table `pt' (simple or path-compressed
+ *        trie) into a frozen FIB. If `pt' is created with
+ *        artOptConcurrent, this function is a reader of `pt': it
+ *        may run in a reader thread between rtArtReadLock() and
+ *        rtArtReadUnlock() while the writer updates `pt'.
+ *
+ * @param[in] pt Pointer to the routing table
+ *
+ * @retval rtArtFib* Pointer to the FIB
+ * @retval NULL      Not supported (compact trie or a table loaded by
+ *                   rtArtLoad()) or no memory
+ */
+rtArtFib*
+rtArtFibCompile (rtTable* pt)
+{
+    fibBuilder b;
+    rtArtFib*  pf;
+    u32  def;
+    int  i, sum, maxSl;
+
+
+    assert(pt);
+
+    if ( (pt->type == compactTrie) || (pt->root == NULL) ) {
+        return NULL;
+    }
+    pf = calloc(1, sizeof(rtArtFib) + 2 * pt->nLevels);
+    if ( !pf ) {
+        return NULL;
+    }
+    pf->alen      = pt->alen;
+    pf->nLevels   = pt->nLevels;
+    pf->routeSlot = (pt->routeSize + 7) & ~7;
+    pf->shift     = (u8*)(pf + 1);
+    pf->sl        = pf->shift + pt->nLevels;
+    for ( i = sum = maxSl = 0; i < pt->nLevels; ++i ) {
+        pf->shift[i] = sum;
+        pf->sl[i]    = pt->psi[i].sl;
+        sum += pt->psi[i].sl;
+        if ( maxSl < pt->psi[i].sl ) {
+            maxSl = pt->psi[i].sl;
+        }
+    }
+
+    memset(&b, 0, sizeof(b));
+    b.pt         = pt;
+    b.pf         = pf;
+    b.hashSize   = 1024;
+    b.maxRoutes  = 1024;
+    b.qSize      = 1024;
+    b.maxEntries = 1 << pt->psi[0].sl;
+    b.pHash      = calloc(b.hashSize, sizeof(routeEnt*));
+    b.pIdx       = malloc(b.hashSize * sizeof(u32));
+    b.pQ         = malloc(b.qSize * sizeof(fibNode));
+    pf->pRoutes  = calloc(b.maxRoutes, pf->routeSlot);
+    pf->tbl      = malloc(b.maxEntries * sizeof(u32));
+    b.pVal       = malloc(((size_t)1 << maxSl) * sizeof(u32));
+    if ( !b.pHash || !b.pIdx || !b.pQ || !pf->pRoutes || !pf->tbl ||
+         !b.pVal ) {
+        goto fail;
+    }
+    pf->nRoutes = 1;            /* index 0: no route */
+
+    /*
+     * Breadth-first: the children of a subtable are queued behind it.
+     */
+    def = fibRouteIndex(&b, loadEnt(pt->root[1]).ent);
+    if ( (def == (u32)-1) || !fibEnqueue(&b, pt->root, 0, def) ) {
+        goto fail;
+    }
+    while ( b.qHead < b.qTail ) {
+        if ( fibCompile(&b, b.qHead++) == false ) {
+            goto fail;
+        }
+    }
+
+    free(b.pHash);
+    free(b.pIdx);
+    free(b.pQ);
+    free(b.pVal);
+    return pf;
+
+fail:
+    free(b.pHash);
+    free(b.pIdx);
+    free(b.pQ);
+    free(b.pVal);
+    rtArtFibFree(pf);
+    return NULL;
+}
+
+
+/**
+ * @name  rtArtFibFree
+ *
+ * @brief API function.
+ *        Frees a FIB returned by rtArtFibCompile().
+ *
+ * @param[in] pf Pointer to the FIB (may be NULL)
+ */
+void
+rtArtFibFree (rtArtFib* pf)
+{
+    if ( pf ) {
+        free(pf->tbl);
+        free(pf->pRoutes);
+        free(pf);
+    }
+}
+
+
+/**
+ * @name  fibRetire
+ *
+ * @brief rtArtFreeFunc of the FIB replaced by rtArtFibPublish()
+ */
+static void
+fibRetire (rtTable* pt, void* p)
+{
+    rtArtFibFree(p);
+}
+
+
+/**
+ * @name  rtArtFibPublish
+ *
+ * @brief API function.
+ *        Replaces the FIB pointed to by `*ppFib' with `pf'
+ *        atomically. Readers get the current FIB with
+ *        rtArtFibGet(). If `pt' is created with artOptConcurrent,
+ *        the old FIB is freed when no reader inside
+ *        rtArtReadLock() can see it. Otherwise it is freed at once.
+ *        Called by the writer of `pt' only.
+ *
+ * @param[in]     pt    Routing table whose readers look up the FIB
+ * @param[in,out] ppFib Pointer to the published FIB (may point to NULL)
+ * @param[in]     pf    New FIB (may be NULL)
+ */
+void
+rtArtFibPublish (rtTable* pt, rtArtFib** ppFib, rtArtFib* pf)
+{
+    rtArtFib* old;
+
+
+    old = __atomic_exchange_n(ppFib, pf, __ATOMIC_ACQ_REL);
+    if ( !old ) {
+        return;
+    }
+    if ( pt->pEpoch ) {
+        rtArtRetire(pt, old, fibRetire);
+    } else {
+        rtArtFibFree(old);
+    }
+}
+
+
+/**
+ * @name  rtArtFibRoute
+ *
+ * @brief API function.
+ *        Returns the copy of the route of index `i' returned by
+ *        the lookups of FIB `pf'.
+ *
+ * @param[in] pf Pointer to the FIB
+ * @param[in] i  Route index
+ *
+ * @retval routeEnt* Pointer to the route copy
+ * @retval NULL      `i' is 0 (no route)
+ */
+routeEnt*
+rtArtFibRoute (rtArtFib* pf, u32 i)
+{
+    assert(i < pf->nRoutes);
+    return (i) ? (routeEnt*)(pf->pRoutes + (size_t)i * pf->routeSlot) : NULL;
+}
+
+
+/**
+ * @name  rtArtFibNumEntries
+ *
+ * @brief API function.
+ *        Returns the number of 32-bit entries of FIB `pf'.
+ *        `pSubtables' is set to the number of the subtables if not
+ *        NULL.
+ */
+u64
+rtArtFibNumEntries (rtArtFib* pf, u32* pSubtables)
+{
+    if ( pSubtables ) {
+        *pSubtables = pf->nSubtables;
+    }
+    return pf->nEntries;
+}
+
+
+/**
+ * @name  rtArtFibNumSparse
+ *
+ * @brief API function.
+ *        Returns the number of the subtables of FIB `pf' stored
+ *        sparse (bitmap and runs).
+ */
+u32
+rtArtFibNumSparse (rtArtFib* pf)
+{
+    return pf->nSparse;
+}
+
+
+/**
+ * @name  fibAddr64
+ *
+ * @brief Returns an address of up to 64 bits left-aligned in a u64
+ */
+static inline u64
+fibAddr64 (rtArtFib* pf, u8* p)
+{
+    u64 a;
+    u32 x;
+    int i;
+
+    if ( pf->alen == 32 ) {
+        memcpy(&x, p, sizeof(x));
+        return (u64)__builtin_bswap32(x) << 32;
+    }
+    for ( a = 0, i = 0; i < 8; ++i ) {
+        a = (a << 8) | ((i < bits2bytes(pf->alen)) ? p[i] : 0);
+    }
+    return a;
+}
+
+
+/**
+ * @name  fibAddr128
+ *
+ * @brief Returns an address of up to 128 bits left-aligned in a u128
+ */
+static inline u128
+fibAddr128 (rtArtFib* pf, u8* p)
+{
+    u64 x[2];
+    u8  buf[16];
+
+    if ( pf->alen != 128 ) {
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf, p, bits2bytes(pf->alen));
+        p = buf;
+    }
+    memcpy(x, p, sizeof(x));
+    return ((u128)__builtin_bswap64(x[0]) << 64) | __builtin_bswap64(x[1]);
+}
+
+
+/**
+ * @name  fibEntry
+ *
+ * @brief Returns entry `i' of the subtable of level `l' that FIB
+ *        entry `node' points to.
+ */
+static inline u32
+fibEntry (rtArtFib* pf, u32 node, int l, u32 i)
+{
+    register u32* p = pf->tbl + (node >> 2);
+    register u64  bm;
+    register u32  w, nW;
+
+
+    if ( !(node & 2) ) {
+        return p[i];
+    }
+    if ( pf->sl[l] <= 5 ) {
+        return p[__builtin_popcountll((u64)p[0] << (63 - i))];
+    }
+    nW = fibWords(pf->sl[l]);
+    w  = i >> 6;
+    bm = ((u64)p[2 * w + 1] << 32) | p[2 * w];
+    return p[3 * nW + p[2 * nW + w] +
+             __builtin_popcountll(bm << (63 - (i & 63))) - 1];
+}
+
+
+/**
+ * @name  fibPrefetch
+ *
+ * @brief Prefetches the first cache line fibEntry() reads.
+ */
+static inline void
+fibPrefetch (rtArtFib* pf, u32 node, u32 i)
+{
+    __builtin_prefetch(pf->tbl + (node >> 2) +
+                       ((node & 2) ? 2 * (i >> 6) : i));
+}
+
+
+/**
+ * @name  rtArtFibFindMatch
+ *
+ * @brief API function.
+ *        Performs the longest prefix match on FIB `pf'.
+ *
+ * @param[in] pf    Pointer to the FIB
+ * @param[in] pDest Pointer to the destination IP address
+ *
+ * @retval u32 Index of the longest prefix matching route
+ *             (rtArtFibRoute()). 0 if there is no matching route.
+ */
+u32
+rtArtFibFindMatch (rtArtFib* pf, u8* pDest)
+{
+    register u32 e;
+    register int l;
+    u64  a;
+    u128 a2;
+
+
+    e = 1;                      /* root */
+    if ( pf->alen <= 64 ) {
+        a = fibAddr64(pf, pDest);
+        for ( l = 0; e & 1; ++l ) {
+            e = fibEntry(pf, e, l,
+                         (u32)((a << pf->shift[l]) >> (64 - pf->sl[l])));
+        }
+    } else {
+        a2 = fibAddr128(pf, pDest);
+        for ( l = 0; e & 1; ++l ) {
+            e = fibEntry(pf, e, l,
+                         (u32)((a2 << pf->shift[l]) >> (128 - pf->sl[l])));
+        }
+    }
+    return e >> 1;
+}
+
+
+/**
+ * @name  rtArtFibFindMatchBatch
+ *
+ * @brief API function.
+ *        Performs the longest prefix match on FIB `pf' for `n'
+ *        addresses. Up to ART_BATCH_WIDTH lookups go down one level
+ *        at a time and the next entry of each is prefetched.
+ *
+ * @param[in]  pf    Pointer to the FIB
+ * @param[in]  pDest Array of `n' pointers to the destination IP addresses
+ * @param[out] pRes  Array of `n' route indices (see rtArtFibFindMatch())
+ * @param[in]  n     The number of addresses to be looked up
+ */
+void
+rtArtFibFindMatchBatch (rtArtFib* pf, u8** pDest, u32* pRes, int n)
+{
+    register u32 e;
+    u128 a[ART_BATCH_WIDTH];
+    u32  node[ART_BATCH_WIDTH];     /* subtable of the next entry */
+    u32  pos[ART_BATCH_WIDTH];      /* index of the next entry */
+    int  live[ART_BATCH_WIDTH];     /* lookups still going down */
+    int  i, j, l, m, nLive, nNext, rs;
+
+
+    for ( ; n > 0; n -= m, pDest += m, pRes += m ) {
+        m = (n < ART_BATCH_WIDTH) ? n : ART_BATCH_WIDTH;
+        rs = 128 - pf->sl[0];
+        for ( i = 0; i < m; ++i ) {
+            if ( pf->alen <= 64 ) {
+                a[i] = (u128)fibAddr64(pf, pDest[i]) << 64;
+            } else {
+                a[i] = fibAddr128(pf, pDest[i]);
+            }
+            node[i] = 1;            /* root */
+            pos[i]  = (u32)(a[i] >> rs);
+            fibPrefetch(pf, node[i], pos[i]);
+            live[i] = i;
+        }
+        nLive = m;
+        for ( l = 1; nLive > 0; ++l ) {
+            nNext = 0;
+            for ( j = 0; j < nLive; ++j ) {
+                i = live[j];
+                e = fibEntry(pf, node[i], l - 1, pos[i]);   /* prefetched */
+                if ( !(e & 1) ) {
+                    pRes[i] = e >> 1;
+                    continue;
+                }
+                assert(l < pf->nLevels);
+                node[i] = e;
+                pos[i]  = (u32)((a[i] << pf->shift[l]) >> (128 - pf->sl[l]));
+                fibPrefetch(pf, node[i], pos[i]);
+                live[nNext++] = i;
+            }
+            nLive = nNext;
+        }
+    }
+}
@@ -0,0 +1,978 @@
+/** @file ipArtImage.c
+    @brif Memory-mappable routing table images
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   rtArtSave() writes a simple trie or a path-compressed trie to a
+   file. rtArtLoad() maps the file read-only and returns a routing
+   table that is looked up in place: no route is parsed or inserted.
+
+   The image is laid out as follows:
+
+     +--------------------+ 0
+     | rtArtImgHdr        |
+     +--------------------+ IMG_HDR_SIZE
+     | subtables          | the same layout as in memory (including
+     |                    | the level and the address cache)
+     +--------------------+ hdr.routes
+     | routes             | hdr.nImgRoutes slots of hdr.routeSlot bytes
+     +--------------------+ hdr.size
+
+   A table entry in the image holds an offset from the beginning of
+   the image instead of a pointer. The lowest bit still tags a
+   subtable, so an entry is
+
+     0                      No route
+     (o)                    Route at offset `o'
+     (o | 1)                Subtable whose index 0 is at offset `o'
+
+   The first update of a loaded table (or rtArtThaw()) copies the
+   image to an ordinary writable table in place. The routes returned
+   by the lookups before that point into the image and must not be
+   used after it.
+*/
+
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ipArt.h"
+
+
+#define IMG_MAGIC    "ARTIMG\r\n"
+#define IMG_VERSION  1
+#define IMG_HDR_SIZE 256
+#define IMG_MAX_LEVELS 128
+
+typedef struct rtArtImgHdr rtArtImgHdr;
+struct rtArtImgHdr {
+    char magic[8];              /* IMG_MAGIC */
+    u32  version;               /* IMG_VERSION */
+    u32  type;                  /* simpleTrie or pathCompTrie */
+    u32  nLevels;               /* number of levels */
+    u32  alen;                  /* address length in bits */
+    u32  routeSize;             /* sizeof(routeEnt) + user data size */
+    u32  routeSlot;             /* bytes of a route in the image */
+    u32  nRoutes;               /* pt->nRoutes */
+    u32  nImgRoutes;            /* number of routes in the image */
+    u64  root;                  /* offset of the root subtable */
+    u64  routes;                /* offset of the first route */
+    u64  size;                  /* size of the image */
+    s8   sl[IMG_MAX_LEVELS];    /* stride lengths */
+};
+
+struct rtArtImage {
+    u8*          base;          /* beginning of the mapping */
+    rtArtImgHdr* hdr;           /* same as `base' */
+};
+
+/*
+ * Used by rtArtSave() to build the image in memory
+ */
+typedef struct imgWriter imgWriter;
+struct imgWriter {
+    rtTable* pt;
+    u8*  pNodes;                /* subtables. `pNodes[0]' is at IMG_HDR_SIZE */
+    u64  top;                   /* bytes used in `pNodes' */
+    u8*  pRoutes;               /* routes */
+    u32  nRoutes;               /* routes in `pRoutes' */
+    u32  maxRoutes;             /* size of `pRoutes' in routes */
+    u32  slot;                  /* bytes of a route in the image */
+    u64  routes;                /* offset of `pRoutes' in the image */
+};
+
+#define imgIsSubtable(e)      ((e) & 1)
+#define imgPtr(pi, e)         ((pi)->base + ((e) & ~(u64)1))
+#define imgSubtablePtr(pi, e) ((u64*)imgPtr(pi, e))
+#define imgRoutePtr(pi, e)    ((routeEnt*)imgPtr(pi, e))
+
+
+/**
+ * @name  hdrWords
+ *
+ * @brief Returns the number of words in front of index 0 of a
+ *        subtable (the level and, if path-compressed, the address
+ *        cache.)
+ *
+ * @param[in] pt Pointer to the routing table
+ *
+ * @retval int The number of words
+ */
+static inline int
+hdrWords (rtTable* pt)
+{
+    return (pt->type == pathCompTrie) ? -pt->off : 1;
+}
+
+
+/**
+ * @name  nodeSize
+ *
+ * @brief Returns the size of a subtable in bytes. Same as
+ *        subtableSize() of each trie.
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] level Level of the subtable
+ *
+ * @retval size_t The size in bytes
+ */
+static inline size_t
+nodeSize (rtTable* pt, int level)
+{
+    return ((1 << (pt->psi[level].sl+1)) + hdrWords(pt)) * sizeof(tableEntry);
+}
+
+
+/**
+ * @name  countNodes
+ *
+ * @brief Returns the number of bytes the subtables from `t' take.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] t  Pointer to a subtable (trie node)
+ *
+ * @retval u64 The number of bytes
+ */
+static u64
+countNodes (rtTable* pt, subtable t)
+{
+    register int i, l;
+    u64 n;
+
+
+    l = t[-1].level;
+    n = nodeSize(pt, l);
+    for ( i = 1 << pt->psi[l].sl; i < (1 << (pt->psi[l].sl+1)); ++i ) {
+        if ( isSubtable(t[i]) ) {
+            n += countNodes(pt, subtablePtr(t[i]).down);
+        }
+    }
+    return n;
+}
+
+
+/**
+ * @name  saveRoute
+ *
+ * @brief Appends a copy of a route to the image
+ *
+ * @param[in] pw Pointer to the image writer
+ * @param[in] r  Pointer to the route
+ *
+ * @retval u64 Offset of the copy
+ * @retval 0   No memory
+ */
+static u64
+saveRoute (imgWriter* pw, routeEnt* r)
+{
+    u8* p;
+    u32 n;
+
+
+    if ( pw->nRoutes == pw->maxRoutes ) {
+        n = (pw->maxRoutes) ? pw->maxRoutes * 2 : 1024;
+        p = realloc(pw->pRoutes, (size_t)n * pw->slot);
+        if ( !p ) {
+            return 0;
+        }
+        pw->pRoutes   = p;
+        pw->maxRoutes = n;
+    }
+    p = pw->pRoutes + (size_t)pw->nRoutes * pw->slot;
+    memset(p, 0, pw->slot);
+    memcpy(p, r, pw->pt->routeSize);
+    return pw->routes + (u64)pw->nRoutes++ * pw->slot;
+}
+
+
+/**
+ * @name  saveNode
+ *
+ * @brief Appends a copy of subtable `t' and its descendants.
+ *        A route is copied at its base index only: an entry that
+ *        has the same route as its parent entry gets the same
+ *        offset as its parent.
+ *
+ * @param[in] pw  Pointer to the image writer
+ * @param[in] t   Pointer to a subtable (trie node)
+ * @param[in] def Entry of the subtable default route in the image
+ *
+ * @retval u64 Offset of index 0 of the copy
+ * @retval 0   No memory
+ */
+static u64
+saveNode (imgWriter* pw, subtable t, u64 def)
+{
+    rtTable* pt = pw->pt;
+    register int i, l;
+    register routeEnt* r;       /* route allotted from the parent */
+    subtable pst;
+    u64* q;
+    u64  off, e;
+    size_t size;
+
+
+    l    = t[-1].level;
+    size = nodeSize(pt, l);
+    off  = IMG_HDR_SIZE + pw->top + hdrWords(pt) * sizeof(tableEntry);
+    memcpy(pw->pNodes + pw->top, t - hdrWords(pt), size);
+    q = (u64*)(pw->pNodes + pw->top + hdrWords(pt) * sizeof(tableEntry));
+    pw->top += size;
+
+    q[1] = def;
+    for ( i = 2; i < (1 << (pt->psi[l].sl+1)); ++i ) {
+        r = ((i >> 1) > 1) ? t[i >> 1].ent : NULL;
+        if ( isSubtable(t[i]) ) {
+            pst = subtablePtr(t[i]).down;
+            if ( !pst[1].ent ) {
+                e = 0;
+            } else if ( pst[1].ent == r ) {
+                e = q[i >> 1];
+            } else if ( !(e = saveRoute(pw, pst[1].ent)) ) {
+                return 0;
+            }
+            e = saveNode(pw, pst, e);
+            if ( !e ) {
+                return 0;
+            }
+            q[i] = e | 1;
+        } else if ( !t[i].ent ) {
+            q[i] = 0;
+        } else if ( t[i].ent == r ) {
+            q[i] = q[i >> 1];
+        } else if ( !(q[i] = saveRoute(pw, t[i].ent)) ) {
+            return 0;
+        }
+    }
+    return off;
+}
+
+
+/**
+ * @name  rtArtSave
+ *
+ * @brief API function.
+ *        Writes routing table `pt' (simple or path-compressed trie)
+ *        to file `path' which can be loaded by rtArtLoad().
+ *        The user data of the routes are copied as they are.
+ *
+ * @param[in] pt   Pointer to the routing table
+ * @param[in] path File name
+ *
+ * @retval true  Success
+ * @retval false Not supported, no memory, or failed to write
+ */
+bool
+rtArtSave (rtTable* pt, const char* path)
+{
+    imgWriter   w;
+    rtArtImgHdr hdr;
+    u8   pad[IMG_HDR_SIZE];
+    FILE* fp;
+    bool rc = false;
+    int  i;
+
+
+    assert(pt && path);
+
+    if ( (pt->type != simpleTrie && pt->type != pathCompTrie) ||
+         (pt->root == NULL) || (pt->nLevels > IMG_MAX_LEVELS) ) {
+        return false;           /* compact trie or not thawed */
+    }
+
+    memset(&w, 0, sizeof(w));
+    w.pt     = pt;
+    w.slot   = (pt->routeSize + 7) & ~7;
+    w.routes = countNodes(pt, pt->root);
+    w.pNodes = malloc(w.routes);
+    if ( !w.pNodes ) {
+        return false;
+    }
+    w.routes += IMG_HDR_SIZE;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, IMG_MAGIC, sizeof(hdr.magic));
+    hdr.version   = IMG_VERSION;
+    hdr.type      = pt->type;
+    hdr.nLevels   = pt->nLevels;
+    hdr.alen      = pt->alen;
+    hdr.routeSize = pt->routeSize;
+    hdr.routeSlot = w.slot;
+    hdr.nRoutes   = pt->nRoutes;
+    hdr.routes    = w.routes;
+    for ( i = 0; i < pt->nLevels; ++i ) {
+        hdr.sl[i] = pt->psi[i].sl;
+    }
+
+    if ( pt->root[1].ent && !(hdr.root = saveRoute(&w, pt->root[1].ent)) ) {
+        goto nodeFree;
+    }
+    hdr.root = saveNode(&w, pt->root, hdr.root);
+    if ( !hdr.root ) {
+        goto nodeFree;
+    }
+    hdr.nImgRoutes = w.nRoutes;
+    hdr.size       = w.routes + (u64)w.nRoutes * w.slot;
+
+    fp = fopen(path, "wb");
+    if ( !fp ) {
+        goto nodeFree;
+    }
+    memset(pad, 0, sizeof(pad));
+    memcpy(pad, &hdr, sizeof(hdr));
+    if ( (fwrite(pad, sizeof(pad), 1, fp) == 1) &&
+         (fwrite(w.pNodes, w.top, 1, fp) == 1) &&
+         ((w.nRoutes == 0) ||
+          (fwrite(w.pRoutes, (size_t)w.nRoutes * w.slot, 1, fp) == 1)) ) {
+        rc = true;
+    }
+    if ( fclose(fp) != 0 ) {
+        rc = false;
+    }
+
+nodeFree:
+    free(w.pRoutes);
+    free(w.pNodes);
+    return rc;
+}
+
+
+/**
+ * @name  rtArtImgFindMatch
+ *
+ * @brief API function.
+ *        (registered as `pt->findMatch()' in `rtArtLoad()').
+ *        Performs the longest prefix match on the image in the
+ *        same way as rtArtPcFindMatch(). The candidate routes are
+ *        compared with `pDest' only if the image is path-compressed.
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] pDest Pointer to the destination IP address
+ *
+ * @retval routeEnt* Pointer to the longest prefix matching route.
+ * @retval NULL      There was no matching route for `pDest'
+ */
+static routeEnt*
+rtArtImgFindMatch (rtTable* pt, u8* pDest)
+{
+    register rtArtImage* pi = pt->pImg;
+    register u64* pst;
+    register u64  e;
+    register int  l;
+    u64  pDef[pt->nLevels];     /* trie-node default routes */
+    u8*  pAddr;
+    u32  offset;
+    bool pc = (pt->type == pathCompTrie);
+    int  n;
+    routeEnt* r;
+
+
+    pst = imgSubtablePtr(pi, pi->hdr->root);
+    n   = 0;
+    for (;;) {
+        l      = pst[-1];
+        pAddr  = pDest + pt->psi[l].sb;
+        offset = pt->psi[l].bo;
+        e = pst[fringeIndex(&pAddr, &offset, pt->psi[l].sl)];
+        if ( !e ) {
+            break;
+        }
+        if ( !imgIsSubtable(e) ) {
+            r = imgRoutePtr(pi, e);
+            if ( !pc || cmpAddr(pDest, r->dest, r->plen) ) {
+                return r;
+            }
+            break;
+        }
+        pst = imgSubtablePtr(pi, e);
+        if ( pst[1] ) {
+            pDef[n++] = pst[1];
+        }
+    }
+
+    /*
+     * No match
+     */
+    while ( --n >= 0 ) {
+        r = imgRoutePtr(pi, pDef[n]);
+        if ( !pc || cmpAddr(pDest, r->dest, r->plen) ) {
+            return r;
+        }
+    }
+    e = imgSubtablePtr(pi, pi->hdr->root)[1];
+    return (e) ? imgRoutePtr(pi, e) : NULL; /* default route */
+}
+
+
+/**
+ * @name  rtArtImgFindMatch4
+ *
+ * @brief API function.
+ *        (registered as `pt->findMatch4()' in `rtArtLoad()').
+ *        Converts `dest' to the network byte order and calls
+ *        rtArtImgFindMatch().
+ *
+ * @param[in] pt   Pointer to the IPv4 routing table
+ * @param[in] dest Destination IPv4 address in the host byte order
+ *
+ * @retval routeEnt* Pointer to the longest prefix matching route.
+ * @retval NULL      There was no matching route
+ */
+static routeEnt*
+rtArtImgFindMatch4 (rtTable* pt, ipv4a dest)
+{
+    ipv4na a[4] = { __builtin_bswap32(dest) }; /* routeEnt.dest size */
+
+    assert(pt->alen == 32);
+    return rtArtImgFindMatch(pt, (u8*)a);
+}
+
+
+/**
+ * @name  rtArtImgFindMatch6
+ *
+ * @brief API function.
+ *        (registered as `pt->findMatch6()' in `rtArtLoad()').
+ *        Converts the address to the network byte order and calls
+ *        rtArtImgFindMatch().
+ *
+ * @param[in] pt Pointer to the IPv6 routing table
+ * @param[in] hi The first 64 bits of the destination address
+ * @param[in] lo The last 64 bits of the destination address
+ *
+ * @retval routeEnt* Pointer to the longest prefix matching route.
+ * @retval NULL      There was no matching route
+ */
+static routeEnt*
+rtArtImgFindMatch6 (rtTable* pt, u64 hi, u64 lo)
+{
+    u64 a[2] = { __builtin_bswap64(hi), __builtin_bswap64(lo) };
+
+    assert(pt->alen == 128);
+    return rtArtImgFindMatch(pt, (u8*)a);
+}
+
+
+/**
+ * @name  rtArtImgFindMatchBatch
+ *
+ * @brief API function.
+ *        (registered as `pt->findMatchBatch()' in `rtArtLoad()').
+ *        Calls rtArtImgFindMatch() `n' times.
+ *
+ * @param[in]  pt    Pointer to the routing table
+ * @param[in]  pDest Array of `n' pointers to the destination IP addresses
+ * @param[out] pRes  Array of `n' longest prefix matching routes
+ * @param[in]  n     The number of addresses to be looked up
+ */
+static void
+rtArtImgFindMatchBatch (rtTable* pt, u8** pDest, routeEnt** pRes, int n)
+{
+    int i;
+
+    for ( i = 0; i < n; ++i ) {
+        pRes[i] = rtArtImgFindMatch(pt, pDest[i]);
+    }
+}
+
+
+/**
+ * @name  rtArtImgFindExactMatch
+ *
+ * @brief API Function.
+ *        (registered as `pt->findExactMatch()' in `rtArtLoad()').
+ *        Performs the exact match (address + prefix length) on
+ *        the image.
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] pDest Pointer to the IP address to be searched for
+ * @param[in] plen  prefix length of `pDest'
+ *
+ * @retval routeEnt* Pointer to the found route entry (success)
+ * @retval NULL      Failed to find a matching route entry
+ */
+static routeEnt*
+rtArtImgFindExactMatch (rtTable* pt, u8* pDest, int plen)
+{
+    register rtArtImage* pi = pt->pImg;
+    register u64* pst;
+    register u64  e;
+    register int  l, ml;
+    routeEnt* r;
+    u8*  pAddr;
+    u32  offset;
+    int  index;
+
+
+    pst = imgSubtablePtr(pi, pi->hdr->root);
+    if ( plen == 0 ) {
+        return (pst[1]) ? imgRoutePtr(pi, pst[1]) : NULL;
+    }
+
+    ml = plen2level(pt, plen);
+    for ( l = pst[-1]; l <= ml; l = pst[-1] ) {
+        if ( l == ml ) {
+            index = baseIndex(pt, pDest, plen);
+        } else {
+            pAddr  = pDest + pt->psi[l].sb;
+            offset = pt->psi[l].bo;
+            index  = fringeIndex(&pAddr, &offset, pt->psi[l].sl);
+        }
+        e = pst[index];
+        if ( imgIsSubtable(e) ) {
+            /*
+             * 1. Go to the next subtable (trie node)
+             * 2. Check the subtable default route.
+             */
+            pst = imgSubtablePtr(pi, e);
+            e   = pst[1];
+        } else {
+            l = ml;             /* no more subtable */
+        }
+        if ( e ) {
+            r = imgRoutePtr(pi, e);
+            if ( (r->plen == plen) && cmpAddr(pDest, r->dest, plen) ) {
+                return r;
+            }
+        }
+        if ( l == ml ) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * @name  thawRoute
+ *
+ * @brief Returns a writable copy of a route in the image. The
+ *        same route in the image is copied only once.
+ *
+ * @param[in] pt   Pointer to the writable routing table
+ * @param[in] pi   Pointer to the image
+ * @param[in] pMap Array of the copies indexed by route in the image
+ * @param[in] e    Route entry in the image
+ *
+ * @retval routeEnt* Pointer to the copy
+ * @retval NULL      No memory
+ */
+static routeEnt*
+thawRoute (rtTable* pt, rtArtImage* pi, routeEnt** pMap, u64 e)
+{
+    rtArtImgHdr* ph = pi->hdr;
+    u32 i;
+
+
+    i = (e - ph->routes) / ph->routeSlot;
+    assert(i < ph->nImgRoutes);
+    if ( !pMap[i] ) {
+        pMap[i] = rtArtNewRoute(pt);
+        if ( !pMap[i] ) {
+            return NULL;
+        }
+        memcpy(pMap[i], imgRoutePtr(pi, e),
+               (pt->routeSize < ph->routeSize) ? pt->routeSize : ph->routeSize);
+        rtArtCountRoute(pt, pMap[i], 1);
+    }
+    return pMap[i];
+}
+
+
+/**
+ * @name  thawNode
+ *
+ * @brief Copies subtable `q' in the image and its descendants to
+ *        subtable `t' of a writable routing table. If there is no
+ *        memory, the entries not copied yet are cleared so that
+ *        the table can be destroyed.
+ *
+ * @param[in] pt   Pointer to the writable routing table
+ * @param[in] pi   Pointer to the image
+ * @param[in] pMap Array of the copies indexed by route in the image
+ * @param[in] q    Pointer to the subtable in the image
+ * @param[in] t    Pointer to the subtable to be filled
+ *
+ * @retval true  Success
+ * @retval false No memory
+ */
+static bool
+thawNode (rtTable* pt, rtArtImage* pi, routeEnt** pMap, u64* q, subtable t)
+{
+    register int i, l, n;
+    size_t size;
+    void*  p;
+    u64    e;
+    bool   rc;
+
+
+    l    = q[-1];
+    n    = 1 << (pt->psi[l].sl+1);
+    size = nodeSize(pt, l);
+    memcpy(t - hdrWords(pt), q - hdrWords(pt), size);
+    for ( i = 1; i < n; ++i ) {
+        e = q[i];
+        if ( !e ) {
+            continue;
+        }
+        if ( !imgIsSubtable(e) ) {
+            t[i].ent = thawRoute(pt, pi, pMap, e);
+            if ( !t[i].ent ) {
+                goto fail;
+            }
+            continue;
+        }
+        p = pt->alloc.alloc(pt->alloc.ctx, imgSubtablePtr(pi, e)[-1],
+                            nodeSize(pt, imgSubtablePtr(pi, e)[-1]));
+        if ( !p ) {
+            goto fail;
+        }
+        rtArtCountSubtable(pt, imgSubtablePtr(pi, e)[-1],
+                           nodeSize(pt, imgSubtablePtr(pi, e)[-1]), 1);
+        t[i].down = (subtable)p + hdrWords(pt);
+        rc = thawNode(pt, pi, pMap, imgSubtablePtr(pi, e), t[i].down);
+        t[i].down = makeSubtable(t[i].down);
+        if ( !rc ) {
+            ++i;
+            goto fail;
+        }
+    }
+    return true;
+
+fail:
+    /*
+     * Entries before `i' (including the parents of the others)
+     * are copied
+     */
+    memset(&t[i], 0, (n - i) * sizeof(t[0]));
+    return false;
+}
+
+
+/**
+ * @name  rtArtThaw
+ *
+ * @brief API function.
+ *        Copies the image of a routing table loaded by rtArtLoad()
+ *        to a writable routing table in place. Called by the first
+ *        update of the table if not called explicitly.
+ *        There must be no reader of `pt'. The routes returned by
+ *        the lookups before this call must not be used anymore.
+ *
+ * @param[in] pt Pointer to the routing table loaded by rtArtLoad()
+ * @param[in] po Options of the writable routing table (may be NULL).
+ *               If NULL, the routes have the same user data size as
+ *               the image.
+ *
+ * @retval true  Success (or `pt' is already writable)
+ * @retval false No memory. `pt' is left as it was.
+ */
+bool
+rtArtThaw (rtTable* pt, rtArtOpts* po)
+{
+    rtArtImage* pi = pt->pImg;
+    rtArtImgHdr* ph;
+    rtArtOpts  opts;
+    routeEnt** pMap;
+    rtTable*   npt;
+
+
+    if ( pi == NULL ) {
+        return true;
+    }
+    ph = pi->hdr;
+
+    if ( po == NULL ) {
+        memset(&opts, 0, sizeof(opts));
+        opts.routeDataSize = ph->routeSize - sizeof(routeEnt);
+    } else {
+        opts = *po;
+    }
+    opts.flags &= ~artOptExactIndex; /* indexed after thawNode() */
+    pMap = calloc(ph->nImgRoutes + 1, sizeof(routeEnt*));
+    if ( !pMap ) {
+        return false;
+    }
+    npt = rtArtInitOpts(ph->nLevels, ph->sl, ph->alen, ph->type, &opts);
+    if ( !npt ) {
+        free(pMap);
+        return false;
+    }
+    if ( !thawNode(npt, pi, pMap, imgSubtablePtr(pi, ph->root), npt->root) ) {
+        free(pMap);
+        npt->deleteTable(&npt);
+        return false;
+    }
+    assert(npt->nRoutes == ph->nRoutes);
+    free(pMap);
+    if ( po && (po->flags & artOptExactIndex) && !rtArtIndexInit(npt) ) {
+        npt->deleteTable(&npt);
+        return false;
+    }
+
+    /*
+     * Replace `pt' with `npt'
+     */
+    munmap(pi->base, ph->size);
+    free(pi);
+    free(pt->pLvStats);
+    free(pt->psi);
+    *pt = *npt;
+    free(npt);
+
+    return true;
+}
+
+
+/**
+ * @name  rtArtImgInsertRoute
+ *
+ * @brief API function.
+ *        (registered as `pt->insert()' in `rtArtLoad()').
+ *        Thaws the table then inserts `pEnt'.
+ *
+ * @retval routeEnt* See `pt->insert()'
+ * @retval NULL      Failed to thaw the table
+ */
+static routeEnt*
+rtArtImgInsertRoute (rtTable* pt, routeEnt* pEnt)
+{
+    if ( !rtArtThaw(pt, NULL) ) {
+        return NULL;
+    }
+    return pt->insert(pt, pEnt);
+}
+
+
+/**
+ * @name  rtArtImgDeleteRoute
+ *
+ * @brief API function.
+ *        (registered as `pt->delete()' in `rtArtLoad()').
+ *        Thaws the table then deletes (`pDest', `plen').
+ */
+static bool
+rtArtImgDeleteRoute (rtTable* pt, u8* pDest, int plen)
+{
+    if ( !rtArtThaw(pt, NULL) ) {
+        return false;
+    }
+    return pt->delete(pt, pDest, plen);
+}
+
+
+/**
+ * @name  rtArtImgReplaceRoute
+ *
+ * @brief API function.
+ *        (registered as `pt->replace()' in `rtArtLoad()').
+ *        Thaws the table then replaces the route of `pEnt'.
+ *
+ * @retval routeEnt* See `pt->replace()'
+ * @retval NULL      Failed to thaw the table
+ */
+static routeEnt*
+rtArtImgReplaceRoute (rtTable* pt, routeEnt* pEnt)
+{
+    if ( !rtArtThaw(pt, NULL) ) {
+        return NULL;
+    }
+    return pt->replace(pt, pEnt);
+}
+
+
+/**
+ * @name  rtArtImgFlushRoutesFunc
+ *
+ * @brief API function.
+ *        (registered as `pt->flushRoutes()' in `rtArtLoad()').
+ *        Thaws the table then flushes it.
+ */
+static bool
+rtArtImgFlushRoutesFunc (rtTable* pt, rtFunc f, void* p2)
+{
+    if ( !rtArtThaw(pt, NULL) ) {
+        return false;
+    }
+    return pt->flushRoutes(pt, f, p2);
+}
+
+
+/**
+ * @name  rtArtImgBulkLoad
+ *
+ * @brief API function.
+ *        (registered as `pt->bulkLoad()' in `rtArtLoad()').
+ *        Thaws the table then inserts the routes.
+ */
+static int
+rtArtImgBulkLoad (rtTable* pt, routeEnt** pRoutes, int n)
+{
+    if ( !rtArtThaw(pt, NULL) ) {
+        return 0;
+    }
+    return pt->bulkLoad(pt, pRoutes, n);
+}
+
+
+/**
+ * @name  rtArtImgDestroy
+ *
+ * @brief API Function.
+ *        (registered as `pt->deleteTable()' in `rtArtLoad()').
+ *        Unmaps the image and frees the routing table.
+ *
+ * @param[in,out] p Pointer to the pointer to `rtTable'. `*p' is
+ *                  set to NULL at the end of this function.
+ */
+static void
+rtArtImgDestroy (rtTable** p)
+{
+    rtTable* pt = *p;
+
+    munmap(pt->pImg->base, pt->pImg->hdr->size);
+    free(pt->pImg);
+    free(pt->pLvStats);
+    free(pt->psi);
+    free(pt);
+    *p = NULL;
+}
+
+
+/**
+ * @name  rtArtLoad
+ *
+ * @brief API function.
+ *        Maps the image written by rtArtSave() read-only, and
+ *        returns a routing table looked up in the image. The
+ *        table is thawed when it is updated first (see rtArtThaw().)
+ *
+ * @param[in] path File name
+ *
+ * @retval rtTable* Pointer to the routing table
+ * @retval NULL     Failed to open the file, wrong image, or no memory
+ */
+rtTable*
+rtArtLoad (const char* path)
+{
+    rtArtImgHdr* ph;
+    rtArtImage*  pi;
+    rtTable*     pt;
+    struct stat  st;
+    void* p;
+    int   fd, i, sum;
+
+
+    fd = open(path, O_RDONLY);
+    if ( fd < 0 ) {
+        return NULL;
+    }
+    if ( (fstat(fd, &st) != 0) || (st.st_size < IMG_HDR_SIZE) ) {
+        close(fd);
+        return NULL;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( p == MAP_FAILED ) {
+        return NULL;
+    }
+
+    /*
+     * Check the header
+     */
+    ph = p;
+    if ( memcmp(ph->magic, IMG_MAGIC, sizeof(ph->magic)) ||
+         (ph->version != IMG_VERSION) || (ph->size != st.st_size) ||
+         ((ph->type != simpleTrie) && (ph->type != pathCompTrie)) ||
+         (ph->nLevels == 0) || (ph->nLevels > IMG_MAX_LEVELS) ||
+         ((ph->alen != 32) && (ph->alen != 128)) ||
+         (ph->routeSize < sizeof(routeEnt)) ||
+         (ph->root >= ph->routes) || (ph->routes > ph->size) ) {
+        goto unmap;
+    }
+    for ( i = sum = 0; i < ph->nLevels; ++i ) {
+        sum += ph->sl[i];
+    }
+    if ( sum != ph->alen ) {
+        goto unmap;
+    }
+
+    pt = calloc(1, sizeof(rtTable));
+    if ( pt == NULL ) {
+        goto unmap;
+    }
+    pi = calloc(1, sizeof(rtArtImage));
+    if ( pi == NULL ) {
+        goto tblFree;
+    }
+    pt->psi = calloc(ph->nLevels, sizeof(strideInfo));
+    if ( pt->psi == NULL ) {
+        goto imgFree;
+    }
+    pt->pLvStats = calloc(ph->nLevels, sizeof(rtArtLevelStats));
+    if ( pt->pLvStats == NULL ) {
+        goto slFree;
+    }
+    pi->base = p;
+    pi->hdr  = ph;
+
+    pt->pImg    = pi;
+    pt->type    = ph->type;
+    pt->nLevels = ph->nLevels;
+    pt->alen    = ph->alen;
+    pt->len     = bits2bytes(ph->alen);
+    pt->off     = -1 - bytes2nPtrs((ph->alen >> 3));
+    pt->nRoutes = ph->nRoutes;
+    pt->routeSize = ph->routeSize;
+    for ( i = sum = 0; i < ph->nLevels; ++i ) {
+        pt->psi[i].sl = ph->sl[i];
+        pt->psi[i].sb = sum >> 3;
+        pt->psi[i].bo = sum & 7;
+        sum += ph->sl[i];
+        pt->psi[i].tl = sum;
+    }
+
+    pt->insert         = rtArtImgInsertRoute;
+    pt->delete         = rtArtImgDeleteRoute;
+    pt->replace        = rtArtImgReplaceRoute;
+    pt->deleteTable    = rtArtImgDestroy;
+    pt->flush          = rtArtFlushRoutes;
+    pt->findMatch      = rtArtImgFindMatch;
+    pt->findMatch4     = rtArtImgFindMatch4;
+    pt->findMatch6     = rtArtImgFindMatch6;
+    pt->findExactMatch = rtArtImgFindExactMatch;
+    pt->findMatchBatch = rtArtImgFindMatchBatch;
+    pt->bulkLoad       = rtArtImgBulkLoad;
+    pt->flushRoutes    = rtArtImgFlushRoutesFunc;
+
+    return pt;
+
+slFree:
+    free(pt->psi);
+imgFree:
+    free(pi);
+tblFree:
+    free(pt);
+unmap:
+    munmap(p, st.st_size);
+    return NULL;
+}
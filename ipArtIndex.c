@@ -0,0 +1,461 @@
+/** @file ipArtIndex.c
+    @brif Hash index of the prefixes for exact matches
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   A routing table created with artOptExactIndex has an open
+   addressing hash table of its routes keyed on (prefix, prefix
+   length). rtArtIndexInit() replaces the update functions of the
+   table with the ones of this file that keep the index in sync and
+   call the functions of the trie:
+
+     - pt->findExactMatch() looks up the index only.
+     - pt->insert() returns the route of the same prefix found in
+       the index without walking the trie.
+     - pt->delete() and pt->replace() of a prefix that has no route
+       return without walking the trie.
+
+   The trie is still walked to delete or replace an existing route
+   because the allotment needs the path from the root.
+   rtArtBulkLoadParallel() of an indexed table loads the routes on
+   one thread.
+   With lock-free readers (artOptConcurrent), the index is used by
+   the writer only and pt->findExactMatch() walks the trie.
+*/
+
+
+#include "ipArt.h"
+
+
+#define IDX_MIN_SLOTS 1024      /* initial size of the hash table */
+
+typedef struct idxSlot idxSlot;
+struct idxSlot {
+    routeEnt* r;                /* route. NULL: empty slot */
+    u32       h;                /* hash of the prefix of `r' */
+};
+
+struct rtArtIndex {
+    u32      nSlots;            /* size of `pSlot' (power of 2) */
+    u32      nUsed;             /* # of used slots */
+    idxSlot* pSlot;             /* open addressing hash table */
+
+    /* functions of the trie */
+    routeEnt* (*insert)(rtTable* p, routeEnt* r);
+    bool (*delete)(rtTable* p, u8* pDest, int plen);
+    routeEnt* (*replace)(rtTable* p, routeEnt* r);
+    int  (*bulkLoad)(rtTable *p, routeEnt** pRoutes, int n);
+    bool (*flushRoutes)(rtTable* pt, rtFunc f, void* p2);
+    void (*deleteTable)(rtTable** pt);
+};
+
+
+/**
+ * @name  idxHash
+ *
+ * @brief Returns the hash of the first `plen' bits of `pDest' and
+ *        `plen'.
+ */
+static inline u32
+idxHash (u8* pDest, int plen)
+{
+    register u64 h;
+    register int i;
+
+
+    h = (plen + 1) * 0x9e3779b97f4a7c15ULL;
+    for ( i = 0; i < (plen >> 3); ++i ) {
+        h = (h ^ pDest[i]) * 0x100000001b3ULL;
+    }
+    if ( plen & 7 ) {
+        h = (h ^ (pDest[i] & (0xff00 >> (plen & 7)))) * 0x100000001b3ULL;
+    }
+    h ^= h >> 29;
+    return (u32)((h * 0xbf58476d1ce4e5b9ULL) >> 32);
+}
+
+
+/**
+ * @name  idxFind
+ *
+ * @brief Returns the slot of the route of prefix `pDest'/`plen', or
+ *        the empty slot where it is added if there is no route.
+ */
+static inline u32
+idxFind (rtArtIndex* pi, u8* pDest, int plen, u32 h)
+{
+    register u32 i, mask;
+    register routeEnt* r;
+
+    mask = pi->nSlots - 1;
+    for ( i = h & mask; (r = pi->pSlot[i].r); i = (i + 1) & mask ) {
+        if ( (pi->pSlot[i].h == h) && (r->plen == plen) &&
+             cmpAddr(r->dest, pDest, plen) ) {
+            break;
+        }
+    }
+    return i;
+}
+
+
+/**
+ * @name  idxGrow
+ *
+ * @brief Doubles the size of the hash table.
+ *
+ * @retval false No memory. The hash table is not changed.
+ */
+static bool
+idxGrow (rtArtIndex* pi)
+{
+    idxSlot* pOld;
+    u32 i, j, n, mask;
+
+
+    pOld = pi->pSlot;
+    n    = pi->nSlots;
+    pi->pSlot = calloc(n << 1, sizeof(idxSlot));
+    if ( pi->pSlot == NULL ) {
+        pi->pSlot = pOld;
+        return false;
+    }
+    pi->nSlots = n << 1;
+    mask = pi->nSlots - 1;
+    for ( i = 0; i < n; ++i ) {
+        if ( pOld[i].r ) {
+            for ( j = pOld[i].h & mask; pi->pSlot[j].r; j = (j + 1) & mask )
+                ;
+            pi->pSlot[j] = pOld[i];
+        }
+    }
+    free(pOld);
+    return true;
+}
+
+
+/**
+ * @name  idxReserve
+ *
+ * @brief Grows the hash table so that `n' more routes can be added
+ *        keeping it at most half full.
+ *
+ * @retval false No memory. There may be no room for `n' routes.
+ */
+static bool
+idxReserve (rtArtIndex* pi, u32 n)
+{
+    while ( ((u64)pi->nUsed + n) * 2 > pi->nSlots ) {
+        if ( !idxGrow(pi) ) return false;
+    }
+    return true;
+}
+
+
+/**
+ * @name  idxAdd
+ *
+ * @brief Adds route `r' to the index, or replaces the route of the
+ *        same prefix with it. The caller must make room for it with
+ *        idxReserve().
+ */
+static void
+idxAdd (rtArtIndex* pi, routeEnt* r)
+{
+    register u32 h, i;
+
+    h = idxHash(r->dest, r->plen);
+    i = idxFind(pi, r->dest, r->plen, h);
+    if ( pi->pSlot[i].r == NULL ) {
+        ++pi->nUsed;
+    }
+    pi->pSlot[i].r = r;
+    pi->pSlot[i].h = h;
+    assert(pi->nUsed * 2 <= pi->nSlots);
+}
+
+
+/**
+ * @name  idxRemove
+ *
+ * @brief Empties slot `i' and moves the following slots of the same
+ *        cluster back so that no tombstone is needed.
+ */
+static void
+idxRemove (rtArtIndex* pi, u32 i)
+{
+    register u32 j, mask;
+
+    mask = pi->nSlots - 1;
+    pi->pSlot[i].r = NULL;
+    --pi->nUsed;
+    for ( j = (i + 1) & mask; pi->pSlot[j].r; j = (j + 1) & mask ) {
+        if ( ((j - pi->pSlot[j].h) & mask) >= ((j - i) & mask) ) {
+            pi->pSlot[i] = pi->pSlot[j];
+            pi->pSlot[j].r = NULL;
+            i = j;
+        }
+    }
+}
+
+
+/**
+ * @name  idxFindExactMatch
+ *
+ * @brief API function.
+ *        (registered as `pt->findExactMatch()' by rtArtIndexInit()).
+ *        Returns the route of prefix `pDest'/`plen' found in the
+ *        index. Returns the default route (or NULL) if there is
+ *        none as `pt->findExactMatch()' of the trie does.
+ */
+static routeEnt*
+idxFindExactMatch (rtTable* pt, u8* pDest, int plen)
+{
+    rtArtIndex* pi = pt->pIdx;
+    register u32 i;
+
+    i = idxFind(pi, pDest, plen, idxHash(pDest, plen));
+    if ( !pi->pSlot[i].r && plen ) {
+        i = idxFind(pi, pDest, 0, idxHash(pDest, 0));   /* default route */
+    }
+    return pi->pSlot[i].r;
+}
+
+
+/**
+ * @name  idxInsertRoute
+ *
+ * @brief API function.
+ *        (registered as `pt->insert()' by rtArtIndexInit()).
+ *        Same as `pt->insert()' of the trie. Returns the existing
+ *        route of the prefix of `pEnt' without walking the trie, or
+ *        NULL without inserting `pEnt' if the index cannot grow.
+ */
+static routeEnt*
+idxInsertRoute (rtTable* pt, routeEnt* pEnt)
+{
+    rtArtIndex* pi = pt->pIdx;
+    routeEnt*   r;
+    u32 i;
+
+
+    assert((pt != NULL) && (pEnt != NULL));
+
+    i = idxFind(pi, pEnt->dest, pEnt->plen, idxHash(pEnt->dest, pEnt->plen));
+    if ( pi->pSlot[i].r ) {
+        return pi->pSlot[i].r;
+    }
+    if ( !idxReserve(pi, 1) ) {
+        return NULL;            /* the trie is not changed */
+    }
+    r = pi->insert(pt, pEnt);
+    if ( r == pEnt ) {
+        idxAdd(pi, pEnt);
+    }
+    return r;
+}
+
+
+/**
+ * @name  idxDeleteRoute
+ *
+ * @brief API function.
+ *        (registered as `pt->delete()' by rtArtIndexInit()).
+ *        Same as `pt->delete()' of the trie. Returns false without
+ *        walking the trie if there is no route of the prefix.
+ */
+static bool
+idxDeleteRoute (rtTable* pt, u8* pDest, int plen)
+{
+    rtArtIndex* pi = pt->pIdx;
+    u32 i;
+
+
+    i = idxFind(pi, pDest, plen, idxHash(pDest, plen));
+    if ( pi->pSlot[i].r == NULL ) {
+        return false;
+    }
+    if ( !pi->delete(pt, pDest, plen) ) {
+        return false;
+    }
+    idxRemove(pi, i);
+    return true;
+}
+
+
+/**
+ * @name  idxReplaceRoute
+ *
+ * @brief API function.
+ *        (registered as `pt->replace()' by rtArtIndexInit()).
+ *        Same as `pt->replace()' of the trie. Returns NULL without
+ *        walking the trie if there is no route of the prefix.
+ */
+static routeEnt*
+idxReplaceRoute (rtTable* pt, routeEnt* pEnt)
+{
+    rtArtIndex* pi = pt->pIdx;
+    routeEnt*   r;
+    u32 i;
+
+
+    assert((pt != NULL) && (pEnt != NULL));
+
+    i = idxFind(pi, pEnt->dest, pEnt->plen, idxHash(pEnt->dest, pEnt->plen));
+    if ( pi->pSlot[i].r == NULL ) {
+        return NULL;
+    }
+    r = pi->replace(pt, pEnt);
+    if ( r ) {
+        pi->pSlot[i].r = pEnt;  /* same prefix, same hash */
+    }
+    return r;
+}
+
+
+/**
+ * @name  idxBulkLoad
+ *
+ * @brief API function.
+ *        (registered as `pt->bulkLoad()' by rtArtIndexInit()).
+ *        Same as `pt->bulkLoad()' of the trie, then adds the
+ *        inserted routes to the index. Inserts no route if the
+ *        index cannot grow for `n' routes.
+ */
+static int
+idxBulkLoad (rtTable* pt, routeEnt** pRoutes, int n)
+{
+    rtArtIndex* pi = pt->pIdx;
+    int i, m;
+
+
+    if ( !idxReserve(pi, n) ) {
+        return 0;
+    }
+    m = pi->bulkLoad(pt, pRoutes, n);
+    for ( i = 0; i < m; ++i ) {
+        idxAdd(pi, pRoutes[i]); /* may be added by pt->insert() */
+    }
+    return m;
+}
+
+
+/**
+ * @name  idxFlushRoutes
+ *
+ * @brief API function.
+ *        (registered as `pt->flushRoutes()' by rtArtIndexInit()).
+ *        Same as `pt->flushRoutes()' of the trie, then empties the
+ *        index.
+ */
+static bool
+idxFlushRoutes (rtTable* pt, rtFunc f, void* p2)
+{
+    rtArtIndex* pi = pt->pIdx;
+    bool rc;
+
+
+    rc = pi->flushRoutes(pt, f, p2);
+    memset(pi->pSlot, 0, pi->nSlots * sizeof(idxSlot));
+    pi->nUsed = 0;
+    return rc;
+}
+
+
+/**
+ * @name  idxDestroy
+ *
+ * @brief API function.
+ *        (registered as `pt->deleteTable()' by rtArtIndexInit()).
+ *        Frees the index, then the routing table.
+ */
+static void
+idxDestroy (rtTable** p)
+{
+    rtArtIndex* pi = (*p)->pIdx;
+
+    pi->deleteTable(p);
+    free(pi->pSlot);
+    free(pi);
+}
+
+
+/**
+ * @name  rtArtIndexInit
+ *
+ * @brief Creates the exact match index of `pt' (artOptExactIndex)
+ *        with the routes in it, and registers the functions of this
+ *        file. Called by rtArtInitOpts() and rtArtThaw().
+ *
+ * @param[in] pt Pointer to the routing table
+ *
+ * @retval true  Success
+ * @retval false No memory, or `pt' is not empty and not walked by
+ *               rtArtIterNext(). `pt' is not changed.
+ */
+bool
+rtArtIndexInit (rtTable* pt)
+{
+    rtArtIndex* pi;
+    rtArtIter   it;
+    routeEnt*   r;
+
+
+    assert(pt->pIdx == NULL);
+
+    pi = calloc(1, sizeof(rtArtIndex));
+    if ( pi == NULL ) return false;
+    pi->nSlots = IDX_MIN_SLOTS;
+    while ( pi->nSlots < (u32)pt->nRoutes * 2 ) {
+        pi->nSlots <<= 1;
+    }
+    pi->pSlot = calloc(pi->nSlots, sizeof(idxSlot));
+    if ( pi->pSlot == NULL ) goto idxFree;
+    if ( pt->nRoutes > 0 ) {
+        if ( !rtArtIterInit(&it, pt, 0, ~0) ) goto idxFree;
+        while ( (r = rtArtIterNext(&it)) ) {
+            idxAdd(pi, r);
+        }
+    }
+
+    pi->insert      = pt->insert;
+    pi->delete      = pt->delete;
+    pi->replace     = pt->replace;
+    pi->bulkLoad    = pt->bulkLoad;
+    pi->flushRoutes = pt->flushRoutes;
+    pi->deleteTable = pt->deleteTable;
+
+    pt->pIdx        = pi;
+    pt->insert      = idxInsertRoute;
+    pt->delete      = idxDeleteRoute;
+    pt->replace     = idxReplaceRoute;
+    pt->bulkLoad    = idxBulkLoad;
+    pt->flushRoutes = idxFlushRoutes;
+    pt->deleteTable = idxDestroy;
+    if ( pt->pEpoch == NULL ) {
+        pt->findExactMatch = idxFindExactMatch;
+    }
+    return true;
+
+
+idxFree:
+    free(pi->pSlot);
+    free(pi);
+    return false;
+}
@@ -258,6 +258,23 @@ checkSubtable (rtTable* pt, subtable t, bool* flag)
 #endif /* DEBUG_FREE_HEAP */
 
 
+/**
+ * @name  subtableSize
+ *
+ * @brief Returns the size of the memory for a subtable (trie node)
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] level level of the subtable
+ *
+ * @retval size_t Size in bytes including the level and address cache
+ */
+static inline size_t
+subtableSize (rtTable* pt, int level)
+{
+    return ((1 << (pt->psi[level].sl+1)) - pt->off) * sizeof(tableEntry);
+}
+
+
 /**
  * @name  rtArtPcNewSubTable
  *
@@ -287,8 +304,9 @@ rtArtPcNewSubTable (rtTable* p, int level, tableEntry base, u8* pa)
      * bytes2nPtrs(p->len):   address to calc. parent heaps' fringe indices
      */
     a = -(p->off);              /* a = bytes2nPtrs(p->len) + 1; */
-    t = (subtable)calloc((1 << (p->psi[level].sl+1))+a, sizeof(tableEntry));
+    t = (subtable)p->alloc.alloc(p->alloc.ctx, level, subtableSize(p, level));
     if (!t) return t;
+    rtArtCountSubtable(p, level, subtableSize(p, level), 1);
 
     /*
      * save the prefix representing this subtable
@@ -326,10 +344,31 @@ getNodeDefAddr (rtTable *p, subtable t)
 }
 
 
+/**
+ * @name  rtArtPcFreeSubtableMem
+ *
+ * @brief Returns the memory of a subtable to the subtable allocator
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] p  Pointer to the beginning of the subtable memory
+ *               (i.e., the address cache)
+ */
+static void
+rtArtPcFreeSubtableMem (rtTable* pt, void* p)
+{
+    register int level = ((subtable)p - pt->off)[-1].level;
+
+    rtArtCountSubtable(pt, level, subtableSize(pt, level), -1);
+    pt->alloc.free(pt->alloc.ctx, level, p, subtableSize(pt, level));
+}
+
+
 /**
  * @name  rtArtPcFreeSubtable
  *
- * @brief Frees the memory allocated for a subtable (trie node)
+ * @brief Frees the memory allocated for a subtable (trie node).
+ *        If the readers are lock-free, the memory is freed after
+ *        all the readers that may see the subtable leave.
  *
  * @param[in] pt Pointer to the routing table
  * @param[in] t  Pointer to the subtable to be freed
@@ -346,13 +385,47 @@ rtArtPcFreeSubtable (rtTable* pt, subtable t)
     assert(pt && t);
 
     base = t[1];
-    free(t + pt->off);
+    if ( pt->pEpoch ) {
+        rtArtRetire(pt, t + pt->off, rtArtPcFreeSubtableMem);
+    } else {
+        rtArtPcFreeSubtableMem(pt, t + pt->off);
+    }
     ++pt->nSubtablesFreed;
 
     return base;
 }
 
 
+/**
+ * @name  rtArtPcDupSubtable
+ *
+ * @brief Allocates a copy of a subtable (trie node) including
+ *        its address cache. Used to modify a subtable that may be
+ *        seen by lock-free readers.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] t  Pointer to the subtable to be copied
+ *
+ * @retval subtable Pointer to the copy of `t' (success)
+ * @retval NULL     Failed to allocate a subtable
+ */
+static subtable
+rtArtPcDupSubtable (rtTable* pt, subtable t)
+{
+    register subtable nt;
+    size_t n;
+
+
+    n  = subtableSize(pt, t[-1].level);
+    nt = (subtable)pt->alloc.alloc(pt->alloc.ctx, t[-1].level, n);
+    if ( !nt ) return nt;
+    rtArtCountSubtable(pt, t[-1].level, n, 1);
+
+    memcpy(nt, t + pt->off, n);
+    return nt - pt->off;
+}
+
+
 /**
  * @name  firstDiffLevel
  *
@@ -368,27 +441,17 @@ rtArtPcFreeSubtable (rtTable* pt, subtable t)
 static inline int
 firstDiffLevel (rtTable* p, int index, u8* p1, u8* p2)
 {
-    u32 offset;
-    u8  mask;
     int nBits;
     int l;
 
-    nBits = index << 3;
+    assert(p1[index] != p2[index]);
+
+    /*
+     * Bit position of the first difference
+     */
+    nBits = (index << 3) + __builtin_clz((u32)(p1[index] ^ p2[index])) - 24;
     for (l = 0; l < p->nLevels; ++l) {
         if ( p->psi[l].tl > nBits ) {
-            offset = p->psi[l].tl - nBits;
-
-            while ( offset > 8 ) {
-                if ( p1[index] != p2[index] ) {
-                    return l;
-                }
-                offset >>= 1;
-                ++index;
-            }
-            mask = ~((1 << (8 - offset)) - 1);
-            if ( (p1[index] & mask) == (p2[index] & mask) ) {
-                return l + 1;
-            }
             return l;
         }
     }
@@ -457,13 +520,13 @@ rtArtInsert (rtTable* pt, subtable t, int k,
 
     t[0].nRoutes++;
     if ( k < threshold ) {
-        rtArtAllot(t, k, r, s, threshold, fringeCheck);
+        rtArtCountAllot(pt, rtArtAllot(t, k, r, s, threshold, fringeCheck));
     } else if ( fringeCheck && isSubtable(z) ) {
-        subtablePtr(z).down[1].ent = s;
+        storeRoute(subtablePtr(z).down[1], s);
     } else {
-        t[k].ent = s;
+        storeRoute(t[k], s);
     }
-    pt->nRoutes++;
+    rtArtCountRoute(pt, s, 1);
     return s;
 }
 
@@ -488,6 +551,7 @@ rtArtPcFindMatch (rtTable* pt, u8* pDest)
     register tableEntry*  pst;
     register routeEnt**   pDefRoute;
     register int l;
+    routeEnt* pDef[pt->nLevels]; /* trie-node default routes */
     u8* pAddr;
     u32 offset;
     int ml;                     /* max level */
@@ -495,16 +559,17 @@ rtArtPcFindMatch (rtTable* pt, u8* pDest)
 
     pst = pt->root;
     ml  = pt->nLevels - 1;
-    pDefRoute = pt->pDef;
+    pDefRoute = pDef;
     for ( l = pst[-1].level; l <= ml; l = pst[-1].level ) {
         pAddr = pDest;
         setStartBitPos(pt, &pAddr, &offset, l);
-        ent = pst[fringeIndex(&pAddr, &offset, pt->psi[l].sl)];
+        ent = loadEnt(pst[fringeIndex(&pAddr, &offset, pt->psi[l].sl)]);
         if ( !ent.ent ) {
             break;
         }
         if ( !isSubtable(ent) ) {
             if ( cmpAddr(pDest, ent.ent->dest, ent.ent->plen) ) {
+                rtArtSampleLookup(pt, l);
                 return ent.ent;
             }
             break;
@@ -518,22 +583,265 @@ rtArtPcFindMatch (rtTable* pt, u8* pDest)
          */
         ent = subtablePtr(ent);
         pst = ent.down;
-        if ( pst[1].ent ) {
-            *pDefRoute++ = pst[1].ent;
+        ent = loadEnt(pst[1]);
+        if ( ent.ent ) {
+            *pDefRoute++ = ent.ent;
         }
     }
+    rtArtSampleLookup(pt, l);
 
     /*
      * No match
      */
-    while ( --pDefRoute >= pt->pDef ) {
+    while ( --pDefRoute >= pDef ) {
         assert(*pDefRoute);
 
         if ( cmpAddr(pDest, (*pDefRoute)->dest, (*pDefRoute)->plen) ) {
             return *pDefRoute;
         }
     }
-    return pt->root[1].ent;     /* default route */
+    return loadEnt(pt->root[1]).ent;    /* default route */
+}
+
+
+/**
+ * @name  rtArtPcFindMatch4
+ *
+ * @brief API Function.
+ *        (registered as `pt->findMatch4()' in `rtArtPcInit()').
+ *        Performs the longest prefix match of an IPv4 address in the
+ *        host byte order. The candidate routes are compared with
+ *        `dest' by one masked 32-bit compare.
+ *
+ * @param[in] pt    Pointer to the IPv4 routing table
+ * @param[in] dest  Destination IPv4 address in the host byte order
+ *
+ * @retval routeEnt* Pointer to the found route entry (success)
+ * @retval NULL      Failed to find a matching route entry
+ */
+static routeEnt *
+rtArtPcFindMatch4 (rtTable* pt, ipv4a dest)
+{
+    register tableEntry   ent;
+    register tableEntry*  pst;
+    register routeEnt**   pDefRoute;
+    register int l;
+    routeEnt* pDef[pt->nLevels]; /* trie-node default routes */
+    int ml;                     /* max level */
+
+
+    assert(pt->alen == 32);
+
+    pst = pt->root;
+    ml  = pt->nLevels - 1;
+    pDefRoute = pDef;
+    for ( l = pst[-1].level; l <= ml; l = pst[-1].level ) {
+        ent = loadEnt(pst[fringeIndex4(&pt->psi[l], dest)]);
+        if ( !ent.ent ) {
+            break;
+        }
+        if ( !isSubtable(ent) ) {
+            if ( cmpAddr4(dest, ent.ent->dest, ent.ent->plen) ) {
+                return ent.ent;
+            }
+            break;
+        }
+
+        assert(l < ml);
+
+        ent = subtablePtr(ent);
+        pst = ent.down;
+        ent = loadEnt(pst[1]);
+        if ( ent.ent ) {
+            *pDefRoute++ = ent.ent;
+        }
+    }
+
+    /*
+     * No match
+     */
+    while ( --pDefRoute >= pDef ) {
+        if ( cmpAddr4(dest, (*pDefRoute)->dest, (*pDefRoute)->plen) ) {
+            return *pDefRoute;
+        }
+    }
+    return loadEnt(pt->root[1]).ent;    /* default route */
+}
+
+
+/**
+ * @name  rtArtPcFindMatch6
+ *
+ * @brief API Function.
+ *        (registered as `pt->findMatch6()' in `rtArtPcInit()').
+ *        Performs the longest prefix match of an IPv6 address given
+ *        as two 64-bit words in the host byte order. The candidate
+ *        routes are compared with the address by one 128-bit compare.
+ *
+ * @param[in] pt    Pointer to the IPv6 routing table
+ * @param[in] hi    The first 64 bits of the destination address
+ * @param[in] lo    The last 64 bits of the destination address
+ *
+ * @retval routeEnt* Pointer to the found route entry (success)
+ * @retval NULL      Failed to find a matching route entry
+ */
+static routeEnt *
+rtArtPcFindMatch6 (rtTable* pt, u64 hi, u64 lo)
+{
+    register tableEntry   ent;
+    register tableEntry*  pst;
+    register routeEnt**   pDefRoute;
+    register int l;
+    routeEnt* pDef[pt->nLevels]; /* trie-node default routes */
+    int ml;                     /* max level */
+    u128 dest = ((u128)hi << 64) | lo;
+
+
+    assert(pt->alen == 128);
+
+    pst = pt->root;
+    ml  = pt->nLevels - 1;
+    pDefRoute = pDef;
+    for ( l = pst[-1].level; l <= ml; l = pst[-1].level ) {
+        ent = loadEnt(pst[fringeIndex6(&pt->psi[l], dest)]);
+        if ( !ent.ent ) {
+            break;
+        }
+        if ( !isSubtable(ent) ) {
+            if ( cmpAddr6(dest, ent.ent->dest, ent.ent->plen) ) {
+                return ent.ent;
+            }
+            break;
+        }
+
+        assert(l < ml);
+
+        ent = subtablePtr(ent);
+        pst = ent.down;
+        ent = loadEnt(pst[1]);
+        if ( ent.ent ) {
+            *pDefRoute++ = ent.ent;
+        }
+    }
+
+    /*
+     * No match
+     */
+    while ( --pDefRoute >= pDef ) {
+        if ( cmpAddr6(dest, (*pDefRoute)->dest, (*pDefRoute)->plen) ) {
+            return *pDefRoute;
+        }
+    }
+    return loadEnt(pt->root[1]).ent;    /* default route */
+}
+
+
+/**
+ * @name  rtArtPcFindMatchBatch
+ *
+ * @brief API Function.
+ *        (registered as `pt->findMatchBatch()' in `rtArtPcInit()').
+ *        Performs the longest prefix match for `n' addresses.
+ *        Up to ART_BATCH_WIDTH lookups go down the trie in lock step.
+ *        Each step first reads the header (level and default route)
+ *        of the current subtable prefetched in the previous step and
+ *        prefetches the table entry, then reads the table entry and
+ *        prefetches the header of the next subtable.
+ *
+ * @param[in]  pt    Pointer to the routing table
+ * @param[in]  pDest Array of `n' pointers to the destination IP addresses
+ * @param[out] pRes  Array of `n' route pointers. `pRes[i]' is set to
+ *                   the longest prefix matching route of `pDest[i]'
+ *                   (or NULL if there is no matching route.)
+ * @param[in]  n     The number of addresses to be looked up
+ */
+static void
+rtArtPcFindMatchBatch (rtTable* pt, u8** pDest, routeEnt** pRes, int n)
+{
+    register tableEntry ent;
+    register routeEnt*  r;
+    tableEntry* pst[ART_BATCH_WIDTH];   /* current subtable */
+    routeEnt*   term[ART_BATCH_WIDTH];  /* route found in the last step */
+    routeEnt*   pDef[ART_BATCH_WIDTH * pt->nLevels];
+    int         nDef[ART_BATCH_WIDTH];  /* # of default routes in pDef */
+    u32         index[ART_BATCH_WIDTH];
+    int         live[ART_BATCH_WIDTH];  /* lookups still going down */
+    u8* pAddr;
+    u32 offset;
+    int i, j, l, m, nLive, nNext;
+
+
+    for ( ; n > 0; n -= m, pDest += m, pRes += m ) {
+        m = (n < ART_BATCH_WIDTH) ? n : ART_BATCH_WIDTH;
+        for ( i = 0; i < m; ++i ) {
+            pst[i]  = pt->root;
+            term[i] = NULL;
+            nDef[i] = 0;
+            live[i] = i;
+        }
+        nLive = m;
+        while ( nLive > 0 ) {
+            /*
+             * 1. Remember the subtable default routes, calculate
+             *    the fringe indices, and prefetch the entries.
+             */
+            for ( j = 0; j < nLive; ++j ) {
+                i = live[j];
+                l = pst[i][-1].level;
+                if ( l > 0 ) {
+                    r = loadEnt(pst[i][1]).ent;
+                    if ( r ) {
+                        assert(nDef[i] < pt->nLevels);
+                        pDef[i * pt->nLevels + nDef[i]++] = r;
+                    }
+                }
+                pAddr = pDest[i];
+                setStartBitPos(pt, &pAddr, &offset, l);
+                index[i] = fringeIndex(&pAddr, &offset, pt->psi[l].sl);
+                __builtin_prefetch(&pst[i][index[i]]);
+            }
+            /*
+             * 2. Read the entries and prefetch the next subtables
+             */
+            nNext = 0;
+            for ( j = 0; j < nLive; ++j ) {
+                i = live[j];
+                ent = loadEnt(pst[i][index[i]]);
+                if ( !ent.ent ) {
+                    continue;
+                }
+                if ( !isSubtable(ent) ) {
+                    term[i] = ent.ent;
+                    __builtin_prefetch(ent.ent);
+                    continue;
+                }
+                pst[i] = subtablePtr(ent).down;
+                __builtin_prefetch(&pst[i][-1]);
+                live[nNext++] = i;
+            }
+            nLive = nNext;
+        }
+
+        /*
+         * All the lookups reached the bottom. Verify the candidates
+         * from the longest one in the same way as rtArtPcFindMatch().
+         */
+        for ( i = 0; i < m; ++i ) {
+            if ( term[i] &&
+                 cmpAddr(pDest[i], term[i]->dest, term[i]->plen) ) {
+                pRes[i] = term[i];
+                continue;
+            }
+            pRes[i] = loadEnt(pt->root[1]).ent; /* default route */
+            for ( j = nDef[i] - 1; j >= 0; --j ) {
+                r = pDef[i * pt->nLevels + j];
+                if ( cmpAddr(pDest[i], r->dest, r->plen) ) {
+                    pRes[i] = r;
+                    break;
+                }
+            }
+        }
+    }
 }
 
 
@@ -569,20 +877,20 @@ rtArtPcFindExactMatch (rtTable* pt, u8* pDest, int plen)
         pAddr = pDest;
         setStartBitPos(pt, &pAddr, &offset, l);
         index = fringeIndex(&pAddr, &offset, pt->psi[l].sl);
-        ent   = pst[index];
+        ent   = loadEnt(pst[index]);
         if ( !ent.ent ) {
             /*
              * Neither route entry nor subtable pointer.
              * Return the default route pointer.
              */
-            return pt->root[1].ent;    /* default route */
+            return loadEnt(pt->root[1]).ent;   /* default route */
         }
         if ( !isSubtable(ent) ) {
             goto AddrComp;
         }
         if ( l == ml ) {
-            ent.ent = subtablePtr(ent).down[1].ent;
-            break;
+            ent = loadEnt(subtablePtr(ent).down[1]);
+            goto AddrComp;
         }
 
         /*
@@ -591,7 +899,11 @@ rtArtPcFindExactMatch (rtTable* pt, u8* pDest, int plen)
         ent = subtablePtr(ent);
         pst = ent.down;
     }
-    assert(1);                  /* should not happen */
+
+    /*
+     * The path compression skipped level `ml'. No route has `plen'.
+     */
+    return loadEnt(pt->root[1]).ent;   /* default route */
 
 AddrComp:
     while ( index > 0 ) {
@@ -603,10 +915,10 @@ AddrComp:
             return ent.ent;
         }
         index >>= 1;
-        ent = pst[index];
+        ent = loadEnt(pst[index]);
     }
 
-    return pt->root[1].ent;      /* default route */
+    return loadEnt(pt->root[1]).ent;    /* default route */
 }
 
 
@@ -633,6 +945,7 @@ insertNewSubtable (rtTable* p, routeEnt* pEnt,
 {
     subtable nst;
     subtable nst2;
+    subtable low;               /* subtable moved under `nst2' */
     tableEntry ent;
     tableEntry e;
     u8* pDest;
@@ -673,7 +986,7 @@ insertNewSubtable (rtTable* p, routeEnt* pEnt,
              */
             nst = rtArtPcNewSubTable(p, l, e, pEnt->dest);
             if ( !nst ) {
-                free(nst2);
+                rtArtPcFreeSubtableMem(p, nst2 + p->off);
                 return NULL;
             }
             /*
@@ -686,17 +999,34 @@ insertNewSubtable (rtTable* p, routeEnt* pEnt,
             nst2[0].nSubtables++;
         }
         /*
-         * 1. Connect `nst2' to the existing subtable (trie node)
-         * 2. Connect `ent.down' to `nst2'
+         * 1. Connect `ent.down' to `nst2' moving the trie-node
+         *    default route of `ent.down' to `nst2'.
+         *    Lock-free readers may be in `ent.down' and have not
+         *    read the default route yet. Move a copy of it instead.
+         * 2. Connect `nst2' to the existing subtable (trie node)
          */
-        pDest = getNodeDefAddr(p, ent.down);
+        low = ent.down;
+        if ( p->pEpoch && low[1].ent ) {
+            low = rtArtPcDupSubtable(p, ent.down);
+            if ( !low ) {
+                if ( nst != nst2 ) {
+                    rtArtPcFreeSubtableMem(p, nst + p->off);
+                }
+                rtArtPcFreeSubtableMem(p, nst2 + p->off);
+                return NULL;
+            }
+        }
+        pDest = getNodeDefAddr(p, low);
         setStartBitPos(p, &pDest, &offset, level);
         i = fringeIndex(&pDest, &offset, p->psi[level].sl);
-        nst2[1] = (ent.down)[1];
-        (ent.down)[1].ent = NULL;
-        pst[pst2 - pst].down = makeSubtable(nst2);
-        nst2[i].down = makeSubtable(ent.down);
+        nst2[1] = low[1];
+        low[1].ent = NULL;
+        nst2[i].down = makeSubtable(low);
         nst2[0].nSubtables++;
+        storeDown(pst[pst2 - pst], makeSubtable(nst2));
+        if ( low != ent.down ) {
+            rtArtPcFreeSubtable(p, ent.down);
+        }
     } else {
         assert(level == l);
 
@@ -704,7 +1034,7 @@ insertNewSubtable (rtTable* p, routeEnt* pEnt,
         if ( !nst ) {
             return NULL;
         }
-        pst[pst2 - pst].down = makeSubtable(nst);
+        storeDown(pst[pst2 - pst], makeSubtable(nst));
         pst[0].nSubtables++;
     }
     flag = (l >= (p->nLevels - 1)) ? false : true;
@@ -757,8 +1087,8 @@ rtArtPcInsertRoute (rtTable* pt, routeEnt* pEnt)
         if ( pt->root[1].ent ) {
             return pt->root[1].ent;
         }
-        pt->root[1].ent = pEnt;
-        pt->nRoutes++;
+        storeRoute(pt->root[1], pEnt);
+        rtArtCountRoute(pt, pEnt, 1);
         return pEnt;
     }
 
@@ -901,7 +1231,7 @@ rtArtPcDelete (rtTable* pt, pcSubtbls* pPcSt,
         return false;
     }
 
-    --pt->nRoutes;
+    rtArtCountRoute(pt, r, -1);
     --t[0].nRoutes;
     save = r;
     s = ((k >> 1) > 1) ? t[k >> 1].ent : NULL;
@@ -941,16 +1271,16 @@ rtArtPcDelete (rtTable* pt, pcSubtbls* pPcSt,
              * Keep subtable default route in the next level
              * because `t' will be freed.
              */
-            pst[1].ent = t[1].ent;
+            storeRoute(pst[1], t[1].ent);
 
             --pPcSt;
-            pPcSt->pst[pPcSt->idx].down = makeSubtable(pst);
+            storeDown(pPcSt->pst[pPcSt->idx], makeSubtable(pst));
         } else {
             assert(t[0].nSubtables == 0);
             assert(t[0].nRoutes == 0);
 
             --pPcSt;
-            pPcSt->pst[pPcSt->idx].ent = t[1].ent;
+            storeRoute(pPcSt->pst[pPcSt->idx], t[1].ent);
             --pPcSt->pst[0].nSubtables;
         }
 
@@ -963,65 +1293,53 @@ rtArtPcDelete (rtTable* pt, pcSubtbls* pPcSt,
          * Update subtable `t'
          */
         if ( k < threshold ) {
-            rtArtAllot(t, k, r, s, threshold, fringeCheck);
+            rtArtCountAllot(pt,
+                            rtArtAllot(t, k, r, s, threshold, fringeCheck));
         } else if ( fringeCheck && isSubtable(z) ) {
-            subtablePtr(z).down[1].ent = s;
+            storeRoute(subtablePtr(z).down[1], s);
         } else {
-            t[k].ent = s;
+            storeRoute(t[k], s);
         }
     }
 
-    free(save);
+    rtArtFreeRoute(pt, save);
     return true;
 }
 
 
 /**
- * @name  rtArtPcDeleteRoute
+ * @name  pcFindNode
  *
- * @brief API function.
- *        (registered as `pt->delete()' in `rtArtPcInit()').
- *        Deletes a route represented by an IP prefix
- *        (address and its prefix length) from the routing table.
- *        The matched route entry is freed in this function.
+ * @brief Finds the subtable (trie node) that has the base index of
+ *        (`pDest', `plen') and records the path to it in
+ *        `pt->pPcSt'.
  *
- * @param[in] pt    Pointer to the routing table
- * @param[in] pDest Pointer to the IP address to be deleted from `pt'
- * @param[in] plen  Prefix length associated with `pDest'
+ * @param[in]  pt    Pointer to the routing table
+ * @param[in]  pDest Pointer to the IP address
+ * @param[in]  plen  Prefix length associated with `pDest' (> 0)
+ * @param[out] ppEnt The trie-node default route of the prefix length
+ *                   `plen' on the path or NULL (see rtArtPcDelete())
  *
- * @retval ture  If the matching route is deleted from `pt'.
- *               The route entry is freed in this function.
- * @retval false If there is no matching route in `pt'.
+ * @retval pcSubtbls* The last element of the path. Its `pst'
+ *                    is the subtable of level plen2level(`plen').
+ * @retval NULL       There is no route of (`pDest', `plen')
  */
-bool
-rtArtPcDeleteRoute (rtTable* pt, u8* pDest, int plen)
+static pcSubtbls*
+pcFindNode (rtTable* pt, u8* pDest, int plen, routeEnt** ppEnt)
 {
     register int      l;        /* level */
     register subtable pst;
     register subtable pst2;
-    routeEnt*  pEnt;
     pcSubtbls* pPcSt;
     u8*        pAddr;
     u32        offset;
     int        ml;
 
 
-    assert(pt && pDest);
-
-    /*
-     * Handle default route
-     */
-    if (plen == 0) {
-        rtArtFreeRoute(pt, pt->root[1].ent);
-        pt->root[1].ent = NULL;
-        --pt->nRoutes;
-        return true;
-    }
-
-    pst   = pt->root;
-    pPcSt = pt->pPcSt;
-    ml    = plen2level(pt, plen);
-    pEnt  = NULL;
+    pst    = pt->root;
+    pPcSt  = pt->pPcSt;
+    ml     = plen2level(pt, plen);
+    *ppEnt = NULL;
 
     assert(ml < pt->nLevels);
 
@@ -1035,25 +1353,151 @@ rtArtPcDeleteRoute (rtTable* pt, u8* pDest, int plen)
             pst2 = subtablePtr(*pst).down;
             if ( pst2[1].ent ) {
                 if ( pst2[1].ent->plen == plen ) {
-                    pEnt = pst2[1].ent;
+                    *ppEnt = pst2[1].ent;
                 }
                 if ( l == ml ) {
-                    goto exit;
+                    return pPcSt;
                 }
             }
             pst = pst2;
             ++pPcSt;
         } else {
             if ( l < ml ) {
-                return false;
+                return NULL;
             }
-            goto exit;
+            return pPcSt;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * @name  rtArtPcDeleteRoute
+ *
+ * @brief API function.
+ *        (registered as `pt->delete()' in `rtArtPcInit()').
+ *        Deletes a route represented by an IP prefix
+ *        (address and its prefix length) from the routing table.
+ *        The matched route entry is freed in this function.
+ *
+ * @param[in] pt    Pointer to the routing table
+ * @param[in] pDest Pointer to the IP address to be deleted from `pt'
+ * @param[in] plen  Prefix length associated with `pDest'
+ *
+ * @retval ture  If the matching route is deleted from `pt'.
+ *               The route entry is freed in this function.
+ * @retval false If there is no matching route in `pt'.
+ */
+bool
+rtArtPcDeleteRoute (rtTable* pt, u8* pDest, int plen)
+{
+    routeEnt*  pEnt;
+    pcSubtbls* pPcSt;
+
+
+    assert(pt && pDest);
+
+    /*
+     * Handle default route
+     */
+    if (plen == 0) {
+        pEnt = pt->root[1].ent;
+        if ( !pEnt ) {
+            return false;
         }
+        storeRoute(pt->root[1], NULL);
+        rtArtCountRoute(pt, pEnt, -1);
+        rtArtFreeRoute(pt, pEnt);
+        return true;
     }
-    return false;
 
-exit:
-    return rtArtPcDelete(pt, pPcSt, pEnt, l, pDest, plen);
+    pPcSt = pcFindNode(pt, pDest, plen, &pEnt);
+    if ( !pPcSt ) {
+        return false;
+    }
+    return rtArtPcDelete(pt, pPcSt, pEnt, plen2level(pt, plen), pDest, plen);
+}
+
+
+/**
+ * @name  rtArtPcReplaceRoute
+ *
+ * @brief API function.
+ *        (registered as `pt->replace()' in `rtArtPcInit()').
+ *        Same as `rtArtReplaceRoute()' for path-compressed tries.
+ *
+ * @param[in] pt   Pointer to the routing table
+ * @param[in] pEnt Pointer to the new route.
+ *                 `pEnt' must NOT point to a local variable.
+ *
+ * @retval routeEnt* The replaced route. It must be freed by the
+ *                   caller with rtArtFreeRoute().
+ * @retval NULL      There is no route of the IP prefix of `pEnt'.
+ */
+static routeEnt*
+rtArtPcReplaceRoute (rtTable* pt, routeEnt* pEnt)
+{
+    register subtable t;
+    routeEnt*  r;
+    pcSubtbls* pPcSt;
+    int        l, k;
+
+
+    assert((pt != NULL) && (pEnt != NULL));
+
+    /*
+     * Handle default route
+     */
+    if ( pEnt->plen == 0 ) {
+        r = pt->root[1].ent;
+        if ( r ) {
+            pEnt->level = r->level;
+            storeRoute(pt->root[1], pEnt);
+            rtArtBumpGen(pt);
+        }
+        return r;
+    }
+
+    pPcSt = pcFindNode(pt, pEnt->dest, pEnt->plen, &r);
+    if ( !pPcSt ) {
+        return NULL;
+    }
+    l = plen2level(pt, pEnt->plen);
+    t = pPcSt->pst;
+    k = baseIndex(pt, pEnt->dest, pEnt->plen);
+    if ( !r && !isSubtable(t[k]) ) {
+        r = t[k].ent;
+    }
+    if ( (!r) || (r->plen != pEnt->plen) ||
+         (cmpAddr(r->dest, pEnt->dest, pEnt->plen) == false) ) {
+        return NULL;
+    }
+    rtArtSwapRoute(pt, t, k, 1 << pt->psi[l].sl,
+                   (l >= (pt->nLevels - 1)) ? false : true, r, pEnt);
+    return r;
+}
+
+
+/**
+ * @name  rtArtPcFlushRoutesFunc
+ *
+ * @brief API Function.
+ *        (registered as `pt->flushRoutes()' in `rtArtPcInit()').
+ *        Same as `rtArtFlushRoutesFunc()' for path-compressed tries.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] f  Callback function called with each route before
+ *               it is freed (may be NULL)
+ * @param[in] p2 Second parameter of `f'
+ *
+ * @retval true Always
+ */
+static bool
+rtArtPcFlushRoutesFunc (rtTable* pt, rtFunc f, void* p2)
+{
+    rtArtFlushTrie(pt, f, p2, rtArtPcFreeSubtable);
+    return true;
 }
 
 
@@ -1072,11 +1516,25 @@ rtArtPcDestroy (rtTable** p)
 {
     rtTable* pt = *p;
 
-    pt->flush(pt);
+    if ( pt->alloc.destroy ) {
+        /*
+         * The subtables (and the routes in the route arena)
+         * are dropped at once by rtArtAllocDestroy().
+         */
+        if ( !pt->pRouteSlab ) {
+            rtArtFlushTrie(pt, NULL, NULL, NULL);
+        }
+        rtArtEpochFree(pt);
+    } else {
+        rtArtPcFlushRoutesFunc(pt, NULL, NULL);
+        rtArtEpochFree(pt);
+        rtArtPcFreeSubtableMem(pt, pt->root + pt->off);
+    }
+    rtArtAllocDestroy(pt);
     free(pt->pPcSt);
-    free(pt->root + pt->off);
     free(pt->pTbl);
     free(pt->pEnt);
+    free(pt->pLvStats);
     free(pt->psi);
     free(pt);
     *p = NULL;
@@ -1111,20 +1569,24 @@ rtArtPcInit (rtTable *pt)
     if ( !pt->pPcSt ) {
         goto defAddrFree;
     }
-    pt->pDef = calloc(pt->nLevels, sizeof(pt->pDef));
-    if ( !pt->pDef ) {
-        goto pcStFree;
-    }
-
     base.ent = NULL;
     pt->root = rtArtPcNewSubTable(pt, 0, base, defAddr);
+    if ( !pt->root ) {
+        goto pcStFree;
+    }
 
     pt->insert         = rtArtPcInsertRoute;
     pt->delete         = rtArtPcDeleteRoute;
+    pt->replace        = rtArtPcReplaceRoute;
     pt->deleteTable    = rtArtPcDestroy;
     pt->flush          = rtArtFlushRoutes;
     pt->findMatch      = rtArtPcFindMatch;
+    pt->findMatch4     = rtArtPcFindMatch4;
+    pt->findMatch6     = rtArtPcFindMatch6;
     pt->findExactMatch = rtArtPcFindExactMatch;
+    pt->findMatchBatch = rtArtPcFindMatchBatch;
+    pt->bulkLoad       = rtArtInsertRoutes;
+    pt->flushRoutes    = rtArtPcFlushRoutesFunc;
 
     free(defAddr);
     return pt;
@@ -1134,6 +1596,8 @@ pcStFree:
 defAddrFree:
     free(defAddr);
 slFree:
+    rtArtAllocDestroy(pt);
+    free(pt->pLvStats);
     free(pt->psi);
     free(pt);
     return NULL;
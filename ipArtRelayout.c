@@ -0,0 +1,426 @@
+/** @file ipArtRelayout.c
+    @brif Incremental relayout of the subtables for cache locality
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   After a lot of inserts and deletes, the subtables of the slab
+   allocator are taken from the free list in no particular order, so
+   the subtables of one lookup path and the siblings of one parent
+   end up far from each other. rtArtRelayout() moves them back into
+   contiguous memory a little at a time.
+
+   The subtables are visited in breadth-first order: the children of
+   the root (depth 1) from the lowest address to the highest, then
+   depth 2, and so on. The root stays where it is. A subtable whose
+   memory is next to neither the previous nor the next subtable of
+   its level in this order is isolated. An isolated subtable is moved
+   right behind the previous one if that was moved by this call, or
+   together with the previous one if that is isolated too. The
+   subtables are moved to the unused memory of the current arena of
+   their size class (rtArtAllocSeq()), so the ones moved one after
+   another are contiguous. A subtable next to another one is left in
+   place, so a relayout of a table that is already laid out moves
+   nothing, and one that was moved is not moved again unless the
+   table changes around it.
+
+   A subtable is moved by copying it and pointing the parent entry to
+   the copy with one release store. The old memory is retired if the
+   readers are lock-free (artOptConcurrent) and freed otherwise, as a
+   deleted subtable is.
+
+   Each call reads or copies about `budget' table entries and saves
+   the position of the next subtable to visit (`pt->relayDepth' and
+   the address bits of the path in `pt->relayPath'). The next call
+   resumes from there, so the positions survive the updates done
+   between the calls.
+*/
+
+
+#include "ipArt.h"
+
+
+/*
+ * Subtable of a level waiting for the next one of the same level
+ */
+typedef struct relayPend relayPend;
+struct relayPend {
+    tableEntry* pe;             /* parent entry. NULL: no subtable */
+    tableEntry* pePred;         /* entry of the previous one if isolated */
+    u8*         predEnd;        /* end of the memory of the previous one */
+    bool        adjPrev;        /* next to the previous one */
+};
+
+/*
+ * Used by rtArtRelayout()
+ */
+typedef struct relayCtx relayCtx;
+struct relayCtx {
+    rtTable*   pt;
+    int        depth;           /* depth of the subtables to be moved */
+    long       budget;          /* entries that may still be read */
+    bool       started;         /* a subtable was visited by this call */
+    bool       found;           /* a subtable of `depth' was found */
+    relayPend* pPend;           /* pending subtable of each level */
+    u8**       pSeqEnd;         /* end of the last one moved, by level */
+    u32*       pIdx;            /* fringe index taken at each depth */
+    int*       pLevel;          /* level of the subtable at each depth */
+    int        nMoved;          /* subtables moved by this call */
+};
+
+
+/**
+ * @name  relaySpan
+ *
+ * @brief Returns the beginning of the memory of subtable `t' and sets
+ *        its size to `*pSize'. The next subtable of the same size
+ *        class is contiguous if it starts at the beginning plus
+ *        rtArtAllocSlot() of the size.
+ */
+static inline u8*
+relaySpan (rtTable* pt, subtable t, size_t* pSize)
+{
+    int n = 1 << (pt->psi[t[-1].level].sl + 1);
+
+    if ( pt->type == pathCompTrie ) {
+        *pSize = (n - pt->off) * sizeof(tableEntry);
+        return (u8*)(t + pt->off);
+    }
+    *pSize = (n + 1) * sizeof(tableEntry);
+    return (u8*)(t - 1);
+}
+
+
+/**
+ * @name  relayFree
+ *
+ * @brief rtArtFreeFunc of a moved subtable. `p' is the beginning of
+ *        its memory.
+ */
+static void
+relayFree (rtTable* pt, void* p)
+{
+    subtable t;
+    size_t   size;
+
+
+    t = (pt->type == pathCompTrie) ? (subtable)p - pt->off : (subtable)p + 1;
+    relaySpan(pt, t, &size);
+    pt->alloc.free(pt->alloc.ctx, t[-1].level, p, size);
+}
+
+
+/**
+ * @name  relayMove
+ *
+ * @brief Moves the subtable pointed to by entry `pe' to the memory
+ *        returned by rtArtAllocSeq().
+ *
+ * @retval u8*  End of the new memory
+ * @retval NULL The subtable could not be moved
+ */
+static u8*
+relayMove (relayCtx* pc, tableEntry* pe)
+{
+    rtTable* pt = pc->pt;
+    subtable t;
+    size_t   size;
+    u8*      p;
+    u8*      np;
+    int      l;
+
+
+    t = subtablePtr(*pe).down;
+    l = t[-1].level;
+    p = relaySpan(pt, t, &size);
+    np = rtArtAllocSeq(pt, l, size);
+    if ( np == NULL ) {
+        return NULL;
+    }
+    memcpy(np, p, size);
+    storeDown(*pe, makeSubtable((subtable)(np + ((u8*)t - p))));
+    if ( pt->pEpoch ) {
+        rtArtRetire(pt, p, relayFree);
+    } else {
+        relayFree(pt, p);
+    }
+    pc->budget -= size / sizeof(tableEntry);
+    pc->pSeqEnd[l] = np + rtArtAllocSlot(pt, size);
+    ++pc->nMoved;
+    ++pt->nSubtablesMoved;
+
+    return pc->pSeqEnd[l];
+}
+
+
+/**
+ * @name  relayResolve
+ *
+ * @brief Decides whether the pending subtable of `pp' stays or moves,
+ *        now that the next subtable of its level starts at `next'.
+ *
+ * @retval u8* End of the memory of the pending subtable
+ */
+static u8*
+relayResolve (relayCtx* pc, relayPend* pp, u8* next)
+{
+    subtable t;
+    size_t   size;
+    u8*      p;
+    u8*      end;
+    int      l;
+
+
+    t   = subtablePtr(*pp->pe).down;
+    l   = t[-1].level;
+    p   = relaySpan(pc->pt, t, &size);
+    end = p + rtArtAllocSlot(pc->pt, size);
+    if ( pp->adjPrev || (next == end) ) {
+        return end;             /* in a run */
+    }
+    if ( pp->predEnd && (pp->predEnd == pc->pSeqEnd[l]) ) {
+        p = relayMove(pc, pp->pe);      /* behind the previous one */
+        return (p) ? p : end;
+    }
+    if ( pp->pePred && relayMove(pc, pp->pePred) ) {
+        p = relayMove(pc, pp->pe);      /* with the previous one */
+        return (p) ? p : end;
+    }
+    return end;
+}
+
+
+/**
+ * @name  relayVisit
+ *
+ * @brief Visits the subtable of depth `pc->depth' pointed to by entry
+ *        `pe'. The pending subtable of its level is resolved and this
+ *        one becomes pending.
+ */
+static void
+relayVisit (relayCtx* pc, tableEntry* pe)
+{
+    relayPend* pp;
+    subtable   t;
+    size_t     size;
+    u8*        p;
+    u8*        end;
+    bool       iso;
+
+
+    t  = subtablePtr(*pe).down;
+    pp = &pc->pPend[t[-1].level];
+    p  = relaySpan(pc->pt, t, &size);
+    pc->budget -= 1;
+    if ( pp->pe == NULL ) {
+        /*
+         * The previous one was visited by the previous call or at
+         * the previous depth. Take it as next to this one so that
+         * this one is not moved away from it.
+         */
+        pp->pe      = pe;
+        pp->pePred  = NULL;
+        pp->predEnd = NULL;
+        pp->adjPrev = true;
+        return;
+    }
+
+    iso = !pp->adjPrev;
+    end = relayResolve(pc, pp, p);
+    iso = iso && (end != p) && !(pc->pSeqEnd[t[-1].level] == end);
+    pp->pePred  = (iso) ? pp->pe : NULL;
+    pp->predEnd = end;
+    pp->adjPrev = (end == p);
+    pp->pe      = pe;
+}
+
+
+/**
+ * @name  relayFlush
+ *
+ * @brief Leaves the pending subtables in place
+ */
+static void
+relayFlush (relayCtx* pc)
+{
+    memset(pc->pPend, 0, pc->pt->nLevels * sizeof(relayPend));
+}
+
+
+/**
+ * @name  relaySave
+ *
+ * @brief Saves the path to the entry taken at depth `d' as the
+ *        position the next call resumes from.
+ */
+static void
+relaySave (relayCtx* pc, int d)
+{
+    rtTable* pt = pc->pt;
+    u32 v, pos;
+    int k, b, sl;
+
+
+    memset(pt->relayPath, 0, sizeof(pt->relayPath));
+    for ( k = 0; k <= d; ++k ) {
+        sl  = pt->psi[pc->pLevel[k]].sl;
+        v   = pc->pIdx[k] - (1 << sl);
+        pos = pt->psi[pc->pLevel[k]].tl - sl;
+        for ( b = 0; b < sl; ++b, ++pos ) {
+            if ( (v >> (sl - 1 - b)) & 1 ) {
+                pt->relayPath[pos >> 3] |= 0x80 >> (pos & 7);
+            }
+        }
+    }
+    pt->relayDepth = pc->depth;
+}
+
+
+/**
+ * @name  relayWalk
+ *
+ * @brief Goes down from subtable `t' of depth `d' and visits the
+ *        subtables of depth `pc->depth' in address order. If `onPath'
+ *        is true, it starts at the saved position.
+ *
+ * @retval true  Done with `t'
+ * @retval false The budget ran out. The position is saved.
+ */
+static bool
+relayWalk (relayCtx* pc, subtable t, int d, bool onPath)
+{
+    rtTable* pt = pc->pt;
+    tableEntry e;
+    u32 i, start, n;
+    u8* pAddr;
+    u32 offset;
+    int l;
+
+
+    l = t[-1].level;
+    n = 1 << pt->psi[l].sl;
+    start = n;
+    if ( onPath ) {
+        pAddr  = pt->relayPath + pt->psi[l].sb;
+        offset = pt->psi[l].bo;
+        start  = fringeIndex(&pAddr, &offset, pt->psi[l].sl);
+    }
+    for ( i = start; i < (n << 1); ++i ) {
+        --pc->budget;
+        e = t[i];
+        if ( !isSubtable(e) ) {
+            continue;
+        }
+        pc->pIdx[d]   = i;
+        pc->pLevel[d] = l;
+        if ( pc->started && (pc->budget <= 0) ) {
+            relaySave(pc, d);
+            return false;
+        }
+        pc->started = true;
+        if ( d + 1 == pc->depth ) {
+            pc->found = true;
+            relayVisit(pc, &t[i]);
+        } else if ( !relayWalk(pc, subtablePtr(e).down, d + 1,
+                               onPath && (i == start)) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @name  rtArtRelayout
+ *
+ * @brief API function.
+ *        Moves the subtables of the routing table that are isolated
+ *        from the other subtables of their level in breadth-first
+ *        order into contiguous memory of the slab allocator. Each
+ *        call reads or copies about `budget' table entries and
+ *        resumes from where the previous call stopped. Called by the
+ *        writer of `pt' only. Lock-free readers may look up `pt'
+ *        during the relayout, but an iterator (rtArtIterInit()) is
+ *        invalidated as by an update.
+ *
+ * @param[in] pt     Pointer to the routing table
+ * @param[in] budget The number of table entries to read or copy
+ *
+ * @retval 1  The relayout continues in the next call
+ * @retval 0  This call finished the relayout of all the subtables.
+ *            The next call starts a new relayout from the root.
+ * @retval -1 Not supported (not the slab allocator (artOptSlab),
+ *            compact trie, clone, table loaded by rtArtLoad()) or
+ *            no memory
+ */
+int
+rtArtRelayout (rtTable* pt, long budget)
+{
+    relayCtx c;
+    void*    p;
+    int      n, ret;
+
+
+    assert(pt);
+
+    if ( !rtArtAllocIsSlab(pt) || (pt->type == compactTrie) ||
+         pt->pCow || pt->pImg || (pt->len > sizeof(pt->relayPath)) ) {
+        return -1;
+    }
+
+    n = pt->nLevels;
+    p = calloc(1, n * (sizeof(relayPend) + sizeof(u8*) +
+                       sizeof(u32) + sizeof(int)));
+    if ( p == NULL ) {
+        return -1;
+    }
+    memset(&c, 0, sizeof(c));
+    c.pt      = pt;
+    c.budget  = budget;
+    c.pPend   = p;
+    c.pSeqEnd = (u8**)(c.pPend + n);
+    c.pIdx    = (u32*)(c.pSeqEnd + n);
+    c.pLevel  = (int*)(c.pIdx + n);
+
+    if ( pt->relayDepth == 0 ) {
+        pt->relayDepth = 1;
+        memset(pt->relayPath, 0, sizeof(pt->relayPath));
+    }
+    for ( c.depth = pt->relayDepth; c.depth < n; ++c.depth ) {
+        c.found = false;
+        if ( !relayWalk(&c, pt->root, 0, c.depth == pt->relayDepth) ) {
+            break;
+        }
+        relayFlush(&c);
+        memset(c.pSeqEnd, 0, n * sizeof(u8*));
+        if ( !c.found ) {
+            c.depth = n;        /* no subtable is deeper */
+            break;
+        }
+    }
+    if ( c.depth >= n ) {
+        pt->relayDepth = 0;     /* done. start over next time */
+        ret = 0;
+    } else {
+        ret = 1;
+    }
+
+    free(p);
+    return ret;
+}
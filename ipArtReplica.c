@@ -0,0 +1,482 @@
+/** @file ipArtReplica.c
+    @brif Per-NUMA-node replicas of a routing table
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   A replica set keeps one routing table per NUMA node so that the
+   readers never walk a trie across the interconnect. Replica `i'
+   is created with artOptNumaLocal on node `i': its subtables are
+   carved out of slab arenas bound to the node (see ipArtAlloc.c).
+   All the replicas have lock-free readers (artOptConcurrent), and
+   the single writer applies each insert and delete to all of them
+   in turn, so a reader may see a route in one replica a little
+   before it sees it in another.
+
+   By default the replicas share the routes: a route is inserted
+   into all the replicas as it is and is owned by replica 0 (the
+   other replicas have `pRouteOwner' and never free a route). The
+   replicas then share the epoch of replica 0 so that a deleted
+   route is freed after the readers of all the replicas leave. With
+   artOptCopyRoutes, replica `i' (i > 0) instead has a copy of each
+   route (and its user data) in its own route arena on node `i' and
+   its own epoch, so the readers of the nodes share no memory. The
+   user data of the copies is not updated with that of the original.
+
+   A reader thread gets the replica of its node and a reader of it
+   by rtArtReplicaAttach() once, and then looks up `ph->pt' in the
+   critical sections of `ph->pr' as a single table.
+*/
+
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "ipArt.h"
+
+
+struct rtArtReplicas {
+    int      nReplicas;         /* valid elements of `pt[]' */
+    bool     copyRoutes;        /* artOptCopyRoutes */
+    u64      nUpdates;          /* inserts and deletes applied */
+    double   tUpdate;           /* seconds spent in the updates */
+    double   maxUpdate;         /* seconds of the slowest update */
+    rtTable* pt[ART_MAX_REPLICAS]; /* replica `i' is on node `i' */
+};
+
+
+/**
+ * @name   numaNodes
+ *
+ * @brief  Returns the number of the NUMA nodes of the system
+ *         (the highest online node + 1), or 1 if it is unknown.
+ */
+static int
+numaNodes (void)
+{
+    FILE* fp;
+    char  buf[256];
+    char* p;
+    long  n, max;
+
+
+    fp = fopen("/sys/devices/system/node/online", "r");
+    if ( fp == NULL ) {
+        return 1;
+    }
+    max = 0;
+    if ( fgets(buf, sizeof(buf), fp) ) {
+        for ( p = buf; *p; ) {
+            if ( (*p >= '0') && (*p <= '9') ) {
+                n = strtol(p, &p, 10);      /* "0", "0-1", "0,2-3" */
+                max = (n > max) ? n : max;
+            } else {
+                ++p;
+            }
+        }
+    }
+    fclose(fp);
+    return (int)max + 1;
+}
+
+
+/**
+ * @name   curNode
+ *
+ * @brief  Returns the NUMA node of the CPU the calling thread runs
+ *         on, or 0 if it is unknown.
+ */
+static int
+curNode (void)
+{
+#ifdef SYS_getcpu
+    unsigned cpu, node;
+
+    if ( syscall(SYS_getcpu, &cpu, &node, NULL) == 0 ) {
+        return (int)node;
+    }
+#endif /* SYS_getcpu */
+    return 0;
+}
+
+
+/**
+ * @name   replicaTime
+ *
+ * @brief  Adds the time since `ps' to the update time of `prs'.
+ */
+static void
+replicaTime (rtArtReplicas* prs, struct timespec* ps)
+{
+    struct timespec te;
+    double t;
+
+    clock_gettime(CLOCK_MONOTONIC, &te);
+    t = (te.tv_sec - ps->tv_sec) + (te.tv_nsec - ps->tv_nsec) * 1e-9;
+    prs->nUpdates++;
+    prs->tUpdate += t;
+    if ( t > prs->maxUpdate ) {
+        prs->maxUpdate = t;
+    }
+}
+
+
+/**
+ * @name   rtArtReplicasNew
+ *
+ * @brief  API function.
+ *         Creates a set of `nReplicas' routing tables that have the
+ *         same routes. Replica `i' is allocated on NUMA node `i'.
+ *         The arguments are those of rtArtInitOpts(); artOptConcurrent
+ *         and artOptNumaLocal are added to the options of each
+ *         replica, and artOptCopyRoutes selects copied routes.
+ *
+ * @param[in] nLevels   The number of trie node levels
+ * @param[in] psl       Pointer to an array of stride lengths
+ * @param[in] alen      Bit length of IP addresses (32 or 128)
+ * @param[in] type      simpleTrie or pathCompTrie
+ * @param[in] po        Pointer to the options (may be NULL).
+ *                      `po->pAlloc' must be NULL.
+ * @param[in] nReplicas The number of replicas (<= ART_MAX_REPLICAS).
+ *                      <= 0: one per NUMA node of the system
+ *
+ * @retval rtArtReplicas* Pointer to the replica set
+ * @retval NULL           Compact trie, `po->pAlloc' was given, or
+ *                        there was no memory
+ */
+rtArtReplicas*
+rtArtReplicasNew (int nLevels, s8* psl, int alen, trieType type,
+                  rtArtOpts* po, int nReplicas)
+{
+    rtArtReplicas* prs;
+    rtArtOpts opts;
+    rtTable*  pt;
+    int i;
+
+
+    if ( (type == compactTrie) || (po && po->pAlloc) ) {
+        return NULL;            /* not in the node-local slabs */
+    }
+    if ( nReplicas <= 0 ) {
+        nReplicas = numaNodes();
+    }
+    if ( nReplicas > ART_MAX_REPLICAS ) {
+        nReplicas = ART_MAX_REPLICAS;
+    }
+
+    prs = calloc(1, sizeof(rtArtReplicas));
+    if ( prs == NULL ) {
+        return NULL;
+    }
+    prs->nReplicas  = nReplicas;
+    prs->copyRoutes = (po && (po->flags & artOptCopyRoutes)) ? true : false;
+    for ( i = 0; i < nReplicas; ++i ) {
+        if ( po ) {
+            opts = *po;
+        } else {
+            memset(&opts, 0, sizeof(opts));
+        }
+        opts.flags   |= artOptConcurrent | artOptNumaLocal;
+        opts.flags   &= ~artOptCopyRoutes;
+        opts.numaNode = i;
+        if ( prs->copyRoutes ) {
+            opts.flags |= artOptRouteArena;     /* node-local copies */
+        } else if ( i > 0 ) {
+            opts.flags &= ~artOptRouteArena;    /* routes of replica 0 */
+        }
+        pt = rtArtInitOpts(nLevels, psl, alen, type, &opts);
+        if ( pt == NULL ) {
+            rtArtReplicasFree(prs);
+            return NULL;
+        }
+        if ( (i > 0) && !prs->copyRoutes ) {
+            rtArtEpochFree(pt);
+            pt->pEpoch      = prs->pt[0]->pEpoch;
+            pt->pRouteOwner = prs->pt[0];
+        }
+        prs->pt[i] = pt;
+    }
+    return prs;
+}
+
+
+/**
+ * @name   rtArtReplicasFree
+ *
+ * @brief  API function. (writer only)
+ *         Destroys all the replicas and frees all their routes.
+ *         All the handles must be detached.
+ */
+void
+rtArtReplicasFree (rtArtReplicas* prs)
+{
+    int i;
+
+    if ( prs == NULL ) {
+        return;
+    }
+    for ( i = prs->nReplicas - 1; i >= 0; --i ) {
+        if ( prs->pt[i] == NULL ) {
+            continue;
+        }
+        rtArtSynchronize(prs->pt[i]);
+        if ( prs->pt[i]->pRouteOwner ) {
+            prs->pt[i]->pEpoch = NULL;  /* the epoch of replica 0 */
+        }
+        prs->pt[i]->deleteTable(&prs->pt[i]);
+    }
+    free(prs);
+}
+
+
+/**
+ * @name   rtArtReplicaTable
+ *
+ * @brief  API function.
+ *         Returns replica `i' (on NUMA node `i'), or NULL if there
+ *         is no such replica. It must not be updated directly.
+ */
+rtTable*
+rtArtReplicaTable (rtArtReplicas* prs, int i)
+{
+    return ((i >= 0) && (i < prs->nReplicas)) ? prs->pt[i] : NULL;
+}
+
+
+/**
+ * @name   rtArtReplicasNewRoute
+ *
+ * @brief  API function.
+ *         Allocates a route to be inserted by rtArtReplicasInsert().
+ *         Same as rtArtNewRoute() of replica 0.
+ */
+routeEnt*
+rtArtReplicasNewRoute (rtArtReplicas* prs)
+{
+    return rtArtNewRoute(prs->pt[0]);
+}
+
+
+/**
+ * @name   rtArtReplicasFreeRoute
+ *
+ * @brief  API function.
+ *         Frees a route allocated by rtArtReplicasNewRoute() that was
+ *         not inserted. Same as rtArtFreeRoute() of replica 0.
+ */
+void
+rtArtReplicasFreeRoute (rtArtReplicas* prs, routeEnt* r)
+{
+    rtArtFreeRoute(prs->pt[0], r);
+}
+
+
+/**
+ * @name   rtArtReplicasInsert
+ *
+ * @brief  API function. (writer only)
+ *         Inserts route `r' into all the replicas, or none of them.
+ *         The replicas own `r' as `pt->insert()' does.
+ *
+ * @param[in] prs Pointer to the replica set
+ * @param[in] r   Pointer to the route allocated by
+ *                rtArtReplicasNewRoute()
+ *
+ * @retval routeEnt* `r' is successfully inserted.
+ * @retval routeEnt* The existing route that has the same prefix.
+ *                   `r' is not inserted and must be freed.
+ * @retval NULL      There was no memory. `r' was freed.
+ */
+routeEnt*
+rtArtReplicasInsert (rtArtReplicas* prs, routeEnt* r)
+{
+    struct timespec ts;
+    rtTable*  pt;
+    routeEnt* r0;
+    routeEnt* ri;
+    int i, j;
+
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    r0 = prs->pt[0]->insert(prs->pt[0], r);
+    if ( r0 != r ) {
+        return r0;
+    }
+    for ( i = 1; i < prs->nReplicas; ++i ) {
+        pt = prs->pt[i];
+        ri = r;
+        if ( prs->copyRoutes ) {
+            ri = rtArtNewRoute(pt);
+            if ( ri ) {
+                memcpy(ri, r, pt->routeSize);
+            }
+        }
+        if ( (ri == NULL) || (pt->insert(pt, ri) != ri) ) {
+            if ( ri && (ri != r) ) {
+                rtArtFreeRoute(pt, ri);
+            }
+            for ( j = i - 1; j >= 0; --j ) {
+                prs->pt[j]->delete(prs->pt[j], r->dest, r->plen);
+            }
+            return NULL;
+        }
+    }
+    replicaTime(prs, &ts);
+    return r;
+}
+
+
+/**
+ * @name   rtArtReplicasDelete
+ *
+ * @brief  API function. (writer only)
+ *         Deletes the route of `pDest'/`plen' from all the replicas
+ *         and frees it as `pt->delete()' does. A shared route is
+ *         deleted from replica 0 (its owner) last.
+ *
+ * @param[in] prs   Pointer to the replica set
+ * @param[in] pDest Pointer to the IP address of the prefix
+ * @param[in] plen  Prefix length
+ *
+ * @retval true  The route was deleted
+ * @retval false There is no such route
+ */
+bool
+rtArtReplicasDelete (rtArtReplicas* prs, u8* pDest, int plen)
+{
+    struct timespec ts;
+    routeEnt* r;
+    int i;
+
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    r = prs->pt[0]->findExactMatch(prs->pt[0], pDest, plen);
+    if ( !r || (r->plen != plen) || !cmpAddr(r->dest, pDest, plen) ) {
+        return false;           /* no route or the default route */
+    }
+    for ( i = prs->nReplicas - 1; i >= 0; --i ) {
+        prs->pt[i]->delete(prs->pt[i], pDest, plen);
+    }
+    replicaTime(prs, &ts);
+    return true;
+}
+
+
+/**
+ * @name   rtArtReplicasSynchronize
+ *
+ * @brief  API function. (writer only)
+ *         rtArtSynchronize() of all the replicas.
+ */
+void
+rtArtReplicasSynchronize (rtArtReplicas* prs)
+{
+    int i;
+
+    for ( i = 0; i < prs->nReplicas; ++i ) {
+        rtArtSynchronize(prs->pt[i]);
+    }
+}
+
+
+/**
+ * @name   rtArtReplicasGetStats
+ *
+ * @brief  API function.
+ *         Copies the memory of each replica and the update time of
+ *         `prs' to `ps'. The memory of the routes shared with replica
+ *         0 is counted in replica 0 only.
+ */
+void
+rtArtReplicasGetStats (rtArtReplicas* prs, rtArtReplicaStats* ps)
+{
+    rtArtStats st;
+    int i;
+
+
+    memset(ps, 0, sizeof(*ps));
+    ps->nReplicas = prs->nReplicas;
+    ps->nUpdates  = prs->nUpdates;
+    ps->tUpdate   = prs->tUpdate;
+    ps->maxUpdate = prs->maxUpdate;
+    for ( i = 0; i < prs->nReplicas; ++i ) {
+        rtArtGetStats(prs->pt[i], &st);
+        ps->node[i]  = i;
+        ps->bytes[i] = st.bytes;
+        if ( (i == 0) || prs->copyRoutes ) {
+            ps->routeBytes[i] = st.nRoutes * prs->pt[i]->routeSize;
+        }
+    }
+}
+
+
+/**
+ * @name   rtArtReplicaAttach
+ *
+ * @brief  API function.
+ *         Creates the handle of the calling reader thread. It has
+ *         the replica of NUMA node `node' and a lock-free reader of
+ *         it. The handle stays with the replica if the thread moves
+ *         to another node.
+ *
+ * @param[in] prs  Pointer to the replica set
+ * @param[in] node NUMA node. -1: the node the thread runs on.
+ *                 Taken modulo the number of the replicas.
+ *
+ * @retval rtArtReplicaHandle* Pointer to the handle
+ * @retval NULL                There was no memory
+ */
+rtArtReplicaHandle*
+rtArtReplicaAttach (rtArtReplicas* prs, int node)
+{
+    rtArtReplicaHandle* ph;
+
+    ph = calloc(1, sizeof(rtArtReplicaHandle));
+    if ( ph == NULL ) {
+        return NULL;
+    }
+    if ( node < 0 ) {
+        node = curNode();
+    }
+    ph->node = node % prs->nReplicas;
+    ph->pt   = prs->pt[ph->node];
+    ph->pr   = rtArtRegisterReader(ph->pt);
+    if ( ph->pr == NULL ) {
+        free(ph);
+        return NULL;
+    }
+    return ph;
+}
+
+
+/**
+ * @name   rtArtReplicaDetach
+ *
+ * @brief  API function.
+ *         Unregisters the reader of handle `ph' and frees it.
+ */
+void
+rtArtReplicaDetach (rtArtReplicaHandle* ph)
+{
+    if ( ph ) {
+        rtArtUnregisterReader(ph->pr);
+        free(ph);
+    }
+}
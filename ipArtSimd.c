@@ -0,0 +1,396 @@
+/** @file ipArtSimd.c
+    @brif Batch lookups of IPv4 simple tries with AVX2 and AVX-512 gathers
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   rtArtInit() calls rtArtSimdInit() for a simple trie. If the
+   table is IPv4 and the CPU supports AVX-512 (or AVX2),
+   `pt->findMatchBatch()' is replaced with a lookup that goes down
+   the trie with 32 (or 8) addresses at a time:
+
+     1. The fringe indices of all the lanes are taken from a vector
+        of the addresses with one shift and one mask.
+     2. The table entries are gathered. The lanes that read a route
+        or an empty entry stop. The lanes that read a subtable
+        gather the subtable default route and go down.
+     3. Step 1 and 2 are repeated until no lane goes down. A vector
+        whose lanes have all stopped is skipped.
+
+   The results are the same as rtArtFindMatchBatch(). Other tables
+   and CPUs keep rtArtFindMatchBatch(). rtArtSimdSelect() registers
+   a given kernel instead so that each one can be tested.
+*/
+
+
+#include "ipArt.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+
+/**
+ * @name  simdAddrs
+ *
+ * @brief Loads `n' IPv4 addresses in the host byte order to `pa'.
+ */
+static inline void
+simdAddrs (u8** pDest, u32* pa, int n)
+{
+    int i;
+
+    for ( i = 0; i < n; ++i ) {
+        pa[i] = addr2ipv4a(pDest[i]);
+    }
+}
+
+
+/**
+ * @name  simdResult
+ *
+ * @brief Returns the longest prefix matching route of a lane from
+ *        the route found in the fringe (`r') and the last subtable
+ *        default route (`def').
+ */
+static inline routeEnt*
+simdResult (rtTable* pt, u64 r, u64 def)
+{
+    if ( r ) {
+        return (routeEnt*)r;
+    }
+    if ( def ) {
+        return (routeEnt*)def;
+    }
+    return loadEnt(pt->root[1]).ent;
+}
+
+
+/**
+ * @name  avx2Index
+ *
+ * @brief Returns the fringe indices of the 8 addresses in `va'
+ *        at the level described by `psi' (AVX2).
+ */
+__attribute__ ((target ("avx2"))) static inline __m256i
+avx2Index (strideInfo* psi, __m256i va)
+{
+    __m256i vi;
+
+    vi = _mm256_srl_epi32(va, _mm_cvtsi32_si128(32 - psi->tl));
+    vi = _mm256_and_si256(vi, _mm256_set1_epi32((1 << psi->sl) - 1));
+    return _mm256_or_si256(vi, _mm256_set1_epi32(1 << psi->sl));
+}
+
+
+/**
+ * @name  avx2Lookup8
+ *
+ * @brief Looks up 8 IPv4 addresses with AVX2 gathers.
+ *        The 8 lanes are held in two vectors of 4 table entries.
+ *
+ * @param[in]  pt    Pointer to the routing table
+ * @param[in]  pDest Array of 8 pointers to the destination IP addresses
+ * @param[out] pRes  Array of 8 longest prefix matching routes
+ */
+__attribute__ ((target ("avx2"))) static void
+avx2Lookup8 (rtTable* pt, u8** pDest, routeEnt** pRes)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one  = _mm256_set1_epi64x(1);
+    const __m256i def8 = _mm256_set1_epi64x(sizeof(tableEntry));
+    __m256i pst[2], res[2], def[2], live[2];
+    __m256i va, vi, ent, d, sub, hit;
+    u32 a[8];
+    u64 r[8], dr[8];
+    int h, l;
+
+
+    simdAddrs(pDest, a, 8);
+    va = _mm256_loadu_si256((__m256i*)a);
+    for ( h = 0; h < 2; ++h ) {
+        pst[h]  = _mm256_set1_epi64x((long long)pt->root);
+        res[h]  = zero;
+        def[h]  = zero;
+        live[h] = _mm256_cmpeq_epi64(zero, zero);
+    }
+
+    for ( l = 0; l < pt->nLevels; ++l ) {
+        vi = avx2Index(&pt->psi[l], va);
+        for ( h = 0; h < 2; ++h ) {
+            if ( _mm256_testz_si256(live[h], live[h]) ) {
+                continue;
+            }
+            d = _mm256_cvtepu32_epi64((h == 0) ?
+                                      _mm256_castsi256_si128(vi) :
+                                      _mm256_extracti128_si256(vi, 1));
+            d = _mm256_add_epi64(pst[h], _mm256_slli_epi64(d, 3));
+            ent = _mm256_mask_i64gather_epi64(zero, NULL, d, live[h], 1);
+
+            /*
+             * Lanes that read a route stop with the route.
+             * Lanes that read an empty entry stop without it.
+             */
+            sub = _mm256_cmpeq_epi64(_mm256_and_si256(ent, one), one);
+            hit = _mm256_andnot_si256(_mm256_cmpeq_epi64(ent, zero),
+                                      _mm256_andnot_si256(sub, live[h]));
+            res[h]  = _mm256_blendv_epi8(res[h], ent, hit);
+            live[h] = _mm256_and_si256(live[h], sub);
+            if ( l >= (pt->nLevels - 1) ) {
+                continue;
+            }
+
+            /*
+             * Lanes that read a subtable go down and remember
+             * its default route.
+             */
+            pst[h] = _mm256_blendv_epi8(pst[h],
+                                        _mm256_andnot_si256(one, ent),
+                                        live[h]);
+            d = _mm256_mask_i64gather_epi64(zero, NULL,
+                                            _mm256_add_epi64(pst[h], def8),
+                                            live[h], 1);
+            hit = _mm256_andnot_si256(_mm256_cmpeq_epi64(d, zero), live[h]);
+            def[h] = _mm256_blendv_epi8(def[h], d, hit);
+        }
+        if ( _mm256_testz_si256(_mm256_or_si256(live[0], live[1]),
+                                _mm256_or_si256(live[0], live[1])) ) {
+            break;
+        }
+    }
+
+    for ( h = 0; h < 2; ++h ) {
+        _mm256_storeu_si256((__m256i*)(r + 4 * h), res[h]);
+        _mm256_storeu_si256((__m256i*)(dr + 4 * h), def[h]);
+    }
+    for ( h = 0; h < 8; ++h ) {
+        pRes[h] = simdResult(pt, r[h], dr[h]);
+    }
+}
+
+
+/**
+ * @name  avx512Lookup32
+ *
+ * @brief Looks up 32 IPv4 addresses with AVX-512 gathers in the same
+ *        way as avx2Lookup8(). The 32 lanes are held in four vectors
+ *        of 8 table entries, and the lanes going down are mask bits.
+ *
+ * @param[in]  pt    Pointer to the routing table
+ * @param[in]  pDest Array of 32 pointers to the destination IP addresses
+ * @param[out] pRes  Array of 32 longest prefix matching routes
+ */
+__attribute__ ((target ("avx512f"))) static void
+avx512Lookup32 (rtTable* pt, u8** pDest, routeEnt** pRes)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one  = _mm512_set1_epi64(1);
+    const __m512i def8 = _mm512_set1_epi64(sizeof(tableEntry));
+    __m512i pst[4], res[4], def[4];
+    __m512i va[2], vi[2], ent, d;
+    __mmask8 live[4], any, hit;
+    strideInfo* psi;
+    u32 a[32];
+    u64 r[32], dr[32];
+    int h, l;
+
+
+    simdAddrs(pDest, a, 32);
+    va[0] = _mm512_loadu_si512(a);
+    va[1] = _mm512_loadu_si512(a + 16);
+    for ( h = 0; h < 4; ++h ) {
+        pst[h]  = _mm512_set1_epi64((long long)pt->root);
+        res[h]  = zero;
+        def[h]  = zero;
+        live[h] = 0xff;
+    }
+
+    for ( l = 0; l < pt->nLevels; ++l ) {
+        psi = &pt->psi[l];
+        for ( h = 0; h < 2; ++h ) {
+            vi[h] = _mm512_srl_epi32(va[h], _mm_cvtsi32_si128(32 - psi->tl));
+            vi[h] = _mm512_and_si512(vi[h],
+                                     _mm512_set1_epi32((1 << psi->sl) - 1));
+            vi[h] = _mm512_or_si512(vi[h], _mm512_set1_epi32(1 << psi->sl));
+        }
+        any = 0;
+        for ( h = 0; h < 4; ++h ) {
+            if ( !live[h] ) {
+                continue;
+            }
+            d = _mm512_cvtepu32_epi64(
+                (h & 1) ? _mm512_extracti64x4_epi64(vi[h >> 1], 1) :
+                          _mm512_castsi512_si256(vi[h >> 1]));
+            d = _mm512_add_epi64(pst[h], _mm512_slli_epi64(d, 3));
+            ent = _mm512_mask_i64gather_epi64(zero, live[h], d, NULL, 1);
+
+            /*
+             * Lanes that read a route stop with the route.
+             * Lanes that read an empty entry stop without it.
+             */
+            hit = _mm512_mask_test_epi64_mask(live[h], ent, ent);
+            live[h] = _mm512_mask_test_epi64_mask(hit, ent, one);
+            res[h]  = _mm512_mask_mov_epi64(res[h], hit & ~live[h], ent);
+            if ( l >= (pt->nLevels - 1) || !live[h] ) {
+                continue;
+            }
+
+            /*
+             * Lanes that read a subtable go down and remember
+             * its default route.
+             */
+            pst[h] = _mm512_mask_andnot_epi64(pst[h], live[h], one, ent);
+            d = _mm512_mask_i64gather_epi64(zero, live[h],
+                                            _mm512_add_epi64(pst[h], def8),
+                                            NULL, 1);
+            hit = _mm512_mask_test_epi64_mask(live[h], d, d);
+            def[h] = _mm512_mask_mov_epi64(def[h], hit, d);
+            any |= live[h];
+        }
+        if ( !any ) {
+            break;
+        }
+    }
+
+    for ( h = 0; h < 4; ++h ) {
+        _mm512_storeu_si512(r + 8 * h, res[h]);
+        _mm512_storeu_si512(dr + 8 * h, def[h]);
+    }
+    for ( h = 0; h < 32; ++h ) {
+        pRes[h] = simdResult(pt, r[h], dr[h]);
+    }
+}
+
+
+/**
+ * @name  rtArtFindMatchBatchAvx2
+ *
+ * @brief API function.
+ *        (registered as `pt->findMatchBatch()' in `rtArtSimdInit()').
+ *        Performs the longest prefix match for `n' IPv4 addresses
+ *        8 at a time with AVX2. The rest are looked up by
+ *        `pt->findMatch()'.
+ *
+ * @param[in]  pt    Pointer to the routing table
+ * @param[in]  pDest Array of `n' pointers to the destination IP addresses
+ * @param[out] pRes  Array of `n' longest prefix matching routes
+ * @param[in]  n     The number of addresses to be looked up
+ */
+static void
+rtArtFindMatchBatchAvx2 (rtTable* pt, u8** pDest, routeEnt** pRes, int n)
+{
+    int i;
+
+    for ( i = 0; i + 8 <= n; i += 8 ) {
+        avx2Lookup8(pt, pDest + i, pRes + i);
+    }
+    for ( ; i < n; ++i ) {
+        pRes[i] = pt->findMatch(pt, pDest[i]);
+    }
+}
+
+
+/**
+ * @name  rtArtFindMatchBatchAvx512
+ *
+ * @brief API function.
+ *        (registered as `pt->findMatchBatch()' in `rtArtSimdInit()').
+ *        Same as rtArtFindMatchBatchAvx2() except that the addresses
+ *        are looked up 32 at a time with AVX-512.
+ */
+static void
+rtArtFindMatchBatchAvx512 (rtTable* pt, u8** pDest, routeEnt** pRes, int n)
+{
+    int i;
+
+    for ( i = 0; i + 32 <= n; i += 32 ) {
+        avx512Lookup32(pt, pDest + i, pRes + i);
+    }
+    for ( ; i + 8 <= n; i += 8 ) {
+        avx2Lookup8(pt, pDest + i, pRes + i);
+    }
+    for ( ; i < n; ++i ) {
+        pRes[i] = pt->findMatch(pt, pDest[i]);
+    }
+}
+#endif /* __x86_64__ */
+
+
+/**
+ * @name  rtArtSimdSelect
+ *
+ * @brief API function.
+ *        Registers batch lookup kernel `kernel' (artBatchScalar,
+ *        artBatchAvx2 or artBatchAvx512) as `pt->findMatchBatch()'
+ *        of an IPv4 simple trie, for example to test or compare the
+ *        kernels one by one. artBatchAvx512 looks up the last
+ *        addresses of a batch 8 at a time with AVX2, and the SIMD
+ *        kernels look up the last 7 or less by `pt->findMatch()'.
+ *
+ * @param[in] pt     Pointer to the routing table
+ * @param[in] kernel The kernel to be registered
+ *
+ * @retval true  `kernel' was registered
+ * @retval false `pt' is not an IPv4 simple trie (or is loaded by
+ *               rtArtLoad()), or the CPU does not support `kernel'.
+ *               `pt' is not changed.
+ */
+bool
+rtArtSimdSelect (rtTable* pt, int kernel)
+{
+    if ( (pt->type != simpleTrie) || (pt->alen != 32) || pt->pImg ) {
+        return false;
+    }
+    if ( kernel == artBatchScalar ) {
+        pt->findMatchBatch = rtArtFindMatchBatch;
+        return true;
+    }
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if ( (kernel == artBatchAvx512) && __builtin_cpu_supports("avx512f") ) {
+        pt->findMatchBatch = rtArtFindMatchBatchAvx512;
+        return true;
+    }
+    if ( (kernel == artBatchAvx2) && __builtin_cpu_supports("avx2") ) {
+        pt->findMatchBatch = rtArtFindMatchBatchAvx2;
+        return true;
+    }
+#endif /* __x86_64__ */
+    return false;
+}
+
+
+/**
+ * @name  rtArtSimdInit
+ *
+ * @brief Registers the gather-based `pt->findMatchBatch()' if `pt' is
+ *        an IPv4 simple trie and the CPU supports AVX-512 or AVX2.
+ *
+ * @param[in] pt Pointer to the routing table (simple trie)
+ *
+ * @retval true  The gather-based batch lookup was registered
+ * @retval false `pt' keeps rtArtFindMatchBatch()
+ */
+bool
+rtArtSimdInit (rtTable* pt)
+{
+    assert(pt->type == simpleTrie);
+
+    return rtArtSimdSelect(pt, artBatchAvx512) ||
+        rtArtSimdSelect(pt, artBatchAvx2);
+}
@@ -0,0 +1,207 @@
+/** @file ipArtSpec.c
+    @brif Specialized lookup functions of common stride layouts
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   rtArtInit() calls rtArtSpecialize() for a simple trie. If the
+   stride lengths are one of the layouts below, `pt->findMatch()'
+   and `pt->findMatch4()' (or `pt->findMatch6()') are replaced with
+   the functions generated by ART_SPEC_LOOKUP4() or ART_SPEC_LOOKUP6()
+   (see ipArtSpec.h).
+
+   Otherwise, if an IPv6 trie has a level that ends at bit 64, the
+   lookups are replaced with rtArtSplitFindMatch6(). The levels up
+   to bit 64 (where nearly all the routes end) take their strides
+   from the first 64 bits of the address and the rest from the last
+   64 bits, each with a shift and a mask of one 64-bit word, and the
+   fringe entry of a /64 that has longer routes hands the lookup off
+   to the subtables of the last 64 bits. rtArtTuneStrides6() finds
+   such stride lengths.
+*/
+
+
+#include "ipArtSpec.h"
+
+
+#define ART_SPEC_MAX_LEVELS 32 /* unroll limit of rtArtSpecFindMatch() */
+
+typedef struct {
+    int  alen;                  /* address length in bits */
+    int  nLevels;               /* number of levels */
+    const u8* psl;              /* stride lengths */
+    routeEnt* (*findMatch)(rtTable* p, u8* pDest);
+    routeEnt* (*findMatch4)(rtTable* p, ipv4a dest);
+    routeEnt* (*findMatch6)(rtTable* p, u64 hi, u64 lo);
+} specLayout;
+
+
+ART_SPEC_LOOKUP4(rtArtSpec4_16_8_8, 3, 16, 8, 8)
+ART_SPEC_LOOKUP4(rtArtSpec4_24_8, 2, 24, 8)
+ART_SPEC_LOOKUP4(rtArtSpec4_8_8_8_8, 4, 8, 8, 8, 8)
+ART_SPEC_LOOKUP4(rtArtSpec4_4x8, 8, 4, 4, 4, 4, 4, 4, 4, 4)
+ART_SPEC_LOOKUP6(rtArtSpec6_16_4x28, 29, 16,
+                 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+                 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4)
+ART_SPEC_LOOKUP6(rtArtSpec6_16_8x14, 15, 16,
+                 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8)
+
+
+static const specLayout specLayouts[] = {
+    {  32,  3, rtArtSpec4_16_8_8_sl,
+       rtArtSpec4_16_8_8, rtArtSpec4_16_8_8_4, NULL },
+    {  32,  2, rtArtSpec4_24_8_sl,
+       rtArtSpec4_24_8, rtArtSpec4_24_8_4, NULL },
+    {  32,  4, rtArtSpec4_8_8_8_8_sl,
+       rtArtSpec4_8_8_8_8, rtArtSpec4_8_8_8_8_4, NULL },
+    {  32,  8, rtArtSpec4_4x8_sl,
+       rtArtSpec4_4x8, rtArtSpec4_4x8_4, NULL },
+    { 128, 29, rtArtSpec6_16_4x28_sl,
+       rtArtSpec6_16_4x28, NULL, rtArtSpec6_16_4x28_6 },
+    { 128, 15, rtArtSpec6_16_8x14_sl,
+       rtArtSpec6_16_8x14, NULL, rtArtSpec6_16_8x14_6 },
+};
+
+
+/**
+ * @name  rtArtSplitFindMatch6
+ *
+ * @brief Performs the longest prefix match on an IPv6 simple trie
+ *        that has a level ending at bit 64 in the same way as
+ *        rtArtFindMatch6(). The fringe index of a level is taken
+ *        from `hi' up to bit 64 and from `lo' after it.
+ *
+ * @param[in] pt Pointer to the routing table
+ * @param[in] hi The first 64 bits of the destination address
+ * @param[in] lo The last 64 bits of the destination address
+ *
+ * @retval routeEnt* Pointer to the longest prefix matching route.
+ * @retval NULL      There was no matching route
+ */
+static routeEnt*
+rtArtSplitFindMatch6 (rtTable* pt, u64 hi, u64 lo)
+{
+    register tableEntry  ent;
+    register tableEntry* pst;
+    register routeEnt*   pDefRoute;
+    register strideInfo* psi;
+    register u64 a;
+    register int l;
+
+
+    assert(pt->alen == 128);
+
+    pst = pt->root;
+    pDefRoute = NULL;
+    a = hi;
+    for ( l = 0, psi = pt->psi; l < pt->nLevels; ++l, ++psi ) {
+        if ( psi->tl > 64 ) {
+            a = lo;             /* the subtables of the last 64 bits */
+        }
+        ent = loadEnt(pst[((a >> ((64 - psi->tl) & 63)) &
+                           ((1 << psi->sl) - 1)) + (1 << psi->sl)]);
+        if ( !ent.ent ) break;
+        if ( !isSubtable(ent) ) return ent.ent;
+        if ( l >= (pt->nLevels - 1) ) break;
+        pst = subtablePtr(ent).down;
+        ent = loadEnt(pst[1]);
+        if ( ent.ent ) {
+            pDefRoute = ent.ent;
+        }
+    }
+
+    if ( pDefRoute ) {
+        return pDefRoute;
+    }
+    return loadEnt(pt->root[1]).ent;
+}
+
+
+/**
+ * @name  rtArtSplitFindMatch
+ *
+ * @brief rtArtSplitFindMatch6() of an address in the network byte order
+ */
+static routeEnt*
+rtArtSplitFindMatch (rtTable* pt, u8* pDest)
+{
+    u128 a = addr2u128(pDest);
+
+    return rtArtSplitFindMatch6(pt, a >> 64, a);
+}
+
+
+/**
+ * @name  rtArtSpecialize
+ *
+ * @brief Registers the specialized lookup functions of a simple trie
+ *        if its stride lengths match one of `specLayouts[]', or the
+ *        split lookups (rtArtSplitFindMatch6()) if it is an IPv6
+ *        trie that has a level ending at bit 64.
+ *
+ * @param[in] pt Pointer to the routing table (simple trie)
+ *
+ * @retval true  The specialized functions were registered
+ * @retval false No layout matched `pt'. `pt' is not changed.
+ */
+bool
+rtArtSpecialize (rtTable* pt)
+{
+    const specLayout* ps;
+    int i, l;
+
+
+    assert(pt->type == simpleTrie);
+
+    for ( i = 0; i < sizeof(specLayouts) / sizeof(specLayouts[0]); ++i ) {
+        ps = &specLayouts[i];
+        if ( ps->alen != pt->alen || ps->nLevels != pt->nLevels ) {
+            continue;
+        }
+        assert(ps->nLevels <= ART_SPEC_MAX_LEVELS);
+        for ( l = 0; l < ps->nLevels; ++l ) {
+            if ( ps->psl[l] != pt->psi[l].sl ) break;
+        }
+        if ( l < ps->nLevels ) {
+            continue;
+        }
+        pt->findMatch = ps->findMatch;
+        if ( ps->findMatch4 ) {
+            pt->findMatch4 = ps->findMatch4;
+        }
+        if ( ps->findMatch6 ) {
+            pt->findMatch6 = ps->findMatch6;
+        }
+        return true;
+    }
+
+    /*
+     * Layouts that split at bit 64
+     */
+    if ( pt->alen == 128 ) {
+        for ( l = 0; l < pt->nLevels; ++l ) {
+            if ( pt->psi[l].tl == 64 ) {
+                pt->findMatch  = rtArtSplitFindMatch;
+                pt->findMatch6 = rtArtSplitFindMatch6;
+                return true;
+            }
+        }
+    }
+    return false;
+}
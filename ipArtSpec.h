@@ -0,0 +1,180 @@
+/** @file ipArtSpec.h
+    @brif Lookup functions specialized for fixed stride layouts
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   The lookup of the simple trie (rtArtFindMatch()) reads the stride
+   lengths and the number of levels from the routing table, so its
+   loop cannot be unrolled and every shift amount is a variable.
+   ART_SPEC_LOOKUP4() and ART_SPEC_LOOKUP6() generate the lookup
+   functions of a simple trie whose stride lengths are compile-time
+   constants. The loop of rtArtSpecFindMatch() is fully unrolled and
+   every stride is taken from a 64-bit word with constant shifts.
+
+   Example (IPv4, stride lengths 16, 8 and 8):
+
+     ART_SPEC_LOOKUP4(rtArtSpec16_8_8, 3, 16, 8, 8)
+
+   defines
+
+     static routeEnt* rtArtSpec16_8_8(rtTable* pt, u8* pDest);
+     static routeEnt* rtArtSpec16_8_8_4(rtTable* pt, ipv4a dest);
+
+   that can be registered as `pt->findMatch()' and `pt->findMatch4()'
+   of a simple trie created with the same stride lengths.
+   ART_SPEC_LOOKUP6() defines `name' and `name_6' for IPv6.
+   rtArtInit() picks the layouts generated in ipArtSpec.c by itself.
+*/
+
+
+#ifndef __ipArtSpec_h__
+#define __ipArtSpec_h__
+
+#include "ipArt.h"
+
+
+/**
+ * @name  rtArtSpecIndex
+ *
+ * @brief Returns the fringe index of the stride that ends at bit `tl'.
+ *        The address is given as two 64-bit words (`hi' has the
+ *        first 64 bits). `tl' and `sl' must be constants so that
+ *        only one of the three cases is compiled.
+ *
+ * @param[in] hi The first 64 bits of the address
+ * @param[in] lo The last 64 bits of the address
+ * @param[in] tl Total stride length up to this level
+ * @param[in] sl Stride length of this level
+ *
+ * @retval u32 The fringe index
+ */
+static inline __attribute__ ((always_inline)) u32
+rtArtSpecIndex (u64 hi, u64 lo, const int tl, const int sl)
+{
+    u64 s;
+
+    if ( tl <= 64 ) {
+        s = hi >> (64 - tl);
+    } else if ( tl - sl >= 64 ) {
+        s = lo >> (128 - tl);
+    } else {
+        s = (hi << (tl - 64)) | (lo >> (128 - tl));
+    }
+    return (s & ((1 << sl) - 1)) + (1 << sl);
+}
+
+
+/**
+ * @name  rtArtSpecFindMatch
+ *
+ * @brief Performs the longest prefix match on a simple trie in the
+ *        same way as rtArtFindMatch(). `n' and `psl' must be
+ *        constants so that the loop is unrolled.
+ *
+ * @param[in] pt  Pointer to the routing table
+ * @param[in] hi  The first 64 bits of the destination address
+ * @param[in] lo  The last 64 bits of the destination address
+ * @param[in] n   The number of levels
+ * @param[in] psl Pointer to an array of `n' stride lengths
+ *
+ * @retval routeEnt* Pointer to the longest prefix matching route.
+ * @retval NULL      There was no matching route
+ */
+static inline __attribute__ ((always_inline)) routeEnt*
+rtArtSpecFindMatch (rtTable* pt, u64 hi, u64 lo, const int n,
+                    const u8* psl)
+{
+    tableEntry  ent;
+    tableEntry* pst;
+    routeEnt*   pDefRoute;
+    int l, tl;
+
+
+    pst = pt->root;
+    pDefRoute = NULL;
+    tl = 0;
+#pragma GCC unroll 32
+    for ( l = 0; l < n; ++l ) {
+        tl += psl[l];
+        ent = loadEnt(pst[rtArtSpecIndex(hi, lo, tl, psl[l])]);
+        if ( !ent.ent ) break;
+        if ( !isSubtable(ent) ) return ent.ent;
+        if ( l >= (n - 1) ) break;
+        pst = subtablePtr(ent).down;
+        ent = loadEnt(pst[1]);
+        if ( ent.ent ) {
+            pDefRoute = ent.ent;
+        }
+    }
+
+    if ( pDefRoute ) {
+        return pDefRoute;
+    }
+    return loadEnt(pt->root[1]).ent;
+}
+
+
+/*
+ * Generates `name' (for pt->findMatch()) and `name_4'
+ * (for pt->findMatch4()) of an IPv4 simple trie with `n' levels.
+ * The stride lengths follow `n'.
+ */
+#define ART_SPEC_LOOKUP4(name, n, ...)                                  \
+static const u8 name##_sl[n] = { __VA_ARGS__ };                         \
+                                                                        \
+static routeEnt*                                                        \
+name##_4 (rtTable* pt, ipv4a dest)                                      \
+{                                                                       \
+    assert(pt->alen == 32);                                             \
+    return rtArtSpecFindMatch(pt, (u64)dest << 32, 0, n, name##_sl);    \
+}                                                                       \
+                                                                        \
+static routeEnt*                                                        \
+name (rtTable* pt, u8* pDest)                                           \
+{                                                                       \
+    return name##_4(pt, addr2ipv4a(pDest));                             \
+}
+
+
+/*
+ * Generates `name' (for pt->findMatch()) and `name_6'
+ * (for pt->findMatch6()) of an IPv6 simple trie with `n' levels.
+ * The stride lengths follow `n'.
+ */
+#define ART_SPEC_LOOKUP6(name, n, ...)                                  \
+static const u8 name##_sl[n] = { __VA_ARGS__ };                         \
+                                                                        \
+static routeEnt*                                                        \
+name##_6 (rtTable* pt, u64 hi, u64 lo)                                  \
+{                                                                       \
+    assert(pt->alen == 128);                                            \
+    return rtArtSpecFindMatch(pt, hi, lo, n, name##_sl);                \
+}                                                                       \
+                                                                        \
+static routeEnt*                                                        \
+name (rtTable* pt, u8* pDest)                                           \
+{                                                                       \
+    u128 a = addr2u128(pDest);                                          \
+                                                                        \
+    return name##_6(pt, a >> 64, a);                                    \
+}
+
+
+#endif /* __ipArtSpec_h__ */
@@ -0,0 +1,537 @@
+/** @file ipArtTune.c
+    @brif Stride length tuner
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   A simple trie has a subtable starting at bit `s' for each
+   distinct `s'-bit prefix of the routes longer than `s' bits.
+   Let nodes(s) be the number of such prefixes (nodes(0) = 1: the
+   root.) nodes() is counted once from the sorted prefixes, then the
+   memory of any stride length distribution is
+
+     sum of nodes(s) * subtableSize(sl) over the levels
+
+   where `s' is the first bit and `sl' is the stride length of a level.
+   rtArtTuneStrides() finds by dynamic programming the distribution
+   with the fewest levels that have subtables (the worst-case number
+   of trie node accesses of a lookup) whose memory fits in the
+   budget, and the least memory among them.
+*/
+
+
+#include "ipArt.h"
+
+
+#define TUNE_MAX_STRIDE 24      /* limit of fringeIndex() */
+#define TUNE_INFINITY   (~(u64)0)
+
+/*
+ * Prefix set summarized for the tuner
+ */
+typedef struct tuneSet tuneSet;
+struct tuneSet {
+    int  alen;                  /* address length in bits */
+    int  nRoutes;               /* distinct prefixes */
+    u64  nodes[129];            /* nodes(s) */
+    u32  nPlen[129];            /* number of prefixes of each length */
+};
+
+typedef struct tunePrefix tunePrefix;
+struct tunePrefix {
+    u128 a;                     /* prefix left-aligned */
+    int  plen;
+};
+
+
+/**
+ * @name  tuneCmp
+ *
+ * @brief qsort() function: address first, then prefix length
+ */
+static int
+tuneCmp (const void* p1, const void* p2)
+{
+    const tunePrefix* a = p1;
+    const tunePrefix* b = p2;
+
+    if ( a->a != b->a ) {
+        return (a->a < b->a) ? -1 : 1;
+    }
+    return a->plen - b->plen;
+}
+
+
+/**
+ * @name  tuneSetInit
+ *
+ * @brief Counts nodes(s) and the prefix length distribution of
+ *        `n' routes.
+ *
+ * @param[out] ps      Pointer to the prefix set
+ * @param[in]  pRoutes Array of `n' route pointers
+ * @param[in]  n       The number of routes
+ * @param[in]  alen    Address length in bits
+ *
+ * @retval true  Success
+ * @retval false No memory
+ */
+static bool
+tuneSetInit (tuneSet* ps, routeEnt** pRoutes, int n, int alen)
+{
+    tunePrefix* pp;
+    u128 key, prev;
+    int  i, j, m, s;
+
+
+    assert((alen > 0) && (alen <= 128));
+
+    memset(ps, 0, sizeof(*ps));
+    ps->alen = alen;
+    pp = malloc((n + 1) * sizeof(tunePrefix));
+    if ( !pp ) {
+        return false;
+    }
+    for ( i = 0; i < n; ++i ) {
+        pp[i].a    = 0;
+        pp[i].plen = pRoutes[i]->plen;
+        for ( j = 0; j < bits2bytes(pRoutes[i]->plen); ++j ) {
+            pp[i].a |= (u128)pRoutes[i]->dest[j] << (120 - 8 * j);
+        }
+        if ( pp[i].plen < 128 ) {
+            pp[i].a &= ~(~(u128)0 >> pp[i].plen);
+        }
+    }
+    qsort(pp, n, sizeof(tunePrefix), tuneCmp);
+
+    /*
+     * Drop the duplicates
+     */
+    for ( i = m = 0; i < n; ++i ) {
+        if ( (m == 0) || tuneCmp(&pp[m - 1], &pp[i]) ) {
+            pp[m++] = pp[i];
+        }
+    }
+    ps->nRoutes = m;
+    for ( i = 0; i < m; ++i ) {
+        ++ps->nPlen[pp[i].plen];
+    }
+
+    /*
+     * Routes sharing the same `s'-bit prefix are contiguous.
+     */
+    ps->nodes[0] = 1;
+    for ( s = 1; s < alen; ++s ) {
+        prev = 0;
+        for ( i = j = 0; i < m; ++i ) {
+            if ( pp[i].plen <= s ) {
+                continue;
+            }
+            key = pp[i].a >> (128 - s);
+            if ( (j == 0) || (key != prev) ) {
+                ++ps->nodes[s];
+                prev = key;
+                j = 1;
+            }
+        }
+    }
+    free(pp);
+    return true;
+}
+
+
+/**
+ * @name  tuneSubtableSize
+ *
+ * @brief Returns the size of a subtable of stride length `sl' in
+ *        bytes. A path-compressed trie is estimated as a simple trie
+ *        with the address caches, which makes an upper bound.
+ */
+static inline u64
+tuneSubtableSize (int sl, int alen, trieType type)
+{
+    u64 n = (1ULL << (sl+1)) + 1;
+
+    if ( type == compactTrie ) {
+        return n * sizeof(u32);
+    }
+    if ( type == pathCompTrie ) {
+        n += bytes2nPtrs(alen >> 3);
+    }
+    return n * sizeof(tableEntry);
+}
+
+
+/**
+ * @name  tuneEval
+ *
+ * @brief Evaluates a stride length distribution
+ *
+ * @param[in]  ps      Pointer to the prefix set
+ * @param[in]  psl     Array of `nLevels' stride lengths
+ * @param[in]  nLevels The number of levels
+ * @param[in]  type    Trie type
+ * @param[out] pStats  Pointer to the results
+ */
+static void
+tuneEval (tuneSet* ps, s8* psl, int nLevels, trieType type,
+          rtArtStrideStats* pStats)
+{
+    u64 w;
+    int l, p, s;
+
+
+    memset(pStats, 0, sizeof(*pStats));
+    w = 0;
+    for ( l = s = 0; l < nLevels; s += psl[l++] ) {
+        pStats->memory += ps->nodes[s] * tuneSubtableSize(psl[l], ps->alen,
+                                                          type);
+        if ( ps->nodes[s] ) {
+            pStats->nLevels = l + 1;
+        }
+        if ( l > 0 ) {
+            pStats->nSubtables += ps->nodes[s];
+        }
+        for ( p = (l == 0) ? 0 : s + 1; p <= s + psl[l]; ++p ) {
+            w += (u64)ps->nPlen[p] * (l + 1);
+        }
+    }
+    pStats->avgLevels = (ps->nRoutes) ? (double)w / ps->nRoutes : 0;
+}
+
+
+/**
+ * @name  rtArtEvalStrides
+ *
+ * @brief API function.
+ *        Evaluates stride length distribution `psl' for `n' routes.
+ *        The memory and the number of the subtables are exact for
+ *        simple and compact tries, and upper bounds for
+ *        path-compressed tries.
+ *
+ * @param[in]  pRoutes Array of `n' route pointers
+ * @param[in]  n       The number of routes
+ * @param[in]  alen    Address length in bits
+ * @param[in]  type    Trie type
+ * @param[in]  psl     Array of `nLevels' stride lengths
+ * @param[in]  nLevels The number of levels
+ * @param[out] pStats  Pointer to the results
+ *
+ * @retval true  Success
+ * @retval false Wrong stride lengths or no memory
+ */
+bool
+rtArtEvalStrides (routeEnt** pRoutes, int n, int alen, trieType type,
+                  s8* psl, int nLevels, rtArtStrideStats* pStats)
+{
+    tuneSet s;
+    int i, sum;
+
+
+    for ( i = sum = 0; i < nLevels; ++i ) {
+        if ( (psl[i] <= 0) || (psl[i] > TUNE_MAX_STRIDE) ) {
+            return false;
+        }
+        sum += psl[i];
+    }
+    if ( (sum != alen) || (tuneSetInit(&s, pRoutes, n, alen) == false) ) {
+        return false;
+    }
+    tuneEval(&s, psl, nLevels, type, pStats);
+    return true;
+}
+
+
+/**
+ * @name  tuneRange
+ *
+ * @brief Finds the stride lengths of bits `b0' to `b1' - 1 that have
+ *        the fewest levels with subtables and whose memory is not more
+ *        than `budget' bytes, or the least memory with any number of
+ *        levels if `minMem' is true. The memory is minimized among
+ *        the distributions with the same number of such levels.
+ *        The levels after the last one with subtables take the rest
+ *        of the bits in strides of up to 24 bits.
+ *
+ * @param[in]  ps     Pointer to the prefix set
+ * @param[in]  b0     The first bit
+ * @param[in]  b1     The bit after the last one
+ * @param[in]  type   Trie type
+ * @param[in]  budget Memory budget of the subtables in bytes
+ * @param[in]  minMem true: the least memory
+ * @param[out] psl    Array of at least `b1' - `b0' stride lengths
+ * @param[out] pMem   The memory of the subtables of the bits
+ *
+ * @retval int The number of levels
+ * @retval 0   No distribution fits in `budget', or no memory
+ */
+static int
+tuneRange (tuneSet* ps, int b0, int b1, trieType type, u64 budget,
+           bool minMem, s8* psl, u64* pMem)
+{
+    u64* best;                  /* best[L * (n+1) + bit - b0] */
+    u8*  pk;                    /* stride length of `best' */
+    u64  c;
+    int  L, b, k, t, n, nLevels, w;
+
+
+    n    = b1 - b0;
+    w    = n + 1;
+    *pMem = 0;
+    best = malloc((n + 1) * w * sizeof(u64));
+    pk   = malloc((n + 1) * w);
+    if ( !best || !pk ) {
+        nLevels = 0;
+        goto done;
+    }
+
+    /*
+     * best[L][b]: the least memory of bits `b0' + `b' to `b1' - 1 by
+     * up to `L' levels with subtables, given nodes(b0 + b) > 0.
+     */
+    for ( b = 0; b <= n; ++b ) {
+        best[b] = TUNE_INFINITY;
+    }
+    for ( L = 1; L <= n; ++L ) {
+        for ( b = n - 1; b >= 0; --b ) {
+            best[L * w + b] = TUNE_INFINITY;
+            for ( k = 1; (k <= TUNE_MAX_STRIDE) && (b + k <= n); ++k ) {
+                c = ps->nodes[b0 + b] * tuneSubtableSize(k, ps->alen, type);
+                t = b + k;
+                if ( (t < n) && ps->nodes[b0 + t] ) {
+                    if ( best[(L - 1) * w + t] == TUNE_INFINITY ) {
+                        continue;
+                    }
+                    c += best[(L - 1) * w + t];
+                }
+                if ( c < best[L * w + b] ) {
+                    best[L * w + b] = c;
+                    pk[L * w + b]   = k;
+                }
+            }
+        }
+        if ( !minMem && (best[L * w] <= budget) ) {
+            break;
+        }
+    }
+    if ( minMem ) {
+        L = n;
+    }
+    if ( (L > n) || (best[L * w] > budget) ) {
+        nLevels = 0;
+        goto done;
+    }
+
+    /*
+     * Follow the choices, then cover the rest of the bits.
+     */
+    nLevels = 0;
+    if ( ps->nodes[b0] ) {
+        *pMem = best[L * w];
+    }
+    for ( b = 0; (b < n) && ps->nodes[b0 + b]; b += k, --L ) {
+        assert(L > 0);
+        k = pk[L * w + b];
+        psl[nLevels++] = k;
+    }
+    for ( ; b < n; b += k ) {
+        k = ((n - b) < TUNE_MAX_STRIDE) ? (n - b) : TUNE_MAX_STRIDE;
+        psl[nLevels++] = k;
+    }
+
+done:
+    free(best);
+    free(pk);
+    return nLevels;
+}
+
+
+/**
+ * @name  rtArtTuneStrides
+ *
+ * @brief API function.
+ *        Finds the stride length distribution for `n' routes that
+ *        has the fewest levels with subtables and whose memory is
+ *        not more than `budget' bytes. The memory is minimized among
+ *        the distributions with the same number of such levels.
+ *        The levels after the last one with subtables take the rest
+ *        of the address bits in strides of up to 24 bits.
+ *
+ * @param[in]  pRoutes Array of `n' route pointers
+ * @param[in]  n       The number of routes
+ * @param[in]  alen    Address length in bits
+ * @param[in]  type    Trie type
+ * @param[in]  budget  Memory budget of the subtables in bytes
+ * @param[out] psl     Array of at least `alen' stride lengths
+ * @param[out] pStats  Pointer to the results (may be NULL)
+ *
+ * @retval int The number of levels (`nLevels' of rtArtInit())
+ * @retval 0   No distribution fits in `budget', or no memory
+ */
+int
+rtArtTuneStrides (routeEnt** pRoutes, int n, int alen, trieType type,
+                  u64 budget, s8* psl, rtArtStrideStats* pStats)
+{
+    tuneSet s;
+    u64 mem;
+    int nLevels;
+
+
+    if ( tuneSetInit(&s, pRoutes, n, alen) == false ) {
+        return 0;
+    }
+    nLevels = tuneRange(&s, 0, alen, type, budget, false, psl, &mem);
+    if ( nLevels && pStats ) {
+        tuneEval(&s, psl, nLevels, type, pStats);
+    }
+    return nLevels;
+}
+
+
+/**
+ * @name  rtArtTuneStrides6
+ *
+ * @brief API function.
+ *        Same as rtArtTuneStrides() for IPv6 routes except that the
+ *        stride lengths split at bit 64 (see rtArtSpecialize()) and
+ *        the two halves are tuned separately. The worst case of a
+ *        lookup is usually set by a few routes longer than /64 that
+ *        few packets match, so the levels of bits 0 to 63 are
+ *        minimized first with the memory left after the least memory
+ *        of bits 64 to 127, then bits 64 to 127 get the fewest levels
+ *        the rest of `budget' allows.
+ *
+ * @param[in]  pRoutes Array of `n' route pointers
+ * @param[in]  n       The number of routes
+ * @param[in]  type    Trie type
+ * @param[in]  budget  Memory budget of the subtables in bytes
+ * @param[out] psl     Array of at least 128 stride lengths
+ * @param[out] pStats  Pointer to the results (may be NULL)
+ *
+ * @retval int The number of levels (`nLevels' of rtArtInit())
+ * @retval 0   No distribution fits in `budget', or no memory
+ */
+int
+rtArtTuneStrides6 (routeEnt** pRoutes, int n, trieType type, u64 budget,
+                   s8* psl, rtArtStrideStats* pStats)
+{
+    tuneSet s;
+    u64 mem[2];
+    int n1, n2;
+
+
+    if ( tuneSetInit(&s, pRoutes, n, 128) == false ) {
+        return 0;
+    }
+    if ( tuneRange(&s, 64, 128, type, TUNE_INFINITY, true, psl, &mem[1])
+         == 0 ) {
+        return 0;
+    }
+    if ( mem[1] > budget ) {
+        return 0;
+    }
+    n1 = tuneRange(&s, 0, 64, type, budget - mem[1], false, psl, &mem[0]);
+    if ( n1 == 0 ) {
+        return 0;
+    }
+    n2 = tuneRange(&s, 64, 128, type, budget - mem[0], false, psl + n1,
+                   &mem[1]);
+    if ( n2 == 0 ) {
+        return 0;
+    }
+    if ( pStats ) {
+        tuneEval(&s, psl, n1 + n2, type, pStats);
+    }
+    return n1 + n2;
+}
+
+
+typedef struct tuneCollect tuneCollect;
+struct tuneCollect {
+    routeEnt** pRoutes;
+    int n, max;
+};
+
+/**
+ * @name  tuneCollectRoute
+ *
+ * @brief rtFunc of rtArtDFwalk() in rtArtTuneTable()
+ */
+static void
+tuneCollectRoute (routeEnt* r, void* p2)
+{
+    tuneCollect* pc = p2;
+    routeEnt**   pr;
+
+    if ( pc->n == pc->max ) {
+        pr = realloc(pc->pRoutes, pc->max * 2 * sizeof(routeEnt*));
+        if ( !pr ) {
+            return;             /* rtArtTuneTable() fails */
+        }
+        pc->pRoutes = pr;
+        pc->max *= 2;
+    }
+    pc->pRoutes[pc->n++] = r;
+}
+
+
+/**
+ * @name  rtArtTuneTable
+ *
+ * @brief API function.
+ *        rtArtTuneStrides() for the routes of routing table `pt'
+ *        (simple or path-compressed trie.)
+ *
+ * @param[in]  pt     Pointer to the routing table
+ * @param[in]  type   Trie type of the table to be tuned
+ * @param[in]  budget Memory budget of the subtables in bytes
+ * @param[out] psl    Array of at least `pt->alen' stride lengths
+ * @param[out] pStats Pointer to the results (may be NULL)
+ *
+ * @retval int The number of levels
+ * @retval 0   No distribution fits in `budget', compact trie, or
+ *             no memory
+ */
+int
+rtArtTuneTable (rtTable* pt, trieType type, u64 budget, s8* psl,
+                rtArtStrideStats* pStats)
+{
+    tuneCollect c;
+    int n;
+
+
+    if ( (pt->type == compactTrie) || (pt->root == NULL) ) {
+        return 0;
+    }
+    c.n       = 0;
+    c.max     = 1024;
+    c.pRoutes = malloc(c.max * sizeof(routeEnt*));
+    if ( !c.pRoutes ) {
+        return 0;
+    }
+    if ( pt->root[1].ent ) {
+        tuneCollectRoute(pt->root[1].ent, &c);
+    }
+    rtArtDFwalk(pt, pt->root, tuneCollectRoute, &c);
+    n = (c.n >= pt->nRoutes) ?
+        rtArtTuneStrides(c.pRoutes, c.n, pt->alen, type, budget, psl, pStats) :
+        0;
+    free(c.pRoutes);
+    return n;
+}
@@ -0,0 +1,1595 @@
+/** @file ipArtUpdate.c
+    @brif Coalesced batch updates
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   rtArtApplyUpdates() applies a batch of route additions and
+   withdrawals with the same result as applying them one by one
+   in the given order, but
+
+     1. The operations of the same prefix are coalesced into at most
+        one delete, insert or replacement of the route.
+        An addition withdrawn later in the same batch is cancelled
+        together with the withdrawal, and an announcement replaced by
+        a later one in the same batch is cancelled.
+     2. The prefixes of a simple trie are applied subtable by
+        subtable (updAllot()), the deepest subtables first. Each
+        subtable is walked once from its index 2 and 3 toward its
+        changed prefixes: the entries that inherit a changed route
+        take the new one, a changed prefix starts to allot its own
+        route, and the subtrees whose entries do not change are
+        skipped. Every table entry is written at most once per batch
+        as rtArtTrieBulkLoad() does for an empty table, and the
+        subtables emptied by the batch are freed once.
+
+   The other tables apply the coalesced prefixes one by one
+   (updApply()): the deletes in the pre-order of the prefixes (a
+   prefix before the prefixes it covers), and the inserts in the
+   post-order (a prefix after the prefixes it covers), so that an
+   allotment does not rewrite the entries of a prefix applied
+   before it in the same batch.
+
+   rtArtApplyUpdatesSharded() also applies the prefixes under
+   different root fringe indices in parallel. A prefix longer than
+   the root stride changes only the subtree under its root fringe
+   index (and the counter of the root), so writer threads that own
+   disjoint ranges of the indices need no locks. The prefixes in the
+   root are allotted across many indices and applied by the caller
+   before the writers start.
+*/
+
+
+#include <pthread.h>
+#include <time.h>
+
+#include "ipArt.h"
+
+
+/*
+ * rtArtApplyUpdatesSharded() gives each writer thread at least
+ * UPD_SHARD_MIN prefixes.
+ */
+#define UPD_SHARD_MIN 512
+
+/*
+ * updAllot() and updApply() prefetch the operation UPD_PREFETCH * 2
+ * prefixes ahead and its route UPD_PREFETCH prefixes ahead since the
+ * additions are applied in the order of the prefixes rather than in
+ * memory.
+ */
+#define UPD_PREFETCH 8
+
+/*
+ * updAllot() also prefetches the entries of the first UPD_PATH levels
+ * on the path of a prefix, the entry of level `l' (UPD_PATH - l) *
+ * UPD_PREFETCH prefixes ahead, so the entry of each level is read
+ * from the entry above it after that one is in the cache.
+ */
+#define UPD_PATH 3
+
+
+/*
+ * Operation sorted by prefix
+ */
+typedef struct updKey updKey;
+struct updKey {
+    u128 a;                     /* prefix left-aligned and masked */
+    int  plen;                  /* prefix length */
+    int  i;                     /* index of the operation */
+    u8   op;                    /* artUpdAdd, Withdraw or Announce */
+    bool rep;                   /* replace the route in the table */
+};
+
+/*
+ * Coalesced prefix located in its subtable by updAllot().
+ * Takes the place of an updKey.
+ */
+typedef struct updSlot updSlot;
+struct updSlot {
+    subtable  t;                /* subtable of the prefix */
+    routeEnt* old;              /* route of the prefix in `t', or NULL */
+    routeEnt* r;                /* new route of the prefix, or NULL */
+    u32       k;                /* base index of the prefix in `t' */
+    int       next;             /* next slot of the same level, or -1 */
+};
+
+/*
+ * Walk of a subtable by updFill()
+ */
+typedef struct updWalk updWalk;
+struct updWalk {
+    subtable t;
+    updSlot* ps;
+    int      q;                 /* next slot to be filled, -1: none */
+    u32      threshold;         /* the first fringe index of `t' */
+    bool     fringeCheck;       /* false if `t' is the deepest level */
+    u32      nVisits;
+};
+
+/*
+ * Memory freed by a writer thread of rtArtApplyUpdatesSharded()
+ */
+typedef struct shardRetired shardRetired;
+struct shardRetired {
+    void*         p;
+    rtArtFreeFunc f;
+};
+
+/*
+ * Writer thread of rtArtApplyUpdatesSharded()
+ */
+struct rtArtShard {
+    rtTable        t;           /* copy of the table for the thread */
+    pthread_t      tid;
+    u64*           pGen;        /* generation of the table */
+    rtArtUpdateOp* pOps;
+    updKey*        pk;          /* sorted operations of the thread */
+    updSlot*       ps;          /* slots of `pk' */
+    int            n;           /* -1: applied by the caller */
+    shardRetired*  pRet;        /* memory to be freed after join */
+    int            nRet;
+    int            maxRet;      /* sized by updSharded() */
+    bool           forked;      /* `t.alloc' is set up */
+};
+
+
+/**
+ * @name   updMask
+ *
+ * @brief  Returns the mask of the first `plen' bits of a u128.
+ */
+static inline u128
+updMask (int plen)
+{
+    return (plen == 0) ? 0 : ~(u128)0 << (128 - plen);
+}
+
+
+/**
+ * @name   updCmp
+ *
+ * @brief  qsort() callback: orders the operations by prefix in the
+ *         pre-order and the operations of the same prefix in the
+ *         given order.
+ */
+static int
+updCmp (const void* p1, const void* p2)
+{
+    const updKey* k1 = p1;
+    const updKey* k2 = p2;
+
+
+    if ( k1->a != k2->a ) {
+        return (k1->a < k2->a) ? -1 : 1;
+    }
+    if ( k1->plen != k2->plen ) {
+        return k1->plen - k2->plen;
+    }
+    return k1->i - k2->i;
+}
+
+
+/**
+ * @name   updLess
+ *
+ * @brief  Returns true if prefix `k1' comes before `k2' in the
+ *         pre-order.
+ */
+static inline bool
+updLess (const updKey* k1, const updKey* k2)
+{
+    return (k1->a < k2->a) || ((k1->a == k2->a) && (k1->plen < k2->plen));
+}
+
+
+/**
+ * @name   updCovers
+ *
+ * @brief  Returns true if prefix `k1' covers (or is) prefix `k2'.
+ */
+static inline bool
+updCovers (const updKey* k1, const updKey* k2)
+{
+    return (k1->plen <= k2->plen) && ((k2->a & updMask(k1->plen)) == k1->a);
+}
+
+
+/*
+ * updSort() distributes the operations to the buckets of the first
+ * UPD_KEY_BITS bits of the prefix (counting sort). updRadix() sorts
+ * each bucket by the next 8 bits in the same way until it has at most
+ * UPD_ISORT_MAX operations, which are sorted by insertion sort. The
+ * counting sort and the insertion sort are stable, so the operations
+ * of the same prefix stay in the given order.
+ */
+#define UPD_KEY_BITS  16
+#define UPD_ISORT_MAX 32
+
+#define updBucket(pk) (u32)((pk)->a >> (128 - UPD_KEY_BITS))
+#define updDigit(pk, bit) ((u32)((pk)->a >> (120 - (bit))) & 0xff)
+
+
+/**
+ * @name   updInsertionSort
+ *
+ * @brief  Sorts `n' operations `p' in the order of `updCmp()' if
+ *         they are in the given order.
+ */
+static void
+updInsertionSort (updKey* p, int n)
+{
+    updKey k;
+    int i, j;
+
+
+    for ( i = 1; i < n; ++i ) {
+        k = p[i];
+        for ( j = i; (j > 0) && updLess(&k, &p[j-1]); --j ) {
+            p[j] = p[j-1];
+        }
+        p[j] = k;
+    }
+}
+
+
+/**
+ * @name   updRadix
+ *
+ * @brief  Sorts `n' operations `p' whose prefixes have the same
+ *         first `bit' bits in the order of `updCmp()' if they are in
+ *         the given order.
+ *
+ * @param[in,out] p    Array of `n' operations
+ * @param[in]     n    The number of operations in `p'
+ * @param[in]     bit  The number of the bits sorted already
+ * @param[in]     pTmp Scratch array of `n' operations
+ */
+static void
+updRadix (updKey* p, int n, int bit, updKey* pTmp)
+{
+    int cnt[256];
+    int i, k, sum;
+
+
+    if ( n <= UPD_ISORT_MAX ) {
+        updInsertionSort(p, n);
+        return;
+    }
+    if ( bit >= 128 ) {
+        qsort(p, n, sizeof(updKey), updCmp);    /* the same address */
+        return;
+    }
+    memset(cnt, 0, sizeof(cnt));
+    for ( i = 0; i < n; ++i ) {
+        cnt[updDigit(&p[i], bit)]++;
+    }
+    for ( k = sum = 0; k < 256; ++k ) {
+        i      = cnt[k];
+        cnt[k] = sum;           /* first position of bucket `k' */
+        sum   += i;
+    }
+    for ( i = 0; i < n; ++i ) {
+        pTmp[cnt[updDigit(&p[i], bit)]++] = p[i];
+    }
+    memcpy(p, pTmp, n * sizeof(updKey));
+    /*
+     * `cnt[k]' is the end of bucket `k' now
+     */
+    for ( k = sum = 0; k < 256; sum = cnt[k++] ) {
+        if ( cnt[k] - sum > 1 ) {
+            updRadix(&p[sum], cnt[k] - sum, bit + 8, &pTmp[sum]);
+        }
+    }
+}
+
+
+/**
+ * @name   updSort
+ *
+ * @brief  Stores the operations `pk' in `pOut' in the order of
+ *         `updCmp()'. `pk' is used as the scratch array. Falls back
+ *         to qsort() of the whole array if there is no memory.
+ *
+ * @param[in,out] pk   Array of `n' operations in the given order
+ * @param[in]     n    The number of operations in `pk'
+ * @param[out]    pOut Array of `n' sorted operations
+ */
+static void
+updSort (updKey* pk, int n, updKey* pOut)
+{
+    int* pCnt;
+    int  i, c, sum;
+
+
+    pCnt = calloc(1 << UPD_KEY_BITS, sizeof(int));
+    if ( !pCnt ) {
+        memcpy(pOut, pk, n * sizeof(updKey));
+        qsort(pOut, n, sizeof(updKey), updCmp);
+        return;
+    }
+    for ( i = 0; i < n; ++i ) {
+        pCnt[updBucket(&pk[i])]++;
+    }
+    for ( i = sum = 0; i < (1 << UPD_KEY_BITS); ++i ) {
+        c       = pCnt[i];
+        pCnt[i] = sum;          /* first position of bucket `i' */
+        sum    += c;
+    }
+    for ( i = 0; i < n; ++i ) {
+        pOut[pCnt[updBucket(&pk[i])]++] = pk[i];
+    }
+    /*
+     * `pCnt[c]' is the end of bucket `c' now
+     */
+    for ( c = sum = 0; c < (1 << UPD_KEY_BITS); sum = pCnt[c++] ) {
+        if ( pCnt[c] - sum > 1 ) {
+            updRadix(&pOut[sum], pCnt[c] - sum, UPD_KEY_BITS, &pk[sum]);
+        }
+    }
+    free(pCnt);
+}
+
+
+/**
+ * @name   updPostOrder
+ *
+ * @brief  Stores the prefixes `pk' sorted in the pre-order (each
+ *         prefix once) in `pOut' in the post-order, that is, a
+ *         prefix after the prefixes it covers. A prefix is moved
+ *         out when the first prefix it does not cover comes.
+ *
+ * @param[in]  pk   Array of `n' prefixes in the pre-order
+ * @param[in]  n    The number of prefixes in `pk'
+ * @param[out] pOut Array of `n' prefixes in the post-order
+ */
+static void
+updPostOrder (updKey* pk, int n, updKey* pOut)
+{
+    int st[129];                /* prefixes covering `pk[i]' */
+    int i, m, sp;
+
+
+    for ( i = m = sp = 0; i < n; ++i ) {
+        while ( sp && !updCovers(&pk[st[sp-1]], &pk[i]) ) {
+            pOut[m++] = pk[st[--sp]];
+        }
+        assert(sp < 129);
+        st[sp++] = i;
+    }
+    while ( sp ) {
+        pOut[m++] = pk[st[--sp]];
+    }
+}
+
+
+/**
+ * @name   updAddr
+ *
+ * @brief  Stores the IP address of prefix `pk' in `dest'
+ *         (network byte order).
+ */
+static void
+updAddr (updKey* pk, u8* dest)
+{
+    u64 x[2];
+
+
+    x[0] = __builtin_bswap64((u64)(pk->a >> 64));
+    x[1] = __builtin_bswap64((u64)pk->a);
+    memcpy(dest, x, sizeof(x));
+}
+
+
+/**
+ * @name   updExists
+ *
+ * @brief  Returns true if `pt' has a route of prefix `pk'.
+ */
+static bool
+updExists (rtTable* pt, updKey* pk)
+{
+    routeEnt* r;
+    u8 dest[16];
+
+
+    updAddr(pk, dest);
+    r = pt->findExactMatch(pt, dest, pk->plen);
+    return (r && (r->plen == pk->plen) && cmpAddr(r->dest, dest, pk->plen))
+        ? true : false;
+}
+
+
+/**
+ * @name   updInsert
+ *
+ * @brief  Inserts the route of addition `pu' into `pt' (or replaces
+ *         the route of the prefix if `pu' is an announcement) and
+ *         sets its result.
+ */
+static void
+updInsert (rtTable* pt, rtArtUpdateOp* pu)
+{
+    routeEnt* q;
+
+
+    q = pt->insert(pt, pu->r);
+    if ( q == pu->r ) {
+        pu->rc = artUpdDone;
+    } else if ( q == NULL ) {
+        pu->rc = artUpdFailed;
+    } else if ( pu->op == artUpdAnnounce ) {
+        q = pt->replace(pt, pu->r);
+        if ( q ) {
+            rtArtFreeRoute(pt, q);
+            pu->rc = artUpdReplaced;
+        } else {
+            pu->rc = artUpdFailed;
+        }
+    } else {
+        pu->rc = artUpdExists;
+    }
+}
+
+
+/**
+ * @name   updSequential
+ *
+ * @brief  Applies the operations one by one in the given order.
+ *         Used if there is no memory to sort them.
+ */
+static void
+updSequential (rtTable* pt, rtArtUpdateOp* pOps, int n)
+{
+    rtArtUpdateOp* pu;
+    int i;
+
+
+    for ( i = 0; i < n; ++i ) {
+        pu = &pOps[i];
+        if ( pu->op == artUpdWithdraw ) {
+            pu->rc = pt->delete(pt, pu->pDest, pu->plen)
+                ? artUpdDone : artUpdNotFound;
+        } else {
+            updInsert(pt, pu);
+        }
+    }
+}
+
+
+/**
+ * @name   updMerge
+ *
+ * @brief  Replays the operations of a prefix `pk[0]' to `pk[n-1]'
+ *         (sorted in the given order) on the route of the prefix,
+ *         which is in the table if `exists', and sets their results.
+ *         Stores in `pOut' a withdrawal if the route in the table is
+ *         to be deleted, or the addition whose route is to be
+ *         inserted (or to replace the route in the table). A single
+ *         operation is stored as it is and `exists' is not used then.
+ *         `pOut' may be `pk' because it is stored after `pk' is read.
+ *
+ * @param[in,out] pOps   Array of the operations
+ * @param[in]     pk     Operations of the same prefix
+ * @param[in]     n      The number of operations in `pk'
+ * @param[in]     exists true if the prefix has a route in the table
+ * @param[out]    pOut   Coalesced operation
+ *
+ * @retval true  `pOut' is to be applied
+ * @retval false The operations cancel each other
+ */
+static bool
+updMerge (rtArtUpdateOp* pOps, updKey* pk, int n, bool exists, updKey* pOut)
+{
+    rtArtUpdateOp* pu;
+    int  i, cur;                /* -1: no route, -2: route in the table,
+                                   others: index of the addition */
+    bool del;
+
+
+    if ( n == 1 ) {
+        /*
+         * The result of a single operation is set when it is applied
+         */
+        *pOut = pk[0];
+        return true;
+    }
+
+    cur = exists ? -2 : -1;
+    del = false;
+    for ( i = 0; i < n; ++i ) {
+        pu = &pOps[pk[i].i];
+        if ( pk[i].op == artUpdWithdraw ) {
+            if ( cur == -1 ) {
+                pu->rc = artUpdNotFound;
+            } else if ( cur == -2 ) {
+                pu->rc = artUpdDone;
+                del = true;
+                cur = -1;
+            } else if ( pOps[pk[cur].i].rc == artUpdReplaced ) {
+                /*
+                 * Deletes the route in the table instead of replacing it
+                 */
+                pOps[pk[cur].i].rc = artUpdCancelled;
+                pu->rc = artUpdDone;
+                cur = -1;
+            } else {
+                pOps[pk[cur].i].rc = artUpdCancelled;
+                pu->rc = artUpdCancelled;
+                cur = -1;
+            }
+        } else if ( cur == -1 ) {
+            pu->rc = artUpdDone;
+            cur = i;
+        } else if ( pk[i].op == artUpdAdd ) {
+            pu->rc = artUpdExists;
+        } else if ( cur == -2 ) {
+            pu->rc = artUpdReplaced;
+            del = true;
+            cur = i;
+        } else {
+            /*
+             * Inserted (or replaces the route in the table) instead
+             * of the previous addition
+             */
+            pu->rc = pOps[pk[cur].i].rc;
+            pOps[pk[cur].i].rc = artUpdCancelled;
+            cur = i;
+        }
+    }
+    if ( cur >= 0 ) {
+        *pOut = pk[cur];
+        pOut->rep = del;            /* replaces the route in the table */
+        return true;
+    }
+    if ( del ) {
+        *pOut = pk[0];
+        pOut->op = artUpdWithdraw;
+        pOut->i  = -1;              /* the results are already set */
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * @name   updCoalesce
+ *
+ * @brief  Coalesces the operations of a prefix `pk[0]' to `pk[n-1]'
+ *         on the route of the prefix in `pt' (see updMerge()) and
+ *         appends the result to `pOut'. A single operation is
+ *         appended without looking up `pt'. `pOut' may end at `pk'.
+ *
+ * @param[in]     pt   Pointer to the routing table
+ * @param[in,out] pOps Array of the operations
+ * @param[in]     pk   Operations of the same prefix
+ * @param[in]     n    The number of operations in `pk'
+ * @param[out]    pOut Coalesced prefixes
+ * @param[in,out] nOut The number of prefixes in `pOut'
+ */
+static void
+updCoalesce (rtTable* pt, rtArtUpdateOp* pOps, updKey* pk, int n,
+             updKey* pOut, int* nOut)
+{
+    if ( updMerge(pOps, pk, n, (n > 1) && updExists(pt, pk),
+                  &pOut[*nOut]) ) {
+        (*nOut)++;
+    }
+}
+
+
+/**
+ * @name   updApply
+ *
+ * @brief  Applies the `n' coalesced prefixes `pk' one by one through
+ *         the functions of `pt' (see above) and sets their results:
+ *         deletes the withdrawals in the pre-order first, then
+ *         inserts the additions in the post-order. `pTmp' has room
+ *         for `n' prefixes.
+ */
+static void
+updApply (rtTable* pt, rtArtUpdateOp* pOps, updKey* pk, int n,
+          updKey* pTmp)
+{
+    routeEnt* r;
+    updKey* pDel;
+    updKey* pAdd;
+    u8  dest[16];
+    int i, nDel, nAdd;
+
+
+    /*
+     * The withdrawals are copied to `pTmp' and the additions packed
+     * at the beginning of `pk', then stored after the withdrawals in
+     * the post-order.
+     */
+    pDel = pTmp;
+    for ( i = nDel = nAdd = 0; i < n; ++i ) {
+        if ( pk[i].op == artUpdWithdraw ) {
+            pDel[nDel++] = pk[i];
+        } else {
+            pk[nAdd++] = pk[i];
+        }
+    }
+    pAdd = &pDel[nDel];
+    updPostOrder(pk, nAdd, pAdd);
+
+    for ( i = 0; i < nDel; ++i ) {
+        updAddr(&pDel[i], dest);
+        if ( pt->delete(pt, dest, pDel[i].plen) ) {
+            if ( pDel[i].i >= 0 ) pOps[pDel[i].i].rc = artUpdDone;
+        } else {
+            assert(pDel[i].i >= 0);     /* found by updExists() */
+            pOps[pDel[i].i].rc = artUpdNotFound;
+        }
+    }
+    for ( i = 0; i < nAdd; ++i ) {
+        if ( i + 2 * UPD_PREFETCH < nAdd ) {
+            __builtin_prefetch(&pOps[pAdd[i + 2 * UPD_PREFETCH].i]);
+        }
+        if ( i + UPD_PREFETCH < nAdd ) {
+            __builtin_prefetch(pOps[pAdd[i + UPD_PREFETCH].i].r);
+        }
+        if ( pAdd[i].rep ) {
+            r = pt->replace(pt, pOps[pAdd[i].i].r);
+            if ( r ) {
+                rtArtFreeRoute(pt, r);
+                continue;
+            }
+        }
+        updInsert(pt, &pOps[pAdd[i].i]);
+    }
+}
+
+
+/**
+ * @name   updResolve
+ *
+ * @brief  Sets the result of the coalesced prefix `pk' whose route in
+ *         the table is `z' (NULL: none) and returns true if the table
+ *         is to be changed. `*pr' is set to the new route of the
+ *         prefix (NULL: deleted).
+ *
+ * @param[in,out] pu Operation of `pk' (NULL if the results are set)
+ * @param[in]     pk Coalesced prefix
+ * @param[in]     z  Route of the prefix in the table
+ * @param[out]    pr New route of the prefix
+ */
+static bool
+updResolve (rtArtUpdateOp* pu, updKey* pk, routeEnt* z, routeEnt** pr)
+{
+    *pr = NULL;
+    if ( pk->op == artUpdWithdraw ) {
+        if ( !z ) {
+            assert(pu);                 /* found by updExists() */
+            pu->rc = artUpdNotFound;
+            return false;
+        }
+        if ( pu ) pu->rc = artUpdDone;
+        return true;
+    }
+
+    *pr = pu->r;
+    if ( !z ) {
+        pu->rc = artUpdDone;
+    } else if ( pk->rep ) {
+        /* the result is set by updCoalesce() */
+    } else if ( pu->op == artUpdAnnounce ) {
+        pu->rc = artUpdReplaced;
+    } else {
+        pu->rc = artUpdExists;
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @name   updDefault
+ *
+ * @brief  Applies the coalesced prefix `pk' of the default route,
+ *         which is stored in index 1 of the root and not allotted.
+ */
+static void
+updDefault (rtTable* pt, rtArtUpdateOp* pu, updKey* pk)
+{
+    routeEnt* z;
+    routeEnt* r;
+
+
+    z = pt->root[1].ent;
+    if ( !updResolve(pu, pk, z, &r) ) return;
+
+    if ( r ) r->level = 0;
+    storeRoute(pt->root[1], r);
+    if ( !z ) {
+        rtArtCountRoute(pt, r, 1);
+        return;
+    }
+    if ( r ) {
+        rtArtBumpGen(pt);
+    } else {
+        rtArtCountRoute(pt, z, -1);
+    }
+    rtArtFreeRoute(pt, z);
+}
+
+
+/**
+ * @name   updCount
+ *
+ * @brief  Adds `n' to the counter of subtable `t' of level `l'.
+ *         The counter of the root is shared by the writers of
+ *         rtArtApplyUpdatesSharded().
+ */
+static inline void
+updCount (subtable t, int l, int n)
+{
+    if ( l == 0 ) {
+        __atomic_add_fetch(&t[0].count, n, __ATOMIC_RELAXED);
+    } else {
+        t[0].count += n;
+    }
+}
+
+
+/**
+ * @name   updUnlink
+ *
+ * @brief  Frees empty subtable `t' of level `l' (> 0) on the path of
+ *         prefix `a' and the ancestors it empties, restoring the
+ *         entry of each in its parent first as rtArtDelete() does.
+ *
+ * @retval int The level of the least deep subtable freed
+ */
+static int
+updUnlink (rtTable* pt, subtable t, int l, u128 a)
+{
+    subtable pst;
+    int i;
+
+
+    pst = pt->root;
+    for ( i = 0; i < l; ++i ) {
+        pt->pTbl[i] = pst;
+        pt->pEnt[i] = &pst[fringeIndex6(&pt->psi[i], a)];
+        pst = subtablePtr(*pt->pEnt[i]).down;
+    }
+    assert(pst == t);
+
+    for (;;) {
+        --l;
+        storeRoute(*pt->pEnt[l], t[1].ent);
+        rtArtFreeSubtable(pt, t);
+        t = pt->pTbl[l];
+        if ( l == 0 ) {
+            updCount(t, 0, -1);
+            break;
+        }
+        if ( --t[0].count > 0 ) break;
+    }
+    return l + 1;
+}
+
+
+/**
+ * @name   updBelow
+ *
+ * @brief  Returns true if the next slot of walk `pw' is at index `j'
+ *         or below it.
+ */
+static inline bool
+updBelow (updWalk* pw, u32 j)
+{
+    u32 k;
+    int d;
+
+
+    if ( pw->q < 0 ) return false;
+    k = pw->ps[pw->q].k;
+    d = __builtin_clz(j) - __builtin_clz(k);
+    return ((d >= 0) && ((k >> d) == j)) ? true : false;
+}
+
+
+static void updFill(updWalk* pw, u32 j, routeEnt* old, routeEnt* new);
+
+/**
+ * @name   updRoots
+ *
+ * @brief  Fills from the slots of walk `pw' below index `j' whose
+ *         parents do not change. Each of them inherits the route in
+ *         the entry of its parent.
+ */
+static void
+updRoots (updWalk* pw, u32 j)
+{
+    u32 k;
+
+
+    while ( updBelow(pw, j) ) {
+        k = pw->ps[pw->q].k;
+        updFill(pw, k, NULL, ((k >> 1) > 1) ? pw->t[k >> 1].ent : NULL);
+    }
+}
+
+
+/**
+ * @name   updFill
+ *
+ * @brief  Stores the new routes of the slots of walk `pw' at index
+ *         `j' and below and allots them. The entries that inherit
+ *         `old' from the parent of `j' take `new'. The slots are
+ *         visited in the order of the heap indices from the least
+ *         specific one, which is their order by prefix, so every
+ *         entry is written at most once and the entries that do not
+ *         change are visited only at the boundaries of the ranges.
+ *
+ * @param[in,out] pw  Walk of the subtable
+ * @param[in]     j   Index of the entry
+ * @param[in]     old Route inherited from the parent of `j' before
+ * @param[in]     new Route inherited from the parent of `j' after
+ */
+static void
+updFill (updWalk* pw, u32 j, routeEnt* old, routeEnt* new)
+{
+    tableEntry* e;
+    routeEnt*   z;
+
+
+    pw->nVisits++;
+    e = &pw->t[j];
+    if ( pw->fringeCheck && isSubtable(*e) ) {
+        e = &subtablePtr(*e).down[1];
+    }
+    z = e->ent;
+    if ( (pw->q >= 0) && (pw->ps[pw->q].k == j) ) {
+        /*
+         * The prefix of the slot: a deleted route leaves the route
+         * of the parent.
+         */
+        old = z;
+        if ( pw->ps[pw->q].r ) new = pw->ps[pw->q].r;
+        pw->q = pw->ps[pw->q].next;
+    } else if ( z != old ) {
+        old = new = z;          /* route of a more specific prefix */
+    }
+    if ( z != new ) {
+        storeRoute(*e, new);
+    }
+    if ( j >= pw->threshold ) return;
+
+    if ( old == new ) {
+        updRoots(pw, j);
+        return;
+    }
+    updFill(pw, j << 1, old, new);
+    updFill(pw, (j << 1) + 1, old, new);
+}
+
+
+/**
+ * @name   updSubtable
+ *
+ * @brief  Applies the slots linked from `ps[q]' to their subtable of
+ *         level `l': counts the deleted routes, frees the subtable if
+ *         it is empty, or fills it otherwise, then frees the deleted
+ *         and replaced routes.
+ *
+ * @retval int The level of the least deep subtable freed, or 0
+ */
+static int
+updSubtable (rtTable* pt, updKey* pk, updSlot* ps, int q, int l)
+{
+    updWalk w;
+    subtable t;
+    int i, f;
+
+
+    t = ps[q].t;
+    for ( i = q; i >= 0; i = ps[i].next ) {
+        assert(ps[i].t == t);
+        if ( ps[i].old && !ps[i].r ) {
+            updCount(t, l, -1);
+        }
+    }
+
+    if ( (l > 0) && (t[0].count == 0) ) {
+        /*
+         * Every route is deleted. The subtable is unlinked before
+         * the routes are freed.
+         */
+        f = updUnlink(pt, t, l, pk[q].a);
+    } else {
+        f = 0;
+        w.t           = t;
+        w.ps          = ps;
+        w.q           = q;
+        w.threshold   = 1 << pt->psi[l].sl;
+        w.fringeCheck = (l < pt->nLevels - 1) ? true : false;
+        w.nVisits     = 0;
+        updRoots(&w, 1);
+        rtArtCountAllot(pt, w.nVisits);
+    }
+
+    for ( i = q; i >= 0; i = ps[i].next ) {
+        if ( !ps[i].old ) {
+            rtArtCountRoute(pt, ps[i].r, 1);
+            continue;
+        }
+        if ( ps[i].r ) {
+            rtArtBumpGen(pt);
+        } else {
+            rtArtCountRoute(pt, ps[i].old, -1);
+        }
+        rtArtFreeRoute(pt, ps[i].old);
+    }
+    return f;
+}
+
+
+/**
+ * @name   updDescend
+ *
+ * @brief  Follows the path of prefix `a' from subtable `cur[lv]' down
+ *         to level `l', setting the subtables in `cur'. The missing
+ *         subtables are created if `create'.
+ *
+ * @retval int The level reached (< `l' if a subtable is missing or
+ *             cannot be created)
+ */
+static inline int
+updDescend (rtTable* pt, subtable* cur, int lv, int l, u128 a, bool create)
+{
+    tableEntry* e;
+    subtable t;
+
+
+    for ( ; lv < l; ++lv ) {
+        e = &cur[lv][fringeIndex6(&pt->psi[lv], a)];
+        if ( isSubtable(*e) ) {
+            cur[lv+1] = subtablePtr(*e).down;
+            continue;
+        }
+        if ( !create ) break;
+        t = rtArtNewSubTable(pt, lv+1, *e);
+        if ( t == NULL ) break;
+        storeDown(*e, makeSubtable(t));
+        updCount(cur[lv], lv, 1);
+        cur[lv+1] = t;
+    }
+    return lv;
+}
+
+
+/**
+ * @name   updPrefetch
+ *
+ * @brief  Prefetches the entry of prefix `a' in its subtable of level
+ *         `l'. The entries of the levels above were prefetched for
+ *         the prefix before.
+ */
+static inline void
+updPrefetch (rtTable* pt, u128 a, int l)
+{
+    tableEntry* e;
+    int i;
+
+
+    e = &pt->root[fringeIndex6(&pt->psi[0], a)];
+    for ( i = 1; i <= l; ++i ) {
+        if ( !isSubtable(*e) ) return;
+        e = &subtablePtr(*e).down[fringeIndex6(&pt->psi[i], a)];
+    }
+    __builtin_prefetch(e);
+}
+
+
+/**
+ * @name   updAllot
+ *
+ * @brief  Coalesces and applies the `n' sorted operations `pk' to
+ *         simple trie `pt' and sets their results. The operations of
+ *         each prefix are coalesced (updMerge()) on the route found
+ *         in its subtable, the subtables of an addition are created
+ *         on the way, and the prefix is linked to the slots of the
+ *         subtable. A subtable is applied (updSubtable()) when the
+ *         prefixes leave its range of addresses, while its entries
+ *         are still in the cache, so it is applied once and after
+ *         its descendants. The prefixes are in the pre-order, or the
+ *         prefixes in the root are moved before the others (see
+ *         shardSplit()).
+ *
+ * @param[in]     pt   Pointer to the simple trie
+ * @param[in,out] pOps Array of the operations
+ * @param[in]     pk   Operations sorted by updSort()
+ * @param[in]     n    The number of operations in `pk'
+ * @param[out]    ps   Slots of the prefixes (may be the same memory
+ *                     as another array of `n' updKeys)
+ */
+static void
+updAllot (rtTable* pt, rtArtUpdateOp* pOps, updKey* pk, int n, updSlot* ps)
+{
+    subtable cur[ART_MAX_LEVELS];   /* subtables of the previous prefix */
+    int      head[ART_MAX_LEVELS];  /* slots of `cur[l]' */
+    int      tail[ART_MAX_LEVELS];
+    rtArtUpdateOp* pu;
+    updKey    key;
+    routeEnt* z;
+    routeEnt* r;
+    subtable  t;
+    u128 prev, x;
+    u32  k;
+    int  i, j, g, l, lv, nCur, bits, sl, plen;
+
+
+    assert(sizeof(updSlot) <= sizeof(updKey));
+
+    for ( l = 0; l < pt->nLevels; ++l ) {
+        head[l] = -1;
+    }
+    cur[0] = pt->root;
+    nCur   = 1;
+    prev   = 0;
+    for ( j = 0; j < n; j = g ) {
+        for ( g = j + 1; g < n; ++g ) {
+            if ( (pk[g].a != pk[j].a) || (pk[g].plen != pk[j].plen) ) break;
+        }
+        if ( g + 2 * UPD_PREFETCH < n ) {
+            __builtin_prefetch(&pOps[pk[g + 2 * UPD_PREFETCH].i]);
+        }
+        if ( (g + UPD_PREFETCH < n) &&
+             (pk[g + UPD_PREFETCH].op != artUpdWithdraw) ) {
+            __builtin_prefetch(pOps[pk[g + UPD_PREFETCH].i].r);
+        }
+        for ( l = 0; (l < UPD_PATH) && (l < pt->nLevels); ++l ) {
+            i = g + (UPD_PATH - l) * UPD_PREFETCH;
+            if ( i < n ) updPrefetch(pt, pk[i].a, l);
+        }
+        plen = pk[j].plen;
+        if ( plen == 0 ) {
+            if ( updMerge(pOps, &pk[j], g - j, pt->root[1].ent != NULL,
+                          &key) ) {
+                updDefault(pt, (key.i >= 0) ? &pOps[key.i] : NULL, &key);
+            }
+            continue;
+        }
+
+        /*
+         * Keep the subtables shared with the previous prefix and
+         * apply the others.
+         */
+        x = pk[j].a ^ prev;
+        if ( (u64)(x >> 64) ) {
+            bits = __builtin_clzll((u64)(x >> 64));
+        } else {
+            bits = (u64)x ? 64 + __builtin_clzll((u64)x) : 128;
+        }
+        for ( lv = 0; (lv + 1 < nCur) && (pt->psi[lv].tl <= bits); ++lv ) ;
+        for ( l = nCur - 1; l > lv; --l ) {
+            if ( head[l] < 0 ) continue;
+            i = updSubtable(pt, pk, ps, head[l], l);
+            head[l] = -1;
+            if ( i && (lv >= i) ) {
+                lv = i - 1;             /* `cur[i]' and below are freed */
+            }
+        }
+        prev = pk[j].a;
+
+        /*
+         * The route of the prefix in its subtable
+         */
+        l  = plen2level(pt, plen);
+        lv = updDescend(pt, cur, lv, l, pk[j].a,
+                        (g - j == 1) && (pk[j].op != artUpdWithdraw));
+        sl = pt->psi[l].sl;
+        i  = plen - (pt->psi[l].tl - sl);       /* prefix length in stride */
+        k  = (((u32)(pk[j].a >> (128 - pt->psi[l].tl)) & ((1 << sl) - 1))
+              >> (sl - i)) + (1 << i);
+        z  = NULL;
+        if ( lv == l ) {
+            t = cur[l];
+            z = ((l < pt->nLevels - 1) && isSubtable(t[k]))
+                ? subtablePtr(t[k]).down[1].ent : t[k].ent;
+            /*
+             * A route inherited from the parent of `k' (as updRoots()
+             * does) belongs to a less specific prefix. Comparing the
+             * entries saves reading the route.
+             */
+            if ( z == (((k >> 1) > 1) ? t[k >> 1].ent : NULL) ) {
+                z = NULL;
+            }
+        }
+        if ( !updMerge(pOps, &pk[j], g - j, z != NULL, &key) ) {
+            nCur = lv + 1;
+            continue;
+        }
+        pu = (key.i >= 0) ? &pOps[key.i] : NULL;
+        if ( (lv < l) && (key.op != artUpdWithdraw) ) {
+            lv = updDescend(pt, cur, lv, l, key.a, true);
+        }
+        nCur = lv + 1;
+        if ( lv < l ) {
+            if ( key.op == artUpdWithdraw ) {
+                updResolve(pu, &key, NULL, &r);         /* no route */
+            } else {
+                pu->rc = artUpdFailed;
+                if ( (lv > 0) && (cur[lv][0].count == 0) ) {
+                    /* the subtables created for the prefix */
+                    nCur = updUnlink(pt, cur[lv], lv, key.a);
+                }
+            }
+            continue;
+        }
+        if ( !updResolve(pu, &key, z, &r) ) continue;
+
+        t = cur[l];
+        if ( r ) {
+            r->level = l;
+            if ( !z ) updCount(t, l, 1);    /* counted before the walk */
+        }
+        ps[j].t    = t;
+        ps[j].old  = z;
+        ps[j].r    = r;
+        ps[j].k    = k;
+        ps[j].next = -1;
+        if ( head[l] < 0 ) {
+            head[l] = j;
+        } else {
+            ps[tail[l]].next = j;
+        }
+        tail[l] = j;
+    }
+    for ( l = nCur - 1; l >= 0; --l ) {
+        if ( head[l] >= 0 ) {
+            updSubtable(pt, pk, ps, head[l], l);
+        }
+    }
+}
+
+
+/**
+ * @name   rtArtShardRetire
+ *
+ * @brief  Called instead of rtArtRetire() and the free functions by
+ *         the writer threads of rtArtApplyUpdatesSharded(). Keeps
+ *         `p' until the threads join (the allocators and the epoch
+ *         of `pt' are not thread-safe). `pRet' is large enough for
+ *         all the memory the thread can free.
+ *
+ * @param[in] pt Pointer to the copy of the table of the thread
+ * @param[in] p  Pointer to the memory to be freed
+ * @param[in] f  Function to free `p'
+ */
+void
+rtArtShardRetire (rtTable* pt, void* p, rtArtFreeFunc f)
+{
+    rtArtShard* pw = pt->pShard;
+
+
+    assert(pw->nRet < pw->maxRet);
+
+    rtArtBumpGen(pt);           /* `p' is unlinked */
+    pw->pRet[pw->nRet].p   = p;
+    pw->pRet[pw->nRet++].f = f;
+}
+
+
+/**
+ * @name   rtArtShardBumpGen
+ *
+ * @brief  Called by rtArtBumpGen() of the writer threads of
+ *         rtArtApplyUpdatesSharded(). Advances the generation of
+ *         the table shared by the threads (not of the copy `pt') so
+ *         that the destination caches of the readers see every
+ *         update as it is applied.
+ *
+ * @param[in] pt Pointer to the copy of the table of the thread
+ */
+void
+rtArtShardBumpGen (rtTable* pt)
+{
+    __atomic_add_fetch(pt->pShard->pGen, 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @name   shardMain
+ *
+ * @brief  Thread function of a writer of rtArtApplyUpdatesSharded()
+ */
+static void*
+shardMain (void* p)
+{
+    rtArtShard* pw = p;
+
+
+    updAllot(&pw->t, pw->pOps, pw->pk, pw->n, pw->ps);
+    return NULL;
+}
+
+
+/**
+ * @name   shardSplit
+ *
+ * @brief  Moves the prefixes in the root (prefix length <=
+ *         `pt->psi[0].sl') of `pk' to the beginning in the same
+ *         order and returns the number of them.
+ */
+static int
+shardSplit (rtTable* pt, updKey* pk, int n, updKey* pTmp)
+{
+    int i, m, j;
+
+
+    for ( i = m = j = 0; i < n; ++i ) {
+        if ( pk[i].plen <= pt->psi[0].sl ) {
+            pk[m++] = pk[i];
+        } else {
+            pTmp[j++] = pk[i];
+        }
+    }
+    memcpy(&pk[m], pTmp, j * sizeof(updKey));
+    return m;
+}
+
+
+/**
+ * @name   updSharded
+ *
+ * @brief  Coalesces and applies the `n' sorted operations `pk' with
+ *         up to `nThreads' writer threads (see updAllot()). The
+ *         prefixes in the root are applied by the caller first
+ *         because their allotments span many root fringe indices.
+ *         The rest, sorted by the root fringe index as they are
+ *         already, is split at the boundaries of the indices into
+ *         ranges of about the same number of operations. Each thread updates the subtrees under
+ *         its range through a copy of `pt' with its own counters,
+ *         scratch arrays and subtable allocator (see
+ *         rtArtAllocFork()), so the threads share no memory to write
+ *         but the counter of the root and the generation of `pt',
+ *         which they advance atomically. The counters are merged and
+ *         the memory freed by the threads is retired by the caller
+ *         after they join. `pTmp' has room for `n' prefixes.
+ *
+ *         `*pSerial' is set to the number of the operations of the
+ *         prefixes in the root.
+ *
+ * @retval int The number of the threads that applied the prefixes
+ * @retval 0   Not applied: there are too few prefixes under the root,
+ *             or no memory
+ */
+static int
+updSharded (rtTable* pt, rtArtUpdateOp* pOps, updKey* pk, int n,
+            updKey* pTmp, int nThreads, int* pSerial)
+{
+    rtArtShard* pw;
+    updSlot* ps;
+    u32 f;
+    int i, k, l, e, nw, rd, sl, rc;
+
+
+#define shardSlot(pk) ((u32)((pk)->a >> (128 - sl)))
+
+    rc = 0;
+    sl = pt->psi[0].sl;
+    pw = calloc(nThreads, sizeof(rtArtShard));
+    if ( !pw ) return 0;
+
+    rd = shardSplit(pt, pk, n, pTmp);
+    ps = (updSlot*)pTmp;        /* `pTmp' is not used any more */
+    if ( nThreads > (n - rd) / UPD_SHARD_MIN ) {
+        nThreads = (n - rd) / UPD_SHARD_MIN;
+    }
+    if ( nThreads <= 1 ) goto Done;
+
+    for ( k = 0; k < nThreads; ++k ) {
+        pw[k].t = *pt;
+        pw[k].t.nRoutes         = 0;
+        pw[k].t.nSubtablesFreed = 0;
+        pw[k].t.nAllots         = 0;
+        pw[k].t.nAllotVisits    = 0;
+        pw[k].t.maxAllotVisits  = 0;
+        pw[k].t.pShard   = &pw[k];
+        pw[k].t.pLvStats = calloc(pt->nLevels, sizeof(rtArtLevelStats));
+        pw[k].t.pEnt     = calloc(pt->nLevels, sizeof(subtable));
+        pw[k].t.pTbl     = calloc(pt->nLevels, sizeof(subtable*));
+        if ( !pw[k].t.pLvStats || !pw[k].t.pEnt || !pw[k].t.pTbl ) {
+            goto Free;
+        }
+        pw[k].forked = rtArtAllocFork(pt, &pw[k].t.alloc);
+        if ( !pw[k].forked ) goto Free;
+        pw[k].pOps = pOps;
+        pw[k].pGen = &pt->gen;
+    }
+
+    /*
+     * Split the prefixes under the root at the boundaries of the root
+     * fringe indices.
+     */
+    i = rd;
+    for ( k = nw = 0; (k < nThreads) && (i < n); ++k ) {
+        e = rd + (int)((u64)(n - rd) * (k + 1) / nThreads);
+        if ( i >= e ) continue;
+        f = shardSlot(&pk[e - 1]);
+        pw[nw].pk = &pk[i];
+        pw[nw].ps = &ps[i];
+        pw[nw].n  = i;
+        while ( (i < n) && (shardSlot(&pk[i]) <= f) ) ++i;
+        pw[nw].n = i - pw[nw].n;
+        ++nw;
+    }
+
+    /*
+     * An operation frees at most a route and a subtable per level but
+     * the root.
+     */
+    for ( k = 0; k < nw; ++k ) {
+        pw[k].maxRet = pw[k].n * pt->nLevels;
+        pw[k].pRet   = malloc(pw[k].maxRet * sizeof(shardRetired) + 1);
+        if ( !pw[k].pRet ) goto Free;
+    }
+
+    /*
+     * The operations of the prefixes in the root
+     */
+    updAllot(pt, pOps, pk, rd, ps);
+
+    for ( k = 0; k < nw; ++k ) {
+        if ( pthread_create(&pw[k].tid, NULL, shardMain, &pw[k]) ) {
+            shardMain(&pw[k]);
+            pw[k].n = -1;       /* done by this thread */
+        }
+    }
+    for ( k = 0; k < nw; ++k ) {
+        if ( pw[k].n >= 0 ) {
+            pthread_join(pw[k].tid, NULL);
+        }
+    }
+
+    /*
+     * Merge the counters and the subtable allocators of the threads,
+     * then free what they deleted.
+     */
+    for ( k = 0; k < nThreads; ++k ) {
+        for ( l = 0; l < pt->nLevels; ++l ) {
+            pt->pLvStats[l].nSubtables += pw[k].t.pLvStats[l].nSubtables;
+            pt->pLvStats[l].bytes      += pw[k].t.pLvStats[l].bytes;
+            pt->pLvStats[l].nRoutes    += pw[k].t.pLvStats[l].nRoutes;
+        }
+        pt->nRoutes         += pw[k].t.nRoutes;
+        pt->nSubtablesFreed += pw[k].t.nSubtablesFreed;
+        pt->nAllots         += pw[k].t.nAllots;
+        pt->nAllotVisits    += pw[k].t.nAllotVisits;
+        if ( pt->maxAllotVisits < pw[k].t.maxAllotVisits ) {
+            pt->maxAllotVisits = pw[k].t.maxAllotVisits;
+        }
+        rtArtAllocJoin(pt, &pw[k].t.alloc);
+        pw[k].forked = false;
+    }
+    rtArtBumpGen(pt);
+    for ( k = 0; k < nThreads; ++k ) {
+        for ( i = 0; i < pw[k].nRet; ++i ) {
+            if ( pt->pEpoch ) {
+                rtArtRetire(pt, pw[k].pRet[i].p, pw[k].pRet[i].f);
+            } else {
+                pw[k].pRet[i].f(pt, pw[k].pRet[i].p);
+            }
+        }
+    }
+    *pSerial = rd;
+    rc = nw;
+
+Free:
+    for ( k = 0; k < nThreads; ++k ) {
+        if ( pw[k].forked ) {
+            rtArtAllocJoin(pt, &pw[k].t.alloc);
+        }
+        free(pw[k].t.pLvStats);
+        free(pw[k].t.pEnt);
+        free(pw[k].t.pTbl);
+        free(pw[k].pRet);
+    }
+
+Done:
+    free(pw);
+    return rc;
+
+#undef shardSlot
+}
+
+
+/**
+ * @name   rtArtApplyUpdates
+ *
+ * @brief  API function.
+ *         Applies `n' additions and withdrawals to routing table
+ *         `pt' with the same result as applying them one by one in
+ *         the order of `pOps', coalescing the operations of the same
+ *         prefix and ordering the rest so that each table entry is
+ *         rewritten once (see above). Sets the result of every
+ *         operation in `pOps[i].rc'. The routes of the additions
+ *         whose result is neither artUpdDone nor artUpdReplaced are
+ *         not inserted and must be freed by the caller. The
+ *         operations are applied one by one if there is no memory.
+ *
+ * @param[in]     pt   Pointer to the routing table
+ * @param[in,out] pOps Array of `n' operations
+ * @param[in]     n    The number of operations in `pOps'
+ * @param[out]    ps   Counters and time of the batch. May be NULL.
+ *
+ * @retval int The number of operations whose result is artUpdDone
+ *             or artUpdReplaced
+ */
+int
+rtArtApplyUpdates (rtTable* pt, rtArtUpdateOp* pOps, int n,
+                   rtArtUpdateStats* ps)
+{
+    return rtArtApplyUpdatesSharded(pt, pOps, n, 1, ps);
+}
+
+
+/**
+ * @name   rtArtApplyUpdatesSharded
+ *
+ * @brief  API function.
+ *         Same as rtArtApplyUpdates() but the coalesced operations
+ *         are applied by up to `nThreads' writer threads, each of
+ *         which owns a range of the root fringe indices and updates
+ *         only the subtrees under it (see updSharded()). The
+ *         prefixes in the root (prefix length <= pt->psi[0].sl) are
+ *         applied by the calling thread before the others. Lock-free
+ *         readers may look up the table meanwhile. The operations are
+ *         applied by the calling thread if `nThreads' <= 1, there are
+ *         less than UPD_SHARD_MIN operations per thread, the table is
+ *         not a simple trie (or has an index, clones or an image), or
+ *         the subtable allocator is given by the user.
+ *
+ * @param[in]     pt       Pointer to the routing table
+ * @param[in,out] pOps     Array of `n' operations
+ * @param[in]     n        The number of operations in `pOps'
+ * @param[in]     nThreads The maximum number of writer threads
+ * @param[out]    ps       Counters and time of the batch. May be NULL.
+ *
+ * @retval int The number of operations whose result is artUpdDone
+ *             or artUpdReplaced
+ */
+int
+rtArtApplyUpdatesSharded (rtTable* pt, rtArtUpdateOp* pOps, int n,
+                          int nThreads, rtArtUpdateStats* ps)
+{
+    struct timespec ts[3];
+    updKey* pk;
+    updKey* pTmp;
+    u8   dest[16];
+    u64  nVisits;
+    int  i, j, m, nDone, nShards, nSerial;
+    bool trie;
+
+
+    assert(pt && (pOps || (n == 0)));
+
+    clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+    nVisits = pt->nAllotVisits;
+    nShards = nSerial = 0;
+    trie = ((pt->type == simpleTrie) && !pt->pIdx && !pt->pCow && !pt->pImg)
+        ? true : false;
+    pk   = malloc(n * sizeof(updKey));
+    pTmp = malloc(n * sizeof(updKey));
+    if ( !pk || !pTmp ) {
+        clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+        updSequential(pt, pOps, n);
+        goto Done;
+    }
+
+    /*
+     * The keys are made in `pTmp' and sorted into `pk'. The coalesced
+     * prefixes of the other tables are packed at the beginning of `pk'
+     * as it is read (there are no more of them than the prefixes read).
+     */
+    for ( i = 0; i < n; ++i ) {
+        if ( (i + UPD_PREFETCH < n) &&
+             (pOps[i + UPD_PREFETCH].op != artUpdWithdraw) ) {
+            __builtin_prefetch(pOps[i + UPD_PREFETCH].r);
+        }
+        pTmp[i].i   = i;
+        pTmp[i].op  = pOps[i].op;
+        pTmp[i].rep = false;
+        if ( pOps[i].op == artUpdWithdraw ) {
+            memset(dest, 0, sizeof(dest));
+            memcpy(dest, pOps[i].pDest, pt->len);
+            pTmp[i].plen = pOps[i].plen;
+        } else {
+            assert(pOps[i].r);
+            memset(dest, 0, sizeof(dest));
+            memcpy(dest, pOps[i].r->dest, pt->len);
+            pTmp[i].plen = pOps[i].r->plen;
+        }
+        assert((pTmp[i].plen >= 0) && (pTmp[i].plen <= pt->alen));
+        pTmp[i].a = addr2u128(dest) & updMask(pTmp[i].plen);
+    }
+    updSort(pTmp, n, pk);
+
+    if ( trie ) {
+        /*
+         * Coalesced while applied
+         */
+        clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+        if ( nThreads > 1 ) {
+            nShards = updSharded(pt, pOps, pk, n, pTmp, nThreads, &nSerial);
+        }
+        if ( nShards == 0 ) {
+            updAllot(pt, pOps, pk, n, (updSlot*)pTmp);
+        }
+        goto Done;
+    }
+
+    m = 0;
+    for ( i = 0; i < n; i = j ) {
+        for ( j = i + 1; j < n; ++j ) {
+            if ( (pk[j].a != pk[i].a) || (pk[j].plen != pk[i].plen) ) break;
+        }
+        updCoalesce(pt, pOps, &pk[i], j - i, pk, &m);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+    updApply(pt, pOps, pk, m, pTmp);
+
+Done:
+    clock_gettime(CLOCK_MONOTONIC, &ts[2]);
+    free(pTmp);
+    free(pk);
+
+    nDone = 0;
+    for ( i = 0; i < n; ++i ) {
+        if ( (pOps[i].rc == artUpdDone) || (pOps[i].rc == artUpdReplaced) ) {
+            nDone++;
+        }
+    }
+    if ( ps ) {
+        memset(ps, 0, sizeof(*ps));
+        for ( i = 0; i < n; ++i ) {
+            switch ( pOps[i].rc ) {
+            case artUpdDone:
+                if ( pOps[i].op == artUpdWithdraw ) {
+                    ps->nWithdrawn++;
+                } else {
+                    ps->nAdded++;
+                }
+                break;
+            case artUpdReplaced:
+                ps->nReplaced++;
+                break;
+            case artUpdCancelled:
+                ps->nCancelled++;
+                break;
+            default:
+                ps->nRejected++;
+                break;
+            }
+        }
+        ps->nShards      = nShards;
+        ps->nSerial      = nSerial;
+        ps->nAllotVisits = pt->nAllotVisits - nVisits;
+        ps->tCoalesce = (ts[1].tv_sec - ts[0].tv_sec)
+            + (ts[1].tv_nsec - ts[0].tv_nsec) * 1e-9;
+        ps->tApply = (ts[2].tv_sec - ts[1].tv_sec)
+            + (ts[2].tv_nsec - ts[1].tv_nsec) * 1e-9;
+    }
+    return nDone;
+}
@@ -1,4 +1,8 @@
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -21,6 +25,8 @@ enum {
     EXIT       = 0x71,
 
     MAX_LEVEL  = 32,
+    BATCH_SIZE = 64,            /* # of addresses per findMatchBatch() */
+    N_READERS  = 2,             /* # of lock-free readers */
 };
 
 
@@ -44,12 +50,34 @@ void    flushRoutes (rtTable* pt);
 void    showMenu();
 void    lookUpRoute(int af);
 void    lookupTest(rtTable *pt);
+boolean batchTest(rtTable *pt);
+boolean intKeyTest(rtTable *pt);
+boolean concurrencyTest(int alen, trieType type, char* sl, int nLevels);
+boolean allocTest(int alen, trieType type, char* sl, int nLevels);
+boolean bulkTest(int alen, trieType type, char* sl, int nLevels);
+boolean imageTest(int alen, trieType type, char* sl, int nLevels);
+boolean updateTest(int alen, trieType type, char* sl, int nLevels);
+boolean replaceTest(int alen, trieType type, char* sl, int nLevels);
+boolean cloneTest(int alen, trieType type, char* sl, int nLevels);
+boolean indexTest(int alen, trieType type, char* sl, int nLevels);
+boolean fibTest(rtTable *pt);
+boolean iterTest(rtTable *pt);
+boolean cacheTest(rtTable *pt);
+boolean rangeTest(rtTable *pt);
+boolean tuneTest(rtTable* pt, char* sl, int nLevels);
+boolean relayoutTest(int alen, trieType type, char* sl, int nLevels);
+boolean replicaTest(int alen, trieType type, char* sl, int nLevels);
+boolean feedTest(int alen, trieType type, char* sl, int nLevels);
+boolean shardTest(int alen, trieType type, char* sl, int nLevels);
+boolean statsTest(rtTable* pt, u32 nRoutes, u32 nSubtables);
+int     loadRoutes(rtTable* pt, routeEnt*** ppp);
 void    addRoute();
 void    delRoute();
 boolean getSearchPerf(int alen, trieType type, char* sl, int nLevels);
 void    printRoutes(rtTable *pt);
 void    printRtTableRange(rtTable* pt);
 void    rtInspect(rtTable* pt, rtStats* pstats, pInspect f);
+void    cpInspect(rtTable* pt, rtStats* pstats);
 void    rtPcInspect(rtTable* pt);
 void    inspectNode (rtTable* pt, routeEnt* pEnt, int l, u8* pDef);
 void    inspectPcNode (rtTable* pt, routeEnt* pEnt, int l, u8* pDef);
@@ -95,7 +123,7 @@ getVer (rtTable* pt)
 
 
 #define USAGE \
-"Usage: rtLookup <4|6> <pc|simple> [batch | [stride length ...]]\n"
+"Usage: rtLookup <4|6> <pc|simple|compact> [batch | [stride length ...]]\n"
 void
 usage (void)
 {
@@ -119,6 +147,9 @@ insRoute (rtTable* pt, u8* dest, int plen, u8* nh, u32 cid)
     len = (pt->alen == 32) ? 4 : 16;
     memcpy(p->dest, dest, len);
     p->plen  = plen;
+    if ( pt->routeSize >= sizeof(routeEnt) + sizeof(u64) ) {
+        *(u64*)rtArtRouteData(p) = plen; /* checked by lookupThread() */
+    }
     if ( pt->insert(pt, p) == p ) return true;
     return false;
 }
@@ -230,6 +261,8 @@ main (int argc, char *argv[])
     }
     if (!strcmp(argv[2], "pc")) {
         type = pathCompTrie;
+    } else if (!strcmp(argv[2], "compact")) {
+        type = compactTrie;
     } else {
         type = simpleTrie;
     }
@@ -307,6 +340,8 @@ main (int argc, char *argv[])
               if ( type == pathCompTrie ) {
                   rtInspect(Ptable, NULL, inspectPcNode);
                   rtPcInspect(Ptable);
+              } else if ( type == compactTrie ) {
+                  cpInspect(Ptable, NULL);
               } else {
                   rtInspect(Ptable, NULL, inspectNode);
               }
@@ -563,7 +598,7 @@ boolean
 getSearchPerf (int alen, trieType type, char* sl, int nLevels)
 {
     rtTable* pt;
-    rtStats  stats;
+    rtStats  stats = { 0, 0 };
     u32      nRoutes;
     boolean  rc = true;
 
@@ -578,13 +613,99 @@ getSearchPerf (int alen, trieType type, char* sl, int nLevels)
     if ( type == pathCompTrie ) {
         rtInspect(pt, &stats, inspectPcNode);
         rtPcInspect(pt);
+    } else if ( type == compactTrie ) {
+        cpInspect(pt, &stats);
     } else {
         rtInspect(pt, &stats, inspectNode);
     }
+    printf("Statistics: ");
+    if ( statsTest(pt, nRoutes, stats.nSubtables + 1) == false ) {
+        rc = false;
+    }
+    printf("Tune the stride lengths: ");
+    if ( tuneTest(pt, sl, nLevels) == false ) {
+        rc = false;
+    }
     printf("Exact and longest prefix matching test: ");
     lookupTest(pt);
-    printf("done.\nRemove all the prefixes: ");
+    printf("done.\nBatch lookup test: ");
+    if ( batchTest(pt) == false ) {
+        rc = false;
+    }
+    printf("Integer key lookup test: ");
+    if ( intKeyTest(pt) == false ) {
+        rc = false;
+    }
+    printf("Frozen FIB test: ");
+    if ( fibTest(pt) == false ) {
+        rc = false;
+    }
+    printf("Iterator test: ");
+    if ( iterTest(pt) == false ) {
+        rc = false;
+    }
+    printf("Destination cache test: ");
+    if ( cacheTest(pt) == false ) {
+        rc = false;
+    }
+    printf("Sub-prefix and covering walk test: ");
+    if ( rangeTest(pt) == false ) {
+        rc = false;
+    }
+    printf("Remove all the prefixes: ");
     rmRtTbl(pt);
+    printf("Statistics after the removal: ");
+    if ( statsTest(pt, 0, 1) == false ) {
+        rc = false;
+    }
+    printf("Lock-free lookups during updates: ");
+    if ( concurrencyTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
+    printf("Insert and flush all the routes again: ");
+    if ( allocTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
+    printf("Build the routing table again: ");
+    if ( bulkTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
+    printf("Save and load the routing table: ");
+    if ( imageTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
+    printf("Batch updates: ");
+    if ( updateTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
+    printf("Replace all the routes: ");
+    if ( replaceTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
+    printf("Clone the routing table: ");
+    if ( cloneTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
+    printf("Exact match index: ");
+    if ( indexTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
+    printf("Relayout of the subtables: ");
+    if ( relayoutTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
+    printf("Per-node table replicas: ");
+    if ( replicaTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
+    printf("MRT feed ingest: ");
+    if ( feedTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
+    printf("Sharded batch updates: ");
+    if ( shardTest(alen, type, sl, nLevels) == false ) {
+        rc = false;
+    }
 
     if ( stats.nRoutes != nRoutes ) {
         fprintf(stderr, "ERROR: %d routes were inserted. "
@@ -914,6 +1035,21 @@ rtInspect (rtTable* pt, rtStats* pStats, pInspect f)
     }
 }
 
+/*
+ * compactTrie subtables are not made of `tableEntry'. Only the
+ * counters are reported.
+ */
+void
+cpInspect (rtTable* pt, rtStats* pStats)
+{
+    printf("%d routes. %d subtables (trie nodes).\n",
+           pt->nRoutes, rtArtCpNumSubtables(pt));
+    if ( pStats ) {
+        pStats->nRoutes    = pt->nRoutes;
+        pStats->nSubtables = rtArtCpNumSubtables(pt);
+    }
+}
+
 bool
 prefixCheck (routeEnt* pent, u8* dest)
 {
@@ -1111,3 +1247,3075 @@ lookupTest (rtTable* pt)
         }
     }
 }
+
+
+/*
+ * Loads the addresses of the longest prefix match test into an array.
+ * Each address is the prefix address + 1 as in lookupTest().
+ * Returns the number of addresses stored in `*pp'.
+ */
+static int
+loadAddrs (rtTable* pt, u8** pp)
+{
+    FILE* fp;
+    char* p;
+    char  buf[128];
+    u8*   pa;
+    int   af, len, n, max, plen;
+
+
+    if ( pt->alen == 32 ) {
+        af  = AF_INET;
+        strcpy(buf, "data/v4routes-random2.txt");
+    } else {
+        af  = AF_INET6;
+        strcpy(buf, "data/v6routes-random1.txt");
+    }
+    if ( (fp = fopen(buf, "r")) == NULL ) {
+        printf("No such file: %s\n", buf);
+        exit(1);
+    }
+
+    len = pt->len;
+    n   = 0;
+    max = 1 << 16;
+    pa  = malloc(max * len);
+    while ( pa && fgets(buf, sizeof(buf), fp) ) {
+        p = index(buf, '/');
+        if ( !p ) {
+            continue;
+        }
+        *p = '\0';
+        if ( n == max ) {
+            max <<= 1;
+            pa = realloc(pa, max * len);
+            if ( !pa ) {
+                break;
+            }
+        }
+        if ( inet_pton(af, buf, pa + n * len) != 1 ) {
+            fprintf(stderr, "Error: inet_pton(): %s\n", buf);
+            continue;
+        }
+        plen = strtol(p+1, NULL, 10);
+        if ( plen < pt->alen ) {
+            ++pa[n * len + len - 1];
+        }
+        ++n;
+    }
+    fclose(fp);
+    if ( !pa ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    *pp = pa;
+    return n;
+}
+
+
+static inline double
+elapsed (struct timespec* ts)
+{
+    struct timespec te;
+
+    clock_gettime(CLOCK_MONOTONIC, &te);
+    return (te.tv_sec - ts->tv_sec) + (te.tv_nsec - ts->tv_nsec) * 1e-9;
+}
+
+
+/*
+ * Looks up all the test addresses with pt->findMatch() and
+ * pt->findMatchBatch(), checks the both results are the same,
+ * and reports the lookup rate of each. The batch lookup kernels of
+ * an IPv4 simple trie (see rtArtSimdSelect()) are checked against
+ * rtArtFindMatchBatch() one by one.
+ */
+boolean
+batchTest (rtTable* pt)
+{
+    static const char* kernel[] = { "scalar kernel", "AVX2 kernel", "AVX-512 kernel" };
+    struct timespec ts;
+    void (*batch)(rtTable*, u8**, routeEnt**, int);
+    routeEnt** pScalar;
+    routeEnt** pBatch;
+    routeEnt** pKernel;
+    u8**   ppDest;
+    u8*    pa;
+    double t1, t2;
+    int    i, j, k, n, nErrs, nDiffs;
+
+
+    n = loadAddrs(pt, &pa);
+    ppDest  = calloc(n, sizeof(*ppDest));
+    pScalar = calloc(n, sizeof(*pScalar));
+    pBatch  = calloc(n, sizeof(*pBatch));
+    pKernel = calloc(n, sizeof(*pKernel));
+    if ( !ppDest || !pScalar || !pBatch || !pKernel ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < n; ++i ) {
+        ppDest[i] = pa + i * pt->len;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < n; ++i ) {
+        pScalar[i] = pt->findMatch(pt, ppDest[i]);
+    }
+    t1 = elapsed(&ts);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < n; i += BATCH_SIZE ) {
+        j = ((n - i) < BATCH_SIZE) ? (n - i) : BATCH_SIZE;
+        pt->findMatchBatch(pt, ppDest + i, pBatch + i, j);
+    }
+    t2 = elapsed(&ts);
+
+    nErrs = 0;
+    for ( i = 0; i < n; ++i ) {
+        if ( pScalar[i] != pBatch[i] ) {
+            ++nErrs;
+        }
+    }
+    printf("%.2f Mlookups/s (scalar), %.2f Mlookups/s (batch of %d)",
+           n / t1 * 1e-6, n / t2 * 1e-6, BATCH_SIZE);
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d batch lookups differ from findMatch()\n",
+                nErrs);
+    }
+
+    /*
+     * Each kernel of an IPv4 simple trie looks up all the addresses
+     * in batches of BATCH_SIZE - 1 so that the AVX2 and scalar tails
+     * of the wider kernels run in every batch too.
+     */
+    batch = pt->findMatchBatch;
+    for ( k = artBatchScalar; k <= artBatchAvx512; ++k ) {
+        if ( !rtArtSimdSelect(pt, k) ) {
+            if ( k == artBatchScalar ) break;       /* not an IPv4 trie */
+            printf(", %s not supported", kernel[k]);
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        for ( i = 0; i < n; i += BATCH_SIZE - 1 ) {
+            j = ((n - i) < BATCH_SIZE - 1) ? (n - i) : BATCH_SIZE - 1;
+            pt->findMatchBatch(pt, ppDest + i, pKernel + i, j);
+        }
+        t2 = elapsed(&ts);
+        nDiffs = 0;
+        for ( i = 0; i < n; ++i ) {
+            if ( pKernel[i] != ((k == artBatchScalar) ? pScalar : pBatch)[i] ) {
+                ++nDiffs;
+            }
+        }
+        printf(", %.2f Mlookups/s (%s)", n / t2 * 1e-6, kernel[k]);
+        if ( nDiffs ) {
+            fprintf(stderr, "ERROR: %d lookups of the %s differ from "
+                    "%s\n", nDiffs, kernel[k],
+                    (k == artBatchScalar) ? "findMatch()"
+                                          : "rtArtFindMatchBatch()");
+            nErrs += nDiffs;
+        }
+        if ( k == artBatchScalar ) {
+            memcpy(pBatch, pKernel, n * sizeof(*pBatch));
+        }
+    }
+    pt->findMatchBatch = batch;
+    printf("\n");
+
+    free(pKernel);
+    free(pBatch);
+    free(pScalar);
+    free(ppDest);
+    free(pa);
+    return (nErrs == 0) ? true : false;
+}
+
+
+/*
+ * Looks up all the test addresses with pt->findMatch() and
+ * pt->findMatch4() (or pt->findMatch6()), checks the both results
+ * are the same, and reports the lookup rate of each.
+ * Each matching route is also looked up with rtArtFindExactMatch4()
+ * (or rtArtFindExactMatch6()).
+ */
+boolean
+intKeyTest (rtTable* pt)
+{
+    struct timespec ts;
+    routeEnt** pRes;
+    routeEnt*  r;
+    u64*   pKey;                /* addresses in the host byte order */
+    u8*    pa;
+    u8*    p;
+    double t1, t2;
+    u128   a;
+    int    i, n, nErrs;
+    bool   v4 = (pt->alen == 32);
+
+
+    n = loadAddrs(pt, &pa);
+    pRes = calloc(n, sizeof(*pRes));
+    pKey = calloc(n, 2 * sizeof(*pKey));
+    if ( !pRes || !pKey ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < n; ++i ) {
+        p = pa + i * pt->len;
+        if ( v4 ) {
+            pKey[2*i] = addr2ipv4a(p);
+        } else {
+            a = addr2u128(p);
+            pKey[2*i]     = a >> 64;
+            pKey[2*i + 1] = a;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < n; ++i ) {
+        pRes[i] = pt->findMatch(pt, pa + i * pt->len);
+    }
+    t1 = elapsed(&ts);
+
+    nErrs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    if ( v4 ) {
+        for ( i = 0; i < n; ++i ) {
+            if ( pt->findMatch4(pt, pKey[2*i]) != pRes[i] ) {
+                ++nErrs;
+            }
+        }
+    } else {
+        for ( i = 0; i < n; ++i ) {
+            if ( pt->findMatch6(pt, pKey[2*i], pKey[2*i + 1]) != pRes[i] ) {
+                ++nErrs;
+            }
+        }
+    }
+    t2 = elapsed(&ts);
+
+    for ( i = 0; i < n; ++i ) {
+        r = pRes[i];
+        if ( !r ) {
+            continue;
+        }
+        if ( v4 ) {
+            if ( rtArtFindExactMatch4(pt, addr2ipv4a(r->dest),
+                                      r->plen) != r ) {
+                ++nErrs;
+            }
+        } else {
+            a = addr2u128(r->dest);
+            if ( rtArtFindExactMatch6(pt, a >> 64, a, r->plen) != r ) {
+                ++nErrs;
+            }
+        }
+    }
+    printf("%.2f Mlookups/s (bytes), %.2f Mlookups/s (integer)\n",
+           n / t1 * 1e-6, n / t2 * 1e-6);
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d integer key lookups differ from "
+                "findMatch()\n", nErrs);
+    }
+    free(pKey);
+    free(pRes);
+    free(pa);
+    return (nErrs == 0) ? true : false;
+}
+
+
+/*
+ * Checks that rtArtGetStats() reports `nRoutes' routes and
+ * `nSubtables' subtables (including the root), and that the
+ * per-level counters add up.
+ */
+boolean
+statsTest (rtTable* pt, u32 nRoutes, u32 nSubtables)
+{
+    rtArtStats gs;
+    u64 n, bytes;
+    int l;
+    boolean rc = true;
+
+
+    rtArtGetStats(pt, &gs);
+    for ( l = 0, n = bytes = 0; l < gs.nLevels; ++l ) {
+        n     += gs.level[l].nRoutes;
+        bytes += gs.level[l].bytes;
+    }
+    printf("%llu routes, %llu subtables (%.1f MB), "
+           "%.1f entries per allotment (max %llu)\n",
+           (unsigned long long)gs.nRoutes,
+           (unsigned long long)gs.nSubtables, gs.bytes / 1048576.0,
+           (gs.nAllots) ? (double)gs.nAllotVisits / gs.nAllots : 0.0,
+           (unsigned long long)gs.maxAllotVisits);
+    if ( gs.nRoutes != nRoutes || n != nRoutes ) {
+        fprintf(stderr, "ERROR: rtArtGetStats(): %llu routes "
+                "(%llu in the levels). %u expected.\n",
+                (unsigned long long)gs.nRoutes, (unsigned long long)n,
+                nRoutes);
+        rc = false;
+    }
+    if ( gs.nSubtables != nSubtables || bytes != gs.bytes ) {
+        fprintf(stderr, "ERROR: rtArtGetStats(): %llu subtables. "
+                "%u expected.\n", (unsigned long long)gs.nSubtables,
+                nSubtables);
+        rc = false;
+    }
+    return rc;
+}
+
+
+typedef struct readerArg readerArg;
+struct readerArg {
+    rtTable*  pt;
+    u8**      ppDest;           /* addresses to be looked up */
+    int       n;                /* # of addresses */
+    volatile int* pStop;        /* stop if nonzero */
+    u64       nLookups;         /* # of lookups done */
+    u64       nErrs;            /* # of wrong routes returned */
+};
+
+
+/*
+ * Reader thread of concurrencyTest(). Every route returned must
+ * cover the address being looked up and keep its user data.
+ */
+static void*
+lookupThread (void* p)
+{
+    readerArg*   pa = p;
+    rtTable*     pt = pa->pt;
+    rtArtReader* pr;
+    routeEnt*    res[BATCH_SIZE];
+    int i, j, m;
+
+
+    pr = rtArtRegisterReader(pt);
+    if ( !pr ) {
+        ++pa->nErrs;
+        return NULL;
+    }
+    while ( !*pa->pStop ) {
+        for ( i = 0; (i < pa->n) && !*pa->pStop; i += m ) {
+            m = ((pa->n - i) < BATCH_SIZE) ? (pa->n - i) : BATCH_SIZE;
+            rtArtReadLock(pr);
+            if ( (i / BATCH_SIZE) & 1 ) {
+                pt->findMatchBatch(pt, pa->ppDest + i, res, m);
+            } else {
+                for ( j = 0; j < m; ++j ) {
+                    res[j] = pt->findMatch(pt, pa->ppDest[i + j]);
+                }
+            }
+            for ( j = 0; j < m; ++j ) {
+                if ( res[j] &&
+                     (!cmpAddr(res[j]->dest, pa->ppDest[i + j], res[j]->plen) ||
+                      (*(u64*)rtArtRouteData(res[j]) != res[j]->plen)) ) {
+                    ++pa->nErrs;
+                }
+            }
+            rtArtReadUnlock(pr);
+            pa->nLookups += m;
+        }
+    }
+    rtArtUnregisterReader(pr);
+    return NULL;
+}
+
+
+/*
+ * Creates a table with lock-free readers, then inserts and deletes
+ * all the routes twice while N_READERS threads keep looking up
+ * the test addresses.
+ */
+boolean
+concurrencyTest (int alen, trieType type, char* sl, int nLevels)
+{
+    struct timespec ts;
+    rtArtOpts  opts = { artOptConcurrent | artOptSlab | artOptRouteArena,
+                        NULL, sizeof(u64) };
+    readerArg  arg[N_READERS];
+    pthread_t  tid[N_READERS];
+    rtTable*   pt;
+    u8**       ppDest;
+    u8*        pa;
+    volatile int stop;
+    double     t;
+    u64        nLookups, nErrs;
+    int        i, n, nUpdates;
+
+
+    pt = rtArtInitOpts(nLevels, (s8*)sl, alen, type, &opts);
+    if ( !pt ) {
+        fprintf(stderr, "ERROR: failed to create a routing table.\n");
+        return false;
+    }
+    n = loadAddrs(pt, &pa);
+    ppDest = calloc(n, sizeof(*ppDest));
+    if ( !ppDest ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < n; ++i ) {
+        ppDest[i] = pa + i * pt->len;
+    }
+
+    stop = 0;
+    for ( i = 0; i < N_READERS; ++i ) {
+        memset(&arg[i], 0, sizeof(arg[i]));
+        arg[i].pt     = pt;
+        arg[i].ppDest = ppDest;
+        arg[i].n      = n;
+        arg[i].pStop  = &stop;
+        if ( pthread_create(&tid[i], NULL, lookupThread, &arg[i]) ) {
+            fprintf(stderr, "Error: pthread_create()\n");
+            exit(1);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    nUpdates = 0;
+    for ( i = 0; i < 2; ++i ) {
+        nUpdates += mkRtTbl(pt);
+        nUpdates += pt->nRoutes;
+        pt->flush(pt);
+    }
+    t = elapsed(&ts);
+
+    stop = 1;
+    nLookups = nErrs = 0;
+    for ( i = 0; i < N_READERS; ++i ) {
+        pthread_join(tid[i], NULL);
+        nLookups += arg[i].nLookups;
+        nErrs    += arg[i].nErrs;
+    }
+    rtArtSynchronize(pt);
+
+    printf("%.2f Mlookups/s by %d readers during %d updates\n",
+           nLookups / t * 1e-6, N_READERS, nUpdates);
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %llu lookups returned a wrong route\n",
+                (unsigned long long)nErrs);
+    }
+    pt->deleteTable(&pt);
+    free(ppDest);
+    free(pa);
+    return (nErrs == 0) ? true : false;
+}
+
+
+/*
+ * Callback of pt->flushRoutes() in allocTest()
+ */
+static void
+countRoute (routeEnt* p, void* p2)
+{
+    ++*(u32*)p2;
+}
+
+
+/*
+ * Inserts and flushes all the routes twice with each subtable
+ * allocator and reports the time spent in the second round
+ * (i.e., when the freed subtables are reused.)
+ */
+boolean
+allocTest (int alen, trieType type, char* sl, int nLevels)
+{
+    static struct {
+        u32   flags;
+        char* name;
+    } alloc[] = {
+        { 0,                             "calloc" },
+        { artOptSlab,                    "slab" },
+        { artOptSlab | artOptHugePages,  "slab on huge pages" },
+        { artOptSlab | artOptHugePages | artOptRouteArena,
+          "slab and route arena on huge pages" },
+    };
+    struct timespec ts;
+    rtArtOpts opts;
+    rtTable*  pt;
+    boolean   rc = true;
+    double    t;
+    u32       nRoutes, nFlushed;
+    int       i;
+
+
+    for ( i = 0; i < sizeof(alloc) / sizeof(alloc[0]); ++i ) {
+        memset(&opts, 0, sizeof(opts));
+        opts.flags = alloc[i].flags;
+        opts.routeDataSize = sizeof(u64);
+        pt = rtArtInitOpts(nLevels, (s8*)sl, alen, type, &opts);
+        if ( !pt ) {
+            fprintf(stderr, "ERROR: failed to create a routing table.\n");
+            return false;
+        }
+        mkRtTbl(pt);
+        pt->flush(pt);
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        nRoutes = mkRtTbl(pt);
+        t = elapsed(&ts);
+        nFlushed = 0;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        pt->flushRoutes(pt, countRoute, &nFlushed);
+        printf("%s%s %.2fs (flush %.2fs)", (i) ? ", " : "", alloc[i].name,
+               t, elapsed(&ts));
+        if ( (pt->nRoutes != 0) || (nFlushed != nRoutes) ) {
+            fprintf(stderr, "\nERROR: %d of %d routes were left. "
+                    "%d were flushed.\n", pt->nRoutes, nRoutes, nFlushed);
+            rc = false;
+        }
+
+        /*
+         * Destroy a full table to drop the slabs at once
+         */
+        mkRtTbl(pt);
+        pt->deleteTable(&pt);
+    }
+    printf("\n");
+    return rc;
+}
+
+
+/*
+ * Reads the routes of the insertion test into an array of
+ * `pt''s routes.
+ */
+int
+loadRoutes (rtTable* pt, routeEnt*** ppp)
+{
+    FILE* fp;
+    char* p;
+    char  buf[128];
+    u8    dest[16];
+    routeEnt** pr;
+    int   af, n, max, plen;
+
+
+    if ( pt->alen == 32 ) {
+        af  = AF_INET;
+        strcpy(buf, "data/v4routes-random1.txt");
+    } else {
+        af  = AF_INET6;
+        strcpy(buf, "data/v6routes-random1.txt");
+    }
+    if ( (fp = fopen(buf, "r")) == NULL ) {
+        printf("No such file: %s\n", buf);
+        exit(1);
+    }
+
+    n   = 0;
+    max = 1 << 16;
+    pr  = malloc(max * sizeof(*pr));
+    while ( pr && fgets(buf, sizeof(buf), fp) ) {
+        p = index(buf, '/');
+        if ( !p ) {
+            continue;
+        }
+        *p = '\0';
+        if ( inet_pton(af, buf, dest) != 1 ) {
+            fprintf(stderr, "Error: inet_pton(): %s\n", buf);
+            continue;
+        }
+        plen = strtol(p+1, NULL, 10);
+        if ( n == max ) {
+            max <<= 1;
+            pr = realloc(pr, max * sizeof(*pr));
+            if ( !pr ) {
+                break;
+            }
+        }
+        pr[n] = rtArtNewRoute(pt);
+        if ( !pr[n] ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+        memcpy(pr[n]->dest, dest, pt->len);
+        pr[n++]->plen = plen;
+    }
+    fclose(fp);
+    if ( !pr ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    *ppp = pr;
+    return n;
+}
+
+
+#define BULK_THREADS 4          /* threads of rtArtBulkLoadParallel() */
+
+/*
+ * Builds the same routing table with pt->insert(), rtArtBulkLoad()
+ * and rtArtBulkLoadParallel() (with the slab allocator), checks the
+ * tables return the same routes and have the same subtables, and
+ * reports the build time of each.
+ */
+boolean
+bulkTest (int alen, trieType type, char* sl, int nLevels)
+{
+    struct timespec ts;
+    rtArtStats* ps[2];
+    rtArtOpts  opts;
+    rtTable*   pt[3];
+    routeEnt** pr[3];
+    routeEnt*  r[3];
+    u8*    pa;
+    double t[3];
+    int    i, j, k, n, m, nErrs;
+
+
+    nErrs = 0;
+    memset(&opts, 0, sizeof(opts));
+    opts.flags = artOptSlab;
+    for ( i = 0; i < 3; ++i ) {
+        pt[i] = rtArtInitOpts(nLevels, (s8*)sl, alen, type,
+                              (i == 2) ? &opts : NULL);
+        if ( !pt[i] ) {
+            fprintf(stderr, "ERROR: failed to create a routing table.\n");
+            return false;
+        }
+        n = loadRoutes(pt[i], &pr[i]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    m = rtArtInsertRoutes(pt[0], pr[0], n);
+    t[0] = elapsed(&ts);
+
+    /*
+     * Add a duplicate to see it is left at the end.
+     */
+    for ( i = 1; i < 3; ++i ) {
+        pr[i] = realloc(pr[i], (n + 1) * sizeof(*pr[i]));
+        if ( !pr[i] ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+        pr[i][n] = rtArtNewRoute(pt[i]);
+        *pr[i][n] = *pr[i][0];
+        r[i] = pr[i][n];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    j = rtArtBulkLoad(pt[1], pr[1], n + 1);
+    t[1] = elapsed(&ts);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    k = rtArtBulkLoadParallel(pt[2], pr[2], n + 1, BULK_THREADS);
+    t[2] = elapsed(&ts);
+
+    printf("insert %.2fs, bulk load %.2fs, "
+           "parallel bulk load %.2fs (%d threads)\n",
+           t[0], t[1], t[2], BULK_THREADS);
+    if ( (j != m) || (pr[1][j] != r[1]) || (k != m) || (pr[2][k] != r[2]) ) {
+        fprintf(stderr, "ERROR: %d and %d of %d routes were loaded. "
+                "%d were inserted.\n", j, k, n + 1, m);
+        ++nErrs;
+    }
+    for ( i = 1; i < 3; ++i ) {
+        rtArtFreeRoute(pt[i], r[i]);
+    }
+
+    ps[0] = malloc(sizeof(rtArtStats));
+    ps[1] = malloc(sizeof(rtArtStats));
+    if ( !ps[0] || !ps[1] ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    rtArtGetStats(pt[1], ps[0]);
+    rtArtGetStats(pt[2], ps[1]);
+    if ( (ps[0]->nRoutes != ps[1]->nRoutes) ||
+         (ps[0]->nSubtables != ps[1]->nSubtables) ||
+         (ps[0]->bytes != ps[1]->bytes) ) {
+        fprintf(stderr, "ERROR: the parallel bulk load made %llu routes "
+                "and %llu subtables instead of %llu and %llu.\n",
+                (unsigned long long)ps[1]->nRoutes,
+                (unsigned long long)ps[1]->nSubtables,
+                (unsigned long long)ps[0]->nRoutes,
+                (unsigned long long)ps[0]->nSubtables);
+        ++nErrs;
+    }
+    free(ps[0]);
+    free(ps[1]);
+
+    lookupTest(pt[1]);
+    lookupTest(pt[2]);
+    n = loadAddrs(pt[0], &pa);
+    for ( i = 0; i < n; ++i ) {
+        r[0] = pt[0]->findMatch(pt[0], pa + i * pt[0]->len);
+        for ( j = 1; j < 3; ++j ) {
+            r[j] = pt[j]->findMatch(pt[j], pa + i * pt[j]->len);
+            if ( (r[0] == NULL) != (r[j] == NULL) ||
+                 (r[0] && ((r[0]->plen != r[j]->plen) ||
+                           !cmpAddr(r[0]->dest, r[j]->dest, r[0]->plen))) ) {
+                ++nErrs;
+            }
+        }
+    }
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d lookups differ\n", nErrs);
+    }
+    free(pa);
+
+    for ( i = 0; i < 3; ++i ) {
+        pt[i]->flush(pt[i]);
+        if ( pt[i]->nRoutes != 0 ) {
+            fprintf(stderr, "ERROR: %d routes were left.\n", pt[i]->nRoutes);
+            ++nErrs;
+        }
+    }
+    for ( i = 1; i < 3; ++i ) {
+        if ( pt[0]->nSubtablesFreed != pt[i]->nSubtablesFreed ) {
+            fprintf(stderr, "ERROR: %d subtables were inserted. "
+                    "%d were loaded.\n",
+                    pt[0]->nSubtablesFreed, pt[i]->nSubtablesFreed);
+            ++nErrs;
+        }
+    }
+    for ( i = 0; i < 3; ++i ) {
+        pt[i]->deleteTable(&pt[i]);
+        free(pr[i]);
+    }
+    return (nErrs == 0) ? true : false;
+}
+
+
+/*
+ * Returns the number of lookups of the test addresses in which
+ * `pt1' and `pt2' return different routes.
+ */
+static int
+cmpLookups (rtTable* pt1, rtTable* pt2, u8* pa, int n)
+{
+    routeEnt* r1;
+    routeEnt* r2;
+    int i, nErrs;
+
+
+    nErrs = 0;
+    for ( i = 0; i < n; ++i ) {
+        r1 = pt1->findMatch(pt1, pa + i * pt1->len);
+        r2 = pt2->findMatch(pt2, pa + i * pt2->len);
+        if ( (r1 == NULL) != (r2 == NULL) ||
+             (r1 && ((r1->plen != r2->plen) ||
+                     !cmpAddr(r1->dest, r2->dest, r1->plen))) ) {
+            ++nErrs;
+        }
+    }
+    return nErrs;
+}
+
+
+/*
+ * Subtable allocator of imageTest() that fails after `*(int*)ctx'
+ * allocations
+ */
+static void*
+failAlloc (void* ctx, int level, size_t size)
+{
+    return ((*(int*)ctx)-- > 0) ? calloc(1, size) : NULL;
+}
+
+static void
+failFree (void* ctx, int level, void* p, size_t size)
+{
+    free(p);
+}
+
+
+/*
+ * Saves a routing table with rtArtSave(), loads it with
+ * rtArtLoad(), checks the both tables return the same routes
+ * before and after the loaded table is thawed, and reports the
+ * time of each. A thaw that runs out of memory must leave the
+ * loaded table as it was.
+ */
+boolean
+imageTest (int alen, trieType type, char* sl, int nLevels)
+{
+    struct timespec ts;
+    rtArtAllocator al;
+    rtArtOpts opts;
+    rtTable*  pt[2];
+    routeEnt* r;
+    routeEnt* q;
+    char   path[64];
+    u8*    pa;
+    double t[3];
+    u32    nFreed;
+    int    i, n, nErrs, nAllocs;
+
+
+    if ( type == compactTrie ) {
+        printf("not supported\n");
+        return true;
+    }
+    pt[0] = rtArtInit(nLevels, (s8*)sl, alen, type);
+    if ( !pt[0] ) {
+        fprintf(stderr, "ERROR: failed to create a routing table.\n");
+        return false;
+    }
+    mkRtTbl(pt[0]);
+
+    snprintf(path, sizeof(path), "/tmp/rtLookup-%d.img", (int)getpid());
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    if ( rtArtSave(pt[0], path) == false ) {
+        fprintf(stderr, "ERROR: failed to save the routing table.\n");
+        pt[0]->deleteTable(&pt[0]);
+        return false;
+    }
+    t[0] = elapsed(&ts);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    pt[1] = rtArtLoad(path);
+    t[1] = elapsed(&ts);
+    unlink(path);
+    if ( !pt[1] ) {
+        fprintf(stderr, "ERROR: failed to load the routing table.\n");
+        pt[0]->deleteTable(&pt[0]);
+        return false;
+    }
+
+    nErrs = 0;
+    lookupTest(pt[1]);
+    n = loadAddrs(pt[0], &pa);
+    nErrs += cmpLookups(pt[0], pt[1], pa, n);
+
+    nAllocs = 100;
+    memset(&al, 0, sizeof(al));
+    al.alloc = failAlloc;
+    al.free  = failFree;
+    al.ctx   = &nAllocs;
+    memset(&opts, 0, sizeof(opts));
+    opts.pAlloc = &al;
+    if ( rtArtThaw(pt[1], &opts) || (pt[1]->pImg == NULL) ) {
+        fprintf(stderr, "ERROR: thawed the table without memory.\n");
+        pt[0]->deleteTable(&pt[0]);
+        return false;
+    }
+    nErrs += cmpLookups(pt[0], pt[1], pa, n);
+
+    /*
+     * Thaw the loaded table by an update
+     */
+    r = rtArtNewRoute(pt[1]);
+    memcpy(r->dest, pa, pt[1]->len);
+    r->plen = pt[1]->alen;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    q = pt[1]->insert(pt[1], r);
+    if ( q == NULL ) {
+        fprintf(stderr, "ERROR: failed to thaw the routing table.\n");
+        rtArtFreeRoute(pt[1], r);
+        ++nErrs;
+    } else if ( q != r ) {
+        rtArtFreeRoute(pt[1], r);   /* existing route */
+    } else if ( pt[1]->delete(pt[1], pa, pt[1]->alen) == false ) {
+        fprintf(stderr, "ERROR: failed to delete the inserted route.\n");
+        ++nErrs;
+    }
+    t[2] = elapsed(&ts);
+    nFreed = pt[1]->nSubtablesFreed;    /* by the delete above */
+    if ( pt[1]->nRoutes != pt[0]->nRoutes ) {
+        fprintf(stderr, "ERROR: %d routes were saved. %d were thawed.\n",
+                pt[0]->nRoutes, pt[1]->nRoutes);
+        ++nErrs;
+    }
+    lookupTest(pt[1]);
+    nErrs += cmpLookups(pt[0], pt[1], pa, n);
+    free(pa);
+    printf("save %.2fs, load %.6fs, thaw %.2fs\n", t[0], t[1], t[2]);
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d lookups differ\n", nErrs);
+    }
+
+    for ( i = 0; i < 2; ++i ) {
+        pt[i]->flush(pt[i]);
+        if ( pt[i]->nRoutes != 0 ) {
+            fprintf(stderr, "ERROR: %d routes were left.\n", pt[i]->nRoutes);
+            ++nErrs;
+        }
+    }
+    if ( pt[0]->nSubtablesFreed != pt[1]->nSubtablesFreed - nFreed ) {
+        fprintf(stderr, "ERROR: %d subtables were saved. "
+                "%d were thawed.\n",
+                pt[0]->nSubtablesFreed, pt[1]->nSubtablesFreed - nFreed);
+        ++nErrs;
+    }
+    for ( i = 0; i < 2; ++i ) {
+        pt[i]->deleteTable(&pt[i]);
+    }
+    return (nErrs == 0) ? true : false;
+}
+
+
+/*
+ * Applies the same additions and withdrawals to two routing tables
+ * one by one and with rtArtApplyUpdates(), checks the both tables
+ * return the same routes and the same results of the operations,
+ * and reports the time and the entries visited by the allotments.
+ * Half of the routes are inserted first. The batch withdraws every
+ * third of them and adds a copy of every sixth back, adds the other
+ * half, and withdraws every fourth of those right after it is added.
+ */
+boolean
+updateTest (int alen, trieType type, char* sl, int nLevels)
+{
+    struct timespec  ts;
+    rtArtUpdateStats us;
+    rtArtUpdateOp*   pu[2];
+    rtTable*   pt[2];
+    routeEnt** pr[2];
+    routeEnt*  r;
+    u8*    pd;
+    u8*    pa;
+    double t;
+    u64    nVisits;
+    int    i, j, k, n, h, m, nOps, nErrs;
+
+
+    nErrs = 0;
+    for ( k = 0; k < 2; ++k ) {
+        pt[k] = rtArtInit(nLevels, (s8*)sl, alen, type);
+        if ( !pt[k] ) {
+            fprintf(stderr, "ERROR: failed to create a routing table.\n");
+            return false;
+        }
+        n = loadRoutes(pt[k], &pr[k]);
+        h = n / 2;
+        m = rtArtInsertRoutes(pt[k], pr[k], h);
+        for ( i = m; i < h; ++i ) {
+            rtArtFreeRoute(pt[k], pr[k][i]);
+        }
+    }
+    pd = malloc(n * 16);
+    for ( k = 0; k < 2; ++k ) {
+        pu[k] = malloc((n + n / 4 + m / 6 + 2) * sizeof(rtArtUpdateOp));
+        if ( !pd || !pu[k] ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+    }
+    for ( i = 0; i < n; ++i ) {
+        memcpy(pd + i * 16, pr[0][i]->dest, 16);
+    }
+
+    for ( k = 0; k < 2; ++k ) {
+        j = 0;
+        for ( i = 0; i < m; ++i ) {
+            if ( (i % 3) != 0 ) continue;
+            pu[k][j].op    = artUpdWithdraw;
+            pu[k][j].pDest = pd + i * 16;
+            pu[k][j++].plen = pr[k][i]->plen;
+            if ( (i % 6) != 0 ) continue;
+            r = rtArtNewRoute(pt[k]);
+            *r = *pr[k][i];
+            pu[k][j].op  = artUpdAdd;
+            pu[k][j++].r = r;
+        }
+        for ( i = h; i < n; ++i ) {
+            pu[k][j].op  = artUpdAdd;
+            pu[k][j++].r = pr[k][i];
+            if ( (i % 4) != 0 ) continue;
+            pu[k][j].op    = artUpdWithdraw;
+            pu[k][j].pDest = pd + i * 16;
+            pu[k][j++].plen = pr[k][i]->plen;
+        }
+        nOps = j;
+    }
+
+    nVisits = pt[0]->nAllotVisits;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( j = 0; j < nOps; ++j ) {
+        if ( pu[0][j].op == artUpdAdd ) {
+            r = pt[0]->insert(pt[0], pu[0][j].r);
+            pu[0][j].rc = (r == pu[0][j].r) ? artUpdDone : artUpdExists;
+        } else {
+            pu[0][j].rc = pt[0]->delete(pt[0], pu[0][j].pDest, pu[0][j].plen)
+                ? artUpdDone : artUpdNotFound;
+        }
+    }
+    t = elapsed(&ts);
+    nVisits = pt[0]->nAllotVisits - nVisits;
+
+    i = rtArtApplyUpdates(pt[1], pu[1], nOps, &us);
+    printf("%d operations: one by one %.2fs (%llu entries allotted), "
+           "batch %.2fs + %.2fs (%llu entries allotted, %u cancelled)\n",
+           nOps, t, (unsigned long long)nVisits, us.tCoalesce, us.tApply,
+           (unsigned long long)us.nAllotVisits, us.nCancelled);
+    if ( i != us.nAdded + us.nWithdrawn ||
+         i + us.nCancelled + us.nRejected != nOps ) {
+        fprintf(stderr, "ERROR: %d of %d operations were applied.\n",
+                i, nOps);
+        ++nErrs;
+    }
+    for ( j = 0; j < nOps; ++j ) {
+        if ( (pu[1][j].rc != pu[0][j].rc) &&
+             ((pu[1][j].rc != artUpdCancelled) ||
+              (pu[0][j].rc != artUpdDone)) ) {
+            ++nErrs;
+        }
+        for ( k = 0; k < 2; ++k ) {
+            if ( (pu[k][j].op == artUpdAdd) && (pu[k][j].rc != artUpdDone) ) {
+                rtArtFreeRoute(pt[k], pu[k][j].r);
+            }
+        }
+    }
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d results differ\n", nErrs);
+    }
+    if ( pt[0]->nRoutes != pt[1]->nRoutes ) {
+        fprintf(stderr, "ERROR: %d routes were updated one by one. "
+                "%d were updated in a batch.\n",
+                pt[0]->nRoutes, pt[1]->nRoutes);
+        ++nErrs;
+    }
+    n = loadAddrs(pt[0], &pa);
+    i = cmpLookups(pt[0], pt[1], pa, n);
+    if ( i ) {
+        fprintf(stderr, "ERROR: %d lookups differ\n", i);
+        nErrs += i;
+    }
+    free(pa);
+
+    for ( k = 0; k < 2; ++k ) {
+        pt[k]->flush(pt[k]);
+        if ( pt[k]->nRoutes != 0 ) {
+            fprintf(stderr, "ERROR: %d routes were left.\n", pt[k]->nRoutes);
+            ++nErrs;
+        }
+        pt[k]->deleteTable(&pt[k]);
+        free(pu[k]);
+        free(pr[k]);
+    }
+    free(pd);
+    return (nErrs == 0) ? true : false;
+}
+
+
+/*
+ * Replaces every route of a routing table with a copy by
+ * pt->replace(), checks the copies are found and no subtable is
+ * freed or created, then does the same with pt->delete() and
+ * pt->insert(), and reports the time of each.
+ */
+boolean
+replaceTest (int alen, trieType type, char* sl, int nLevels)
+{
+    struct timespec ts;
+    rtArtStats* ps;
+    rtTable*   pt;
+    routeEnt** pr[2];
+    routeEnt*  r;
+    double t[2];
+    u32    nFreed[2];
+    u64    nSubtables;
+    int    i, n, nErrs;
+
+
+    pt = rtArtInit(nLevels, (s8*)sl, alen, type);
+    ps = malloc(sizeof(*ps));
+    if ( !pt || !ps ) {
+        fprintf(stderr, "ERROR: failed to create a routing table.\n");
+        return false;
+    }
+    mkRtTbl(pt);
+    rtArtGetStats(pt, ps);
+    nSubtables = ps->nSubtables;
+    for ( i = 0; i < 2; ++i ) {
+        n = loadRoutes(pt, &pr[i]);
+    }
+
+    nErrs = 0;
+    nFreed[0] = pt->nSubtablesFreed;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < n; ++i ) {
+        r = pt->replace(pt, pr[0][i]);
+        if ( !r || (r->plen != pr[0][i]->plen) ||
+             !cmpAddr(r->dest, pr[0][i]->dest, r->plen) ) {
+            ++nErrs;
+            continue;
+        }
+        rtArtFreeRoute(pt, r);
+    }
+    t[0] = elapsed(&ts);
+    nFreed[0] = pt->nSubtablesFreed - nFreed[0];
+    for ( i = 0; i < n; ++i ) {
+        if ( pt->findExactMatch(pt, pr[0][i]->dest, pr[0][i]->plen)
+             != pr[0][i] ) {
+            ++nErrs;
+        }
+    }
+    rtArtGetStats(pt, ps);
+    if ( nFreed[0] || (ps->nSubtables != nSubtables) ||
+         (pt->nRoutes != n) ) {
+        fprintf(stderr, "ERROR: %d subtables were freed and %d are left "
+                "of %d. %d routes are left of %d.\n", nFreed[0],
+                (int)ps->nSubtables, (int)nSubtables, pt->nRoutes, n);
+        ++nErrs;
+    }
+
+    nFreed[1] = pt->nSubtablesFreed;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < n; ++i ) {
+        pt->delete(pt, pr[1][i]->dest, pr[1][i]->plen);
+        if ( pt->insert(pt, pr[1][i]) != pr[1][i] ) {
+            ++nErrs;
+        }
+    }
+    t[1] = elapsed(&ts);
+    nFreed[1] = pt->nSubtablesFreed - nFreed[1];
+    printf("replace %.2fs (%u subtables freed), "
+           "delete and insert %.2fs (%u subtables freed)\n",
+           t[0], nFreed[0], t[1], nFreed[1]);
+
+    /*
+     * No route to replace
+     */
+    r = rtArtNewRoute(pt);
+    *r = *pr[1][0];
+    pt->delete(pt, r->dest, r->plen);
+    if ( pt->replace(pt, r) != NULL ) {
+        fprintf(stderr, "ERROR: a deleted route was replaced.\n");
+        ++nErrs;
+    }
+    rtArtFreeRoute(pt, r);
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d routes were not replaced.\n", nErrs);
+    }
+
+    pt->flush(pt);
+    pt->deleteTable(&pt);
+    for ( i = 0; i < 2; ++i ) {
+        free(pr[i]);
+    }
+    free(ps);
+    return (nErrs == 0) ? true : false;
+}
+
+
+/*
+ * Builds a routing table with artOptExactIndex in bulk, checks its
+ * exact matches, deletes and duplicate inserts against a table
+ * without the index, and reports the time of the exact matches of
+ * both.
+ */
+boolean
+indexTest (int alen, trieType type, char* sl, int nLevels)
+{
+    struct timespec ts;
+    rtArtOpts  opts;
+    rtTable*   pt[2];
+    routeEnt** pr[2];
+    routeEnt*  pk;
+    routeEnt*  r;
+    routeEnt*  q[2];
+    double t[2];
+    int    i, j, m, n, nErrs, def;
+
+
+    memset(&opts, 0, sizeof(opts));
+    pt[0] = rtArtInit(nLevels, (s8*)sl, alen, type);
+    opts.flags = artOptExactIndex;
+    pt[1] = rtArtInitOpts(nLevels, (s8*)sl, alen, type, &opts);
+    if ( !pt[0] || !pt[1] ) {
+        fprintf(stderr, "ERROR: failed to create a routing table.\n");
+        return false;
+    }
+    for ( j = 0; j < 2; ++j ) {
+        n = loadRoutes(pt[j], &pr[j]);
+        m = pt[j]->bulkLoad(pt[j], pr[j], n);
+        for ( i = m; i < n; ++i ) {
+            rtArtFreeRoute(pt[j], pr[j][i]);
+        }
+    }
+    n  = m;
+    pk = malloc(n * sizeof(routeEnt));  /* prefixes of the routes */
+    if ( !pk ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < n; ++i ) {
+        pk[i] = *pr[0][i];
+    }
+
+    nErrs = 0;
+    for ( j = 0; j < 2; ++j ) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        for ( i = 0; i < n; ++i ) {
+            if ( pt[j]->findExactMatch(pt[j], pk[i].dest, pk[i].plen)
+                 != pr[j][i] ) {
+                ++nErrs;
+            }
+        }
+        t[j] = elapsed(&ts);
+    }
+    printf("exact match %.2f Mlookups/s (trie), %.2f Mlookups/s (index)\n",
+           n / t[0] * 1e-6, n / t[1] * 1e-6);
+
+    /*
+     * Delete every other route, then insert them again
+     */
+    r = rtArtNewRoute(pt[1]);
+    for ( i = 0; i < n; i += 2 ) {
+        *r = pk[i];
+        if ( (pt[1]->insert(pt[1], r) != pr[1][i]) ||
+             !pt[1]->delete(pt[1], pk[i].dest, pk[i].plen) ||
+             pt[1]->delete(pt[1], pk[i].dest, pk[i].plen) ) {
+            ++nErrs;
+        }
+        pt[0]->delete(pt[0], pk[i].dest, pk[i].plen);
+    }
+
+    /*
+     * The misses return the default route as the trie does
+     */
+    def = (pt[0]->findExactMatch(pt[0], pk[0].dest, 0) == NULL);
+    for ( j = 0; def && (j < 2); ++j ) {
+        q[j] = rtArtNewRoute(pt[j]);
+        memset(q[j]->dest, 0, pt[j]->len);
+        q[j]->plen = 0;
+        if ( pt[j]->insert(pt[j], q[j]) != q[j] ) {
+            ++nErrs;
+        }
+    }
+    for ( i = 0; i < n; ++i ) {
+        for ( j = 0; j < 2; ++j ) {
+            q[j] = pt[j]->findExactMatch(pt[j], pk[i].dest, pk[i].plen);
+        }
+        if ( (!q[0] != !q[1]) ||
+             (q[0] && ((q[0]->plen != q[1]->plen) ||
+                       !cmpAddr(q[0]->dest, q[1]->dest, q[0]->plen))) ) {
+            ++nErrs;
+        }
+    }
+    for ( j = 0; def && (j < 2); ++j ) {
+        pt[j]->delete(pt[j], pk[0].dest, 0);
+    }
+    for ( i = 0; i < n; i += 2 ) {
+        pr[1][i] = rtArtNewRoute(pt[1]);
+        *pr[1][i] = pk[i];
+        if ( pt[1]->insert(pt[1], pr[1][i]) != pr[1][i] ) {
+            ++nErrs;
+        }
+    }
+    rtArtFreeRoute(pt[1], r);
+    for ( i = 0; i < n; ++i ) {
+        if ( pt[1]->findExactMatch(pt[1], pk[i].dest, pk[i].plen)
+             != pr[1][i] ) {
+            ++nErrs;
+        }
+    }
+    pt[1]->flush(pt[1]);
+    if ( pt[1]->findExactMatch(pt[1], pk[1].dest, pk[1].plen) ) {
+        ++nErrs;
+    }
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d exact matches of the index differ "
+                "from the trie.\n", nErrs);
+    }
+
+    for ( j = 0; j < 2; ++j ) {
+        pt[j]->flush(pt[j]);
+        pt[j]->deleteTable(&pt[j]);
+        free(pr[j]);
+    }
+    free(pk);
+    return (nErrs == 0) ? true : false;
+}
+
+
+#define N_CLONES 8              /* clones of cloneTest() */
+#define N_LOCAL  16             /* host routes added to each clone */
+
+/*
+ * Subtable allocator of cloneTest() that counts the bytes in use
+ */
+static void*
+cntAlloc (void* ctx, int level, size_t size)
+{
+    *(u64*)ctx += size;
+    return calloc(1, size);
+}
+
+static void
+cntFree (void* ctx, int level, void* p, size_t size)
+{
+    *(u64*)ctx -= size;
+    free(p);
+}
+
+static void
+cntRoute (routeEnt* r, void* p2)
+{
+    ++*(int*)p2;
+}
+
+
+/*
+ * Updates clone `c' of cloneTest(): deletes route pr[c], replaces
+ * route pr[N_CLONES+c] with a copy and adds N_LOCAL host routes.
+ * Returns the number of the updates that failed.
+ */
+static int
+cloneUpdate (rtTable* pt, routeEnt** pr, u8* pa, int c)
+{
+    routeEnt* r;
+    routeEnt* s;
+    int j, nErrs;
+
+
+    nErrs = 0;
+    if ( !pt->delete(pt, pr[c]->dest, pr[c]->plen) ) {
+        ++nErrs;
+    }
+    r  = rtArtNewRoute(pt);
+    *r = *pr[N_CLONES + c];
+    s  = pt->replace(pt, r);
+    if ( s == NULL ) {
+        ++nErrs;
+        s = r;
+    }
+    rtArtFreeRoute(pt, s);
+    for ( j = 0; j < N_LOCAL; ++j ) {
+        r = rtArtNewRoute(pt);
+        memcpy(r->dest, pa + (c * N_LOCAL + j) * pt->len, pt->len);
+        r->plen = pt->alen;
+        if ( pt->insert(pt, r) != r ) {
+            rtArtFreeRoute(pt, r);
+        }
+    }
+    return nErrs;
+}
+
+
+/*
+ * Clones a routing table N_CLONES times by rtArtClone(), updates
+ * each clone, checks the original and a clone return the same
+ * routes as the tables updated without cloning, destroys the
+ * tables in turn, and reports the time and the subtable memory
+ * of the clones.
+ */
+boolean
+cloneTest (int alen, trieType type, char* sl, int nLevels)
+{
+    struct timespec ts;
+    rtArtAllocator al;
+    rtArtOpts  opts;
+    rtTable*   pt;
+    rtTable*   pRef;
+    rtTable*   pc[N_CLONES];
+    routeEnt** pr;
+    u8*    pa;
+    u64    bytes, base;
+    double t[2];
+    int    i, n, nAddrs, nErrs, nFlushed;
+
+
+    bytes = 0;
+    memset(&opts, 0, sizeof(opts));
+    memset(&al, 0, sizeof(al));
+    al.alloc    = cntAlloc;
+    al.free     = cntFree;
+    al.ctx      = &bytes;
+    opts.pAlloc = &al;
+    pt   = rtArtInitOpts(nLevels, (s8*)sl, alen, type, &opts);
+    pRef = rtArtInit(nLevels, (s8*)sl, alen, type);
+    if ( !pt || !pRef ) {
+        fprintf(stderr, "ERROR: failed to create a routing table.\n");
+        return false;
+    }
+    mkRtTbl(pt);
+    base = bytes;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < N_CLONES; ++i ) {
+        pc[i] = rtArtClone(i ? pc[i-1] : pt);
+        if ( pc[i] == NULL ) break;
+    }
+    t[0] = elapsed(&ts);
+    if ( i < N_CLONES ) {
+        printf("not supported\n");
+        while ( --i >= 0 ) {
+            pc[i]->deleteTable(&pc[i]);
+        }
+        pt->deleteTable(&pt);
+        pRef->deleteTable(&pRef);
+        return (type == simpleTrie) ? false : true;
+    }
+
+    n      = loadRoutes(pRef, &pr);
+    nAddrs = loadAddrs(pRef, &pa);
+    assert((n >= 2 * N_CLONES) && (nAddrs >= N_CLONES * N_LOCAL));
+    nErrs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < N_CLONES; ++i ) {
+        nErrs += cloneUpdate(pc[i], pr, pa, i);
+    }
+    t[1] = elapsed(&ts);
+    printf("%d clones %.6fs, %d updates each %.6fs, "
+           "%.2f%% of the subtable memory of full copies\n",
+           N_CLONES, t[0], N_LOCAL + 2, t[1] / N_CLONES,
+           (bytes - base) * 100.0 / (base * N_CLONES));
+
+    /*
+     * The original has no update. Clone 0 has the updates of
+     * cloneUpdate(pc[0], ...).
+     */
+    mkRtTbl(pRef);
+    if ( cmpLookups(pt, pRef, pa, nAddrs) || (pt->nRoutes != pRef->nRoutes) ) {
+        fprintf(stderr, "ERROR: the clones updated the original.\n");
+        ++nErrs;
+    }
+    nErrs += cloneUpdate(pRef, pr, pa, 0);
+    if ( cmpLookups(pc[0], pRef, pa, nAddrs) ||
+         (pc[0]->nRoutes != pRef->nRoutes) ) {
+        fprintf(stderr, "ERROR: clone 0 is not updated.\n");
+        ++nErrs;
+    }
+
+    /*
+     * Clone 0 is left alone and then flushed.
+     */
+    for ( i = 1; i < N_CLONES; ++i ) {
+        pc[i]->deleteTable(&pc[i]);
+    }
+    pt->deleteTable(&pt);
+    if ( cmpLookups(pc[0], pRef, pa, nAddrs) ) {
+        fprintf(stderr, "ERROR: clone 0 is broken by the others.\n");
+        ++nErrs;
+    }
+    nFlushed = 0;
+    pc[0]->flushRoutes(pc[0], cntRoute, &nFlushed);
+    if ( (nFlushed != pRef->nRoutes) || pc[0]->nRoutes ) {
+        fprintf(stderr, "ERROR: %d routes were flushed of %d.\n",
+                nFlushed, pRef->nRoutes);
+        ++nErrs;
+    }
+    pc[0]->deleteTable(&pc[0]);
+    if ( bytes ) {
+        fprintf(stderr, "ERROR: %llu bytes of subtables are left.\n",
+                (unsigned long long)bytes);
+        ++nErrs;
+    }
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d clone updates failed.\n", nErrs);
+    }
+
+    for ( i = 0; i < n; ++i ) {
+        rtArtFreeRoute(pRef, pr[i]);
+    }
+    pRef->flush(pRef);
+    pRef->deleteTable(&pRef);
+    free(pr);
+    free(pa);
+    return (nErrs == 0) ? true : false;
+}
+
+
+/*
+ * Compiles `pt' into a frozen FIB, checks the FIB returns the same
+ * routes as pt->findMatch(), and reports the lookup rate.
+ */
+boolean
+fibTest (rtTable* pt)
+{
+    struct timespec ts;
+    rtArtFib*  pf;
+    rtArtFib*  pPub;
+    routeEnt*  r1;
+    routeEnt*  r2;
+    u32*   pScalar;
+    u32*   pBatch;
+    u8**   ppDest;
+    u8*    pa;
+    double t0, t1, t2;
+    u64    nEntries;
+    u32    nSubtables;
+    int    i, j, n, nErrs;
+
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    pf = rtArtFibCompile(pt);
+    t0 = elapsed(&ts);
+    if ( !pf ) {
+        printf("not supported\n");
+        return (pt->type == compactTrie) ? true : false;
+    }
+    nEntries = rtArtFibNumEntries(pf, &nSubtables);
+
+    n = loadAddrs(pt, &pa);
+    ppDest  = calloc(n, sizeof(*ppDest));
+    pScalar = calloc(n, sizeof(*pScalar));
+    pBatch  = calloc(n, sizeof(*pBatch));
+    if ( !ppDest || !pScalar || !pBatch ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < n; ++i ) {
+        ppDest[i] = pa + i * pt->len;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < n; ++i ) {
+        pScalar[i] = rtArtFibFindMatch(pf, ppDest[i]);
+    }
+    t1 = elapsed(&ts);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < n; i += BATCH_SIZE ) {
+        j = ((n - i) < BATCH_SIZE) ? (n - i) : BATCH_SIZE;
+        rtArtFibFindMatchBatch(pf, ppDest + i, pBatch + i, j);
+    }
+    t2 = elapsed(&ts);
+
+    nErrs = 0;
+    for ( i = 0; i < n; ++i ) {
+        r1 = pt->findMatch(pt, ppDest[i]);
+        r2 = rtArtFibRoute(pf, pScalar[i]);
+        if ( (pScalar[i] != pBatch[i]) || ((r1 == NULL) != (r2 == NULL)) ||
+             (r1 && ((r1->plen != r2->plen) ||
+                     !cmpAddr(r1->dest, r2->dest, r1->plen))) ) {
+            ++nErrs;
+        }
+    }
+    printf("%u subtables (%u sparse, %.1f MB) in %.2fs, "
+           "%.2f Mlookups/s (scalar), %.2f Mlookups/s (batch of %d)\n",
+           nSubtables, rtArtFibNumSparse(pf),
+           nEntries * sizeof(u32) / 1048576.0, t0,
+           n / t1 * 1e-6, n / t2 * 1e-6, BATCH_SIZE);
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d FIB lookups differ from findMatch()\n",
+                nErrs);
+    }
+
+    /*
+     * Replace the FIB with itself compiled again, then remove it.
+     */
+    pPub = NULL;
+    rtArtFibPublish(pt, &pPub, pf);
+    pf = rtArtFibCompile(pt);
+    rtArtFibPublish(pt, &pPub, pf);
+    if ( !pf || (rtArtFibGet(&pPub) != pf) ) {
+        fprintf(stderr, "ERROR: failed to publish a FIB\n");
+        ++nErrs;
+    }
+    rtArtFibPublish(pt, &pPub, NULL);
+
+    free(pBatch);
+    free(pScalar);
+    free(ppDest);
+    free(pa);
+    return (nErrs == 0) ? true : false;
+}
+
+
+#define N_SLICES 4              /* threads of iterTest() */
+
+typedef struct {
+    rtTable*   pt;
+    u32        start;           /* root fringe index offsets to walk */
+    u32        end;
+    routeEnt** pr;              /* returned routes */
+    int        n;               /* # of returned routes */
+} sliceArg;
+
+static void*
+sliceThread (void* p)
+{
+    sliceArg*  pa = p;
+    rtArtIter  it;
+    routeEnt*  r;
+
+    rtArtIterInit(&it, pa->pt, pa->start, pa->end);
+    for ( pa->n = 0; (r = rtArtIterNext(&it)); ) {
+        pa->pr[pa->n++] = r;
+    }
+    return NULL;
+}
+
+
+/*
+ * Returns true if prefix `r1' precedes prefix `r2' in the prefix
+ * order (the addresses of the routes are masked).
+ */
+static boolean
+iterBefore (rtTable* pt, routeEnt* r1, routeEnt* r2)
+{
+    int c = memcmp(r1->dest, r2->dest, pt->len);
+
+    return (c < 0) || ((c == 0) && (r1->plen < r2->plen));
+}
+
+
+/*
+ * Walks `pt' with rtArtIterNext(), checks every route is returned
+ * once in the prefix order, walks it again in N_SLICES ranges of
+ * the root fringe indices by as many threads, checks they return
+ * the same sequence, and reports the time of each and that of
+ * rtArtBFwalk().
+ */
+boolean
+iterTest (rtTable* pt)
+{
+    struct timespec ts;
+    pthread_t  tid[N_SLICES];
+    sliceArg   arg[N_SLICES];
+    rtArtIter  it;
+    routeEnt** pAll;
+    routeEnt*  r;
+    double t[3];
+    u64    nFringes;
+    int    i, j, k, n, nErrs, nWalked;
+
+
+    if ( rtArtIterInit(&it, pt, 0, ~0u) == false ) {
+        printf("not supported\n");
+        return (pt->type == compactTrie) ? true : false;
+    }
+    pAll = malloc((pt->nRoutes + 1) * sizeof(*pAll));
+    if ( !pAll ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+
+    n = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    while ( (r = rtArtIterNext(&it)) && (n <= pt->nRoutes) ) {
+        pAll[n++] = r;
+    }
+    t[0] = elapsed(&ts);
+
+    nErrs = 0;
+    if ( n != pt->nRoutes ) {
+        fprintf(stderr, "ERROR: %d routes were returned of %d.\n",
+                n, pt->nRoutes);
+        ++nErrs;
+    }
+    for ( i = 0; i < n; ++i ) {
+        if ( (i > 0) && !iterBefore(pt, pAll[i-1], pAll[i]) ) {
+            ++nErrs;
+        }
+        if ( pt->findExactMatch(pt, pAll[i]->dest, pAll[i]->plen)
+             != pAll[i] ) {
+            ++nErrs;
+        }
+    }
+
+    nWalked = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    rtArtBFwalk(pt, pt->root, cntRoute, &nWalked);
+    t[1] = elapsed(&ts);
+
+    nFringes = 1 << pt->psi[0].sl;
+    for ( k = 0; k < N_SLICES; ++k ) {
+        arg[k].pt    = pt;
+        arg[k].start = k * nFringes / N_SLICES;
+        arg[k].end   = (k + 1) * nFringes / N_SLICES;
+        arg[k].pr    = malloc((n + 1) * sizeof(*pAll));
+        if ( !arg[k].pr ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( k = 0; k < N_SLICES; ++k ) {
+        if ( pthread_create(&tid[k], NULL, sliceThread, &arg[k]) ) {
+            fprintf(stderr, "Error: pthread_create()\n");
+            exit(1);
+        }
+    }
+    for ( k = 0; k < N_SLICES; ++k ) {
+        pthread_join(tid[k], NULL);
+    }
+    t[2] = elapsed(&ts);
+
+    j = 0;
+    for ( k = 0; k < N_SLICES; ++k ) {
+        for ( i = 0; i < arg[k].n; ++i, ++j ) {
+            if ( (j >= n) || (arg[k].pr[i] != pAll[j]) ) {
+                ++nErrs;
+            }
+        }
+        free(arg[k].pr);
+    }
+    if ( j != n ) {
+        fprintf(stderr, "ERROR: %d routes were returned by %d slices "
+                "of %d.\n", j, N_SLICES, n);
+        ++nErrs;
+    }
+    printf("%d routes in %.3fs (rtArtBFwalk() %d routes in %.3fs), "
+           "%d slices by %d threads %.3fs\n", n, t[0], nWalked, t[1],
+           N_SLICES, N_SLICES, t[2]);
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d routes were not walked "
+                "in the prefix order.\n", nErrs);
+    }
+    free(pAll);
+    return (nErrs == 0) ? true : false;
+}
+
+
+#define N_HOT       4096         /* hot destinations of cacheTest() */
+#define CACHE_SIZE  16384        /* entries of the cache of cacheTest() */
+
+
+/*
+ * Looks up a skewed stream of destinations (9 of 10 lookups from
+ * N_HOT addresses) with and without a destination cache, checks
+ * the cache returns the same routes before and after a host route
+ * of a cached destination is inserted and deleted, and reports
+ * the lookup rates and the hit ratio.
+ */
+boolean
+cacheTest (rtTable* pt)
+{
+    struct timespec ts;
+    rtArtCacheStats cs;
+    rtArtCache* pc;
+    routeEnt*   r;
+    routeEnt**  pRes;
+    u8**   ppDest;
+    u8*    pa;
+    u8*    p;
+    double t0, t1;
+    ipv4a  a;
+    u32    x;
+    int    i, n, m, nErrs;
+
+
+    n  = loadAddrs(pt, &pa);
+    m  = 4 * n;
+    pc = rtArtCacheNew(pt, CACHE_SIZE);
+    ppDest = calloc(m, sizeof(*ppDest));
+    pRes   = calloc(m, sizeof(*pRes));
+    if ( !pc || !ppDest || !pRes || (n == 0) ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0, x = 1; i < m; ++i ) {
+        x = x * 1103515245 + 12345;
+        ppDest[i] = pa + (((x >> 8) % 10) ? (x >> 12) % N_HOT % n
+                                          : (x >> 12) % n) * pt->len;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < m; ++i ) {
+        pRes[i] = pt->findMatch(pt, ppDest[i]);
+    }
+    t0 = elapsed(&ts);
+    nErrs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < m; ++i ) {
+        if ( rtArtCacheFindMatch(pc, ppDest[i]) != pRes[i] ) {
+            ++nErrs;
+        }
+    }
+    t1 = elapsed(&ts);
+    rtArtCacheGetStats(pc, &cs);
+    printf("%.2f Mlookups/s (findMatch), %.2f Mlookups/s (cache), "
+           "%.1f%% hits\n", m / t0 * 1e-6, m / t1 * 1e-6,
+           100.0 * cs.nHits / m);
+    if ( cs.nHits + cs.nMisses != m ) {
+        fprintf(stderr, "ERROR: %llu hits and %llu misses of %d lookups\n",
+                (unsigned long long)cs.nHits,
+                (unsigned long long)cs.nMisses, m);
+        ++nErrs;
+    }
+
+    /*
+     * A host route of a cached destination
+     */
+    p = ppDest[0];
+    r = rtArtNewRoute(pt);
+    memcpy(r->dest, p, pt->len);
+    r->plen = pt->alen;
+    if ( pt->insert(pt, r) == r ) {
+        if ( rtArtCacheFindMatch(pc, p) != r ) {
+            ++nErrs;            /* stale route */
+        }
+        pt->delete(pt, p, pt->alen);
+    } else {
+        rtArtFreeRoute(pt, r);
+    }
+    if ( rtArtCacheFindMatch(pc, p) != pt->findMatch(pt, p) ) {
+        ++nErrs;
+    }
+    rtArtCacheGetStats(pc, &cs);
+    if ( cs.nStale == 0 ) {
+        fprintf(stderr, "ERROR: no stale entry after the updates\n");
+        ++nErrs;
+    }
+    if ( pt->alen == 32 ) {
+        for ( i = 0; i < m; i += 7 ) {
+            p = ppDest[i];
+            a = ((u32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+            if ( rtArtCacheFindMatch4(pc, a) != pt->findMatch4(pt, a) ) {
+                ++nErrs;
+            }
+        }
+    }
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d cached lookups differ from "
+                "findMatch()\n", nErrs);
+    }
+
+    rtArtCacheFree(pc);
+    free(pRes);
+    free(ppDest);
+    free(pa);
+    return (nErrs == 0) ? true : false;
+}
+
+
+#define N_RANGES 64             /* queries of rangeTest() */
+
+typedef struct rangeArg rangeArg;
+struct rangeArg {
+    rtTable*  pt;
+    u8*       pDest;            /* prefix or address of the query */
+    int       plen;             /* prefix length. -1: covering walk */
+    int       n;                /* routes passed to rangeVisit() */
+    int       nErrs;            /* routes not in the result */
+    routeEnt* last;             /* the previous route */
+};
+
+
+/*
+ * Callback of rtArtWalkSubPrefixes() and rtArtWalkCovering() of
+ * rangeTest(). Checks the route is in the result and after the
+ * previous one (in the prefix order or by the prefix length.)
+ */
+static void
+rangeVisit (routeEnt* r, void* p2)
+{
+    rangeArg* pa = p2;
+
+    if ( pa->plen < 0 ) {
+        if ( !cmpAddr(pa->pDest, r->dest, r->plen) ||
+             (pa->last && (pa->last->plen >= r->plen)) ) {
+            ++pa->nErrs;
+        }
+    } else if ( (r->plen < pa->plen) ||
+                !cmpAddr(pa->pDest, r->dest, pa->plen) ||
+                (pa->last && !iterBefore(pa->pt, pa->last, r)) ) {
+        ++pa->nErrs;
+    }
+    pa->last = r;
+    ++pa->n;
+}
+
+
+/*
+ * Walks the routes under N_RANGES prefixes made from the routes of
+ * `pt' with rtArtWalkSubPrefixes() and the routes covering as many
+ * addresses with rtArtWalkCovering(), checks the results with scans
+ * of all the routes, and reports the time of the walks and that of
+ * the scans.
+ */
+boolean
+rangeTest (rtTable* pt)
+{
+    struct timespec ts;
+    rangeArg   arg;
+    rtArtIter  it;
+    routeEnt** pAll;
+    routeEnt*  r;
+    u8*    pa;
+    u8*    pDest[2 * N_RANGES];
+    int    plen[2 * N_RANGES];
+    int    nRes[2 * N_RANGES];
+    double t[2];
+    int    i, k, m, n, nErrs, nSub, nCov;
+
+
+    if ( rtArtIterInit(&it, pt, 0, ~0u) == false ) {
+        printf("not supported\n");
+        return (pt->type == compactTrie) ? true : false;
+    }
+    pAll = malloc((pt->nRoutes + 1) * sizeof(*pAll));
+    if ( !pAll ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( n = 0; (n <= pt->nRoutes) && (r = rtArtIterNext(&it)); ) {
+        pAll[n++] = r;
+    }
+    m = loadAddrs(pt, &pa);
+    if ( (n == 0) || (m == 0) ) {
+        fprintf(stderr, "Error: no routes or addresses\n");
+        exit(1);
+    }
+
+    /*
+     * pDest[k]: sub-prefix walks, pDest[N_RANGES + k]: covering walks
+     */
+    for ( k = 0; k < N_RANGES; ++k ) {
+        r = pAll[(long)k * n / N_RANGES];
+        pDest[k] = r->dest;
+        plen[k]  = (k == 0) ? 0 : r->plen - (k % 9);
+        if ( plen[k] < 0 ) {
+            plen[k] = 0;
+        }
+        pDest[N_RANGES + k] = pa + ((long)k * m / N_RANGES) * pt->len;
+        plen[N_RANGES + k]  = -1;
+    }
+
+    nErrs = 0;
+    nSub = nCov = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( k = 0; k < 2 * N_RANGES; ++k ) {
+        memset(&arg, 0, sizeof(arg));
+        arg.pt    = pt;
+        arg.pDest = pDest[k];
+        arg.plen  = plen[k];
+        if ( plen[k] < 0 ) {
+            nRes[k] = rtArtWalkCovering(pt, pDest[k], rangeVisit, &arg);
+            nCov   += nRes[k];
+            if ( arg.last != pt->findMatch(pt, pDest[k]) ) {
+                ++nErrs;
+            }
+        } else {
+            nRes[k] = rtArtWalkSubPrefixes(pt, pDest[k], plen[k],
+                                           rangeVisit, &arg);
+            nSub   += nRes[k];
+        }
+        if ( (nRes[k] != arg.n) || arg.nErrs ) {
+            ++nErrs;
+        }
+    }
+    t[0] = elapsed(&ts);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( k = 0; k < 2 * N_RANGES; ++k ) {
+        for ( i = 0; i < n; ++i ) {
+            r = pAll[i];
+            if ( (plen[k] < 0) ? cmpAddr(pDest[k], r->dest, r->plen)
+                 : ((r->plen >= plen[k]) &&
+                    cmpAddr(pDest[k], r->dest, plen[k])) ) {
+                --nRes[k];
+            }
+        }
+        if ( nRes[k] ) {
+            ++nErrs;
+        }
+    }
+    t[1] = elapsed(&ts);
+
+    printf("%d routes under %d prefixes and %d covering routes of %d "
+           "addresses in %.3fs (scans %.3fs)\n", nSub, N_RANGES, nCov,
+           N_RANGES, t[0], t[1]);
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d walks returned wrong routes.\n", nErrs);
+    }
+    free(pa);
+    free(pAll);
+    return (nErrs == 0) ? true : false;
+}
+
+
+static void
+prStrides (s8* sl, int nLevels)
+{
+    int i;
+
+    for ( i = 0; i < nLevels; ++i ) {
+        printf("%s%d", (i) ? " " : "", sl[i]);
+    }
+}
+
+
+/*
+ * Tunes the stride lengths of the test routes within the memory
+ * of `sl', builds a routing table with the tuned stride lengths,
+ * and checks the number of the subtables is the estimated one.
+ */
+boolean
+tuneTest (rtTable* pt, char* sl, int nLevels)
+{
+    rtArtStrideStats st[3];
+    rtTable*   pt2;
+    routeEnt** pr;
+    s8     tsl[128];
+    s8     tsl2[128];
+    s8     tsl6[128];
+    u32    nSubtables;
+    int    i, j, n, m, m6, nErrs;
+
+
+    nErrs = 0;
+    n = loadRoutes(pt, &pr);
+    if ( rtArtEvalStrides(pr, n, pt->alen, pt->type, (s8*)sl, nLevels,
+                          &st[0]) == false ) {
+        fprintf(stderr, "ERROR: failed to evaluate the stride lengths.\n");
+        return false;
+    }
+    m = rtArtTuneStrides(pr, n, pt->alen, pt->type, st[0].memory, tsl, &st[1]);
+    m6 = (pt->alen == 128) ?
+        rtArtTuneStrides6(pr, n, pt->type, st[0].memory, tsl6, &st[2]) : 0;
+    for ( i = 0; i < n; ++i ) {
+        rtArtFreeRoute(pt, pr[i]);
+    }
+    free(pr);
+    if ( m == 0 ) {
+        fprintf(stderr, "ERROR: failed to tune the stride lengths.\n");
+        return false;
+    }
+    printf("%d levels (", st[0].nLevels);
+    prStrides((s8*)sl, nLevels);
+    printf(") %.1f MB -> %d levels (", st[0].memory / 1048576.0,
+           st[1].nLevels);
+    prStrides(tsl, m);
+    printf(") %.1f MB, %.2f -> %.2f levels on average\n",
+           st[1].memory / 1048576.0, st[0].avgLevels, st[1].avgLevels);
+    if ( (st[1].nLevels > st[0].nLevels) || (st[1].memory > st[0].memory) ) {
+        fprintf(stderr, "ERROR: tuned stride lengths are worse.\n");
+        ++nErrs;
+    }
+    if ( pt->alen == 128 ) {
+        for ( i = j = 0; (i < m6) && (j < 64); j += tsl6[i++] ) ;
+        printf("Split at /64: %d levels (", st[2].nLevels);
+        prStrides(tsl6, m6);
+        printf(") %.1f MB, %.2f levels on average\n",
+               st[2].memory / 1048576.0, st[2].avgLevels);
+        if ( (m6 == 0) || (j != 64) || (st[2].memory > st[0].memory) ) {
+            fprintf(stderr, "ERROR: wrong stride lengths split at /64.\n");
+            ++nErrs;
+        } else if ( (pt2 = rtArtInit(m6, tsl6, 128, pt->type)) ) {
+            mkRtTbl(pt2);
+            lookupTest(pt2);
+            pt2->flush(pt2);
+            pt2->deleteTable(&pt2);
+        }
+    }
+    if ( (pt->type != compactTrie) &&
+         ((rtArtTuneTable(pt, pt->type, st[0].memory, tsl2, NULL) != m) ||
+          memcmp(tsl, tsl2, m)) ) {
+        fprintf(stderr, "ERROR: rtArtTuneTable() returned different "
+                "stride lengths.\n");
+        ++nErrs;
+    }
+
+    /*
+     * Build the routing table with the tuned stride lengths.
+     */
+    pt2 = rtArtInit(m, tsl, pt->alen, pt->type);
+    if ( !pt2 ) {
+        fprintf(stderr, "ERROR: failed to create a routing table.\n");
+        return false;
+    }
+    mkRtTbl(pt2);
+    lookupTest(pt2);
+    nSubtables = (pt2->type == compactTrie) ? rtArtCpNumSubtables(pt2) : 0;
+    pt2->flush(pt2);
+    if ( pt2->type == simpleTrie ) {
+        nSubtables = pt2->nSubtablesFreed;
+    }
+    if ( (pt2->type != pathCompTrie) && (nSubtables != st[1].nSubtables) ) {
+        fprintf(stderr, "ERROR: %u subtables were estimated. "
+                "%u were created.\n", (u32)st[1].nSubtables, nSubtables);
+        ++nErrs;
+    }
+    pt2->deleteTable(&pt2);
+    return (nErrs == 0) ? true : false;
+}
+
+
+#define RELAYOUT_BUDGET 4096    /* entries of a call of relayoutTest() */
+#define RELAYOUT_STEP   7919    /* prime stride of the deletes */
+
+/*
+ * Runs rtArtRelayout() to the end and returns the number of the calls.
+ * The number of the moved subtables is added to `*pMoved'.
+ */
+static int
+relayoutPass (rtTable* pt, u32* pMoved)
+{
+    u32 n0 = pt->nSubtablesMoved;
+    int n, rc;
+
+    for ( n = 1; (rc = rtArtRelayout(pt, RELAYOUT_BUDGET)) > 0; ++n ) ;
+    *pMoved = pt->nSubtablesMoved - n0;
+    return (rc < 0) ? -1 : n;
+}
+
+
+/*
+ * Returns the lookup rate of `n' addresses in Mlookups/s.
+ * The results are checked against `pRes' if `check' is true or
+ * stored to it otherwise. `*pErrs' counts the differences.
+ */
+static double
+relayoutLookups (rtTable* pt, u8** ppDest, routeEnt** pRes, int n,
+                 boolean check, int* pErrs)
+{
+    struct timespec ts;
+    routeEnt* r;
+    double    t;
+    int       i;
+
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < n; ++i ) {
+        r = pt->findMatch(pt, ppDest[i]);
+        if ( !check ) {
+            pRes[i] = r;
+        } else if ( pRes[i] != r ) {
+            ++*pErrs;
+        }
+    }
+    t = elapsed(&ts);
+    return n / t * 1e-6;
+}
+
+
+/*
+ * Builds a table with lock-free readers and the slab allocator after
+ * inserting all the routes and deleting them in a scattered order,
+ * so the subtables are reused in no particular order. Relays the subtables out while
+ * N_READERS threads look up the table, checks the lookups return the
+ * same routes, and relays them out again: a laid-out table should
+ * have few subtables to move.
+ */
+boolean
+relayoutTest (int alen, trieType type, char* sl, int nLevels)
+{
+    rtArtOpts  opts = { artOptConcurrent | artOptSlab | artOptRouteArena,
+                        NULL, sizeof(u64) };
+    readerArg  arg[N_READERS];
+    pthread_t  tid[N_READERS];
+    rtArtStats s0, s1;
+    rtTable*   pt;
+    routeEnt** pRes;
+    routeEnt** pr;
+    u8**       ppDest;
+    u8*        pa;
+    volatile int stop;
+    double     r0, r1;
+    u32        nMoved[2];
+    int        i, j, n, nCalls, nErrs;
+
+
+    pt = rtArtInitOpts(nLevels, (s8*)sl, alen, type, &opts);
+    if ( !pt ) {
+        fprintf(stderr, "ERROR: failed to create a routing table.\n");
+        return false;
+    }
+    mkRtTbl(pt);
+    n = loadRoutes(pt, &pr);
+    for ( i = 0; i < n; ++i ) {
+        j = (int)(((u64)i * RELAYOUT_STEP) % n);    /* scatter the frees */
+        pt->delete(pt, pr[j]->dest, pr[j]->plen);
+    }
+    for ( i = 0; i < n; ++i ) {
+        rtArtFreeRoute(pt, pr[i]);
+    }
+    free(pr);
+    mkRtTbl(pt);
+    rtArtSynchronize(pt);       /* free the retired subtables */
+    if ( rtArtRelayout(pt, RELAYOUT_BUDGET) < 0 ) {
+        printf("not supported\n");
+        pt->deleteTable(&pt);
+        return (type == compactTrie) ? true : false;
+    }
+    pt->relayDepth = 0;         /* start over */
+
+    n = loadAddrs(pt, &pa);
+    ppDest = calloc(n, sizeof(*ppDest));
+    pRes   = calloc(n, sizeof(*pRes));
+    if ( !ppDest || !pRes ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < n; ++i ) {
+        ppDest[i] = pa + i * pt->len;
+    }
+    nErrs = 0;
+    relayoutLookups(pt, ppDest, pRes, n, false, &nErrs);
+    r0 = relayoutLookups(pt, ppDest, pRes, n, true, &nErrs);
+    rtArtGetStats(pt, &s0);
+
+    stop = 0;
+    for ( i = 0; i < N_READERS; ++i ) {
+        memset(&arg[i], 0, sizeof(arg[i]));
+        arg[i].pt     = pt;
+        arg[i].ppDest = ppDest;
+        arg[i].n      = n;
+        arg[i].pStop  = &stop;
+        if ( pthread_create(&tid[i], NULL, lookupThread, &arg[i]) ) {
+            fprintf(stderr, "Error: pthread_create()\n");
+            exit(1);
+        }
+    }
+    nCalls = relayoutPass(pt, &nMoved[0]);
+    stop = 1;
+    for ( i = 0; i < N_READERS; ++i ) {
+        pthread_join(tid[i], NULL);
+        nErrs += arg[i].nErrs;
+    }
+    rtArtSynchronize(pt);
+
+    r1 = relayoutLookups(pt, ppDest, pRes, n, true, &nErrs);
+    relayoutPass(pt, &nMoved[1]);
+    relayoutLookups(pt, ppDest, pRes, n, true, &nErrs);
+    rtArtGetStats(pt, &s1);
+
+    printf("%u of %llu subtables moved in %d calls, %u moved again, "
+           "%.2f -> %.2f Mlookups/s\n", nMoved[0],
+           (unsigned long long)s0.nSubtables, nCalls, nMoved[1], r0, r1);
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d lookups returned a wrong route\n", nErrs);
+    }
+    if ( (s0.nSubtables != s1.nSubtables) || (s0.bytes != s1.bytes) ) {
+        fprintf(stderr, "ERROR: %llu subtables (%llu bytes) after the "
+                "relayout\n", (unsigned long long)s1.nSubtables,
+                (unsigned long long)s1.bytes);
+        ++nErrs;
+    }
+    if ( nMoved[1] * 10 > nMoved[0] ) {
+        fprintf(stderr, "ERROR: %u subtables moved again\n", nMoved[1]);
+        ++nErrs;
+    }
+
+    pt->deleteTable(&pt);
+    free(pRes);
+    free(ppDest);
+    free(pa);
+    return (nErrs == 0) ? true : false;
+}
+
+
+#define N_REPLICAS 2            /* replicas of replicaTest() */
+
+/*
+ * Checks that all the replicas return the same route as replica 0
+ * for each address: the same route if the routes are shared, or a
+ * copy of it otherwise. Returns the number of the differences.
+ */
+static int
+replicaCheck (rtArtReplicas* prs, boolean copied, u8** ppDest, int n)
+{
+    rtTable*  pt0 = rtArtReplicaTable(prs, 0);
+    rtTable*  pt;
+    routeEnt* r0;
+    routeEnt* r;
+    int i, j, nErrs;
+
+
+    nErrs = 0;
+    for ( j = 1; (pt = rtArtReplicaTable(prs, j)); ++j ) {
+        for ( i = 0; i < n; ++i ) {
+            r0 = pt0->findMatch(pt0, ppDest[i]);
+            r  = pt->findMatch(pt, ppDest[i]);
+            if ( !copied || !r0 || !r ) {
+                nErrs += (r != r0) ? 1 : 0;
+            } else if ( (r == r0) || (r->plen != r0->plen) ||
+                        memcmp(r->dest, r0->dest, pt->len) ||
+                        (*(u64*)rtArtRouteData(r) != r0->plen) ) {
+                ++nErrs;
+            }
+        }
+    }
+    return nErrs;
+}
+
+
+/*
+ * Builds N_REPLICAS replicas with shared and then copied routes,
+ * deletes every other route while N_READERS threads look up the
+ * replicas, and checks the replicas return the same routes. Reports
+ * the memory of each replica and the time of an update.
+ */
+boolean
+replicaTest (int alen, trieType type, char* sl, int nLevels)
+{
+    rtArtOpts  opts = { artOptSlab | artOptRouteArena, NULL, sizeof(u64) };
+    rtArtReplicaStats st;
+    rtArtReplicaHandle* ph;
+    rtArtReplicas* prs;
+    readerArg  arg[N_READERS];
+    pthread_t  tid[N_READERS];
+    routeEnt** pr;
+    routeEnt*  r;
+    u8**       ppDest;
+    u8*        pa;
+    u8         dest[16];
+    volatile int stop;
+    int        copied, i, n, nAddrs, nErrs, plen;
+
+
+    nErrs = 0;
+    for ( copied = 0; copied < 2; ++copied ) {
+        opts.flags = artOptSlab | artOptRouteArena |
+            ((copied) ? artOptCopyRoutes : 0);
+        prs = rtArtReplicasNew(nLevels, (s8*)sl, alen, type, &opts,
+                               N_REPLICAS);
+        if ( !prs ) {
+            if ( type == compactTrie ) {
+                printf("not supported\n");
+                return true;
+            }
+            fprintf(stderr, "ERROR: failed to create the replicas.\n");
+            return false;
+        }
+        ph = rtArtReplicaAttach(prs, -1);
+        if ( !ph || (ph->pt != rtArtReplicaTable(prs, ph->node)) ) {
+            fprintf(stderr, "ERROR: wrong replica handle\n");
+            ++nErrs;
+        }
+        rtArtReplicaDetach(ph);
+
+        n = loadRoutes(rtArtReplicaTable(prs, 0), &pr);
+        for ( i = 0; i < n; ++i ) {
+            *(u64*)rtArtRouteData(pr[i]) = pr[i]->plen;
+            r = rtArtReplicasInsert(prs, pr[i]);
+            if ( r == NULL ) {
+                fprintf(stderr, "ERROR: failed to insert a route\n");
+                ++nErrs;
+            } else if ( r != pr[i] ) {
+                rtArtReplicasFreeRoute(prs, pr[i]);     /* duplicate */
+            }
+            if ( r != pr[i] ) {
+                pr[i] = NULL;
+            }
+        }
+
+        nAddrs = loadAddrs(rtArtReplicaTable(prs, 0), &pa);
+        ppDest = calloc(nAddrs, sizeof(*ppDest));
+        if ( !ppDest ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+        for ( i = 0; i < nAddrs; ++i ) {
+            ppDest[i] = pa + i * alen / 8;
+        }
+        nErrs += replicaCheck(prs, copied, ppDest, nAddrs);
+
+        stop = 0;
+        for ( i = 0; i < N_READERS; ++i ) {
+            memset(&arg[i], 0, sizeof(arg[i]));
+            arg[i].pt     = rtArtReplicaTable(prs, i % N_REPLICAS);
+            arg[i].ppDest = ppDest;
+            arg[i].n      = nAddrs;
+            arg[i].pStop  = &stop;
+            if ( pthread_create(&tid[i], NULL, lookupThread, &arg[i]) ) {
+                fprintf(stderr, "Error: pthread_create()\n");
+                exit(1);
+            }
+        }
+        plen = -1;
+        for ( i = 0; i < n; i += 2 ) {
+            if ( !pr[i] ) {
+                continue;
+            }
+            memcpy(dest, pr[i]->dest, sizeof(dest));
+            plen = pr[i]->plen;
+            if ( rtArtReplicasDelete(prs, dest, plen) == false ) {
+                fprintf(stderr, "ERROR: failed to delete a route\n");
+                ++nErrs;
+            }
+        }
+        stop = 1;
+        for ( i = 0; i < N_READERS; ++i ) {
+            pthread_join(tid[i], NULL);
+            nErrs += arg[i].nErrs;
+        }
+
+        /*
+         * The default route is not deleted in place of a missing route
+         */
+        r = rtArtNewRoute(rtArtReplicaTable(prs, 0));
+        if ( r ) {
+            memset(r->dest, 0, alen / 8);
+            r->plen = 0;
+            *(u64*)rtArtRouteData(r) = 0;
+            if ( rtArtReplicasInsert(prs, r) != r ) {
+                rtArtReplicasFreeRoute(prs, r);
+            }
+        }
+        if ( (plen >= 0) && rtArtReplicasDelete(prs, dest, plen) ) {
+            fprintf(stderr, "ERROR: deleted a missing route\n");
+            ++nErrs;
+        }
+        rtArtReplicasSynchronize(prs);
+        nErrs += replicaCheck(prs, copied, ppDest, nAddrs);
+
+        rtArtReplicasGetStats(prs, &st);
+        printf("%s%s routes: %d replicas of %.1f MB subtables and "
+               "%.1f/%.1f MB routes, %.2f us/update",
+               (copied) ? ", " : "", (copied) ? "copied" : "shared",
+               st.nReplicas, st.bytes[0] / 1048576.0,
+               st.routeBytes[0] / 1048576.0, st.routeBytes[1] / 1048576.0,
+               st.tUpdate / st.nUpdates * 1e6);
+        if ( (st.bytes[0] != st.bytes[1]) ||
+             ((st.routeBytes[1] != 0) != copied) ) {
+            fprintf(stderr, "\nERROR: wrong memory of the replicas\n");
+            ++nErrs;
+        }
+
+        rtArtReplicasFree(prs);
+        free(ppDest);
+        free(pa);
+        free(pr);
+    }
+    printf("\n");
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d lookups or updates of the replicas "
+                "failed\n", nErrs);
+    }
+    return (nErrs == 0) ? true : false;
+}
+
+
+#define FEED_UPDATE_PFXS 64     /* prefixes of an UPDATE of feedTest() */
+
+/*
+ * Growing buffer of the MRT records of feedTest()
+ */
+typedef struct mrtBuf mrtBuf;
+struct mrtBuf {
+    u8*    p;
+    size_t n;                   /* bytes used */
+    size_t max;                 /* bytes allocated */
+};
+
+static void
+mrtPut (mrtBuf* pb, const void* p, size_t n)
+{
+    while ( pb->n + n > pb->max ) {
+        pb->max = (pb->max) ? pb->max * 2 : 1 << 16;
+        pb->p   = realloc(pb->p, pb->max);
+        if ( !pb->p ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+    }
+    memcpy(pb->p + pb->n, p, n);
+    pb->n += n;
+}
+
+static void
+mrtPut16 (mrtBuf* pb, u32 v)
+{
+    u8 b[2] = { v >> 8, v };
+    mrtPut(pb, b, 2);
+}
+
+static void
+mrtPut32 (mrtBuf* pb, u32 v)
+{
+    u8 b[4] = { v >> 24, v >> 16, v >> 8, v };
+    mrtPut(pb, b, 4);
+}
+
+/*
+ * Appends the header of an MRT record and returns its offset.
+ * The length is set by mrtEnd().
+ */
+static size_t
+mrtBegin (mrtBuf* pb, u32 type, u32 sub)
+{
+    size_t off = pb->n;
+
+    mrtPut32(pb, 0);            /* timestamp */
+    mrtPut16(pb, type);
+    mrtPut16(pb, sub);
+    mrtPut32(pb, 0);
+    return off;
+}
+
+static void
+mrtEnd (mrtBuf* pb, size_t off)
+{
+    u32 len = pb->n - off - 12;
+    u8* p   = pb->p + off + 8;
+
+    p[0] = len >> 24;
+    p[1] = len >> 16;
+    p[2] = len >> 8;
+    p[3] = len;
+}
+
+static void
+mrtPrefix (mrtBuf* pb, routeEnt* r)
+{
+    u8 plen = r->plen;
+
+    mrtPut(pb, &plen, 1);
+    mrtPut(pb, r->dest, (plen + 7) / 8);
+}
+
+/*
+ * Appends the TABLE_DUMP_V2 records of the routes `pr[0..n)' and a
+ * route of the other address family after a PEER_INDEX_TABLE.
+ */
+static void
+mrtRib (mrtBuf* pb, int alen, routeEnt** pr, int n)
+{
+    static const u8 peer[] = { 0, 10, 0, 0, 1, 10, 0, 0, 1, 0x80, 0 };
+    static const u8 origin[] = { 0x40, 1, 1, 0 };   /* ORIGIN IGP */
+    routeEnt other;
+    size_t   off;
+    int      i;
+
+
+    off = mrtBegin(pb, 13, 1);                      /* PEER_INDEX_TABLE */
+    mrtPut32(pb, 0x0a000001);
+    mrtPut16(pb, 0);
+    mrtPut16(pb, 1);
+    mrtPut(pb, peer, sizeof(peer));
+    mrtEnd(pb, off);
+
+    memset(&other, 0, sizeof(other));
+    other.dest[0] = 0x20;
+    other.plen    = 8;
+    for ( i = -1; i < n; ++i ) {
+        off = mrtBegin(pb, 13, ((alen == 32) != (i < 0)) ? 2 : 4);
+        mrtPut32(pb, i);                            /* sequence number */
+        mrtPrefix(pb, (i < 0) ? &other : pr[i]);
+        mrtPut16(pb, 1);                            /* entry count */
+        mrtPut16(pb, 0);                            /* peer index */
+        mrtPut32(pb, 0);                            /* originated time */
+        mrtPut16(pb, sizeof(origin));
+        mrtPut(pb, origin, sizeof(origin));
+        mrtEnd(pb, off);
+    }
+}
+
+/*
+ * Appends a BGP4MP_MESSAGE_AS4 UPDATE that withdraws (`add' is
+ * false) or announces the routes `pr[0..n)' with an ORIGIN attribute
+ * (and a MULTI_EXIT_DISC if `med' is true). IPv6 prefixes are in an
+ * MP_UNREACH_NLRI or MP_REACH_NLRI attribute.
+ */
+static void
+mrtUpdate (mrtBuf* pb, int alen, routeEnt** pr, int n, boolean add,
+           boolean med)
+{
+    static const u8 attr[] = { 0x40, 1, 1, 0, 0x80, 4, 4, 0, 0, 0, 100 };
+    mrtBuf m;
+    size_t off, al;
+    u8     hdr[16];
+    int    i;
+
+
+    al = (med) ? sizeof(attr) : 4;
+    memset(&m, 0, sizeof(m));
+    for ( i = 0; i < n; ++i ) {
+        mrtPrefix(&m, pr[i]);
+    }
+
+    off = mrtBegin(pb, 16, 4);
+    mrtPut32(pb, 65001);                            /* peer AS */
+    mrtPut32(pb, 65000);                            /* local AS */
+    mrtPut16(pb, 0);                                /* interface */
+    mrtPut16(pb, 1);                                /* AFI IPv4 */
+    mrtPut32(pb, 0x0a000002);
+    mrtPut32(pb, 0x0a000001);
+    memset(hdr, 0xff, sizeof(hdr));
+    mrtPut(pb, hdr, sizeof(hdr));                   /* marker */
+    if ( alen == 32 ) {
+        mrtPut16(pb, 19 + 4 + ((add) ? al : 0) + m.n);
+        mrtPut(pb, "\2", 1);
+        mrtPut16(pb, (add) ? 0 : m.n);
+        if ( !add ) {
+            mrtPut(pb, m.p, m.n);
+        }
+        mrtPut16(pb, (add) ? al : 0);
+        if ( add ) {
+            mrtPut(pb, attr, al);
+            mrtPut(pb, m.p, m.n);
+        }
+    } else if ( add ) {
+        mrtPut16(pb, 19 + 4 + al + 4 + 21 + m.n);
+        mrtPut(pb, "\2", 1);
+        mrtPut16(pb, 0);
+        mrtPut16(pb, al + 4 + 21 + m.n);
+        mrtPut(pb, attr, al);
+        mrtPut(pb, "\x90\x0e", 2);                   /* MP_REACH_NLRI */
+        mrtPut16(pb, 21 + m.n);
+        mrtPut16(pb, 2);                            /* AFI IPv6 */
+        mrtPut(pb, "\1\x10", 2);                     /* SAFI, next hop */
+        memset(hdr, 0, sizeof(hdr));
+        mrtPut(pb, hdr, sizeof(hdr));
+        mrtPut(pb, "", 1);                          /* reserved */
+        mrtPut(pb, m.p, m.n);
+    } else {
+        mrtPut16(pb, 19 + 4 + 4 + 3 + m.n);
+        mrtPut(pb, "\2", 1);
+        mrtPut16(pb, 0);
+        mrtPut16(pb, 4 + 3 + m.n);
+        mrtPut(pb, "\x90\x0f", 2);                   /* MP_UNREACH_NLRI */
+        mrtPut16(pb, 3 + m.n);
+        mrtPut16(pb, 2);
+        mrtPut(pb, "\1", 1);
+        mrtPut(pb, m.p, m.n);
+    }
+    mrtEnd(pb, off);
+    free(m.p);
+}
+
+/*
+ * Callback of rtArtFeedLoad() in feedTest(). The user data is the
+ * number of the bytes of the path attributes.
+ */
+static void
+feedRoute (routeEnt* r, const rtArtFeedRec* pRec, void* p2)
+{
+    *(u64*)rtArtRouteData(r) = (pRec->pAttr) ? pRec->attrLen : 0;
+}
+
+/*
+ * Returns the number of the test addresses for which `pt' and the
+ * reference table `pr' return different routes or `pt' returns a
+ * route without the path attributes.
+ */
+static int
+feedCheck (rtTable* pt, rtTable* pr, u8* pa, int n)
+{
+    routeEnt* r0;
+    routeEnt* r;
+    int i, nErrs;
+
+
+    for ( i = nErrs = 0; i < n; ++i ) {
+        r0 = pr->findMatch(pr, pa + i * pt->len);
+        r  = pt->findMatch(pt, pa + i * pt->len);
+        if ( !r0 || !r ) {
+            nErrs += (!r0 != !r) ? 1 : 0;
+        } else if ( (r->plen != r0->plen) ||
+                    memcmp(r->dest, r0->dest, pt->len) ||
+                    (*(u64*)rtArtRouteData(r) == 0) ) {
+            ++nErrs;
+        }
+    }
+    return nErrs;
+}
+
+/*
+ * Writes the test routes as an MRT TABLE_DUMP_V2 file and loads it
+ * with the parser thread into an empty table by the bulk load, then
+ * applies BGP UPDATE records that withdraw every other route and
+ * announce a quarter of them again and a third of the others
+ * (replacements). The tables are checked against one built by
+ * pt->insert() and pt->delete(), and the path attributes of a route
+ * announced, withdrawn and announced again in a block.
+ */
+boolean
+feedTest (int alen, trieType type, char* sl, int nLevels)
+{
+    struct timespec ts;
+    rtArtOpts  opts = { artOptRouteArena, NULL, sizeof(u64) };
+    rtArtFeedStats st[3];
+    rtArtFeed* pf;
+    rtTable*   pt;
+    rtTable*   pref;
+    routeEnt** pr;
+    routeEnt** pu;
+    routeEnt*  r;
+    mrtBuf     rib, upd;
+    char       path[64];
+    FILE*      fp;
+    u8*        pa;
+    double     tText;
+    u64        d = 0;
+    int        i, m, n, nAddrs, nErrs;
+
+
+    pt   = rtArtInitOpts(nLevels, (s8*)sl, alen, type, &opts);
+    pref = rtArtInitOpts(nLevels, (s8*)sl, alen, type, &opts);
+    if ( !pt || !pref ) {
+        fprintf(stderr, "ERROR: failed to create a routing table.\n");
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    mkRtTbl(pref);
+    tText = elapsed(&ts);
+    pref->flush(pref);
+
+    n  = loadRoutes(pref, &pr);
+    pu = malloc(n * sizeof(*pu));
+    if ( !pu ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    memset(&rib, 0, sizeof(rib));
+    memset(&upd, 0, sizeof(upd));
+    mrtRib(&rib, alen, pr, n);
+    for ( i = m = 0; i < n; i += 2 ) {
+        pu[m++] = pr[i];
+        if ( (m == FEED_UPDATE_PFXS) || (i + 2 >= n) ) {
+            mrtUpdate(&upd, alen, pu, m, false, false);
+            m = 0;
+        }
+    }
+    for ( i = m = 0; i < n; ++i ) {
+        if ( ((i & 3) == 0) || ((i & 1) && (i % 3 == 0)) ) {
+            pu[m++] = pr[i];
+        }
+        if ( m && ((m == FEED_UPDATE_PFXS) || (i + 1 >= n)) ) {
+            mrtUpdate(&upd, alen, pu, m, true, false);
+            m = 0;
+        }
+    }
+
+    /*
+     * The reference table
+     */
+    for ( i = 0; i < n; ++i ) {
+        *(u64*)rtArtRouteData(pr[i]) = 1;
+        if ( pref->insert(pref, pr[i]) != pr[i] ) {
+            rtArtFreeRoute(pref, pr[i]);            /* duplicate */
+            pr[i] = NULL;
+        }
+    }
+    for ( i = 0; i < n; i += 2 ) {
+        if ( pr[i] && (i & 3) ) {
+            pref->delete(pref, pr[i]->dest, pr[i]->plen);
+        }
+    }
+
+    nErrs = 0;
+    snprintf(path, sizeof(path), "/tmp/rtLookup-%d.mrt", (int)getpid());
+    fp = fopen(path, "w");
+    if ( !fp || (fwrite(rib.p, 1, rib.n, fp) != rib.n) || fclose(fp) ) {
+        fprintf(stderr, "ERROR: failed to write %s\n", path);
+        return false;
+    }
+    pf = rtArtFeedOpen(path);
+    if ( !pf ) {
+        fprintf(stderr, "ERROR: failed to open %s\n", path);
+        return false;
+    }
+    m = rtArtFeedLoad(pt, pf, artFeedBulk | artFeedThreaded, feedRoute,
+                      NULL, &st[0]);
+    rtArtFeedClose(pf);
+    unlink(path);
+    if ( (m != pt->nRoutes) || (st[0].nSkipped != 2) ) {
+        fprintf(stderr, "ERROR: %d of %d routes loaded, %llu prefixes "
+                "skipped\n", m, pt->nRoutes,
+                (unsigned long long)st[0].nSkipped);
+        ++nErrs;
+    }
+
+    pf = rtArtFeedOpenMem(upd.p, upd.n);
+    if ( !pf ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    rtArtFeedLoad(pt, pf, artFeedThreaded, feedRoute, NULL, &st[1]);
+    rtArtFeedClose(pf);
+
+    nAddrs = loadAddrs(pt, &pa);
+    nErrs += feedCheck(pt, pref, pa, nAddrs);
+    if ( pt->nRoutes != pref->nRoutes ) {
+        fprintf(stderr, "ERROR: %d routes after the updates. %d expected\n",
+                pt->nRoutes, pref->nRoutes);
+        ++nErrs;
+    }
+
+    /*
+     * An announcement, a withdrawal and an announcement with a MED of
+     * a prefix in the table in one block leave the route of the last
+     * announcement (7 bytes more path attributes than the first)
+     */
+    for ( i = 0; (i < n) && (!pr[i] || (i & 3)); ++i ) ;
+    for ( m = 0; (i < n) && (m < 2); ++m ) {
+        upd.n = 0;
+        mrtUpdate(&upd, alen, &pr[i], 1, true, false);
+        if ( m ) {
+            mrtUpdate(&upd, alen, &pr[i], 1, false, false);
+            mrtUpdate(&upd, alen, &pr[i], 1, true, true);
+        }
+        pf = rtArtFeedOpenMem(upd.p, upd.n);
+        if ( !pf ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+        rtArtFeedLoad(pt, pf, 0, feedRoute, NULL, &st[2]);
+        rtArtFeedClose(pf);
+        r = pt->findExactMatch(pt, pr[i]->dest, pr[i]->plen);
+        if ( m == 0 ) {
+            d = (r && (r->plen == pr[i]->plen))
+                ? *(u64*)rtArtRouteData(r) : 0;
+            continue;
+        }
+        if ( !d || !r || (r->plen != pr[i]->plen) ||
+             (*(u64*)rtArtRouteData(r) != d + 7) ||
+             (pt->nRoutes != pref->nRoutes) ) {
+            fprintf(stderr, "ERROR: the route has %llu bytes of path "
+                    "attributes after the updates. %llu expected\n",
+                    (r) ? (unsigned long long)*(u64*)rtArtRouteData(r) : 0,
+                    (unsigned long long)d + 7);
+            ++nErrs;
+        }
+    }
+
+    printf("%llu routes in %.3fs (parse %.3fs, insert %.3fs; text %.3fs), "
+           "%llu updates in %.3fs (%llu withdrawn, %llu replaced)\n",
+           (unsigned long long)st[0].nAdded, st[0].tTotal, st[0].tParse,
+           st[0].tApply, tText,
+           (unsigned long long)(st[1].nAdded + st[1].nReplaced +
+                                st[1].nWithdrawn), st[1].tTotal,
+           (unsigned long long)st[1].nWithdrawn,
+           (unsigned long long)st[1].nReplaced);
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d lookups of the fed table failed\n",
+                nErrs);
+    }
+
+    pt->deleteTable(&pt);
+    pref->deleteTable(&pref);
+    free(rib.p);
+    free(upd.p);
+    free(pu);
+    free(pr);
+    free(pa);
+    return (nErrs == 0) ? true : false;
+}
+
+
+#define N_SHARDS 4              /* writers of rtArtApplyUpdatesSharded() */
+#define STALE_WAIT 0.01         /* seconds cacheThread() waits for `gen' */
+
+/*
+ * Cache reader of shardTest(). The cached route of an address must
+ * be the route the trie returns as long as the generation of the
+ * table stays the same. If they differ, a writer may be in the
+ * middle of an update, so the generation must advance within
+ * STALE_WAIT seconds. Otherwise the cache returned a stale route.
+ */
+static void*
+cacheThread (void* p)
+{
+    struct timespec ts;
+    readerArg*   pa = p;
+    rtTable*     pt = pa->pt;
+    rtArtReader* pr;
+    rtArtCache*  pc;
+    routeEnt*    c;
+    routeEnt*    r;
+    u64 gen;
+    int i;
+
+
+    pr = rtArtRegisterReader(pt);
+    pc = rtArtCacheNew(pt, CACHE_SIZE);
+    if ( !pr || !pc ) {
+        ++pa->nErrs;
+        goto Done;
+    }
+    while ( !*pa->pStop ) {
+        for ( i = 0; (i < pa->n) && !*pa->pStop; ++i ) {
+            rtArtReadLock(pr);
+            gen = __atomic_load_n(&pt->gen, __ATOMIC_ACQUIRE);
+            c   = rtArtCacheFindMatch(pc, pa->ppDest[i]);
+            r   = pt->findMatch(pt, pa->ppDest[i]);
+            rtArtReadUnlock(pr);
+            pa->nLookups++;
+            if ( c == r ) continue;
+
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            while ( __atomic_load_n(&pt->gen, __ATOMIC_ACQUIRE) == gen ) {
+                if ( elapsed(&ts) > STALE_WAIT ) {
+                    ++pa->nErrs;
+                    break;
+                }
+                sched_yield();
+            }
+        }
+    }
+
+Done:
+    rtArtCacheFree(pc);
+    if ( pr ) rtArtUnregisterReader(pr);
+    return NULL;
+}
+
+/*
+ * Applies the batch of updateTest() to two tables with lock-free
+ * readers by rtArtApplyUpdates() and by rtArtApplyUpdatesSharded()
+ * while N_READERS threads and a cache reader keep looking up the
+ * latter, checks the both tables return the same routes and have
+ * the same subtables, and reports the time of each.
+ */
+boolean
+shardTest (int alen, trieType type, char* sl, int nLevels)
+{
+    rtArtOpts  opts = { artOptConcurrent | artOptSlab | artOptRouteArena,
+                        NULL, sizeof(u64) };
+    rtArtUpdateStats us[2];
+    rtArtUpdateOp*   pu[2];
+    readerArg  arg[N_READERS + 1];
+    pthread_t  tid[N_READERS + 1];
+    rtTable*   pt[2];
+    routeEnt** pr[2];
+    routeEnt*  r;
+    u8**       ppDest;
+    u8*        pd;
+    u8*        pa;
+    volatile int stop;
+    int        i, j, k, l, n, h, m, nAddrs, nOps, nErrs;
+
+
+    nErrs = 0;
+    for ( k = 0; k < 2; ++k ) {
+        pt[k] = rtArtInitOpts(nLevels, (s8*)sl, alen, type, &opts);
+        if ( !pt[k] ) {
+            fprintf(stderr, "ERROR: failed to create a routing table.\n");
+            return false;
+        }
+        n = loadRoutes(pt[k], &pr[k]);
+        for ( i = 0; i < n; ++i ) {
+            *(u64*)rtArtRouteData(pr[k][i]) = pr[k][i]->plen;
+        }
+        h = n / 2;
+        m = rtArtInsertRoutes(pt[k], pr[k], h);
+        for ( i = m; i < h; ++i ) {
+            rtArtFreeRoute(pt[k], pr[k][i]);
+        }
+    }
+    pd = malloc(n * 16);
+    for ( k = 0; k < 2; ++k ) {
+        pu[k] = malloc((n + n / 4 + m / 6 + 2) * sizeof(rtArtUpdateOp));
+        if ( !pd || !pu[k] ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+    }
+    for ( i = 0; i < n; ++i ) {
+        memcpy(pd + i * 16, pr[0][i]->dest, 16);
+    }
+    for ( k = 0; k < 2; ++k ) {
+        j = 0;
+        for ( i = 0; i < m; ++i ) {
+            if ( (i % 3) != 0 ) continue;
+            pu[k][j].op    = artUpdWithdraw;
+            pu[k][j].pDest = pd + i * 16;
+            pu[k][j++].plen = pr[k][i]->plen;
+            if ( (i % 6) != 0 ) continue;
+            r = rtArtNewRoute(pt[k]);
+            memcpy(r->dest, pr[k][i]->dest, pt[k]->len);
+            r->plen = pr[k][i]->plen;
+            *(u64*)rtArtRouteData(r) = r->plen;
+            pu[k][j].op  = artUpdAdd;
+            pu[k][j++].r = r;
+        }
+        for ( i = h; i < n; ++i ) {
+            pu[k][j].op  = artUpdAdd;
+            pu[k][j++].r = pr[k][i];
+            if ( (i % 4) != 0 ) continue;
+            pu[k][j].op    = artUpdWithdraw;
+            pu[k][j].pDest = pd + i * 16;
+            pu[k][j++].plen = pr[k][i]->plen;
+        }
+        nOps = j;
+    }
+
+    nAddrs = loadAddrs(pt[0], &pa);
+    ppDest = calloc(nAddrs, sizeof(*ppDest));
+    if ( !ppDest ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < nAddrs; ++i ) {
+        ppDest[i] = pa + i * pt[1]->len;
+    }
+    stop = 0;
+    for ( i = 0; i <= N_READERS; ++i ) {
+        memset(&arg[i], 0, sizeof(arg[i]));
+        arg[i].pt     = pt[1];
+        arg[i].ppDest = ppDest;
+        arg[i].n      = nAddrs;
+        arg[i].pStop  = &stop;
+        if ( pthread_create(&tid[i], NULL,
+                            (i < N_READERS) ? lookupThread : cacheThread,
+                            &arg[i]) ) {
+            fprintf(stderr, "Error: pthread_create()\n");
+            exit(1);
+        }
+    }
+
+    i = rtArtApplyUpdates(pt[0], pu[0], nOps, &us[0]);
+    j = rtArtApplyUpdatesSharded(pt[1], pu[1], nOps, N_SHARDS, &us[1]);
+
+    stop = 1;
+    for ( k = 0; k < N_READERS; ++k ) {
+        pthread_join(tid[k], NULL);
+        nErrs += arg[k].nErrs;
+    }
+    if ( nErrs ) {
+        fprintf(stderr, "ERROR: %d lookups returned a wrong route\n", nErrs);
+    }
+    pthread_join(tid[N_READERS], NULL);
+    if ( arg[N_READERS].nErrs ) {
+        fprintf(stderr, "ERROR: the cache returned %llu stale routes\n",
+                (unsigned long long)arg[N_READERS].nErrs);
+        nErrs += arg[N_READERS].nErrs;
+    }
+    for ( k = 0; k < 2; ++k ) {
+        rtArtSynchronize(pt[k]);    /* free the retired subtables */
+    }
+    if ( us[1].nShards ) {
+        printf("%d operations: 1 writer %.3fs, sharded %.3fs "
+               "(%u writers, %u operations in the root)\n", nOps,
+               us[0].tApply, us[1].tApply, us[1].nShards, us[1].nSerial);
+    } else {
+        printf("%d operations: 1 writer %.3fs, %.3fs "
+               "(not sharded: fell back to 1 writer)\n", nOps,
+               us[0].tApply, us[1].tApply);
+    }
+    if ( i != j ) {
+        fprintf(stderr, "ERROR: %d and %d operations were applied.\n", i, j);
+        ++nErrs;
+    }
+    for ( j = 0; j < nOps; ++j ) {
+        if ( pu[0][j].rc != pu[1][j].rc ) {
+            ++nErrs;
+        }
+        for ( k = 0; k < 2; ++k ) {
+            if ( (pu[k][j].op == artUpdAdd) && (pu[k][j].rc != artUpdDone) ) {
+                rtArtFreeRoute(pt[k], pu[k][j].r);
+            }
+        }
+    }
+    if ( pt[0]->nRoutes != pt[1]->nRoutes ) {
+        fprintf(stderr, "ERROR: %d routes were updated by 1 writer. "
+                "%d were updated by %u writers.\n",
+                pt[0]->nRoutes, pt[1]->nRoutes,
+                (us[1].nShards) ? us[1].nShards : 1);
+        ++nErrs;
+    }
+    for ( l = 0; l < nLevels; ++l ) {
+        if ( (pt[0]->pLvStats[l].nSubtables != pt[1]->pLvStats[l].nSubtables) ||
+             (pt[0]->pLvStats[l].nRoutes != pt[1]->pLvStats[l].nRoutes) ) {
+            fprintf(stderr, "ERROR: level %d has different subtables or "
+                    "routes\n", l);
+            ++nErrs;
+        }
+    }
+    if ( pt[0]->nSubtablesFreed != pt[1]->nSubtablesFreed ) {
+        fprintf(stderr, "ERROR: %u and %u subtables were freed.\n",
+                pt[0]->nSubtablesFreed, pt[1]->nSubtablesFreed);
+        ++nErrs;
+    }
+    i = cmpLookups(pt[0], pt[1], pa, nAddrs);
+    if ( i ) {
+        fprintf(stderr, "ERROR: %d lookups differ\n", i);
+        nErrs += i;
+    }
+
+    for ( k = 0; k < 2; ++k ) {
+        pt[k]->flush(pt[k]);
+        if ( pt[k]->nRoutes != 0 ) {
+            fprintf(stderr, "ERROR: %d routes were left.\n", pt[k]->nRoutes);
+            ++nErrs;
+        }
+        pt[k]->deleteTable(&pt[k]);
+        free(pu[k]);
+        free(pr[k]);
+    }
+    free(ppDest);
+    free(pd);
+    free(pa);
+    return (nErrs == 0) ? true : false;
+}
@@ -0,0 +1,1172 @@
+/** @file rtBench.c
+    @brif Lookup throughput and update latency benchmark
+
+
+   ART: Allotment Routing Table
+
+   Copyright (c) 2001-2016
+   Yoichi Hariguchi. All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+   Usage: rtBench <4|6> [simple|pc|compact|all] [-t threads] [-n lookups]
+                  [-c ops/s [-b batch] [-w writers]] [stride lengths]
+
+   The prefixes in data/ and the destination addresses are converted
+   to binary before anything is timed. For each trie type and stride
+   length distribution, rtBench reports
+
+     o the latency of each insertion and deletion (percentiles and
+       a histogram),
+     o the lookup rate of pt->findMatch() and pt->findMatchBatch()
+       and the latency of each lookup for the following traffic:
+         uniform  a prefix is chosen uniformly at random
+         zipf     a prefix is chosen by Zipf's law (s = 1) so that
+                  a few prefixes get most of the traffic
+         random   random addresses (IPv4 only)
+       The host bits of the address are random.
+     o the lookup rate of 1, 2, 4, ... threads (uniform traffic).
+
+   Without stride lengths, IPv6 is also run with the stride lengths
+   split at /64 by rtArtTuneStrides6() within BENCH_V6_BUDGET bytes.
+
+   With -c, rtBench replays route churn instead: half of the
+   prefixes are loaded into a table with lock-free readers, then the
+   writer adds the rest in the order of v4routes-random1.txt, each
+   followed by the withdrawal of the next prefix in the table in the
+   order of v4routes-random3.txt (v6routes-random2.txt for IPv6), at
+   `ops/s' (0: as fast as it can). `-b' applies the trace in batches
+   of rtArtApplyUpdates() (rtArtApplyUpdatesSharded() of `-w'
+   writers). Meanwhile `threads' readers look up the uniform traffic.
+   rtBench reports
+
+     o the lookup rate and the sampled lookup latency of the readers
+       before (quiet) and during the churn,
+     o the latency of each update (or batch) and the writer rate,
+     o the subtables allocated and freed per second, and the peak
+       memory of the subtables and the routes, and of the process.
+*/
+
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ipArt.h"
+
+
+#define BENCH_LOOKUPS   (1 << 21)   /* addresses of each traffic */
+#define BENCH_BATCH     64          /* addresses of a batch lookup */
+#define BENCH_THREADS   8           /* max threads by default */
+#define BENCH_V6_BUDGET (64 << 20)  /* memory of rtArtTuneStrides6() */
+#define CHURN_QUIET     0.5         /* seconds of lookups before churn */
+#define CHURN_SAMPLES   (1 << 20)   /* max latency samples of a reader */
+#define CHURN_MEM_EVERY 4096        /* operations between memory samples */
+
+typedef struct prefix prefix;
+struct prefix {
+    u8  dest[16];
+    int plen;
+};
+
+typedef struct traffic traffic;
+struct traffic {
+    const char* name;
+    u8*  pa;                    /* addresses */
+    u8** ppDest;                /* pointers to the addresses */
+};
+
+typedef struct churnOp churnOp;
+struct churnOp {
+    int  i;                     /* index of the prefix */
+    bool add;                   /* true: add, false: withdraw */
+};
+
+typedef struct churnKey churnKey;
+struct churnKey {
+    prefix p;
+    int    i;                   /* index of `p' */
+};
+
+typedef struct churnReader churnReader;
+struct churnReader {
+    rtTable*  pt;
+    traffic*  ptr;
+    int       n;                /* # of addresses */
+    volatile int* pStop;        /* stop if nonzero */
+    u64       nLookups;
+    u64       sum;              /* keeps the lookups */
+    u32*      pl;               /* sampled latencies in ns */
+    int       nl;               /* # of samples in `pl' */
+};
+
+typedef struct benchThread benchThread;
+struct benchThread {
+    rtTable* pt;
+    u8**     ppDest;
+    int      n;
+    double   t;                 /* elapsed time */
+    u64      sum;               /* keeps the lookups */
+};
+
+
+static const char* TypeName[] = { "simple", "pc", "compact" };
+static u64 Seed = 0x2545f4914f6cdd1dULL;
+static volatile u64 Sink;
+static double TimerOverhead;    /* ns of clock_gettime() */
+static double ChurnRate = -1;   /* ops/s of the churn. <0: no churn */
+static int    ChurnBatch = 1;   /* operations of a batch update */
+static int    ChurnWriters = 1; /* writers of a batch update */
+static prefix* ChurnPfx;        /* prefixes in the withdrawal order */
+static int    ChurnNumPfx;
+
+
+/*
+ * xorshift64*
+ */
+static inline u64
+rnd (void)
+{
+    Seed ^= Seed >> 12;
+    Seed ^= Seed << 25;
+    Seed ^= Seed >> 27;
+    return Seed * 0x2545f4914f6cdd1dULL;
+}
+
+
+static inline double
+elapsed (struct timespec* ts)
+{
+    struct timespec te;
+
+    clock_gettime(CLOCK_MONOTONIC, &te);
+    return (te.tv_sec - ts->tv_sec) + (te.tv_nsec - ts->tv_nsec) * 1e-9;
+}
+
+
+static inline u64
+nsec (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static int
+cmpU32 (const void* p1, const void* p2)
+{
+    u32 a = *(const u32*)p1;
+    u32 b = *(const u32*)p2;
+
+    return (a < b) ? -1 : (a > b);
+}
+
+
+/*
+ * Loads the prefixes of data/v<4|6>routes-`name'.txt in binary
+ */
+static int
+loadPrefixes (int alen, const char* name, prefix** pp)
+{
+    FILE*   fp;
+    prefix* p;
+    char    buf[128];
+    char*   s;
+    int     af, n, max;
+
+
+    af = (alen == 32) ? AF_INET : AF_INET6;
+    snprintf(buf, sizeof(buf), "data/v%droutes-%s.txt",
+             (alen == 32) ? 4 : 6, name);
+    if ( (fp = fopen(buf, "r")) == NULL ) {
+        fprintf(stderr, "No such file: %s\n", buf);
+        exit(1);
+    }
+    n   = 0;
+    max = 1 << 16;
+    p   = malloc(max * sizeof(prefix));
+    while ( p && fgets(buf, sizeof(buf), fp) ) {
+        s = index(buf, '/');
+        if ( !s ) {
+            continue;
+        }
+        *s = '\0';
+        if ( n == max ) {
+            max <<= 1;
+            p = realloc(p, max * sizeof(prefix));
+            if ( !p ) {
+                break;
+            }
+        }
+        memset(p[n].dest, 0, sizeof(p[n].dest));
+        if ( inet_pton(af, buf, p[n].dest) != 1 ) {
+            continue;
+        }
+        p[n++].plen = strtol(s+1, NULL, 10);
+    }
+    fclose(fp);
+    if ( !p ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    *pp = p;
+    return n;
+}
+
+
+/*
+ * Stores an address of prefix `pp' with random host bits to `pa'
+ */
+static void
+hostAddr (prefix* pp, u8* pa, int len)
+{
+    int i, b;
+
+    for ( i = 0; i < len; ++i ) {
+        b = pp->plen - (i << 3);        /* prefix bits in this byte */
+        if ( b >= 8 ) {
+            pa[i] = pp->dest[i];
+        } else if ( b <= 0 ) {
+            pa[i] = rnd();
+        } else {
+            pa[i] = (pp->dest[i] & (0xff << (8 - b))) |
+                (rnd() & (0xff >> b));
+        }
+    }
+}
+
+
+/*
+ * Makes `n' destination addresses of traffic `name'
+ */
+static void
+mkTraffic (traffic* ptr, const char* name, prefix* pPfx, int nPfx,
+           int len, int n)
+{
+    double* cdf = NULL;
+    double  x, sum;
+    int     i, lo, hi, mid;
+
+
+    ptr->name   = name;
+    ptr->pa     = malloc((size_t)n * len);
+    ptr->ppDest = malloc(n * sizeof(u8*));
+    if ( !ptr->pa || !ptr->ppDest ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    if ( strcmp(name, "zipf") == 0 ) {
+        cdf = malloc(nPfx * sizeof(double));
+        if ( !cdf ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+        for ( sum = 0, i = 0; i < nPfx; ++i ) {
+            sum += 1.0 / (i + 1);
+            cdf[i] = sum;
+        }
+    }
+    for ( i = 0; i < n; ++i ) {
+        ptr->ppDest[i] = ptr->pa + (size_t)i * len;
+        if ( strcmp(name, "random") == 0 ) {
+            hostAddr(&(prefix){ .plen = 0 }, ptr->ppDest[i], len);
+        } else if ( cdf ) {
+            x  = (rnd() >> 11) * (1.0 / 9007199254740992.0) * sum;
+            lo = 0;
+            hi = nPfx - 1;
+            while ( lo < hi ) {
+                mid = (lo + hi) >> 1;
+                if ( cdf[mid] < x ) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            hostAddr(&pPfx[lo], ptr->ppDest[i], len);
+        } else {
+            hostAddr(&pPfx[rnd() % nPfx], ptr->ppDest[i], len);
+        }
+    }
+    free(cdf);
+}
+
+
+/*
+ * Prints the percentiles of `n' latencies in ns. The latencies are
+ * sorted.
+ */
+static void
+prPercentiles (u32* pl, int n)
+{
+    qsort(pl, n, sizeof(u32), cmpU32);
+    printf("p50 %u p90 %u p99 %u p99.9 %u max %u ns",
+           pl[n / 2], pl[(int)(n * 0.9)], pl[(int)(n * 0.99)],
+           pl[(int)(n * 0.999)], pl[n - 1]);
+}
+
+
+/*
+ * Prints the histogram of `n' sorted latencies in power-of-2 ns
+ * buckets. The slowest 0.1% are put into the last bucket.
+ */
+static void
+prHistogram (u32* pl, int n)
+{
+    u32 b;
+    int i, j;
+
+    printf("          ");
+    for ( i = 0, b = 32; i < n - n / 1000; b <<= 1 ) {
+        for ( j = i; (j < n) && (pl[j] < b); ++j ) ;
+        if ( j > i ) {
+            printf(" <%u:%.1f%%", b, (j - i) * 100.0 / n);
+        }
+        i = j;
+    }
+    if ( i < n ) {
+        printf(" >=%u:%.1f%%", b >> 1, (n - i) * 100.0 / n);
+    }
+    printf("\n");
+}
+
+
+static void
+prLatency (const char* name, u32* pl, int n, double total)
+{
+    printf("  %-8s ", name);
+    prPercentiles(pl, n);
+    printf(" (%.2fs)\n", total);
+    prHistogram(pl, n);
+}
+
+
+/*
+ * Measures the overhead of reading the clock
+ */
+static void
+calibrate (void)
+{
+    u32 d[1001];
+    u64 t0, t1;
+    int i;
+
+    for ( i = 0; i < 1001; ++i ) {
+        t0 = nsec();
+        t1 = nsec();
+        d[i] = t1 - t0;
+    }
+    qsort(d, 1001, sizeof(u32), cmpU32);
+    TimerOverhead = d[500];
+}
+
+
+/*
+ * Lookup rate (scalar and batch) and the latency of each lookup
+ */
+static void
+benchLookups (rtTable* pt, traffic* ptr, int n)
+{
+    struct timespec ts;
+    routeEnt* pRes[BENCH_BATCH];
+    u32*   pl;
+    u64    sum, t0, d;
+    double t1, t2;
+    int    i, j;
+
+
+    sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < n; ++i ) {
+        sum += (size_t)pt->findMatch(pt, ptr->ppDest[i]);
+    }
+    t1 = elapsed(&ts);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < n; i += BENCH_BATCH ) {
+        j = ((n - i) < BENCH_BATCH) ? (n - i) : BENCH_BATCH;
+        pt->findMatchBatch(pt, ptr->ppDest + i, pRes, j);
+        sum += (size_t)pRes[0];
+    }
+    t2 = elapsed(&ts);
+
+    pl = malloc(n * sizeof(u32));
+    if ( !pl ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < n; ++i ) {
+        t0 = nsec();
+        sum += (size_t)pt->findMatch(pt, ptr->ppDest[i]);
+        d = nsec() - t0;
+        pl[i] = (d > TimerOverhead) ? d - TimerOverhead : 0;
+    }
+    Sink = sum;
+
+    printf("  %-8s %.2f Mlookups/s (scalar), %.2f Mlookups/s (batch), ",
+           ptr->name, n / t1 * 1e-6, n / t2 * 1e-6);
+    prPercentiles(pl, n);
+    printf("\n");
+    free(pl);
+}
+
+
+static void*
+lookupThread (void* p)
+{
+    benchThread* pb = p;
+    struct timespec ts;
+    rtTable* pt = pb->pt;
+    u64 sum = 0;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for ( i = 0; i < pb->n; ++i ) {
+        sum += (size_t)pt->findMatch(pt, pb->ppDest[i]);
+    }
+    pb->t   = elapsed(&ts);
+    pb->sum = sum;
+    return NULL;
+}
+
+
+/*
+ * Aggregate lookup rate of 1, 2, 4, ... `maxThreads' threads.
+ * Each thread looks up all the addresses of `ptr'.
+ */
+static void
+benchThreads (rtTable* pt, traffic* ptr, int n, int maxThreads)
+{
+    benchThread* pb;
+    pthread_t*   pth;
+    double t;
+    int    i, m;
+
+
+    pb  = calloc(maxThreads, sizeof(benchThread));
+    pth = calloc(maxThreads, sizeof(pthread_t));
+    if ( !pb || !pth ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    printf("  threads ");
+    for ( m = 1; ; m <<= 1 ) {
+        if ( m > maxThreads ) {
+            if ( (m >> 1) == maxThreads ) {
+                break;
+            }
+            m = maxThreads;
+        }
+        for ( i = 0; i < m; ++i ) {
+            pb[i].pt     = pt;
+            pb[i].ppDest = ptr->ppDest;
+            pb[i].n      = n;
+            if ( pthread_create(&pth[i], NULL, lookupThread, &pb[i]) ) {
+                fprintf(stderr, "Error: pthread_create()\n");
+                exit(1);
+            }
+        }
+        for ( i = 0, t = 0; i < m; ++i ) {
+            pthread_join(pth[i], NULL);
+            t += n / pb[i].t;
+            Sink += pb[i].sum;
+        }
+        printf(" %d: %.2f", m, t * 1e-6);
+        if ( m == maxThreads ) {
+            break;
+        }
+    }
+    printf(" Mlookups/s (%s)\n", ptr->name);
+    free(pth);
+    free(pb);
+}
+
+
+/*
+ * Reader thread of churn(). Times every `every'-th lookup. When `pl'
+ * is full, every other sample is dropped and `every' is doubled so
+ * that the samples cover the whole run.
+ */
+static void*
+churnReaderMain (void* p)
+{
+    churnReader* pc = p;
+    rtTable*     pt = pc->pt;
+    rtArtReader* pr;
+    u64 sum, t0, d;
+    int i, j, m, every;
+
+
+    pr = rtArtRegisterReader(pt);
+    if ( !pr ) {
+        fprintf(stderr, "Error: rtArtRegisterReader()\n");
+        exit(1);
+    }
+    sum   = 0;
+    every = 64;
+    while ( !*pc->pStop ) {
+        for ( i = 0; (i < pc->n) && !*pc->pStop; i += m ) {
+            m = ((pc->n - i) < BENCH_BATCH) ? (pc->n - i) : BENCH_BATCH;
+            rtArtReadLock(pr);
+            for ( j = i; j < i + m; ++j ) {
+                if ( (j % every) != 0 ) {
+                    sum += (size_t)pt->findMatch(pt, pc->ptr->ppDest[j]);
+                    continue;
+                }
+                t0   = nsec();
+                sum += (size_t)pt->findMatch(pt, pc->ptr->ppDest[j]);
+                d    = nsec() - t0;
+                if ( pc->nl == CHURN_SAMPLES ) {
+                    for ( pc->nl = 0; pc->nl < CHURN_SAMPLES / 2; ++pc->nl ) {
+                        pc->pl[pc->nl] = pc->pl[pc->nl * 2];
+                    }
+                    every *= 2;
+                }
+                pc->pl[pc->nl++] = (d > TimerOverhead) ? d - TimerOverhead : 0;
+            }
+            rtArtReadUnlock(pr);
+            pc->nLookups += m;
+        }
+    }
+    rtArtUnregisterReader(pr);
+    pc->sum = sum;
+    return NULL;
+}
+
+
+/*
+ * Starts `nReaders' readers of churn()
+ */
+static void
+churnStart (churnReader* pc, pthread_t* pth, int nReaders)
+{
+    int i;
+
+    *pc[0].pStop = 0;
+    for ( i = 0; i < nReaders; ++i ) {
+        pc[i].nLookups = 0;
+        pc[i].nl       = 0;
+        if ( pthread_create(&pth[i], NULL, churnReaderMain, &pc[i]) ) {
+            fprintf(stderr, "Error: pthread_create()\n");
+            exit(1);
+        }
+    }
+}
+
+
+/*
+ * Stops the readers of churn(), then prints their lookup rate during
+ * `t' seconds and the percentiles of the sampled lookup latencies
+ */
+static void
+churnStop (const char* name, churnReader* pc, pthread_t* pth, int nReaders,
+           double t)
+{
+    u32* pl;
+    u64  nLookups;
+    int  i, n;
+
+
+    *pc[0].pStop = 1;
+    for ( i = n = 0, nLookups = 0; i < nReaders; ++i ) {
+        pthread_join(pth[i], NULL);
+        nLookups += pc[i].nLookups;
+        n        += pc[i].nl;
+        Sink     += pc[i].sum;
+    }
+    pl = malloc((n + 1) * sizeof(u32));
+    if ( !pl ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = n = 0; i < nReaders; ++i ) {
+        memcpy(pl + n, pc[i].pl, pc[i].nl * sizeof(u32));
+        n += pc[i].nl;
+    }
+    printf("  %-8s %.2f Mlookups/s by %d readers, ", name,
+           nLookups / t * 1e-6, nReaders);
+    if ( n ) {
+        prPercentiles(pl, n);
+    }
+    printf("\n");
+    free(pl);
+}
+
+
+static int
+cmpChurnKey (const void* p1, const void* p2)
+{
+    const churnKey* a = p1;
+    const churnKey* b = p2;
+    int c;
+
+    c = memcmp(a->p.dest, b->p.dest, sizeof(a->p.dest));
+    if ( c ) {
+        return c;
+    }
+    return (a->p.plen != b->p.plen) ? a->p.plen - b->p.plen : a->i - b->i;
+}
+
+
+/*
+ * Returns the index of the first prefix that is the same as `pp' in
+ * `pk' sorted by cmpChurnKey() (-1: none)
+ */
+static int
+churnFind (churnKey* pk, int n, prefix* pp)
+{
+    churnKey key;
+    int lo, hi, mid;
+
+    key.p = *pp;
+    key.i = -1;
+    for ( lo = 0, hi = n; lo < hi; ) {
+        mid = (lo + hi) >> 1;
+        if ( cmpChurnKey(&pk[mid], &key) < 0 ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if ( (lo < n) && (pk[lo].p.plen == pp->plen) &&
+         (memcmp(pk[lo].p.dest, pp->dest, sizeof(pp->dest)) == 0) ) {
+        return pk[lo].i;
+    }
+    return -1;
+}
+
+
+/*
+ * Makes the churn trace: each prefix `pPfx[h]' to `pPfx[nPfx-1]' is
+ * added, followed by the withdrawal of the next prefix of ChurnPfx
+ * that is in the table. `pPfx[0]' to `pPfx[h-1]' are preloaded.
+ * The duplicates of earlier prefixes are skipped. Returns the
+ * number of the operations in `pOps'.
+ */
+static int
+mkChurn (prefix* pPfx, int nPfx, int h, churnOp* pOps)
+{
+    churnKey* pk;
+    u8*  pSt;                   /* 0: not added, 1: in, 2: withdrawn */
+    int  i, j, k, n;
+
+
+    pk  = malloc(nPfx * sizeof(churnKey));
+    pSt = calloc(nPfx, 1);
+    if ( !pk || !pSt ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < nPfx; ++i ) {
+        pk[i].p = pPfx[i];
+        pk[i].i = i;
+    }
+    qsort(pk, nPfx, sizeof(churnKey), cmpChurnKey);
+    for ( i = 0; i < h; ++i ) {
+        pSt[i] = (churnFind(pk, nPfx, &pPfx[i]) == i) ? 1 : 0;
+    }
+
+    for ( i = h, j = n = 0; i < nPfx; ++i ) {
+        if ( churnFind(pk, nPfx, &pPfx[i]) != i ) continue;
+        pOps[n].i     = i;
+        pOps[n++].add = true;
+        pSt[i] = 1;
+        while ( j < ChurnNumPfx ) {
+            k = churnFind(pk, nPfx, &ChurnPfx[j++]);
+            if ( (k >= 0) && (pSt[k] == 1) ) {
+                pOps[n].i     = k;
+                pOps[n++].add = false;
+                pSt[k] = 2;
+                break;
+            }
+        }
+    }
+    free(pSt);
+    free(pk);
+    return n;
+}
+
+
+/*
+ * Sleeps until `t' (nsec())
+ */
+static void
+churnWait (u64 t)
+{
+    struct timespec ts;
+    u64 now;
+
+    while ( (now = nsec()) < t ) {
+        ts.tv_sec  = (t - now) / 1000000000ULL;
+        ts.tv_nsec = (t - now) % 1000000000ULL;
+        nanosleep(&ts, NULL);
+    }
+}
+
+
+/*
+ * Replays the churn trace of mkChurn() on a table with lock-free
+ * readers while `nReaders' threads look up the traffic `ptr'
+ */
+static void
+churn (int alen, trieType type, s8* sl, int nLevels, prefix* pPfx,
+       int nPfx, traffic* ptr, int n, int nReaders)
+{
+    struct timespec ts;
+    struct rusage   ru;
+    rtArtOpts      opts = { artOptConcurrent | artOptSlab | artOptRouteArena,
+                            NULL, 0 };
+    rtArtStats     st;
+    rtArtUpdateOp* pu;
+    churnReader*   pc;
+    churnOp*   pOps;
+    pthread_t* pth;
+    rtTable*   pt;
+    routeEnt*  r;
+    volatile int stop;
+    u32*   pl;
+    u64    t0, d, nSub0, nFreed, peakSub, peakRoute;
+    double t, total;
+    int    i, j, k, m, nOps, nAdd, len;
+
+
+    pt = rtArtInitOpts(nLevels, sl, alen, type, &opts);
+    if ( !pt ) {
+        fprintf(stderr, "ERROR: failed to create a routing table.\n");
+        exit(1);
+    }
+    len = pt->len;
+    printf("IPv%d %s (", (alen == 32) ? 4 : 6, TypeName[type]);
+    for ( i = 0; i < nLevels; ++i ) {
+        printf("%s%d", (i) ? " " : "", sl[i]);
+    }
+    printf("):\n");
+
+    pOps = malloc(2 * nPfx * sizeof(churnOp));
+    pu   = malloc(ChurnBatch * sizeof(rtArtUpdateOp));
+    pc   = calloc(nReaders, sizeof(churnReader));
+    pth  = calloc(nReaders, sizeof(pthread_t));
+    if ( !pOps || !pu || !pc || !pth ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    nOps = mkChurn(pPfx, nPfx, nPfx / 2, pOps);
+    pl   = malloc((nOps / ChurnBatch + 1) * sizeof(u32));
+    for ( i = 0; i < nReaders; ++i ) {
+        pc[i].pt    = pt;
+        pc[i].ptr   = ptr;
+        pc[i].n     = n;
+        pc[i].pStop = &stop;
+        pc[i].pl    = malloc(CHURN_SAMPLES * sizeof(u32));
+        if ( !pl || !pc[i].pl ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+    }
+
+    /*
+     * Preload the first half
+     */
+    for ( i = 0; i < nPfx / 2; ++i ) {
+        r = rtArtNewRoute(pt);
+        if ( !r ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+        memcpy(r->dest, pPfx[i].dest, len);
+        r->plen = pPfx[i].plen;
+        if ( pt->insert(pt, r) != r ) {
+            rtArtFreeRoute(pt, r);      /* duplicate */
+        }
+    }
+    for ( i = nAdd = 0; i < nOps; ++i ) {
+        nAdd += (pOps[i].add) ? 1 : 0;
+    }
+    printf("  %d routes, %d additions and %d withdrawals at ",
+           pt->nRoutes, nAdd, nOps - nAdd);
+    if ( ChurnRate > 0 ) {
+        printf("%.0f ops/s", ChurnRate);
+    } else {
+        printf("full speed");
+    }
+    if ( ChurnBatch > 1 ) {
+        printf(" in batches of %d", ChurnBatch);
+    }
+    if ( (ChurnBatch > 1) && (ChurnWriters > 1) ) {
+        printf(" by %d writers", ChurnWriters);
+    }
+    printf("\n");
+
+    /*
+     * Lookups without updates
+     */
+    churnStart(pc, pth, nReaders);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    churnWait(nsec() + (u64)(CHURN_QUIET * 1e9));
+    churnStop("quiet", pc, pth, nReaders, elapsed(&ts));
+
+    /*
+     * Lookups during the churn
+     */
+    rtArtGetStats(pt, &st);
+    nSub0     = st.nSubtables;
+    nFreed    = pt->nSubtablesFreed;
+    peakSub   = st.bytes;
+    peakRoute = st.nRoutes * pt->routeSize;
+    churnStart(pc, pth, nReaders);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    t0 = nsec();
+    total = 0;
+    for ( i = k = 0; i < nOps; i += m ) {
+        m = ((nOps - i) < ChurnBatch) ? (nOps - i) : ChurnBatch;
+        if ( ChurnRate > 0 ) {
+            churnWait(t0 + (u64)(i * 1e9 / ChurnRate));
+        }
+        d = nsec();
+        for ( j = 0; j < m; ++j ) {
+            if ( pOps[i + j].add ) {
+                r = rtArtNewRoute(pt);
+                if ( !r ) {
+                    fprintf(stderr, "Error: no memory\n");
+                    exit(1);
+                }
+                memcpy(r->dest, pPfx[pOps[i + j].i].dest, len);
+                r->plen = pPfx[pOps[i + j].i].plen;
+                pu[j].op = artUpdAdd;
+                pu[j].r  = r;
+            } else {
+                pu[j].op    = artUpdWithdraw;
+                pu[j].pDest = pPfx[pOps[i + j].i].dest;
+                pu[j].plen  = pPfx[pOps[i + j].i].plen;
+            }
+        }
+        if ( m == 1 ) {
+            if ( pu[0].op == artUpdWithdraw ) {
+                pt->delete(pt, pu[0].pDest, pu[0].plen);
+            } else if ( pt->insert(pt, pu[0].r) != pu[0].r ) {
+                rtArtFreeRoute(pt, pu[0].r);
+            }
+        } else {
+            rtArtApplyUpdatesSharded(pt, pu, m, ChurnWriters, NULL);
+            for ( j = 0; j < m; ++j ) {
+                if ( (pu[j].op == artUpdAdd) && (pu[j].rc != artUpdDone) ) {
+                    rtArtFreeRoute(pt, pu[j].r);
+                }
+            }
+        }
+        d = nsec() - d;
+        total  += d * 1e-9;
+        pl[k++] = (d > TimerOverhead) ? d - TimerOverhead : 0;
+        if ( (i + m) / CHURN_MEM_EVERY != i / CHURN_MEM_EVERY ) {
+            rtArtGetStats(pt, &st);
+            if ( peakSub < st.bytes ) {
+                peakSub = st.bytes;
+            }
+            if ( peakRoute < st.nRoutes * pt->routeSize ) {
+                peakRoute = st.nRoutes * pt->routeSize;
+            }
+        }
+    }
+    t = elapsed(&ts);
+    churnStop("churn", pc, pth, nReaders, t);
+
+    rtArtSynchronize(pt);       /* frees the retired subtables */
+    rtArtGetStats(pt, &st);
+    nFreed = pt->nSubtablesFreed - nFreed;
+    prLatency((ChurnBatch > 1) ? "batch" : "update", pl, k, total);
+    getrusage(RUSAGE_SELF, &ru);
+    printf("  writer   %.3f Mops/s (busy %.0f%%), "
+           "subtables %.0f allocated/s %.0f freed/s,\n"
+           "           peak %.1f MB subtables + %.1f MB routes, "
+           "max RSS %.1f MB\n\n",
+           nOps / t * 1e-6, total / t * 100,
+           (st.nSubtables + nFreed - nSub0) / t, nFreed / t,
+           peakSub / 1048576.0, peakRoute / 1048576.0, ru.ru_maxrss / 1024.0);
+
+    pt->deleteTable(&pt);
+    for ( i = 0; i < nReaders; ++i ) {
+        free(pc[i].pl);
+    }
+    free(pl);
+    free(pth);
+    free(pc);
+    free(pu);
+    free(pOps);
+}
+
+
+/*
+ * Runs all the benchmarks for a trie type and stride lengths
+ */
+static void
+bench (int alen, trieType type, s8* sl, int nLevels, prefix* pPfx,
+       int nPfx, traffic* ptr, int nTraffic, int n, int maxThreads)
+{
+    routeEnt** pr;
+    rtTable*   pt;
+    u32*  pl;
+    u64   t0, d;
+    double total;
+    int   i, m, len;
+
+
+    if ( ChurnRate >= 0 ) {
+        churn(alen, type, sl, nLevels, pPfx, nPfx, ptr, n, maxThreads);
+        return;
+    }
+    pt = rtArtInit(nLevels, sl, alen, type);
+    if ( !pt ) {
+        fprintf(stderr, "ERROR: failed to create a routing table.\n");
+        exit(1);
+    }
+    len = pt->len;
+    printf("IPv%d %s (", (alen == 32) ? 4 : 6, TypeName[type]);
+    for ( i = 0; i < nLevels; ++i ) {
+        printf("%s%d", (i) ? " " : "", sl[i]);
+    }
+    printf("):\n");
+
+    pr = malloc(nPfx * sizeof(routeEnt*));
+    pl = malloc(nPfx * sizeof(u32));
+    if ( !pr || !pl ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < nPfx; ++i ) {
+        pr[i] = rtArtNewRoute(pt);
+        if ( !pr[i] ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+        memcpy(pr[i]->dest, pPfx[i].dest, len);
+        pr[i]->plen = pPfx[i].plen;
+    }
+
+    /*
+     * Insertion
+     */
+    for ( i = m = 0, total = 0; i < nPfx; ++i ) {
+        t0 = nsec();
+        if ( pt->insert(pt, pr[i]) != pr[i] ) {
+            rtArtFreeRoute(pt, pr[i]);  /* duplicate */
+            continue;
+        }
+        d = nsec() - t0;
+        total += d * 1e-9;
+        pl[m++] = (d > TimerOverhead) ? d - TimerOverhead : 0;
+    }
+    prLatency("insert", pl, m, total);
+
+    /*
+     * Lookups
+     */
+    for ( i = 0; i < nTraffic; ++i ) {
+        benchLookups(pt, &ptr[i], n);
+    }
+    benchThreads(pt, &ptr[0], n, maxThreads);
+
+    /*
+     * Deletion
+     */
+    for ( i = m = 0, total = 0; i < nPfx; ++i ) {
+        t0 = nsec();
+        if ( pt->delete(pt, pPfx[i].dest, pPfx[i].plen) == false ) {
+            continue;
+        }
+        d = nsec() - t0;
+        total += d * 1e-9;
+        pl[m++] = (d > TimerOverhead) ? d - TimerOverhead : 0;
+    }
+    prLatency("delete", pl, m, total);
+    printf("\n");
+
+    pt->deleteTable(&pt);
+    free(pl);
+    free(pr);
+}
+
+
+/*
+ * Tunes the stride lengths of the prefixes split at /64 for `type'.
+ * Returns the number of levels (0: failed).
+ */
+static int
+tuneSplit (trieType type, prefix* pPfx, int nPfx, s8* sl)
+{
+    static s8  Sl[] = { 16, 16, 16, 16, 16, 16, 16, 16 };
+    routeEnt** pr;
+    rtTable*   pt;
+    int i, n;
+
+
+    pt = rtArtInit(8, Sl, 128, simpleTrie);     /* allocates the routes */
+    pr = malloc(nPfx * sizeof(routeEnt*));
+    if ( !pt || !pr ) {
+        fprintf(stderr, "Error: no memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < nPfx; ++i ) {
+        pr[i] = rtArtNewRoute(pt);
+        if ( !pr[i] ) {
+            fprintf(stderr, "Error: no memory\n");
+            exit(1);
+        }
+        memcpy(pr[i]->dest, pPfx[i].dest, 16);
+        pr[i]->plen = pPfx[i].plen;
+    }
+    n = rtArtTuneStrides6(pr, nPfx, type, BENCH_V6_BUDGET, sl, NULL);
+    for ( i = 0; i < nPfx; ++i ) {
+        rtArtFreeRoute(pt, pr[i]);
+    }
+    free(pr);
+    pt->deleteTable(&pt);
+    return n;
+}
+
+
+static void
+usage (void)
+{
+    fprintf(stderr, "Usage: rtBench <4|6> [simple|pc|compact|all] "
+            "[-t threads] [-n lookups]\n"
+            "               [-c ops/s [-b batch] [-w writers]] "
+            "[stride lengths]\n");
+    exit(1);
+}
+
+
+int
+main (int argc, char* argv[])
+{
+    static s8 V4Sl[][32] = {
+        { 16, 8, 8 }, { 8, 8, 8, 8 }, { 4, 4, 4, 4, 4, 4, 4, 4 },
+    };
+    static s8 V6Sl[][128] = {
+        { 16, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+          4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 },
+        { 16, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8 },
+        { 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8 },
+    };
+    static const char* TrafficName[] = { "uniform", "zipf", "random" };
+    traffic  tr[3];
+    prefix*  pPfx;
+    s8       sl[128];
+    int      nSl[3];
+    int      i, j, k, alen, nPfx, nTraffic, n, maxThreads, nLevels, sum;
+    int      types[3], nTypes;
+
+
+    if ( argc < 2 ) {
+        usage();
+    }
+    alen = (atoi(argv[1]) == 4) ? 32 : (atoi(argv[1]) == 6) ? 128 : 0;
+    if ( alen == 0 ) {
+        usage();
+    }
+    n = BENCH_LOOKUPS;
+    maxThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if ( maxThreads > BENCH_THREADS ) {
+        maxThreads = BENCH_THREADS;
+    }
+    if ( maxThreads < 1 ) {
+        maxThreads = 1;
+    }
+    types[0] = simpleTrie;
+    types[1] = pathCompTrie;
+    types[2] = compactTrie;
+    nTypes   = 3;
+    nLevels  = 0;
+    for ( i = 2, sum = 0; i < argc; ++i ) {
+        if ( strcmp(argv[i], "simple") == 0 ) {
+            types[0] = simpleTrie;
+            nTypes = 1;
+        } else if ( strcmp(argv[i], "pc") == 0 ) {
+            types[0] = pathCompTrie;
+            nTypes = 1;
+        } else if ( strcmp(argv[i], "compact") == 0 ) {
+            types[0] = compactTrie;
+            nTypes = 1;
+        } else if ( strcmp(argv[i], "all") == 0 ) {
+            nTypes = 3;
+        } else if ( (strcmp(argv[i], "-t") == 0) && (i + 1 < argc) ) {
+            maxThreads = atoi(argv[++i]);
+        } else if ( (strcmp(argv[i], "-n") == 0) && (i + 1 < argc) ) {
+            n = atoi(argv[++i]);
+        } else if ( (strcmp(argv[i], "-c") == 0) && (i + 1 < argc) ) {
+            ChurnRate = atof(argv[++i]);
+        } else if ( (strcmp(argv[i], "-b") == 0) && (i + 1 < argc) ) {
+            ChurnBatch = atoi(argv[++i]);
+        } else if ( (strcmp(argv[i], "-w") == 0) && (i + 1 < argc) ) {
+            ChurnWriters = atoi(argv[++i]);
+        } else if ( (nLevels < alen) && (atoi(argv[i]) > 0) ) {
+            sl[nLevels] = atoi(argv[i]);
+            sum += sl[nLevels++];
+        } else {
+            usage();
+        }
+    }
+    if ( (nLevels && (sum != alen)) || (n <= 0) || (maxThreads <= 0) ||
+         (ChurnBatch <= 0) || (ChurnWriters <= 0) ) {
+        usage();
+    }
+
+    calibrate();
+    nPfx = loadPrefixes(alen, "random1", &pPfx);
+    if ( ChurnRate >= 0 ) {
+        ChurnNumPfx = loadPrefixes(alen, (alen == 32) ? "random3" : "random2",
+                                   &ChurnPfx);
+    }
+    nTraffic = (alen == 32) ? 3 : 2;
+    for ( i = 0; i < nTraffic; ++i ) {
+        mkTraffic(&tr[i], TrafficName[i], pPfx, nPfx, bits2bytes(alen), n);
+    }
+    printf("%d prefixes, %d addresses of each traffic, "
+           "timer overhead %.0f ns\n\n", nPfx, n, TimerOverhead);
+
+    for ( i = 0; i < 3; ++i ) {
+        for ( nSl[i] = 0, j = 0, sum = 0; sum < alen; ++j ) {
+            sum += (alen == 32) ? V4Sl[i][j] : V6Sl[i][j];
+        }
+        nSl[i] = j;
+    }
+    for ( k = 0; k < nTypes; ++k ) {
+        if ( nLevels ) {
+            bench(alen, types[k], sl, nLevels, pPfx, nPfx, tr, nTraffic,
+                  n, maxThreads);
+            continue;
+        }
+        for ( i = 0; i < 3; ++i ) {
+            bench(alen, types[k], (alen == 32) ? V4Sl[i] : V6Sl[i], nSl[i],
+                  pPfx, nPfx, tr, nTraffic, n, maxThreads);
+        }
+        if ( (alen == 128) && (j = tuneSplit(types[k], pPfx, nPfx, sl)) ) {
+            bench(alen, types[k], sl, j, pPfx, nPfx, tr, nTraffic, n,
+                  maxThreads);
+        }
+    }
+
+    for ( i = 0; i < nTraffic; ++i ) {
+        free(tr[i].pa);
+        free(tr[i].ppDest);
+    }
+    free(ChurnPfx);
+    free(pPfx);
+    return 0;
+}
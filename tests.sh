@@ -12,3 +12,9 @@ echo && echo && echo "3. IPv6 simple tire:"
 
 echo && echo && echo "4. IPv6 path-compressed tire:"
 ./rtLookup 6 pc perf
+
+echo && echo && echo "5. IPv4 compact tire:"
+./rtLookup 4 compact perf
+
+echo && echo && echo "6. IPv6 compact tire:"
+./rtLookup 6 compact perf